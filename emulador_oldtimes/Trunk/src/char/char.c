@@ -80,8 +80,25 @@ struct mmo_map_server {
 	uint16 port;
 	int users;
 	unsigned short map[MAX_MAP_PER_SERVER];
+	unsigned short map_users[MAX_MAP_PER_SERVER]; // players on each map, from the last load report
+	bool standby[MAX_MAP_PER_SERVER]; // map is loaded here but served by another map-server
+	struct {
+		unsigned int lag_avg, lag_max; // timer delay (ms)
+		unsigned int memory; // KB
+		unsigned int tick; // when the last report arrived (0: none yet)
+	} load;
 } server[MAX_MAP_SERVERS];
 
+// Map-server load balancing
+static int map_rebalance_interval = 0; // seconds between automatic rebalancing checks (0: disabled)
+static int map_rebalance_threshold = 100; // minimum difference of players between the busiest and the idlest map-server
+static struct {
+	unsigned int moves; // maps moved to another map-server
+	unsigned int count; // players that switched map-server
+	uint64 total; // sum of the switch latencies (ms)
+	unsigned int max; // worst switch latency (ms)
+} handoff_stats;
+
 int login_fd=-1, char_fd=-1;
 char userid[24];
 char passwd[24];
@@ -176,6 +193,7 @@ struct auth_node {
 	time_t expiration_time; // # of seconds 1/1/1970 (timestamp): Validity limit of the account (0 = unlimited)
 	int group_id;
 	unsigned changing_mapservers : 1;
+	unsigned int tick; // when the map-server change was requested
 };
 
 static DBMap* auth_db; // int account_id -> struct auth_node*
@@ -195,6 +213,7 @@ struct online_char_data {
 static DBMap* online_char_db; // int account_id -> struct online_char_data*
 static int chardb_waiting_disconnect(int tid, unsigned int tick, int id, intptr_t data);
 int delete_char_sql(int char_id);
+static void char_select_cache_invalidate(int account_id);
 
 /**
  * @see DBCreateData
@@ -413,7 +432,36 @@ static DBData create_charstatus(DBKey key, va_list args)
 	return db_ptr2data(cp);
 }
 
-int inventory_to_sql(const struct item items[], int max, int id);
+int inventory_to_sql(struct item items[], int max, int id);
+static int char_items_tosql(struct item items[], struct item saved[], int max, int id, int tableswitch, bool synced);
+
+/// Level of a skill as stored in the skill table, or 0 if the skill has no row.
+static int char_skill_savelv(const struct s_skill* skill)
+{
+	int lv;
+
+	if( skill->id == 0 || skill->flag == SKILL_FLAG_TEMPORARY )
+		return 0;
+	lv = ( skill->flag == SKILL_FLAG_PERMANENT ) ? skill->lv : skill->flag - SKILL_FLAG_REPLACED_LV_0;
+	return max(lv, 0);
+}
+
+/// Deletes the rows of a character from a table with a cached statement.
+static int char_delete_by_char_id(enum e_char_stmt stmt_id, const char* table, int char_id)
+{
+	SqlStmt* stmt;
+
+	if( (stmt = Sql_GetStmt(sql_handle, stmt_id)) == NULL )
+		stmt = Sql_PrepareStmt(sql_handle, stmt_id, "DELETE FROM `%s` WHERE `char_id`=?", table);
+	if( stmt == NULL
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
+	||	SQL_ERROR == SqlStmt_Execute(stmt) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+}
 
 int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 {
@@ -423,18 +471,21 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 	char save_status[128]; //For displaying save information. [Skotlex]
 	struct mmo_charstatus *cp;
 	int errors = 0; //If there are any errors while saving, "cp" will not be updated at the end.
+	bool synced; // whether "cp" mirrors the database rows of this character
 	StringBuf buf;
 
 	if (char_id!=p->char_id) return 0;
 
 	cp = idb_ensure(char_db_, char_id, create_charstatus);
+	synced = ( cp->account_id == p->account_id ); // false for a blank entry from create_charstatus
 
 	StringBuf_Init(&buf);
 	memset(save_status, 0, sizeof(save_status));
 
+	// Item tables are saved slot by slot against the cached copy.
 	//map inventory data
 	if( memcmp(p->inventory, cp->inventory, sizeof(p->inventory)) ) {
-		if (!inventory_to_sql(p->inventory, MAX_INVENTORY, p->char_id))
+		if (!char_items_tosql(p->inventory, cp->inventory, MAX_INVENTORY, p->char_id, TABLE_INVENTORY, synced))
 			strcat(save_status, " inventory");
 		else
 			errors++;
@@ -442,7 +493,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 
 	//map cart data
 	if( memcmp(p->cart, cp->cart, sizeof(p->cart)) ) {
-		if (!memitemdata_to_sql(p->cart, MAX_CART, p->char_id, TABLE_CART))
+		if (!char_items_tosql(p->cart, cp->cart, MAX_CART, p->char_id, TABLE_CART, synced))
 			strcat(save_status, " cart");
 		else
 			errors++;
@@ -450,7 +501,7 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 
 	//map storage data
 	if( memcmp(p->storage.items, cp->storage.items, sizeof(p->storage.items)) ) {
-		if (!memitemdata_to_sql(p->storage.items, MAX_STORAGE, p->account_id, TABLE_STORAGE))
+		if (!char_items_tosql(p->storage.items, cp->storage.items, MAX_STORAGE, p->account_id, TABLE_STORAGE, synced))
 			strcat(save_status, " storage");
 		else
 			errors++;
@@ -475,28 +526,67 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		(p->rename != cp->rename) || (p->robe != cp->robe)
 	)
 	{	//Save status
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `base_level`='%d', `job_level`='%d',"
-			"`base_exp`='%u', `job_exp`='%u', `zeny`='%d',"
-			"`max_hp`='%d',`hp`='%d',`max_sp`='%d',`sp`='%d',`status_point`='%d',`skill_point`='%d',"
-			"`str`='%d',`agi`='%d',`vit`='%d',`int`='%d',`dex`='%d',`luk`='%d',"
-			"`option`='%d',`party_id`='%d',`guild_id`='%d',`pet_id`='%d',`homun_id`='%d',`elemental_id`='%d',"
-			"`weapon`='%d',`shield`='%d',`head_top`='%d',`head_mid`='%d',`head_bottom`='%d',"
-			"`last_map`='%s',`last_x`='%d',`last_y`='%d',`save_map`='%s',`save_x`='%d',`save_y`='%d', `rename`='%d',"
-			"`delete_date`='%lu',`robe`='%d'"
-			" WHERE  `account_id`='%d' AND `char_id` = '%d'",
-			char_db, p->base_level, p->job_level,
-			p->base_exp, p->job_exp, p->zeny,
-			p->max_hp, p->hp, p->max_sp, p->sp, p->status_point, p->skill_point,
-			p->str, p->agi, p->vit, p->int_, p->dex, p->luk,
-			p->option, p->party_id, p->guild_id, p->pet_id, p->hom_id, p->ele_id,
-			p->weapon, p->shield, p->head_top, p->head_mid, p->head_bottom,
-			mapindex_id2name(p->last_point.map), p->last_point.x, p->last_point.y,
-			mapindex_id2name(p->save_point.map), p->save_point.x, p->save_point.y, p->rename,
-			(unsigned long)p->delete_date,  // FIXME: platform-dependent size
-			p->robe,
-			p->account_id, p->char_id) )
+		SqlStmt* stmt;
+		const char* last_map = mapindex_id2name(p->last_point.map);
+		const char* save_map = mapindex_id2name(p->save_point.map);
+		unsigned long delete_date = (unsigned long)p->delete_date; // FIXME: platform-dependent size
+
+		char_select_cache_invalidate(p->account_id);
+
+		if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_SAVE_STATUS)) == NULL )
+			stmt = Sql_PrepareStmt(sql_handle, CHAR_STMT_SAVE_STATUS, "UPDATE `%s` SET `base_level`=?, `job_level`=?,"
+				"`base_exp`=?, `job_exp`=?, `zeny`=?,"
+				"`max_hp`=?,`hp`=?,`max_sp`=?,`sp`=?,`status_point`=?,`skill_point`=?,"
+				"`str`=?,`agi`=?,`vit`=?,`int`=?,`dex`=?,`luk`=?,"
+				"`option`=?,`party_id`=?,`guild_id`=?,`pet_id`=?,`homun_id`=?,`elemental_id`=?,"
+				"`weapon`=?,`shield`=?,`head_top`=?,`head_mid`=?,`head_bottom`=?,"
+				"`last_map`=?,`last_x`=?,`last_y`=?,`save_map`=?,`save_x`=?,`save_y`=?, `rename`=?,"
+				"`delete_date`=?,`robe`=?"
+				" WHERE  `account_id`=? AND `char_id` = ?",
+				char_db);
+		if( stmt == NULL
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 0,  SQLDT_UINT,   &p->base_level, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 1,  SQLDT_UINT,   &p->job_level, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 2,  SQLDT_UINT,   &p->base_exp, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 3,  SQLDT_UINT,   &p->job_exp, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 4,  SQLDT_INT,    &p->zeny, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 5,  SQLDT_INT,    &p->max_hp, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 6,  SQLDT_INT,    &p->hp, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 7,  SQLDT_INT,    &p->max_sp, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 8,  SQLDT_INT,    &p->sp, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 9,  SQLDT_UINT,   &p->status_point, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 10, SQLDT_UINT,   &p->skill_point, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 11, SQLDT_SHORT,  &p->str, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 12, SQLDT_SHORT,  &p->agi, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 13, SQLDT_SHORT,  &p->vit, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 14, SQLDT_SHORT,  &p->int_, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 15, SQLDT_SHORT,  &p->dex, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 16, SQLDT_SHORT,  &p->luk, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 17, SQLDT_UINT,   &p->option, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 18, SQLDT_INT,    &p->party_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 19, SQLDT_INT,    &p->guild_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 20, SQLDT_INT,    &p->pet_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 21, SQLDT_INT,    &p->hom_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 22, SQLDT_INT,    &p->ele_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 23, SQLDT_SHORT,  &p->weapon, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 24, SQLDT_SHORT,  &p->shield, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 25, SQLDT_SHORT,  &p->head_top, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 26, SQLDT_SHORT,  &p->head_mid, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 27, SQLDT_SHORT,  &p->head_bottom, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 28, SQLDT_STRING, (void*)last_map, strnlen(last_map, MAP_NAME_LENGTH_EXT))
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 29, SQLDT_SHORT,  &p->last_point.x, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 30, SQLDT_SHORT,  &p->last_point.y, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 31, SQLDT_STRING, (void*)save_map, strnlen(save_map, MAP_NAME_LENGTH_EXT))
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 32, SQLDT_SHORT,  &p->save_point.x, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 33, SQLDT_SHORT,  &p->save_point.y, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 34, SQLDT_SHORT,  &p->rename, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 35, SQLDT_ULONG,  &delete_date, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 36, SQLDT_SHORT,  &p->robe, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 37, SQLDT_INT,    &p->account_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 38, SQLDT_INT,    &p->char_id, 0)
+		||	SQL_ERROR == SqlStmt_Execute(stmt) )
 		{
-			Sql_ShowDebug(sql_handle);
+			SqlStmt_ShowDebug(stmt);
 			errors++;
 		} else
 			strcat(save_status, " status");
@@ -512,18 +602,34 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		(p->fame != cp->fame)
 	)
 	{
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `class`='%d',"
-			"`hair`='%d',`hair_color`='%d',`clothes_color`='%d',"
-			"`partner_id`='%d', `father`='%d', `mother`='%d', `child`='%d',"
-			"`karma`='%d',`manner`='%d', `fame`='%d'"
-			" WHERE  `account_id`='%d' AND `char_id` = '%d'",
-			char_db, p->class_,
-			p->hair, p->hair_color, p->clothes_color,
-			p->partner_id, p->father, p->mother, p->child,
-			p->karma, p->manner, p->fame,
-			p->account_id, p->char_id) )
+		SqlStmt* stmt;
+
+		char_select_cache_invalidate(p->account_id);
+
+		if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_SAVE_STATUS2)) == NULL )
+			stmt = Sql_PrepareStmt(sql_handle, CHAR_STMT_SAVE_STATUS2, "UPDATE `%s` SET `class`=?,"
+				"`hair`=?,`hair_color`=?,`clothes_color`=?,"
+				"`partner_id`=?, `father`=?, `mother`=?, `child`=?,"
+				"`karma`=?,`manner`=?, `fame`=?"
+				" WHERE  `account_id`=? AND `char_id` = ?",
+				char_db);
+		if( stmt == NULL
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 0,  SQLDT_SHORT, &p->class_, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 1,  SQLDT_SHORT, &p->hair, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 2,  SQLDT_SHORT, &p->hair_color, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 3,  SQLDT_SHORT, &p->clothes_color, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 4,  SQLDT_INT,   &p->partner_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 5,  SQLDT_INT,   &p->father, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 6,  SQLDT_INT,   &p->mother, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 7,  SQLDT_INT,   &p->child, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 8,  SQLDT_UCHAR, &p->karma, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 9,  SQLDT_SHORT, &p->manner, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 10, SQLDT_INT,   &p->fame, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 11, SQLDT_INT,   &p->account_id, 0)
+		||	SQL_ERROR == SqlStmt_BindParam(stmt, 12, SQLDT_INT,   &p->char_id, 0)
+		||	SQL_ERROR == SqlStmt_Execute(stmt) )
 		{
-			Sql_ShowDebug(sql_handle);
+			SqlStmt_ShowDebug(stmt);
 			errors++;
 		} else
 			strcat(save_status, " status2");
@@ -547,11 +653,8 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 		char esc_mapname[NAME_LENGTH*2+1];
 
 		//`memo` (`memo_id`,`char_id`,`map`,`x`,`y`)
-		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", memo_db, p->char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
+		if( SQL_ERROR == char_delete_by_char_id(CHAR_STMT_DELETE_MEMO, memo_db, p->char_id) )
 			errors++;
-		}
 
 		//insert here.
 		StringBuf_Clear(&buf);
@@ -585,14 +688,55 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 
 
 	//skills
-	if( memcmp(p->skill, cp->skill, sizeof(p->skill)) )
-	{
-		//`skill` (`char_id`, `id`, `lv`)
-		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", skill_db, p->char_id) )
+	if( synced && memcmp(p->skill, cp->skill, sizeof(p->skill)) )
+	{// only the rows of skills whose saved level changed
+		StringBuf delbuf;
+		int lv, count2 = 0;
+
+		StringBuf_Init(&delbuf);
+		StringBuf_Clear(&buf);
+		StringBuf_Printf(&buf, "REPLACE INTO `%s`(`char_id`,`id`,`lv`) VALUES ", skill_db);
+		StringBuf_Printf(&delbuf, "DELETE FROM `%s` WHERE `char_id`='%d' AND `id` IN (", skill_db, char_id);
+		for( i = 0, count = 0; i < MAX_SKILL; ++i )
+		{
+			if( (lv = char_skill_savelv(&p->skill[i])) == char_skill_savelv(&cp->skill[i]) )
+				continue;
+			if( lv > 0 )
+			{
+				if( count )
+					StringBuf_AppendStr(&buf, ",");
+				StringBuf_Printf(&buf, "('%d','%d','%d')", char_id, p->skill[i].id, lv);
+				++count;
+			}
+			else
+			{
+				if( count2 )
+					StringBuf_AppendStr(&delbuf, ",");
+				StringBuf_Printf(&delbuf, "'%d'", cp->skill[i].id);
+				++count2;
+			}
+		}
+		StringBuf_AppendStr(&delbuf, ")");
+		if( count2 && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&delbuf)) )
 		{
 			Sql_ShowDebug(sql_handle);
 			errors++;
 		}
+		if( count && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
+		{
+			Sql_ShowDebug(sql_handle);
+			errors++;
+		}
+		StringBuf_Destroy(&delbuf);
+
+		if( count || count2 )
+			strcat(save_status, " skills");
+	}
+	else if( memcmp(p->skill, cp->skill, sizeof(p->skill)) )
+	{
+		//`skill` (`char_id`, `id`, `lv`)
+		if( SQL_ERROR == char_delete_by_char_id(CHAR_STMT_DELETE_SKILL, skill_db, p->char_id) )
+			errors++;
 
 		StringBuf_Clear(&buf);
 		StringBuf_Printf(&buf, "INSERT INTO `%s`(`char_id`,`id`,`lv`) VALUES ", skill_db);
@@ -634,11 +778,8 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 
 	if(diff == 1)
 	{	//Save friends
-		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", friend_db, char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
+		if( SQL_ERROR == char_delete_by_char_id(CHAR_STMT_DELETE_FRIEND, friend_db, char_id) )
 			errors++;
-		}
 
 		StringBuf_Clear(&buf);
 		StringBuf_Printf(&buf, "INSERT INTO `%s` (`char_id`, `friend_account`, `friend_id`) VALUES ", friend_db);
@@ -694,10 +835,170 @@ int mmo_char_tosql(int char_id, struct mmo_charstatus* p)
 	return 0;
 }
 
+/// Executes the cached statement that selects the items of a table, preparing it on first use.
+/// Returns the statement ready for SqlStmt_BindColumn, or NULL on error.
+static SqlStmt* char_item_select(int tableswitch, const char* tablename, const char* selectoption, int id)
+{
+	SqlStmt* stmt;
+	int j;
+
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_ITEM_SELECT + tableswitch)) == NULL )
+	{
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`");
+		if( tableswitch == TABLE_INVENTORY )
+			StringBuf_AppendStr(&buf, ", `favorite`");
+		for( j = 0; j < MAX_SLOTS; ++j )
+			StringBuf_Printf(&buf, ", `card%d`", j);
+		StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`=?", tablename, selectoption);
+		stmt = Sql_PrepareStmtStr(sql_handle, CHAR_STMT_ITEM_SELECT + tableswitch, StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+	}
+	if( stmt == NULL
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &id, 0)
+	||	SQL_ERROR == SqlStmt_Execute(stmt) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return NULL;
+	}
+	return stmt;
+}
+
+/// Overwrites the row 'id' of an item table with a cached statement.
+static int char_item_update(int tableswitch, const char* tablename, const struct item* it, int id)
+{
+	SqlStmt* stmt;
+	size_t col = 0;
+	int j;
+
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_ITEM_UPDATE + tableswitch)) == NULL )
+	{
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		StringBuf_Printf(&buf, "UPDATE `%s` SET `nameid`=?, `amount`=?, `equip`=?, `identify`=?, `refine`=?,`attribute`=?, `expire_time`=?", tablename);
+		if( tableswitch == TABLE_INVENTORY )
+			StringBuf_AppendStr(&buf, ", `favorite`=?");
+		for( j = 0; j < MAX_SLOTS; ++j )
+			StringBuf_Printf(&buf, ", `card%d`=?", j);
+		StringBuf_AppendStr(&buf, " WHERE `id`=? LIMIT 1");
+		stmt = Sql_PrepareStmtStr(sql_handle, CHAR_STMT_ITEM_UPDATE + tableswitch, StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+		if( stmt == NULL )
+			return SQL_ERROR;
+	}
+
+	SqlStmt_BindParam(stmt, col++, SQLDT_SHORT,  (void*)&it->nameid, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_SHORT,  (void*)&it->amount, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_USHORT, (void*)&it->equip, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_CHAR,   (void*)&it->identify, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_CHAR,   (void*)&it->refine, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_CHAR,   (void*)&it->attribute, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_UINT,   (void*)&it->expire_time, 0);
+	if( tableswitch == TABLE_INVENTORY )
+		SqlStmt_BindParam(stmt, col++, SQLDT_CHAR, (void*)&it->favorite, 0);
+	for( j = 0; j < MAX_SLOTS; ++j )
+		SqlStmt_BindParam(stmt, col++, SQLDT_SHORT, (void*)&it->card[j], 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_INT, &id, 0);
+	if( SQL_ERROR == SqlStmt_Execute(stmt) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+}
+
+/// Inserts 'it' as a new row of an item table with a cached statement.
+/// The id of the new row is stored in it->id.
+static int char_item_insert(int tableswitch, const char* tablename, const char* selectoption, struct item* it, int id)
+{
+	SqlStmt* stmt;
+	size_t col = 0;
+	int j;
+
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_ITEM_INSERT + tableswitch)) == NULL )
+	{
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`", tablename, selectoption);
+		if( tableswitch == TABLE_INVENTORY )
+			StringBuf_AppendStr(&buf, ", `favorite`");
+		for( j = 0; j < MAX_SLOTS; ++j )
+			StringBuf_Printf(&buf, ", `card%d`", j);
+		StringBuf_AppendStr(&buf, ") VALUES (?, ?, ?, ?, ?, ?, ?, ?");
+		if( tableswitch == TABLE_INVENTORY )
+			StringBuf_AppendStr(&buf, ", ?");
+		for( j = 0; j < MAX_SLOTS; ++j )
+			StringBuf_AppendStr(&buf, ", ?");
+		StringBuf_AppendStr(&buf, ")");
+		stmt = Sql_PrepareStmtStr(sql_handle, CHAR_STMT_ITEM_INSERT + tableswitch, StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+		if( stmt == NULL )
+			return SQL_ERROR;
+	}
+
+	SqlStmt_BindParam(stmt, col++, SQLDT_INT,    &id, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_SHORT,  &it->nameid, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_SHORT,  &it->amount, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_USHORT, &it->equip, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_CHAR,   &it->identify, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_CHAR,   &it->refine, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_CHAR,   &it->attribute, 0);
+	SqlStmt_BindParam(stmt, col++, SQLDT_UINT,   &it->expire_time, 0);
+	if( tableswitch == TABLE_INVENTORY )
+		SqlStmt_BindParam(stmt, col++, SQLDT_CHAR, &it->favorite, 0);
+	for( j = 0; j < MAX_SLOTS; ++j )
+		SqlStmt_BindParam(stmt, col++, SQLDT_SHORT, &it->card[j], 0);
+	if( SQL_ERROR == SqlStmt_Execute(stmt) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		it->id = 0;
+		return SQL_ERROR;
+	}
+	it->id = (int)SqlStmt_LastInsertId(stmt);
+	return SQL_SUCCESS;
+}
+
+/// Deletes the row 'id' of an item table with a cached statement.
+static int char_item_delete(int tableswitch, const char* tablename, int id)
+{
+	SqlStmt* stmt;
+
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_ITEM_DELETE + tableswitch)) == NULL )
+		stmt = Sql_PrepareStmt(sql_handle, CHAR_STMT_ITEM_DELETE + tableswitch, "DELETE from `%s` where `id`=? LIMIT 1", tablename);
+	if( stmt == NULL
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &id, 0)
+	||	SQL_ERROR == SqlStmt_Execute(stmt) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+}
+
+/// Resolves the table name and owner column of an item table.
+static bool char_item_table(int tableswitch, const char** tablename, const char** selectoption)
+{
+	switch (tableswitch) {
+	case TABLE_INVENTORY:     *tablename = inventory_db;     *selectoption = "char_id";    break;
+	case TABLE_CART:          *tablename = cart_db;          *selectoption = "char_id";    break;
+	case TABLE_STORAGE:       *tablename = storage_db;       *selectoption = "account_id"; break;
+	case TABLE_GUILD_STORAGE: *tablename = guild_storage_db; *selectoption = "guild_id";   break;
+	default:
+		ShowError("Nome de tabela invlida!\n");
+		return false;
+	}
+	return true;
+}
+
 /// Saves an array of 'item' entries into the specified table.
-int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch)
+/// With 'want_ids' the id of the row that holds each entry is stored in items[i].id,
+/// which costs one INSERT per new entry; otherwise they are inserted with a single query.
+static int memitemdata_to_sql_sub(struct item items[], int max, int id, int tableswitch, bool want_ids)
 {
-	StringBuf buf;
 	SqlStmt* stmt;
 	int i;
 	int j;
@@ -708,15 +1009,8 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 	bool found;
 	int errors = 0;
 
-	switch (tableswitch) {
-	case TABLE_INVENTORY:     tablename = inventory_db;     selectoption = "char_id";    break;
-	case TABLE_CART:          tablename = cart_db;          selectoption = "char_id";    break;
-	case TABLE_STORAGE:       tablename = storage_db;       selectoption = "account_id"; break;
-	case TABLE_GUILD_STORAGE: tablename = guild_storage_db; selectoption = "guild_id";   break;
-	default:
-		ShowError("Nome de tabela invlida!\n");
+	if( !char_item_table(tableswitch, &tablename, &selectoption) )
 		return 1;
-	}
 
 
 	// The following code compares inventory with current database values
@@ -724,21 +1018,8 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 	// This approach is more complicated than a trivial delete&insert, but
 	// it significantly reduces cpu load on the database server.
 
-	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`");
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`='%d'", tablename, selectoption, id);
-
-	stmt = SqlStmt_Malloc(sql_handle);
-	if( SQL_ERROR == SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf))
-	||  SQL_ERROR == SqlStmt_Execute(stmt) )
-	{
-		SqlStmt_ShowDebug(stmt);
-		SqlStmt_Free(stmt);
-		StringBuf_Destroy(&buf);
+	if( (stmt = char_item_select(tableswitch, tablename, selectoption, id)) == NULL )
 		return 1;
-	}
 
 	SqlStmt_BindColumn(stmt, 0, SQLDT_INT,       &item.id,          0, NULL, NULL);
 	SqlStmt_BindColumn(stmt, 1, SQLDT_SHORT,     &item.nameid,      0, NULL, NULL);
@@ -781,76 +1062,90 @@ int memitemdata_to_sql(const struct item items[], int max, int id, int tableswit
 				else
 				{
 					// update all fields.
-					StringBuf_Clear(&buf);
-					StringBuf_Printf(&buf, "UPDATE `%s` SET `amount`='%d', `equip`='%d', `identify`='%d', `refine`='%d',`attribute`='%d', `expire_time`='%u'",
-						tablename, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time);
-					for( j = 0; j < MAX_SLOTS; ++j )
-						StringBuf_Printf(&buf, ", `card%d`=%d", j, items[i].card[j]);
-					StringBuf_Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
-					
-					if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-					{
-						Sql_ShowDebug(sql_handle);
+					if( SQL_ERROR == char_item_update(tableswitch, tablename, &items[i], item.id) )
 						errors++;
-					}
 				}
 
+				items[i].id = item.id;
 				found = flag[i] = true; //Item dealt with,
 				break; //skip to next item in the db.
 			}
 		}
 		if( !found )
 		{// Item not present in inventory, remove it.
-			if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", tablename, item.id) )
-			{
-				Sql_ShowDebug(sql_handle);
+			if( SQL_ERROR == char_item_delete(tableswitch, tablename, item.id) )
 				errors++;
-			}
 		}
 	}
-	SqlStmt_Free(stmt);
-
-	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`", tablename, selectoption);
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_AppendStr(&buf, ") VALUES ");
+	SqlStmt_FreeResult(stmt);
 
-	found = false;
 	// insert non-matched items into the db as new items
-	for( i = 0; i < max; ++i )
+	if( want_ids )
 	{
-		// skip empty and already matched entries
-		if( items[i].nameid == 0 || flag[i] )
-			continue;
+		for( i = 0; i < max; ++i )
+		{
+			// skip empty and already matched entries
+			if( items[i].nameid == 0 || flag[i] )
+			{
+				if( items[i].nameid == 0 )
+					items[i].id = 0;
+				continue;
+			}
 
-		if( found )
-			StringBuf_AppendStr(&buf, ",");
-		else
-			found = true;
+			if( SQL_ERROR == char_item_insert(tableswitch, tablename, selectoption, &items[i], id) )
+				errors++;
+		}
+	}
+	else
+	{
+		StringBuf buf;
 
-		StringBuf_Printf(&buf, "('%d', '%d', '%d', '%d', '%d', '%d', '%d', '%u'",
-			id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time);
+		StringBuf_Init(&buf);
+		StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`", tablename, selectoption);
 		for( j = 0; j < MAX_SLOTS; ++j )
-			StringBuf_Printf(&buf, ", '%d'", items[i].card[j]);
-		StringBuf_AppendStr(&buf, ")");
-	}
+			StringBuf_Printf(&buf, ", `card%d`", j);
+		StringBuf_AppendStr(&buf, ") VALUES ");
 
-	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-	{
-		Sql_ShowDebug(sql_handle);
-		errors++;
+		found = false;
+		for( i = 0; i < max; ++i )
+		{
+			// skip empty and already matched entries
+			if( items[i].nameid == 0 || flag[i] )
+				continue;
+
+			if( found )
+				StringBuf_AppendStr(&buf, ",");
+			else
+				found = true;
+
+			StringBuf_Printf(&buf, "('%d', '%d', '%d', '%d', '%d', '%d', '%d', '%u'",
+				id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time);
+			for( j = 0; j < MAX_SLOTS; ++j )
+				StringBuf_Printf(&buf, ", '%d'", items[i].card[j]);
+			StringBuf_AppendStr(&buf, ")");
+		}
+
+		if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
+		{
+			Sql_ShowDebug(sql_handle);
+			errors++;
+		}
+		StringBuf_Destroy(&buf);
 	}
 
-	StringBuf_Destroy(&buf);
 	aFree(flag);
 
 	return errors;
 }
+
+/// Saves an array of 'item' entries into the specified table.
+int memitemdata_to_sql(struct item items[], int max, int id, int tableswitch)
+{
+	return memitemdata_to_sql_sub(items, max, id, tableswitch, false);
+}
 /* pretty much a copy of memitemdata_to_sql except it handles inventory_db exclusively,
  * - this is required because inventory db is the only one with the 'favorite' column. */
-int inventory_to_sql(const struct item items[], int max, int id) {
-	StringBuf buf;
+int inventory_to_sql(struct item items[], int max, int id) {
 	SqlStmt* stmt;
 	int i;
 	int j;
@@ -865,21 +1160,8 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 	// This approach is more complicated than a trivial delete&insert, but
 	// it significantly reduces cpu load on the database server.
 	
-	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `favorite`");
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `char_id`='%d'", inventory_db, id);
-	
-	stmt = SqlStmt_Malloc(sql_handle);
-	if( SQL_ERROR == SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf))
-	   ||  SQL_ERROR == SqlStmt_Execute(stmt) )
-	{
-		SqlStmt_ShowDebug(stmt);
-		SqlStmt_Free(stmt);
-		StringBuf_Destroy(&buf);
+	if( (stmt = char_item_select(TABLE_INVENTORY, inventory_db, "char_id", id)) == NULL )
 		return 1;
-	}
 	
 	SqlStmt_BindColumn(stmt, 0, SQLDT_INT,       &item.id,          0, NULL, NULL);
 	SqlStmt_BindColumn(stmt, 1, SQLDT_SHORT,     &item.nameid,      0, NULL, NULL);
@@ -921,80 +1203,159 @@ int inventory_to_sql(const struct item items[], int max, int id) {
 					;	//Do nothing.
 				else {
 					// update all fields.
-					StringBuf_Clear(&buf);
-					StringBuf_Printf(&buf, "UPDATE `%s` SET `amount`='%d', `equip`='%d', `identify`='%d', `refine`='%d',`attribute`='%d', `expire_time`='%u', `favorite`='%d'",
-									 inventory_db, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].favorite);
-					for( j = 0; j < MAX_SLOTS; ++j )
-						StringBuf_Printf(&buf, ", `card%d`=%d", j, items[i].card[j]);
-					StringBuf_Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
-					
-					if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
-						Sql_ShowDebug(sql_handle);
+					if( SQL_ERROR == char_item_update(TABLE_INVENTORY, inventory_db, &items[i], item.id) )
 						errors++;
-					}
 				}
 				
+				items[i].id = item.id;
 				found = flag[i] = true; //Item dealt with,
 				break; //skip to next item in the db.
 			}
 		}
 		if( !found ) {// Item not present in inventory, remove it.
-			if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", inventory_db, item.id) ) {
-				Sql_ShowDebug(sql_handle);
+			if( SQL_ERROR == char_item_delete(TABLE_INVENTORY, inventory_db, item.id) )
 				errors++;
-			}
 		}
 	}
-	SqlStmt_Free(stmt);
-	
-	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "INSERT INTO `%s` (`char_id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `favorite`", inventory_db);
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_AppendStr(&buf, ") VALUES ");
+	SqlStmt_FreeResult(stmt);
 	
-	found = false;
 	// insert non-matched items into the db as new items
 	for( i = 0; i < max; ++i ) {
 		// skip empty and already matched entries
-		if( items[i].nameid == 0 || flag[i] )
+		if( items[i].nameid == 0 || flag[i] ) {
+			if( items[i].nameid == 0 )
+				items[i].id = 0;
 			continue;
+		}
 		
-		if( found )
-			StringBuf_AppendStr(&buf, ",");
-		else
-			found = true;
-		
-		StringBuf_Printf(&buf, "('%d', '%d', '%d', '%d', '%d', '%d', '%d', '%u', '%d'",
-						 id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].favorite);
-		for( j = 0; j < MAX_SLOTS; ++j )
-			StringBuf_Printf(&buf, ", '%d'", items[i].card[j]);
-		StringBuf_AppendStr(&buf, ")");
-	}
-	
-	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
-		Sql_ShowDebug(sql_handle);
-		errors++;
+		if( SQL_ERROR == char_item_insert(TABLE_INVENTORY, inventory_db, "char_id", &items[i], id) )
+			errors++;
 	}
 	
-	StringBuf_Destroy(&buf);
 	aFree(flag);
 	
 	return errors;
 }
 
+/// Saves only the slots of 'items' that differ from 'saved', the copy of the
+/// same array last loaded from or written to the table. Each slot keeps the
+/// row it was loaded into, so changing a slot updates that row in place.
+/// Returns the number of errors, or -1 if 'saved' does not know the row of
+/// every entry and the table must be reconciled with memitemdata_to_sql.
+static int memitemdata_diff_to_sql(struct item items[], const struct item saved[], int max, int id, int tableswitch)
+{
+	const char* tablename;
+	const char* selectoption;
+	int i;
+	int errors = 0;
+
+	ARR_FIND( 0, max, i, saved[i].id < 0 || (saved[i].nameid != 0 && saved[i].id == 0) );
+	if( i < max || !char_item_table(tableswitch, &tablename, &selectoption) )
+		return -1;
+
+	for( i = 0; i < max; ++i )
+	{
+		items[i].id = ( saved[i].nameid != 0 ) ? saved[i].id : 0;
+		if( items[i].nameid == 0 && saved[i].nameid == 0 )
+			continue; // still empty
+		if( memcmp(&items[i], &saved[i], sizeof(struct item)) == 0 )
+			continue; // unchanged
+
+		if( items[i].nameid == 0 )
+		{// emptied
+			if( SQL_ERROR == char_item_delete(tableswitch, tablename, saved[i].id) )
+				errors++;
+			items[i].id = 0;
+		}
+		else if( saved[i].nameid == 0 )
+		{// filled
+			if( SQL_ERROR == char_item_insert(tableswitch, tablename, selectoption, &items[i], id) )
+				errors++;
+		}
+		else if( SQL_ERROR == char_item_update(tableswitch, tablename, &items[i], saved[i].id) )
+			errors++;
+	}
+
+	return errors;
+}
+
+/// Saves one item table of a character.
+/// 'saved' is the cached copy of the table; it is brought up to date with 'items'
+/// and, on errors, marked so that the next save reconciles the whole table.
+static int char_items_tosql(struct item items[], struct item saved[], int max, int id, int tableswitch, bool synced)
+{
+	int errors = -1;
+
+	if( synced )
+		errors = memitemdata_diff_to_sql(items, saved, max, id, tableswitch);
+	if( errors < 0 )
+		errors = ( tableswitch == TABLE_INVENTORY ) ? inventory_to_sql(items, max, id) : memitemdata_to_sql_sub(items, max, id, tableswitch, true);
+
+	memcpy(saved, items, max*sizeof(struct item));
+	if( errors )
+		saved[0].id = -1;
+	return errors;
+}
+
 
+#define MAX_CHAR_BUF 144 //Max size (for WFIFOHEAD calls)
 int mmo_char_tobuf(uint8* buf, struct mmo_charstatus* p);
 
+//=====================================================================================================
+// Char-select snapshot cache.
+// Keeps the character blocks sent by mmo_chars_fromsql per account, so
+// reconnecting players don't query the char table again. Any write to a
+// column shown in char-select must call char_select_cache_invalidate.
+#define CHAR_SELECT_CACHE_TIMEOUT 600000 // drop snapshots unused for 10 minutes
+
+struct char_select_cache {
+	int found_char[MAX_CHARS];
+	int len;
+	unsigned int tick; // last use
+	uint8 buf[MAX_CHARS*MAX_CHAR_BUF];
+};
+static DBMap* char_select_db; // int account_id -> struct char_select_cache*
+static unsigned int char_select_hits = 0, char_select_misses = 0;
+
+static void char_select_cache_invalidate(int account_id)
+{
+	idb_remove(char_select_db, account_id);
+}
+
+static int char_select_cache_cleanup(int tid, unsigned int tick, int id, intptr_t data)
+{
+	DBIterator* iter = db_iterator(char_select_db);
+	struct char_select_cache* cache;
+
+	for( cache = (struct char_select_cache*)dbi_first(iter); dbi_exists(iter); cache = (struct char_select_cache*)dbi_next(iter) )
+		if( DIFF_TICK(tick, cache->tick) > CHAR_SELECT_CACHE_TIMEOUT )
+			dbi_remove(iter);
+	dbi_destroy(iter);
+	return 0;
+}
+
 //=====================================================================================================
 // Loads the basic character rooster for the given account. Returns total buffer used.
 int mmo_chars_fromsql(struct char_session_data* sd, uint8* buf)
 {
 	SqlStmt* stmt;
 	struct mmo_charstatus p;
+	struct char_select_cache* cache;
 	int j = 0, i;
 	char last_map[MAP_NAME_LENGTH_EXT];
 
+	memset(sd->new_name,0,sizeof(sd->new_name));
+
+	if( (cache = (struct char_select_cache*)idb_get(char_select_db, sd->account_id)) != NULL )
+	{// served from memory
+		memcpy(sd->found_char, cache->found_char, sizeof(sd->found_char));
+		memcpy(buf, cache->buf, cache->len);
+		cache->tick = gettick();
+		char_select_hits++;
+		return cache->len;
+	}
+	char_select_misses++;
+
 	stmt = SqlStmt_Malloc(sql_handle);
 	if( stmt == NULL )
 	{
@@ -1063,51 +1424,221 @@ int mmo_chars_fromsql(struct char_session_data* sd, uint8* buf)
 	for( ; i < MAX_CHARS; i++ )
 		sd->found_char[i] = -1;
 
-	memset(sd->new_name,0,sizeof(sd->new_name));
-
 	SqlStmt_Free(stmt);
+
+	CREATE(cache, struct char_select_cache, 1);
+	memcpy(cache->found_char, sd->found_char, sizeof(cache->found_char));
+	memcpy(cache->buf, buf, j);
+	cache->len = j;
+	cache->tick = gettick();
+	idb_put(char_select_db, sd->account_id, cache);
+
 	return j;
 }
 
+//=====================================================================================================
+// Sections of mmo_char_fromsql.
+// Each one fetches several tables in a single round-trip (UNION ALL with a
+// leading column telling the source table) through a cached statement.
+
+/// Loads the inventory, cart and storage of a character.
+/// `inventory`/`cart_inventory` (`char_id`, ...) and `storage` (`account_id`, ...)
+static bool char_load_items(int char_id, struct mmo_charstatus* p)
+{
+	SqlStmt* stmt;
+	struct item tmp_item;
+	struct item* items[TABLE_STORAGE+1];
+	int max[TABLE_STORAGE+1];
+	int count[TABLE_STORAGE+1];
+	int table, i;
+
+	items[TABLE_INVENTORY] = p->inventory;    max[TABLE_INVENTORY] = MAX_INVENTORY;
+	items[TABLE_CART]      = p->cart;         max[TABLE_CART]      = MAX_CART;
+	items[TABLE_STORAGE]   = p->storage.items; max[TABLE_STORAGE]  = MAX_STORAGE;
+	memset(count, 0, sizeof(count));
+
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_LOAD_ITEMS)) == NULL )
+	{
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		for( table = TABLE_INVENTORY; table <= TABLE_STORAGE; ++table )
+		{
+			const char* tablename;
+			const char* selectoption;
+
+			char_item_table(table, &tablename, &selectoption);
+			if( table != TABLE_INVENTORY )
+				StringBuf_AppendStr(&buf, " UNION ALL ");
+			// storage is kept sorted by item, the others in insertion order
+			StringBuf_Printf(&buf, "(SELECT %d AS `tbl`, `%s` AS `ord`, `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, %s",
+				table, (table == TABLE_STORAGE ? "nameid" : "id"), (table == TABLE_INVENTORY ? "`favorite`" : "0"));
+			for( i = 0; i < MAX_SLOTS; ++i )
+				StringBuf_Printf(&buf, ", `card%d`", i);
+			StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`=?)", tablename, selectoption);
+		}
+		StringBuf_AppendStr(&buf, " ORDER BY `tbl`, `ord`");
+		stmt = Sql_PrepareStmtStr(sql_handle, CHAR_STMT_LOAD_ITEMS, StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+	}
+	if( stmt == NULL
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 1, SQLDT_INT, &char_id, 0)
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 2, SQLDT_INT, &p->account_id, 0)
+	||	SQL_ERROR == SqlStmt_Execute(stmt)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0,  SQLDT_INT,    &table, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2,  SQLDT_INT,    &tmp_item.id, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 3,  SQLDT_SHORT,  &tmp_item.nameid, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 4,  SQLDT_SHORT,  &tmp_item.amount, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 5,  SQLDT_USHORT, &tmp_item.equip, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 6,  SQLDT_CHAR,   &tmp_item.identify, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 7,  SQLDT_CHAR,   &tmp_item.refine, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 8,  SQLDT_CHAR,   &tmp_item.attribute, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 9,  SQLDT_UINT,   &tmp_item.expire_time, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 10, SQLDT_CHAR,   &tmp_item.favorite, 0, NULL, NULL) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return false;
+	}
+	for( i = 0; i < MAX_SLOTS; ++i )
+		if( SQL_ERROR == SqlStmt_BindColumn(stmt, 11+i, SQLDT_SHORT, &tmp_item.card[i], 0, NULL, NULL) )
+			SqlStmt_ShowDebug(stmt);
+
+	while( SQL_SUCCESS == SqlStmt_NextRow(stmt) )
+	{
+		if( table < TABLE_INVENTORY || table > TABLE_STORAGE || count[table] >= max[table] )
+			continue;
+		memcpy(&items[table][count[table]++], &tmp_item, sizeof(tmp_item));
+	}
+	p->storage.storage_amount = count[TABLE_STORAGE];
+	SqlStmt_FreeResult(stmt);
+	return true;
+}
+
+/// Loads the memo points, skills, friends and hotkeys of a character.
+/// Rows are (`type`, `str`, `val1`, `val2`, `val3`, `val4`):
+///  0: memo (map, x, y)
+///  1: skill (-, id, lv)
+///  2: friend (name, account_id, char_id)
+///  3: hotkey (-, hotkey, type, itemskill_id, skill_lvl)
+static bool char_load_misc(int char_id, struct mmo_charstatus* p)
+{
+	SqlStmt* stmt;
+	int type, val1, val2, val3, val4;
+	char str[NAME_LENGTH];
+	int memo_count = 0, skill_count = 0, friend_count = 0;
+
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_LOAD_MISC)) == NULL )
+	{
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		StringBuf_Printf(&buf, "(SELECT 0 AS `type`, `memo_id` AS `ord`, `map` AS `str`, `x`, `y`, 0, 0 FROM `%s` WHERE `char_id`=?)", memo_db);
+		StringBuf_Printf(&buf, " UNION ALL (SELECT 1, 0, '', `id`, `lv`, 0, 0 FROM `%s` WHERE `char_id`=?)", skill_db);
+		StringBuf_Printf(&buf, " UNION ALL (SELECT 2, 0, c.`name`, c.`account_id`, c.`char_id`, 0, 0 FROM `%s` c JOIN `%s` f ON f.`friend_account` = c.`account_id` AND f.`friend_id` = c.`char_id` WHERE f.`char_id`=?)", char_db, friend_db);
+#ifdef HOTKEY_SAVING
+		StringBuf_Printf(&buf, " UNION ALL (SELECT 3, 0, '', `hotkey`, `type`, `itemskill_id`, `skill_lvl` FROM `%s` WHERE `char_id`=?)", hotkey_db);
+#endif
+		StringBuf_AppendStr(&buf, " ORDER BY `type`, `ord`");
+		stmt = Sql_PrepareStmtStr(sql_handle, CHAR_STMT_LOAD_MISC, StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+	}
+	if( stmt == NULL
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 1, SQLDT_INT, &char_id, 0)
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 2, SQLDT_INT, &char_id, 0)
+#ifdef HOTKEY_SAVING
+	||	SQL_ERROR == SqlStmt_BindParam(stmt, 3, SQLDT_INT, &char_id, 0)
+#endif
+	||	SQL_ERROR == SqlStmt_Execute(stmt)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_INT,    &type, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2, SQLDT_STRING, &str, sizeof(str), NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 3, SQLDT_INT,    &val1, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 4, SQLDT_INT,    &val2, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 5, SQLDT_INT,    &val3, 0, NULL, NULL)
+	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 6, SQLDT_INT,    &val4, 0, NULL, NULL) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return false;
+	}
+
+	while( SQL_SUCCESS == SqlStmt_NextRow(stmt) )
+	{
+		switch( type )
+		{
+		case 0: // memo
+			if( memo_count < MAX_MEMOPOINTS )
+			{
+				struct point* pt = &p->memo_point[memo_count++];
+				pt->map = mapindex_name2id(str);
+				pt->x = val1;
+				pt->y = val2;
+			}
+			break;
+		case 1: // skill
+			if( skill_count >= MAX_SKILL )
+				break;
+			skill_count++;
+			if( val1 >= 0 && val1 < ARRAYLENGTH(p->skill) )
+			{
+				p->skill[val1].id = val1;
+				p->skill[val1].lv = val2;
+				p->skill[val1].flag = SKILL_FLAG_PERMANENT;
+			}
+			else
+				ShowWarning("mmo_char_fromsql: ignorando habilidade invlida (id=%d,lv=%d) da personagem %s (AID=%d,CID=%d)\n", val1, val2, p->name, p->account_id, p->char_id);
+			break;
+		case 2: // friend
+			if( friend_count < MAX_FRIENDS )
+			{
+				struct s_friend* f = &p->friends[friend_count++];
+				f->account_id = val1;
+				f->char_id = val2;
+				safestrncpy(f->name, str, sizeof(f->name));
+			}
+			break;
+#ifdef HOTKEY_SAVING
+		case 3: // hotkey
+			if( val1 >= 0 && val1 < MAX_HOTKEYS )
+			{
+				p->hotkeys[val1].type = val2;
+				p->hotkeys[val1].id = val3;
+				p->hotkeys[val1].lv = val4;
+			}
+			else
+				ShowWarning("mmo_char_fromsql: ignorando atalho invlido (hotkey=%d,type=%d,id=%d,lv=%d) da personagem %s (AID=%d,CID=%d)\n", val1, val2, val3, val4, p->name, p->account_id, p->char_id);
+			break;
+#endif
+		}
+	}
+	SqlStmt_FreeResult(stmt);
+	return true;
+}
+
 //=====================================================================================================
 int mmo_char_fromsql(int char_id, struct mmo_charstatus* p, bool load_everything)
 {
-	int i,j;
 	char t_msg[128] = "";
 	struct mmo_charstatus* cp;
-	StringBuf buf;
 	SqlStmt* stmt;
 	char last_map[MAP_NAME_LENGTH_EXT];
 	char save_map[MAP_NAME_LENGTH_EXT];
-	char point_map[MAP_NAME_LENGTH_EXT];
-	struct point tmp_point;
-	struct item tmp_item;
-	struct s_skill tmp_skill;
-	struct s_friend tmp_friend;
-#ifdef HOTKEY_SAVING
-	struct hotkey tmp_hotkey;
-	int hotkey_num;
-#endif
+	unsigned int tick = gettick_nocache();
 
 	memset(p, 0, sizeof(struct mmo_charstatus));
 	
 	if (save_log) ShowInfo("Carregando personagem "CL_WHITE"%d"CL_RESET".\n", char_id);
 
-	stmt = SqlStmt_Malloc(sql_handle);
-	if( stmt == NULL )
-	{
-		SqlStmt_ShowDebug(stmt);
-		return 0;
-	}
-
 	// read char data
-	if( SQL_ERROR == SqlStmt_Prepare(stmt, "SELECT "
+	if( (stmt = Sql_GetStmt(sql_handle, CHAR_STMT_LOAD_STATUS)) == NULL )
+		stmt = Sql_PrepareStmt(sql_handle, CHAR_STMT_LOAD_STATUS, "SELECT "
 		"`char_id`,`account_id`,`char_num`,`name`,`class`,`base_level`,`job_level`,`base_exp`,`job_exp`,`zeny`,"
 		"`str`,`agi`,`vit`,`int`,`dex`,`luk`,`max_hp`,`hp`,`max_sp`,`sp`,"
 		"`status_point`,`skill_point`,`option`,`karma`,`manner`,`party_id`,`guild_id`,`pet_id`,`homun_id`,`elemental_id`,`hair`,"
 		"`hair_color`,`clothes_color`,`weapon`,`shield`,`head_top`,`head_mid`,`head_bottom`,`last_map`,`last_x`,`last_y`,"
 		"`save_map`,`save_x`,`save_y`,`partner_id`,`father`,`mother`,`child`,`fame`,`rename`,`delete_date`,`robe`"
-		" FROM `%s` WHERE `char_id`=? LIMIT 1", char_db)
+		" FROM `%s` WHERE `char_id`=? LIMIT 1", char_db);
+	if( stmt == NULL
 	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
 	||	SQL_ERROR == SqlStmt_Execute(stmt)
 	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0,  SQLDT_INT,    &p->char_id, 0, NULL, NULL)
@@ -1165,168 +1696,37 @@ int mmo_char_fromsql(int char_id, struct mmo_charstatus* p, bool load_everything
 	)
 	{
 		SqlStmt_ShowDebug(stmt);
-		SqlStmt_Free(stmt);
 		return 0;
 	}
 	if( SQL_ERROR == SqlStmt_NextRow(stmt) )
 	{
 		ShowError("Requisito de char id %d no existente!\n", char_id);
-		SqlStmt_Free(stmt);
+		SqlStmt_FreeResult(stmt);
 		return 0;
 	}
+	SqlStmt_FreeResult(stmt);
 	p->last_point.map = mapindex_name2id(last_map);
 	p->save_point.map = mapindex_name2id(save_map);
 
 	strcat(t_msg, " status");
 
 	if (!load_everything) // For quick selection of data when displaying the char menu
-	{
-		SqlStmt_Free(stmt);
 		return 1;
-	}
-
-	//read memo data
-	//`memo` (`memo_id`,`char_id`,`map`,`x`,`y`)
-	if( SQL_ERROR == SqlStmt_Prepare(stmt, "SELECT `map`,`x`,`y` FROM `%s` WHERE `char_id`=? ORDER by `memo_id` LIMIT %d", memo_db, MAX_MEMOPOINTS)
-	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
-	||	SQL_ERROR == SqlStmt_Execute(stmt)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_STRING, &point_map, sizeof(point_map), NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 1, SQLDT_SHORT,  &tmp_point.x, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2, SQLDT_SHORT,  &tmp_point.y, 0, NULL, NULL) )
-		SqlStmt_ShowDebug(stmt);
 
-	for( i = 0; i < MAX_MEMOPOINTS && SQL_SUCCESS == SqlStmt_NextRow(stmt); ++i )
-	{
-		tmp_point.map = mapindex_name2id(point_map);
-		memcpy(&p->memo_point[i], &tmp_point, sizeof(tmp_point));
-	}
-	strcat(t_msg, " memo");
+	//read inventory, cart and storage
+	if( char_load_items(char_id, p) )
+		strcat(t_msg, " inventory cart storage");
 
-	//read inventory
-	//`inventory` (`id`,`char_id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `card0`, `card1`, `card2`, `card3`)
-	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `favorite`");
-	for( i = 0; i < MAX_SLOTS; ++i )
-		StringBuf_Printf(&buf, ", `card%d`", i);
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `char_id`=? LIMIT %d", inventory_db, MAX_INVENTORY);
-
-	if( SQL_ERROR == SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf))
-	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
-	||	SQL_ERROR == SqlStmt_Execute(stmt)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_INT,       &tmp_item.id, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 1, SQLDT_SHORT,     &tmp_item.nameid, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2, SQLDT_SHORT,     &tmp_item.amount, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 3, SQLDT_USHORT,    &tmp_item.equip, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 4, SQLDT_CHAR,      &tmp_item.identify, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 5, SQLDT_CHAR,      &tmp_item.refine, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 6, SQLDT_CHAR,      &tmp_item.attribute, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 7, SQLDT_UINT,      &tmp_item.expire_time, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 8, SQLDT_CHAR,      &tmp_item.favorite, 0, NULL, NULL) )
-		SqlStmt_ShowDebug(stmt);
-	for( i = 0; i < MAX_SLOTS; ++i )
-		if( SQL_ERROR == SqlStmt_BindColumn(stmt, 9+i, SQLDT_SHORT, &tmp_item.card[i], 0, NULL, NULL) )
-			SqlStmt_ShowDebug(stmt);
-
-	for( i = 0; i < MAX_INVENTORY && SQL_SUCCESS == SqlStmt_NextRow(stmt); ++i )
-		memcpy(&p->inventory[i], &tmp_item, sizeof(tmp_item));
-
-	strcat(t_msg, " inventory");
-
-	//read cart
-	//`cart_inventory` (`id`,`char_id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `card0`, `card1`, `card2`, `card3`)
-	StringBuf_Clear(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`");
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `char_id`=? LIMIT %d", cart_db, MAX_CART);
-
-	if( SQL_ERROR == SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf))
-	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
-	||	SQL_ERROR == SqlStmt_Execute(stmt)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_INT,         &tmp_item.id, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 1, SQLDT_SHORT,       &tmp_item.nameid, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2, SQLDT_SHORT,       &tmp_item.amount, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 3, SQLDT_USHORT,      &tmp_item.equip, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 4, SQLDT_CHAR,        &tmp_item.identify, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 5, SQLDT_CHAR,        &tmp_item.refine, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 6, SQLDT_CHAR,        &tmp_item.attribute, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 7, SQLDT_UINT,        &tmp_item.expire_time, 0, NULL, NULL) )
-		SqlStmt_ShowDebug(stmt);
-	for( i = 0; i < MAX_SLOTS; ++i )
-		if( SQL_ERROR == SqlStmt_BindColumn(stmt, 8+i, SQLDT_SHORT, &tmp_item.card[i], 0, NULL, NULL) )
-			SqlStmt_ShowDebug(stmt);
-
-	for( i = 0; i < MAX_CART && SQL_SUCCESS == SqlStmt_NextRow(stmt); ++i )
-		memcpy(&p->cart[i], &tmp_item, sizeof(tmp_item));
-	strcat(t_msg, " cart");
-
-	//read storage
-	storage_fromsql(p->account_id, &p->storage);
-	strcat(t_msg, " storage");
-
-	//read skill
-	//`skill` (`char_id`, `id`, `lv`)
-	if( SQL_ERROR == SqlStmt_Prepare(stmt, "SELECT `id`, `lv` FROM `%s` WHERE `char_id`=? LIMIT %d", skill_db, MAX_SKILL)
-	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
-	||	SQL_ERROR == SqlStmt_Execute(stmt)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_USHORT, &tmp_skill.id, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 1, SQLDT_USHORT, &tmp_skill.lv, 0, NULL, NULL) )
-		SqlStmt_ShowDebug(stmt);
-	tmp_skill.flag = SKILL_FLAG_PERMANENT;
-
-	for( i = 0; i < MAX_SKILL && SQL_SUCCESS == SqlStmt_NextRow(stmt); ++i )
-	{
-		if( tmp_skill.id < ARRAYLENGTH(p->skill) )
-			memcpy(&p->skill[tmp_skill.id], &tmp_skill, sizeof(tmp_skill));
-		else
-			ShowWarning("mmo_char_fromsql: ignorando habilidade invlida (id=%u,lv=%u) da personagem %s (AID=%d,CID=%d)\n", tmp_skill.id, tmp_skill.lv, p->name, p->account_id, p->char_id);
-	}
-	strcat(t_msg, " skills");
-
-	//read friends
-	//`friends` (`char_id`, `friend_account`, `friend_id`)
-	if( SQL_ERROR == SqlStmt_Prepare(stmt, "SELECT c.`account_id`, c.`char_id`, c.`name` FROM `%s` c LEFT JOIN `%s` f ON f.`friend_account` = c.`account_id` AND f.`friend_id` = c.`char_id` WHERE f.`char_id`=? LIMIT %d", char_db, friend_db, MAX_FRIENDS)
-	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
-	||	SQL_ERROR == SqlStmt_Execute(stmt)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_INT,    &tmp_friend.account_id, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 1, SQLDT_INT,    &tmp_friend.char_id, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2, SQLDT_STRING, &tmp_friend.name, sizeof(tmp_friend.name), NULL, NULL) )
-		SqlStmt_ShowDebug(stmt);
-
-	for( i = 0; i < MAX_FRIENDS && SQL_SUCCESS == SqlStmt_NextRow(stmt); ++i )
-		memcpy(&p->friends[i], &tmp_friend, sizeof(tmp_friend));
-	strcat(t_msg, " friends");
-
-#ifdef HOTKEY_SAVING
-	//read hotkeys
-	//`hotkey` (`char_id`, `hotkey`, `type`, `itemskill_id`, `skill_lvl`
-	if( SQL_ERROR == SqlStmt_Prepare(stmt, "SELECT `hotkey`, `type`, `itemskill_id`, `skill_lvl` FROM `%s` WHERE `char_id`=?", hotkey_db)
-	||	SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &char_id, 0)
-	||	SQL_ERROR == SqlStmt_Execute(stmt)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_INT,    &hotkey_num, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 1, SQLDT_UCHAR,  &tmp_hotkey.type, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 2, SQLDT_UINT,   &tmp_hotkey.id, 0, NULL, NULL)
-	||	SQL_ERROR == SqlStmt_BindColumn(stmt, 3, SQLDT_USHORT, &tmp_hotkey.lv, 0, NULL, NULL) )
-		SqlStmt_ShowDebug(stmt);
-
-	while( SQL_SUCCESS == SqlStmt_NextRow(stmt) )
-	{
-		if( hotkey_num >= 0 && hotkey_num < MAX_HOTKEYS )
-			memcpy(&p->hotkeys[hotkey_num], &tmp_hotkey, sizeof(tmp_hotkey));
-		else
-			ShowWarning("mmo_char_fromsql: ignorando atalho invlido (hotkey=%d,type=%u,id=%u,lv=%u) da personagem %s (AID=%d,CID=%d)\n", hotkey_num, tmp_hotkey.type, tmp_hotkey.id, tmp_hotkey.lv, p->name, p->account_id, p->char_id);
-	}
-	strcat(t_msg, " hotkeys");
-#endif
+	//read memo points, skills, friends and hotkeys
+	if( char_load_misc(char_id, p) )
+		strcat(t_msg, " memo skills friends hotkeys");
 
 	/* Mercenary Owner DataBase */
 	mercenary_owner_fromsql(char_id, p);
 	strcat(t_msg, " mercenary");
 
 
-	if (save_log) ShowInfo("Personagem carregada ("CL_WHITE"%d"CL_RESET" - "CL_WHITE"%s"CL_RESET"): "CL_WHITE"%s"CL_RESET"\n", char_id, p->name, t_msg);	//ok. all data load successfuly!
-	SqlStmt_Free(stmt);
-	StringBuf_Destroy(&buf);
+	if (save_log) ShowInfo("Personagem carregada ("CL_WHITE"%d"CL_RESET" - "CL_WHITE"%s"CL_RESET") em "CL_WHITE"%d"CL_RESET" ms: "CL_WHITE"%s"CL_RESET"\n", char_id, p->name, DIFF_TICK(gettick_nocache(), tick), t_msg);	//ok. all data load successfuly!
 
 	cp = idb_ensure(char_db_, char_id, create_charstatus);
 	memcpy(cp, p, sizeof(struct mmo_charstatus));
@@ -1390,6 +1790,7 @@ int rename_char_sql(struct char_session_data *sd, int char_id)
 		Sql_ShowDebug(sql_handle);
 		return 3;
 	}
+	char_select_cache_invalidate(sd->account_id);
 
 	// Change character's name into guild_db.
 	if( char_dat.guild_id )
@@ -1542,6 +1943,7 @@ int make_new_char_sql(struct char_session_data* sd, char* name_, int str, int ag
 #endif
 	//Retrieve the newly auto-generated char id
 	char_id = (int)Sql_LastInsertId(sql_handle);
+	char_select_cache_invalidate(sd->account_id);
 	//Give the char the default items
 	if (start_weapon > 0) { //add Start Weapon (Knife?)
 		if( SQL_ERROR == Sql_Query(sql_handle, "INSERT INTO `%s` (`char_id`,`nameid`, `amount`, `identify`) VALUES ('%d', '%d', '%d', '%d')", inventory_db, char_id, start_weapon, 1, 1) )
@@ -1715,6 +2117,7 @@ int delete_char_sql(int char_id)
 	/* delete character */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", char_db, char_id) )
 		Sql_ShowDebug(sql_handle);
+	char_select_cache_invalidate(account_id);
 
 	/* No need as we used inter_guild_leave [Skotlex]
 	// Also delete info from guildtables.
@@ -1750,7 +2153,6 @@ int count_users(void)
 // Writes char data to the buffer in the format used by the client.
 // Used in packets 0x6b (chars info) and 0x6d (new char info)
 // Returns the size
-#define MAX_CHAR_BUF 144 //Max size (for WFIFOHEAD calls)
 int mmo_char_tobuf(uint8* buffer, struct mmo_charstatus* p)
 {
 	unsigned short offset = 0;
@@ -2228,6 +2630,7 @@ int parse_fromlogin(int fd)
 
 					if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `class`='%d', `weapon`='0', `shield`='0', `head_top`='0', `head_mid`='0', `head_bottom`='0' WHERE `char_id`='%d'", char_db, class_[i], char_id[i]) ) 
 						Sql_ShowDebug(sql_handle); 
+					char_select_cache_invalidate(acc);
 					
 					if( guild_id[i] )// If there is a guild, update the guild_member data [Skotlex]
 						inter_guild_sex_changed(guild_id[i], acc, char_id[i], sex);
@@ -2539,6 +2942,7 @@ int char_loadName(int char_id, char* name)
 }
 
 int search_mapserver(unsigned short map, uint32 ip, uint16 port);
+static void mapif_map_promote(int id, int i);
 
 
 /// Initializes a server structure.
@@ -2578,6 +2982,9 @@ void mapif_server_reset(int id)
 		WBUFW(buf,2) = j * 4 + 10;
 		mapif_sendallwos(fd, buf, WBUFW(buf,2));
 	}
+	for(i = 0; i < MAX_MAP_PER_SERVER && server[id].map[i]; i++)
+		if (!server[id].standby[i])
+			mapif_map_promote(id, i);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `index`='%d'", ragsrvinfo_db, server[id].fd) )
 		Sql_ShowDebug(sql_handle);
 	online_char_db->foreach(online_char_db,char_db_setoffline,id); //Tag relevant chars as 'in disconnected' server.
@@ -2594,6 +3001,176 @@ void mapif_on_disconnect(int id)
 }
 
 
+/// Tells map-servers that mapindex is served by map-server owner (fd -1: all of them).
+/// The old owner sends its players there, the new one stops redirecting them.
+/// 2b2a <map index>.W <ip>.L <port>.W
+static void mapif_map_route(int fd, unsigned short mapindex, int owner)
+{
+	unsigned char buf[10];
+
+	WBUFW(buf,0) = 0x2b2a;
+	WBUFW(buf,2) = mapindex;
+	WBUFL(buf,4) = htonl(server[owner].ip);
+	WBUFW(buf,8) = htons(server[owner].port);
+	if( fd < 0 )
+		mapif_sendall(buf, 10);
+	else
+		mapif_send(fd, buf, 10);
+}
+
+
+/// Hands map i of map-server id, which is going away, to a map-server that has it in standby.
+static void mapif_map_promote(int id, int i)
+{
+	unsigned short mapindex = server[id].map[i];
+	int x, j = 0;
+
+	for( x = 0; x < ARRAYLENGTH(server); x++ )
+	{
+		if( x == id || server[x].fd <= 0 )
+			continue;
+		ARR_FIND( 0, MAX_MAP_PER_SERVER, j, server[x].map[j] == mapindex );
+		if( j < MAX_MAP_PER_SERVER && server[x].standby[j] )
+			break;
+	}
+	if( x == ARRAYLENGTH(server) )
+		return; // not loaded anywhere else
+
+	server[x].standby[j] = false;
+	mapif_map_route(-1, mapindex, x);
+	ShowStatus("Mapa '"CL_WHITE"%s"CL_RESET"' assumido pelo map-server "CL_WHITE"%d"CL_RESET".\n", mapindex_id2name(mapindex), x);
+}
+
+
+/// Moves mapindex to map-server to, which must have it loaded in standby.
+/// Returns false if that is not possible.
+static bool mapif_map_move(unsigned short mapindex, int to)
+{
+	int from, i, j;
+
+	from = search_mapserver(mapindex, -1, -1);
+	if( from < 0 || from == to || server[to].fd <= 0 )
+		return false;
+	ARR_FIND( 0, MAX_MAP_PER_SERVER, j, server[to].map[j] == mapindex );
+	if( j == MAX_MAP_PER_SERVER || !server[to].standby[j] )
+		return false;
+	ARR_FIND( 0, MAX_MAP_PER_SERVER, i, server[from].map[i] == mapindex );
+
+	server[from].standby[i] = true;
+	server[to].standby[j] = false;
+	// the players follow the map, until the next load report says otherwise
+	server[to].map_users[j] = server[from].map_users[i];
+	server[to].users += server[from].map_users[i];
+	server[from].users -= server[from].map_users[i];
+	server[from].map_users[i] = 0;
+
+	mapif_map_route(-1, mapindex, to);
+	handoff_stats.moves++;
+	ShowStatus("Mapa '"CL_WHITE"%s"CL_RESET"' movido do map-server "CL_WHITE"%d"CL_RESET" para o map-server "CL_WHITE"%d"CL_RESET".\n", mapindex_id2name(mapindex), from, to);
+	return true;
+}
+
+
+/// Receives the load report of a map-server.
+/// 2b29 <len>.W <users>.L <lag avg>.L <lag max>.L <memory>.L { <map index>.W <users>.W }*
+static void mapif_parse_load_report(int fd, int id)
+{
+	int i, j, len = RFIFOW(fd,2);
+
+	server[id].users = RFIFOL(fd,4);
+	server[id].load.lag_avg = RFIFOL(fd,8);
+	server[id].load.lag_max = RFIFOL(fd,12);
+	server[id].load.memory = RFIFOL(fd,16);
+	server[id].load.tick = gettick();
+
+	memset(server[id].map_users, 0, sizeof(server[id].map_users));
+	for( i = 20; i + 4 <= len; i += 4 )
+	{
+		unsigned short mapindex = RFIFOW(fd,i);
+		ARR_FIND( 0, MAX_MAP_PER_SERVER, j, server[id].map[j] == mapindex );
+		if( j < MAX_MAP_PER_SERVER )
+			server[id].map_users[j] = RFIFOW(fd,i+2);
+	}
+}
+
+
+/// A player arrived at the map-server it was sent to.
+static void mapif_handoff_done(struct auth_node* node)
+{
+	unsigned int latency = DIFF_TICK(gettick(), node->tick);
+
+	handoff_stats.count++;
+	handoff_stats.total += latency;
+	if( latency > handoff_stats.max )
+		handoff_stats.max = latency;
+}
+
+
+/// Moves a low-traffic map from the busiest to the idlest map-server, if the
+/// difference of players between them is above map_rebalance_threshold.
+/// Only maps the idlest map-server has in standby can be moved.
+static int mapif_rebalance_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int from = -1, to = -1, best = -1;
+	int i, j, gap;
+
+	for( i = 0; i < ARRAYLENGTH(server); i++ )
+	{
+		if( server[i].fd <= 0 || !server[i].load.tick )
+			continue;
+		if( from < 0 || server[i].users > server[from].users )
+			from = i;
+		if( to < 0 || server[i].users < server[to].users )
+			to = i;
+	}
+	if( from < 0 || from == to )
+		return 0;
+	gap = server[from].users - server[to].users;
+	if( gap < map_rebalance_threshold )
+		return 0;
+
+	// the busiest map that doesn't swap the roles of the two map-servers
+	for( i = 0; i < MAX_MAP_PER_SERVER && server[from].map[i]; i++ )
+	{
+		if( server[from].standby[i] || !server[from].map_users[i] || server[from].map_users[i] > gap / 2 )
+			continue;
+		if( best >= 0 && server[from].map_users[i] <= server[from].map_users[best] )
+			continue;
+		ARR_FIND( 0, MAX_MAP_PER_SERVER, j, server[to].map[j] == server[from].map[i] );
+		if( j < MAX_MAP_PER_SERVER && server[to].standby[j] )
+			best = i;
+	}
+	if( best >= 0 )
+		mapif_map_move(server[from].map[best], to);
+	return 0;
+}
+
+
+/// Shows the load of each map-server and the handoff statistics.
+static void mapif_load_show(void)
+{
+	int i, j, owned, standby;
+
+	for( i = 0; i < ARRAYLENGTH(server); i++ )
+	{
+		if( server[i].fd <= 0 )
+			continue;
+		owned = standby = 0;
+		for( j = 0; j < MAX_MAP_PER_SERVER && server[i].map[j]; j++ )
+		{
+			if( server[i].standby[j] )
+				standby++;
+			else
+				owned++;
+		}
+		ShowInfo("Map-server "CL_WHITE"%d"CL_RESET" (%u.%u.%u.%u:%u): "CL_WHITE"%d"CL_RESET" jogadores, atraso mdio "CL_WHITE"%u"CL_RESET" ms (mx. %u), "CL_WHITE"%u"CL_RESET" KB, %d mapas + %d em espera.\n",
+			i, CONVIP(server[i].ip), server[i].port, server[i].users, server[i].load.lag_avg, server[i].load.lag_max, server[i].load.memory, owned, standby);
+	}
+	ShowInfo("Mapas movidos: "CL_WHITE"%u"CL_RESET", trocas de map-server: "CL_WHITE"%u"CL_RESET" (mdia "CL_WHITE"%u"CL_RESET" ms, mx. "CL_WHITE"%u"CL_RESET" ms).\n",
+		handoff_stats.moves, handoff_stats.count, handoff_stats.count ? (unsigned int)(handoff_stats.total / handoff_stats.count) : 0, handoff_stats.max);
+}
+
+
 int parse_frommap(int fd)
 {
 	int i, j;
@@ -2616,6 +3193,14 @@ int parse_frommap(int fd)
 
 	while(RFIFOREST(fd) >= 2)
 	{
+		if( RFIFOW(fd,0) == INTER_FRAME_CMD )
+		{// unpack the frame in place and parse its packets
+			int r = inter_frame_unpack(fd);
+			if( r == 0 ) return 0;
+			if( r < 0 ) { set_eof(fd); return 0; }
+			continue;
+		}
+
 		switch(RFIFOW(fd,0))
 		{
 
@@ -2624,11 +3209,16 @@ int parse_frommap(int fd)
 				return 0;
 
 			memset(server[id].map, 0, sizeof(server[id].map));
+			memset(server[id].map_users, 0, sizeof(server[id].map_users));
 			j = 0;
 			for(i = 4; i < RFIFOW(fd,2); i += 4) {
 				server[id].map[j] = RFIFOW(fd,i);
+				server[id].standby[j] = true; // hidden from search_mapserver below
 				j++;
 			}
+			// maps already served by another map-server are kept in standby here
+			for(i = 0; i < j; i++)
+				server[id].standby[i] = ( search_mapserver(server[id].map[i], -1, -1) >= 0 );
 
 			ShowStatus("Map-server "CL_WHITE"%d"CL_RESET" conectado: "CL_WHITE"%d"CL_RESET" mapas, pelo IP "CL_WHITE"%d.%d.%d.%d"CL_RESET" porta "CL_WHITE"%d"CL_RESET".\n",
 						id, j, CONVIP(server[id].ip), server[id].port);
@@ -2649,13 +3239,19 @@ int parse_frommap(int fd)
 			if (j == 0) {
 				ShowWarning("Map-server "CL_WHITE"%d"CL_RESET" "CL_RED"NO"CL_RESET" possui mapas.\n", id);
 			} else {
-				// Transmitting maps information to the other map-servers
+				// Transmitting maps information to the other map-servers (standby maps are not served)
 				WBUFW(buf,0) = 0x2b04;
-				WBUFW(buf,2) = j * 4 + 10;
 				WBUFL(buf,4) = htonl(server[id].ip);
 				WBUFW(buf,8) = htons(server[id].port);
-				memcpy(WBUFP(buf,10), RFIFOP(fd,4), j * 4);
+				for(i = 0, x = 0; i < j; i++)
+					if (!server[id].standby[i])
+						WBUFW(buf,10+(x++)*4) = server[id].map[i];
+				WBUFW(buf,2) = x * 4 + 10;
 				mapif_sendallwos(fd, buf, WBUFW(buf,2));
+				// Telling the new map-server who serves its standby maps
+				for(i = 0; i < j; i++)
+					if (server[id].standby[i])
+						mapif_map_route(fd, server[id].map[i], search_mapserver(server[id].map[i], -1, -1));
 			}
 			// Transmitting the maps of the other map-servers to the new map-server
 			for(x = 0; x < ARRAYLENGTH(server); x++) {
@@ -2666,9 +3262,9 @@ int parse_frommap(int fd)
 					WFIFOW(fd,8) = htons(server[x].port);
 					j = 0;
 					for(i = 0; i < ARRAYLENGTH(server[x].map); i++)
-						if (server[x].map[i])
+						if (server[x].map[i] && !server[x].standby[i])
 							WFIFOW(fd,10+(j++)*4) = server[x].map[i];
-					if (j > 0) {
+					if (server[x].map[0]) {
 						WFIFOW(fd,2) = j * 4 + 10;
 						WFIFOSET(fd,WFIFOW(fd,2));
 					}
@@ -2798,12 +3394,14 @@ int parse_frommap(int fd)
 			if (RFIFOB(fd,12))
 			{	//Flag, set character offline after saving. [Skotlex]
 				set_char_offline(cid, aid);
-				WFIFOHEAD(fd,10);
-				WFIFOW(fd,0) = 0x2b21; //Save ack only needed on final save.
-				WFIFOL(fd,2) = aid;
-				WFIFOL(fd,6) = cid;
-				WFIFOSET(fd,10);
 			}
+			// Save ack, the map-server bounds its unacknowledged autosaves with it.
+			WFIFOHEAD(fd,11);
+			WFIFOW(fd,0) = 0x2b21;
+			WFIFOL(fd,2) = aid;
+			WFIFOL(fd,6) = cid;
+			WFIFOB(fd,10) = RFIFOB(fd,12); // final save
+			WFIFOSET(fd,11);
 			RFIFOSKIP(fd,size);
 		}
 		break;
@@ -2896,6 +3494,7 @@ int parse_frommap(int fd)
 				node->ip = ntohl(RFIFOL(fd,31));
 				node->group_id = RFIFOL(fd,35);
 				node->changing_mapservers = 1;
+				node->tick = gettick();
 				idb_put(auth_db, RFIFOL(fd,2), node);
 
 				data = idb_ensure(online_char_db, RFIFOL(fd,2), create_online_char_data);
@@ -3248,6 +3847,7 @@ int parse_frommap(int fd)
 			{// auth ok
 				cd->sex = sex;
 
+				inter_frame_begin(fd);
 				WFIFOHEAD(fd,25 + sizeof(struct mmo_charstatus));
 				WFIFOW(fd,0) = 0x2afd;
 				WFIFOW(fd,2) = 25 + sizeof(struct mmo_charstatus);
@@ -3259,6 +3859,10 @@ int parse_frommap(int fd)
 				WFIFOB(fd,24) = node->changing_mapservers;
 				memcpy(WFIFOP(fd,25), cd, sizeof(struct mmo_charstatus));
 				WFIFOSET(fd, WFIFOW(fd,2));
+				inter_frame_end(fd);
+
+				if( node->changing_mapservers )
+					mapif_handoff_done(node);
 
 				// only use the auth once and mark user online
 				idb_remove(auth_db, account_id);
@@ -3278,6 +3882,13 @@ int parse_frommap(int fd)
 		}
 		break;
 
+		case 0x2b29: // map-server load report
+			if (RFIFOREST(fd) < 4 || RFIFOREST(fd) < RFIFOW(fd,2))
+				return 0;
+			mapif_parse_load_report(fd, id);
+			RFIFOSKIP(fd,RFIFOW(fd,2));
+		break;
+
 		case 0x2736: // ip address update
 			if (RFIFOREST(fd) < 6) return 0;
 			server[id].ip = ntohl(RFIFOL(fd, 2));
@@ -3330,7 +3941,7 @@ int search_mapserver(unsigned short map, uint32 ip, uint16 port)
 		&& (port == (uint16)-1 || server[i].port == port))
 		{
 			for (j = 0; server[i].map[j]; j++)
-				if (server[i].map[j] == map)
+				if (server[i].map[j] == map && (ip != (uint32)-1 || !server[i].standby[j]))
 					return i;
 		}
 	}
@@ -3466,6 +4077,7 @@ static void char_delete2_req(int fd, struct char_session_data* sd)
 		char_delete2_ack(fd, char_id, 3, 0);
 		return;
 	}
+	char_select_cache_invalidate(sd->account_id);
 
 	char_delete2_ack(fd, char_id, 1, delete_date);
 }
@@ -3569,6 +4181,7 @@ static void char_delete2_cancel(int fd, struct char_session_data* sd)
 		char_delete2_cancel_ack(fd, char_id, 2);
 		return;
 	}
+	char_select_cache_invalidate(sd->account_id);
 
 	char_delete2_cancel_ack(fd, char_id, 1);
 }
@@ -4118,12 +4731,36 @@ int parse_console(const char* command)
 		runflag = 0;
 	else if( strcmpi("alive", command) == 0 || strcmpi("status", command) == 0 )
 		ShowInfo(CL_CYAN"Console: "CL_BOLD"Estou Operacional."CL_RESET"\n");
+	else if( strcmpi("guildsave", command) == 0 )
+		inter_guild_save_stats();
+	else if( strcmpi("interstats", command) == 0 )
+		inter_stats_show();
+	else if( strcmpi("mapload", command) == 0 )
+		mapif_load_show();
+	else if( strncmpi("mapmove ", command, 8) == 0 )
+	{
+		char map_name[MAP_NAME_LENGTH_EXT];
+		int to;
+		if( sscanf(command + 8, "%15s %d", map_name, &to) != 2 || to < 0 || to >= ARRAYLENGTH(server) || !mapif_map_move(mapindex_name2id(map_name), to) )
+			ShowError("No foi possvel mover o mapa. O map-server de destino precisa ter o mapa carregado em espera.\n");
+	}
+	else if( strcmpi("charselect", command) == 0 )
+		ShowInfo("Cache da seleo de personagens: "CL_WHITE"%u"CL_RESET" contas, "CL_WHITE"%u"CL_RESET" acertos, "CL_WHITE"%u"CL_RESET" consultas ao SQL.\n", db_size(char_select_db), char_select_hits, char_select_misses);
 	else if( strcmpi("help", command) == 0 )
 	{
 		ShowInfo("Para desligar o servidor:\n");
 		ShowInfo("  'shutdown|exit|quit|end'\n");
 		ShowInfo("Para saber se o servidor est ativo:\n");
 		ShowInfo("  'alive|status'\n");
+		ShowInfo("Para ver as estatsticas de salvamento dos cls:\n");
+		ShowInfo("  'guildsave'\n");
+		ShowInfo("Para ver as estatsticas do cache da seleo de personagens:\n");
+		ShowInfo("  'charselect'\n");
+		ShowInfo("Para ver o trfego entre servidores por pacote:\n");
+		ShowInfo("  'interstats'\n");
+		ShowInfo("Para ver a carga dos map-servers e mover um mapa para outro map-server:\n");
+		ShowInfo("  'mapload'\n");
+		ShowInfo("  'mapmove <mapa> <map-server>'\n");
 	}
 
 	return 0;
@@ -4137,9 +4774,11 @@ int mapif_sendall(unsigned char *buf, unsigned int len)
 	for(i = 0; i < ARRAYLENGTH(server); i++) {
 		int fd;
 		if ((fd = server[i].fd) > 0) {
+			inter_frame_begin(fd);
 			WFIFOHEAD(fd,len);
 			memcpy(WFIFOP(fd,0), buf, len);
 			WFIFOSET(fd,len);
+			inter_frame_end(fd);
 			c++;
 		}
 	}
@@ -4155,9 +4794,11 @@ int mapif_sendallwos(int sfd, unsigned char *buf, unsigned int len)
 	for(i = 0; i < ARRAYLENGTH(server); i++) {
 		int fd;
 		if ((fd = server[i].fd) > 0 && fd != sfd) {
+			inter_frame_begin(fd);
 			WFIFOHEAD(fd,len);
 			memcpy(WFIFOP(fd,0), buf, len);
 			WFIFOSET(fd,len);
+			inter_frame_end(fd);
 			c++;
 		}
 	}
@@ -4172,9 +4813,11 @@ int mapif_send(int fd, unsigned char *buf, unsigned int len)
 		ARR_FIND( 0, ARRAYLENGTH(server), i, fd == server[i].fd );
 		if( i < ARRAYLENGTH(server) )
 		{
+			inter_frame_begin(fd);
 			WFIFOHEAD(fd,len);
 			memcpy(WFIFOP(fd,0), buf, len);
 			WFIFOSET(fd,len);
+			inter_frame_end(fd);
 			return 1;
 		}
 	}
@@ -4589,6 +5232,10 @@ int char_config_read(const char* cfgName)
 			char_del_level = atoi(w2);
 		} else if (strcmpi(w1, "char_del_delay") == 0) {
 			char_del_delay = atoi(w2);
+		} else if (strcmpi(w1, "map_rebalance_interval") == 0) {
+			map_rebalance_interval = atoi(w2);
+		} else if (strcmpi(w1, "map_rebalance_threshold") == 0) {
+			map_rebalance_threshold = atoi(w2);
 		} else if(strcmpi(w1,"db_path")==0) {
 			safestrncpy(db_path, w2, sizeof(db_path));
 		} else if (strcmpi(w1, "console") == 0) {
@@ -4630,6 +5277,8 @@ void do_final(void)
 	set_all_offline(-1);
 	set_all_offline_sql();
 
+	mapif_load_show();
+
 	inter_final();
 
 	flush_fifos();
@@ -4642,6 +5291,7 @@ void do_final(void)
 
 	char_db_->destroy(char_db_, NULL);
 	online_char_db->destroy(online_char_db, NULL);
+	char_select_db->destroy(char_select_db, NULL);
 	auth_db->destroy(auth_db, NULL);
 
 	if( char_fd != -1 )
@@ -4650,6 +5300,7 @@ void do_final(void)
 		char_fd = -1;
 	}
 
+	Sql_ShowStmtStats(sql_handle);
 	Sql_Free(sql_handle);
 	mapindex_final();
 
@@ -4715,6 +5366,7 @@ int do_init(int argc, char **argv)
 	ShowInfo("Inicializando char-server.\n");
 	auth_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	online_char_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	char_select_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	mmo_char_sql_init();
 	char_read_fame_list(); //Read fame lists.
 	ShowInfo("char-server inicializado.\n");
@@ -4752,6 +5404,15 @@ int do_init(int argc, char **argv)
 	add_timer_func_list(online_data_cleanup, "online_data_cleanup");
 	add_timer_interval(gettick() + 1000, online_data_cleanup, 0, 0, 600 * 1000);
 
+	// drop unused char-select snapshots
+	add_timer_func_list(char_select_cache_cleanup, "char_select_cache_cleanup");
+	add_timer_interval(gettick() + 60 * 1000, char_select_cache_cleanup, 0, 0, 60 * 1000);
+
+	// move maps from busy to idle map-servers
+	add_timer_func_list(mapif_rebalance_timer, "mapif_rebalance_timer");
+	if( map_rebalance_interval > 0 )
+		add_timer_interval(gettick() + map_rebalance_interval * 1000, mapif_rebalance_timer, 0, 0, map_rebalance_interval * 1000);
+
 	if( console )
 	{
 		//##TODO invoke a CONSOLE_START plugin event
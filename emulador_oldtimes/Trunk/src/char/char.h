@@ -26,7 +26,26 @@ enum {
 	TABLE_GUILD_STORAGE,
 };
 
-int memitemdata_to_sql(const struct item items[], int max, int id, int tableswitch);
+/// Ids of the statements cached in sql_handle (see Sql_GetStmt).
+enum e_char_stmt
+{
+	CHAR_STMT_LOAD_STATUS,
+	CHAR_STMT_LOAD_ITEMS, // inventory, cart and storage
+	CHAR_STMT_LOAD_MISC,  // memo, skills, friends and hotkeys
+	CHAR_STMT_SAVE_STATUS,
+	CHAR_STMT_SAVE_STATUS2,
+	CHAR_STMT_DELETE_MEMO,
+	CHAR_STMT_DELETE_SKILL,
+	CHAR_STMT_DELETE_FRIEND,
+	// one of each per item table (TABLE_*)
+	CHAR_STMT_ITEM_SELECT,
+	CHAR_STMT_ITEM_UPDATE = CHAR_STMT_ITEM_SELECT + TABLE_GUILD_STORAGE + 1,
+	CHAR_STMT_ITEM_DELETE = CHAR_STMT_ITEM_UPDATE + TABLE_GUILD_STORAGE + 1,
+	CHAR_STMT_ITEM_INSERT = CHAR_STMT_ITEM_DELETE + TABLE_GUILD_STORAGE + 1,
+	CHAR_STMT_MAX = CHAR_STMT_ITEM_INSERT + TABLE_GUILD_STORAGE + 1
+};
+
+int memitemdata_to_sql(struct item items[], int max, int id, int tableswitch);
 
 int mapif_sendall(unsigned char *buf,unsigned int len);
 int mapif_sendallwos(int fd,unsigned char *buf,unsigned int len);
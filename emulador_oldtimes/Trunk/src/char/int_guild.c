@@ -40,53 +40,113 @@ static unsigned int guild_exp[100];
 int mapif_parse_GuildLeave(int fd,int guild_id,int account_id,int char_id,int flag,const char *mes);
 int mapif_guild_broken(int guild_id,int flag);
 static bool guild_check_empty(struct guild *g);
+static void guild_flag_save(struct guild* g, int flag);
 int guild_calcinfo(struct guild *g);
 int mapif_guild_basicinfochanged(int guild_id,int type,const void *data,int len);
 int mapif_guild_info(int fd,struct guild *g);
 int guild_break_sub(int key,void *data,va_list ap);
 int inter_guild_tosql(struct guild *g,int flag);
 
+/// Minimum time between two guild saves (ms).
+#define GUILD_SAVE_MIN_INTERVAL 100
+
+struct guild_save_entry {
+	int guild_id;
+	unsigned int tick; // when the guild was queued
+};
+
+/// FIFO of the guilds with pending save flags, in the order they were flagged.
+static struct {
+	struct guild_save_entry* data;
+	int head, count, max;
+	// statistics
+	unsigned int saves, removals;
+	uint64 latency_sum; // time the saved guilds waited in the queue (ms)
+	unsigned int latency_max;
+} guild_save_queue;
+
+/// Sets save flags of a guild, queueing it for guild_save_timer if it isn't queued yet.
+static void guild_flag_save(struct guild* g, int flag)
+{
+	int i;
+
+	g->save_flag |= flag;
+	if( g->save_flag&GS_QUEUED )
+		return;
+
+	if( guild_save_queue.count == guild_save_queue.max )
+	{// grow, unrolling the ring to the start of the buffer
+		int max = guild_save_queue.max ? guild_save_queue.max*2 : 64;
+
+		RECREATE(guild_save_queue.data, struct guild_save_entry, max);
+		for( i = 0; i < guild_save_queue.head; ++i )
+			guild_save_queue.data[guild_save_queue.max+i] = guild_save_queue.data[i];
+		if( guild_save_queue.head > 0 )
+			memmove(guild_save_queue.data, guild_save_queue.data + guild_save_queue.head, guild_save_queue.max*sizeof(guild_save_queue.data[0]));
+		guild_save_queue.head = 0;
+		guild_save_queue.max = max;
+	}
+	i = (guild_save_queue.head + guild_save_queue.count)%guild_save_queue.max;
+	guild_save_queue.data[i].guild_id = g->guild_id;
+	guild_save_queue.data[i].tick = gettick();
+	guild_save_queue.count++;
+	g->save_flag |= GS_QUEUED;
+}
+
+/// Shows the guild save statistics.
+void inter_guild_save_stats(void)
+{
+	ShowInfo("Cls: %u salvos, %u descarregados, %d na fila de salvamento, espera mdia %ums, mxima %ums.\n",
+		guild_save_queue.saves, guild_save_queue.removals, guild_save_queue.count,
+		guild_save_queue.saves ? (unsigned int)(guild_save_queue.latency_sum/guild_save_queue.saves) : 0, guild_save_queue.latency_max);
+}
+
+/// Consumes the queue of guild_flag_save, saving at most one guild per call.
+/// Guilds that only wait to be unloaded don't count towards the save rate.
 static int guild_save_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
-	static int last_id = 0; //To know in which guild we were.
-	int state = 0; //0: Have not reached last guild. 1: Reached last guild, ready for save. 2: Some guild saved, don't do further saving.
-	DBIterator *iter = db_iterator(guild_db_);
-	DBKey key;
 	struct guild* g;
+	int interval;
 
-	if( last_id == 0 ) //Save the first guild in the list.
-		state = 1;
-
-	for( g = db_data2ptr(iter->first(iter, &key)); dbi_exists(iter); g = db_data2ptr(iter->next(iter, &key)) )
+	while( guild_save_queue.count > 0 )
 	{
-		if( state == 0 && g->guild_id == last_id )
-			state++; //Save next guild in the list.
-		else
-		if( state == 1 && g->save_flag&GS_MASK )
+		int guild_id = guild_save_queue.data[guild_save_queue.head].guild_id;
+		unsigned int queued = guild_save_queue.data[guild_save_queue.head].tick;
+		bool saved = false;
+
+		guild_save_queue.head = (guild_save_queue.head + 1)%guild_save_queue.max;
+		guild_save_queue.count--;
+
+		if( (g = (struct guild*)idb_get(guild_db_, guild_id)) == NULL )
+			continue; // broken or already unloaded
+		g->save_flag &= ~GS_QUEUED;
+
+		if( g->save_flag&GS_MASK )
 		{
+			unsigned int latency = DIFF_TICK(tick, queued);
+
 			inter_guild_tosql(g, g->save_flag&GS_MASK);
 			g->save_flag &= ~GS_MASK;
-
-			//Some guild saved.
-			last_id = g->guild_id;
-			state++;
+			guild_save_queue.saves++;
+			guild_save_queue.latency_sum += latency;
+			guild_save_queue.latency_max = max(guild_save_queue.latency_max, latency);
+			saved = true;
 		}
 
 		if( g->save_flag == GS_REMOVE )
 		{// Nothing to save, guild is ready for removal.
 			if (save_log)
 				ShowInfo("Cl descarregado (%d - %s)\n", g->guild_id, g->name);
-			db_remove(guild_db_, key);
+			idb_remove(guild_db_, guild_id);
+			guild_save_queue.removals++;
 		}
-	}
-	dbi_destroy(iter);
 
-	if( state != 2 ) //Reached the end of the guild db without saving.
-		last_id = 0; //Reset guild saved, return to beginning.
+		if( saved )
+			break;
+	}
 
-	state = guild_db_->size(guild_db_);
-	if( state < 1 ) state = 1; //Calculate the time slot for the next save.
-	add_timer(tick  + autosave_interval/state, guild_save_timer, 0, 0);
+	interval = autosave_interval/(guild_save_queue.count+1); //Calculate the time slot for the next save.
+	add_timer(tick + max(interval, GUILD_SAVE_MIN_INTERVAL), guild_save_timer, 0, 0);
 	return 0;
 }
 
@@ -516,7 +576,7 @@ struct guild * inter_guild_fromsql(int guild_id)
 	Sql_FreeResult(sql_handle);
 
 	idb_put(guild_db_, guild_id, g); //Add to cache
-	g->save_flag |= GS_REMOVE; //But set it to be removed, in case it is not needed for long.
+	guild_flag_save(g, GS_REMOVE); //But set it to be removed, in case it is not needed for long.
 	
 	if (save_log)
 		ShowInfo("Cl carregado (%d - %s)\n", guild_id, g->name);
@@ -731,7 +791,7 @@ int inter_guild_CharOffline(int char_id, int guild_id)
 
 	// Remove guild from memory if no players online
 	if( online_count == 0 )
-		g->save_flag |= GS_REMOVE;
+		guild_flag_save(g, GS_REMOVE);
 
 	return 1;
 }
@@ -766,7 +826,10 @@ static int guild_db_final(DBKey key, DBData *data, va_list ap)
 
 void inter_guild_sql_final(void)
 {
+	inter_guild_save_stats();
 	guild_db_->destroy(guild_db_, guild_db_final);
+	if( guild_save_queue.data )
+		aFree(guild_save_queue.data);
 	db_destroy(castle_db);
 	return;
 }
@@ -889,7 +952,7 @@ int guild_calcinfo(struct guild *g)
 	// Check if guild stats has change
 	if(g->max_member != before.max_member || g->guild_lv != before.guild_lv || g->skill_point != before.skill_point	)
 	{
-		g->save_flag |= GS_LEVEL;
+		guild_flag_save(g, GS_LEVEL);
 		mapif_guild_info(-1,g);
 		return 1;
 	}
@@ -1264,7 +1327,7 @@ int mapif_parse_GuildAddMember(int fd,int guild_id,struct guild_member *m)
 			if (!guild_calcinfo(g)) //Send members if it was not invoked.
 				mapif_guild_info(-1,g);
 
-			g->save_flag |= GS_MEMBER;
+			guild_flag_save(g, GS_MEMBER);
 			if (g->save_flag&GS_REMOVE)
 				g->save_flag&=~GS_REMOVE;
 			return 0;
@@ -1327,7 +1390,7 @@ int mapif_parse_GuildLeave(int fd, int guild_id, int account_id, int char_id, in
 		//Update member info.
 		if (!guild_calcinfo(g))
 			mapif_guild_info(fd,g);
-		g->save_flag |= GS_EXPULSION;
+		guild_flag_save(g, GS_EXPULSION);
 	}
 
 	return 0;
@@ -1378,11 +1441,11 @@ int mapif_parse_GuildChangeMemberInfoShort(int fd,int guild_id,int account_id,in
 	{
 		g->average_lv = sum / c;
 		if( g->connect_member != prev_count || g->average_lv != prev_alv )
-			g->save_flag |= GS_CONNECT;
+			guild_flag_save(g, GS_CONNECT);
 		if( g->save_flag & GS_REMOVE )
 			g->save_flag &= ~GS_REMOVE;
 	}
-	g->save_flag |= GS_MEMBER; //Update guild member data
+	guild_flag_save(g, GS_MEMBER); //Update guild member data
 	return 0;
 }
 
@@ -1461,7 +1524,7 @@ int mapif_parse_GuildBasicInfoChange(int fd,int guild_id,int type,const char *da
 			else if(dw<0 && g->guild_lv+dw>=1)
 				g->guild_lv+=dw;
 			mapif_guild_info(-1,g);
-			g->save_flag |= GS_LEVEL;
+			guild_flag_save(g, GS_LEVEL);
 			return 0;
 		default:
 			ShowError("int_guild: GuildBasicInfoChange: Tipo desconhecido %d\n",type);
@@ -1502,7 +1565,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].position=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER;
+			guild_flag_save(g, GS_MEMBER);
 			break;
 		  }
 		case GMI_EXP:
@@ -1526,10 +1589,10 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 
 				guild_calcinfo(g);
 				mapif_guild_basicinfochanged(guild_id,GBI_EXP,&g->exp,sizeof(g->exp));
-				g->save_flag |= GS_LEVEL;
+				guild_flag_save(g, GS_LEVEL);
 			}
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER;
+			guild_flag_save(g, GS_MEMBER);
 			break;
 		}
 		case GMI_HAIR:
@@ -1537,7 +1600,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].hair=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			guild_flag_save(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_HAIR_COLOR:
@@ -1545,7 +1608,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].hair_color=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			guild_flag_save(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_GENDER:
@@ -1553,7 +1616,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].gender=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			guild_flag_save(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_CLASS:
@@ -1561,7 +1624,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].class_=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			guild_flag_save(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		case GMI_LEVEL:
@@ -1569,7 +1632,7 @@ int mapif_parse_GuildMemberInfoChange(int fd,int guild_id,int account_id,int cha
 			g->member[i].lv=*((short *)data);
 			g->member[i].modified = GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
-			g->save_flag |= GS_MEMBER; //Save new data.
+			guild_flag_save(g, GS_MEMBER); //Save new data.
 			break;
 		}
 		default:
@@ -1633,7 +1696,7 @@ int mapif_parse_GuildPosition(int fd,int guild_id,int idx,struct guild_position
 	memcpy(&g->position[idx],p,sizeof(struct guild_position));
 	mapif_guild_position(g,idx);
 	g->position[idx].modified = GS_POSITION_MODIFIED;
-	g->save_flag |= GS_POSITION; // Change guild_position
+	guild_flag_save(g, GS_POSITION); // Change guild_position
 	return 0;
 }
 
@@ -1654,7 +1717,7 @@ int mapif_parse_GuildSkillUp(int fd,int guild_id,int skill_num,int account_id,in
 		if (!guild_calcinfo(g))
 			mapif_guild_info(-1,g);
 		mapif_guild_skillupack(guild_id,skill_num,account_id);
-		g->save_flag |= (GS_LEVEL|GS_SKILL); // Change guild & guild_skill
+		guild_flag_save(g, GS_LEVEL|GS_SKILL); // Change guild & guild_skill
 	}
 	return 0;
 }
@@ -1673,7 +1736,7 @@ static int mapif_parse_GuildDeleteAlliance(struct guild *g, int guild_id, int ac
 	g->alliance[i].guild_id=0;
 	
 	mapif_guild_alliance(g->guild_id,guild_id,account_id1,account_id2,flag,g->name,name);
-	g->save_flag |= GS_ALLIANCE;
+	guild_flag_save(g, GS_ALLIANCE);
 	return 0;
 }
 
@@ -1723,8 +1786,8 @@ int mapif_parse_GuildAlliance(int fd,int guild_id1,int guild_id2,int account_id1
 	mapif_guild_alliance(guild_id1,guild_id2,account_id1,account_id2,flag,g[0]->name,g[1]->name);
 
 	// Mark the two guild to be saved
-	g[0]->save_flag |= GS_ALLIANCE;
-	g[1]->save_flag |= GS_ALLIANCE;
+	guild_flag_save(g[0], GS_ALLIANCE);
+	guild_flag_save(g[1], GS_ALLIANCE);
 	return 0;
 }
 
@@ -1739,7 +1802,7 @@ int mapif_parse_GuildNotice(int fd,int guild_id,const char *mes1,const char *mes
 
 	memcpy(g->mes1,mes1,MAX_GUILDMES1);
 	memcpy(g->mes2,mes2,MAX_GUILDMES2);
-	g->save_flag |= GS_MES;	//Change mes of guild
+	guild_flag_save(g, GS_MES);	//Change mes of guild
 	return mapif_guild_notice(g);
 }
 
@@ -1757,7 +1820,7 @@ int mapif_parse_GuildEmblem(int fd,int len,int guild_id,int dummy,const char *da
 	memcpy(g->emblem_data,data,len);
 	g->emblem_len=len;
 	g->emblem_id++;
-	g->save_flag |= GS_EMBLEM;	//Change guild
+	guild_flag_save(g, GS_EMBLEM);	//Change guild
 	return mapif_guild_emblem(g);
 }
 
@@ -1838,7 +1901,7 @@ int mapif_parse_GuildMasterChange(int fd, int guild_id, const char* name, int le
 		g->master[len] = '\0';
 
 	ShowInfo("int_guild: Lder do Cl alterado para %s (Cl %d - %s)\n",g->master, guild_id, g->name);
-	g->save_flag |= (GS_BASIC|GS_MEMBER); //Save main data and member data.
+	guild_flag_save(g, GS_BASIC|GS_MEMBER); //Save main data and member data.
 	return mapif_guild_master_changed(g, g->member[0].account_id, g->member[0].char_id);
 }
 
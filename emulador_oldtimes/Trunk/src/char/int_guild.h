@@ -17,6 +17,7 @@ enum {
 	GS_MES = 0x0200,
 	GS_MASK = 0x03FF,
 	GS_BASIC_MASK = (GS_BASIC | GS_EMBLEM | GS_CONNECT | GS_LEVEL | GS_MES),
+	GS_QUEUED = 0x4000, // waiting in the queue of guild_save_timer
 	GS_REMOVE = 0x8000,
 };
 
@@ -33,6 +34,7 @@ int inter_guild_sex_changed(int guild_id,int account_id,int char_id, short gende
 int inter_guild_charname_changed(int guild_id,int account_id, int char_id, char *name);
 int inter_guild_CharOnline(int char_id, int guild_id);
 int inter_guild_CharOffline(int char_id, int guild_id);
+void inter_guild_save_stats(void);
 
 //For the TXT->SQL converter.
 int inter_guild_tosql(struct guild *g,int flag);
@@ -162,6 +162,7 @@ int mapif_load_guild_storage(int fd,int account_id,int guild_id)
 		Sql_ShowDebug(sql_handle);
 	else if( Sql_NumRows(sql_handle) > 0 )
 	{// guild exists
+		inter_frame_begin(fd);
 		WFIFOHEAD(fd, sizeof(struct guild_storage)+12);
 		WFIFOW(fd,0) = 0x3818;
 		WFIFOW(fd,2) = sizeof(struct guild_storage)+12;
@@ -169,6 +170,7 @@ int mapif_load_guild_storage(int fd,int account_id,int guild_id)
 		WFIFOL(fd,8) = guild_id;
 		guild_storage_fromsql(guild_id, (struct guild_storage*)WFIFOP(fd,12));
 		WFIFOSET(fd, WFIFOW(fd,2));
+		inter_frame_end(fd);
 		return 0;
 	}
 	// guild does not exist
@@ -11,6 +11,7 @@
 #include "../common/timer.h"
 #include "../common/thread.h"
 #include "../common/mempool.h"
+#include "../common/ers.h"
 #endif
 
 #include <stdio.h>
@@ -345,6 +346,7 @@ int main (int argc, char **argv)
 	timer_final();
 	socket_final();
 	db_final();
+	ers_force_destroy_all(); // entry managers that were never destroyed live in mempools
 	mempool_final();	
 	rathread_final();
 #endif
@@ -2820,3 +2820,88 @@ void linkdb_final( struct linkdb_node** head )
 	}
 	*head = NULL;
 }
+
+// Trigram DB System
+struct trigramdb_list {
+	int* ids;
+	int count;
+	int max;
+};
+
+/// Case-folded trigram at p (3 chars must be available).
+static unsigned int trigramdb_key( const char* p )
+{
+	return ((unsigned int)(unsigned char)TOUPPER(p[0])<<16) | ((unsigned int)(unsigned char)TOUPPER(p[1])<<8) | (unsigned int)(unsigned char)TOUPPER(p[2]);
+}
+
+static DBData trigramdb_create_list( DBKey key, va_list args )
+{
+	struct trigramdb_list* list;
+	CREATE(list, struct trigramdb_list, 1);
+	return db_ptr2data(list);
+}
+
+static int trigramdb_final_sub( DBKey key, DBData* data, va_list ap )
+{
+	struct trigramdb_list* list = db_data2ptr(data);
+	if( list->ids )
+		aFree(list->ids);
+	aFree(list);
+	return 0;
+}
+
+void trigramdb_init( struct trigramdb* tdb )
+{
+	tdb->lists = uidb_alloc(DB_OPT_BASE);
+}
+
+void trigramdb_add( struct trigramdb* tdb, const char* name, int id )
+{
+	size_t i, len = strlen(name);
+
+	for( i = 0; i + 3 <= len; i++ ) {
+		struct trigramdb_list* list = uidb_ensure(tdb->lists, trigramdb_key(name+i), trigramdb_create_list);
+
+		if( list->count && list->ids[list->count-1] == id )
+			continue; // repeated trigram, or another name of the same id
+		if( list->count == list->max ) {
+			list->max = list->max ? list->max*2 : 4;
+			RECREATE(list->ids, int, list->max);
+		}
+		list->ids[list->count++] = id;
+	}
+}
+
+const int* trigramdb_candidates( struct trigramdb* tdb, const char* str, int* count )
+{
+	struct trigramdb_list* best = NULL;
+	size_t i, len = strlen(str);
+
+	if( len < 3 )
+		return NULL;
+	for( i = 0; i + 3 <= len; i++ ) {
+		struct trigramdb_list* list = uidb_get(tdb->lists, trigramdb_key(str+i));
+
+		if( list == NULL || list->count == 0 ) {
+			// no name contains this piece
+			static const int none[1] = { 0 };
+			*count = 0;
+			return none;
+		}
+		if( best == NULL || list->count < best->count )
+			best = list;
+	}
+	*count = best->count;
+	return best->ids;
+}
+
+void trigramdb_clear( struct trigramdb* tdb )
+{
+	tdb->lists->clear(tdb->lists, trigramdb_final_sub);
+}
+
+void trigramdb_final( struct trigramdb* tdb )
+{
+	tdb->lists->destroy(tdb->lists, trigramdb_final_sub);
+	tdb->lists = NULL;
+}
@@ -884,6 +884,20 @@ void* linkdb_erase  ( struct linkdb_node** head, void *key);
 void  linkdb_final  ( struct linkdb_node** head );
 void  linkdb_foreach( struct linkdb_node** head, LinkDBFunc func, ...  );
 
+// Trigram DB System - case-insensitive substring search over names
+/// Names are split into overlapping three-letter pieces (trigrams), each
+/// listing the ids of the names that contain it, in the order they were added.
+/// A search only has to check the ids of the rarest trigram of the string.
+struct trigramdb {
+	DBMap* lists; // trigram -> struct trigramdb_list*
+};
+
+void       trigramdb_init      ( struct trigramdb* tdb );
+void       trigramdb_add       ( struct trigramdb* tdb, const char* name, int id );
+const int* trigramdb_candidates( struct trigramdb* tdb, const char* str, int* count ); // NULL: str too short, check everything
+void       trigramdb_clear     ( struct trigramdb* tdb );
+void       trigramdb_final     ( struct trigramdb* tdb );
+
 
 
 /// Finds an entry in an array.
@@ -28,28 +28,47 @@
  *    destroyed so memory will usually only be recovered near the end.       *
  *  - Always wastes space for entries smaller than a pointer.                *
  *                                                                           *
- *  WARNING: The system is not thread-safe at the moment.                    *
+ *  The entries come from a mempool per size class (multiples of 16 bytes),  *
+ *  so the managers can be used from any thread. Each thread keeps a few     *
+ *  freed entries of every size class to itself, avoiding the pool lock.     *
  *                                                                           *
  *  HISTORY:                                                                 *
  *    0.1 - Initial version                                                  *
  *    1.0 - ERS Rework                                                       *
+ *    2.0 - Entries from mempools, per-thread caches                         *
  *                                                                           *
- * @version 1.0 - ERS Rework                                                 *
+ * @version 2.0 - Entries from mempools, per-thread caches                   *
  * @author GreenBox @ rAthena Project                                        *
  * @encoding US-ASCII                                                        *
  * @see common#ers.h                                                         *
 \*****************************************************************************/
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "../common/cbasetypes.h"
+#include "../common/atomic.h"
 #include "../common/malloc.h" // CREATE, RECREATE, aMalloc, aFree
+#include "../common/mempool.h"
 #include "../common/showmsg.h" // ShowMessage, ShowError, ShowFatalError, CL_BOLD, CL_NORMAL
+#include "../common/spinlock.h"
 #include "ers.h"
 
 #ifndef DISABLE_ERS
 
+// Maximum number of size classes with per-thread caches
 #define ERS_ROOT_SIZE 256
-#define ERS_BLOCK_ENTRIES 4096
+// Freed entries a thread keeps for itself in each size class
+#define ERS_LOCAL_ENTRIES 64
+// Bytes of entries preallocated/added at a time by the mempool of a size class
+#define ERS_SEGMENT_SIZE 65536
+
+// Per-thread caches, __thread is native on GCC (configure also sets HAS_TLS)
+#if !defined(HAS_TLS) && ( defined(_MSC_VER) || defined(__GNUC__) )
+#define HAS_TLS
+#endif
+#if defined(HAS_TLS) && defined(WIN32)
+#define __thread __declspec( thread )
+#endif
 
 struct ers_list
 {
@@ -58,26 +77,20 @@ struct ers_list
 
 typedef struct ers_cache
 {
-	// Allocated object size, including ers_list size
+	// Size class of the entries, multiple of 16
 	unsigned int ObjectSize;
 
 	// Number of ers_instances referencing this
 	int ReferenceCount;
 
-	// Reuse linked list
-	struct ers_list *ReuseList;
+	// Pool of the entries
+	mempool Pool;
 
-	// Memory blocks array
-	unsigned char **Blocks;
+	// Slot of the per-thread caches, -1 if there is none
+	int Index;
 
-	// Max number of blocks 
-	unsigned int Max;
-
-	// Free objects count
-	unsigned int Free;
-	
-	// Used objects count
-	unsigned int Used;
+	// Entries left allocated by destroyed ERS_OPT_CLEAR instances
+	volatile int32 Cleared;
 
 	// Linked list
 	struct ers_cache *Next, *Prev;
@@ -98,30 +111,46 @@ typedef struct
 	ers_cache_t *Cache;
 
 	// Count of objects in use, used for detecting memory leaks
-	unsigned int Count;
+	volatile int32 Count;
 } ers_instance_t;
 
+#ifdef HAS_TLS
+// Freed entries kept by this thread, by ers_cache.Index
+struct ers_local
+{
+	struct ers_list *ReuseList;
+	unsigned int Free;
+};
+static __thread struct ers_local ers_local[ERS_ROOT_SIZE];
+#endif
 
 // Array containing a pointer for all ers_cache structures
 static ers_cache_t *CacheList;
+static SPIN_LOCK CacheListLock;
+static int CacheCount = 0;
 
 static ers_cache_t *ers_find_cache(unsigned int size)
 {
 	ers_cache_t *cache;
+	char name[32];
 
+	EnterSpinLock(&CacheListLock);
 	for (cache = CacheList; cache; cache = cache->Next)
 		if (cache->ObjectSize == size)
+		{
+			cache->ReferenceCount++;
+			LeaveSpinLock(&CacheListLock);
 			return cache;
+		}
 
 	CREATE(cache, ers_cache_t, 1);
 	cache->ObjectSize = size;
-	cache->ReferenceCount = 0;
-	cache->ReuseList = NULL;
-	cache->Blocks = NULL;
-	cache->Free = 0;
-	cache->Used = 0;
-	cache->Max = 0;
-	
+	cache->ReferenceCount = 1;
+	cache->Index = ( CacheCount < ERS_ROOT_SIZE ) ? CacheCount++ : -1; // slots are never reused
+	cache->Cleared = 0;
+	sprintf(name, "ERS %u", size);
+	cache->Pool = mempool_create(name, size, max(ERS_SEGMENT_SIZE/size, 1), max(ERS_SEGMENT_SIZE/size, 1), NULL, NULL);
+
 	if (CacheList == NULL)
 	{
 		CacheList = cache;
@@ -133,16 +162,38 @@ static ers_cache_t *ers_find_cache(unsigned int size)
 		CacheList = cache;
 		CacheList->Prev = NULL;
 	}
+	LeaveSpinLock(&CacheListLock);
 
 	return cache;
 }
 
-static void ers_free_cache(ers_cache_t *cache, bool remove)
+/// Returns the entries kept by this thread to the pool.
+static void ers_flush_local(ers_cache_t *cache)
 {
-	unsigned int i;
+#ifdef HAS_TLS
+	struct ers_local *local;
 
-	for (i = 0; i < cache->Used; i++)
-		aFree(cache->Blocks[i]);
+	if (cache->Index < 0)
+		return;
+
+	local = &ers_local[cache->Index];
+	while (local->ReuseList != NULL)
+	{
+		struct ers_list *entry = local->ReuseList;
+		local->ReuseList = entry->Next;
+		mempool_node_put(cache->Pool, entry);
+	}
+	local->Free = 0;
+#endif
+}
+
+static void ers_free_cache(ers_cache_t *cache, bool remove)
+{
+	ers_flush_local(cache);
+	if (cache->Cleared)
+		mempool_discard(cache->Pool); // entries of ERS_OPT_CLEAR instances were dropped on purpose
+	else
+		mempool_destroy(cache->Pool);
 
 	if (cache->Next)
 		cache->Next->Prev = cache->Prev;
@@ -152,14 +203,13 @@ static void ers_free_cache(ers_cache_t *cache, bool remove)
 	else
 		CacheList = cache->Next;
 
-	aFree(cache->Blocks);
 	aFree(cache);
 }
 
 static void *ers_obj_alloc_entry(ERS self)
 {
 	ers_instance_t *instance = (ers_instance_t *)self;
-	void *ret;
+	void *ret = NULL;
 
 	if (instance == NULL) 
 	{
@@ -167,32 +217,23 @@ static void *ers_obj_alloc_entry(ERS self)
 		return NULL;
 	}
 
-	if (instance->Cache->ReuseList != NULL)
+#ifdef HAS_TLS
+	if (instance->Cache->Index >= 0)
 	{
-		ret = (void *)((unsigned char *)instance->Cache->ReuseList + sizeof(struct ers_list));
-		instance->Cache->ReuseList = instance->Cache->ReuseList->Next;
-	} 
-	else if (instance->Cache->Free > 0) 
-	{
-		instance->Cache->Free--;
-		ret = &instance->Cache->Blocks[instance->Cache->Used - 1][instance->Cache->Free * instance->Cache->ObjectSize + sizeof(struct ers_list)];
-	} 
-	else 
-	{
-		if (instance->Cache->Used == instance->Cache->Max) 
+		struct ers_local *local = &ers_local[instance->Cache->Index];
+
+		if (local->ReuseList != NULL)
 		{
-			instance->Cache->Max = (instance->Cache->Max * 4) + 3;
-			RECREATE(instance->Cache->Blocks, unsigned char *, instance->Cache->Max);
+			ret = local->ReuseList;
+			local->ReuseList = local->ReuseList->Next;
+			local->Free--;
 		}
-
-		CREATE(instance->Cache->Blocks[instance->Cache->Used], unsigned char, instance->Cache->ObjectSize * ERS_BLOCK_ENTRIES);
-		instance->Cache->Used++;
-
-		instance->Cache->Free = ERS_BLOCK_ENTRIES -1;
-		ret = &instance->Cache->Blocks[instance->Cache->Used - 1][instance->Cache->Free * instance->Cache->ObjectSize + sizeof(struct ers_list)];
 	}
+#endif
+	if (ret == NULL)
+		ret = mempool_node_get(instance->Cache->Pool);
 
-	instance->Count++;
+	InterlockedIncrement(&instance->Count);
 
 	return ret;
 }
@@ -200,7 +241,6 @@ static void *ers_obj_alloc_entry(ERS self)
 static void ers_obj_free_entry(ERS self, void *entry)
 {
 	ers_instance_t *instance = (ers_instance_t *)self;
-	struct ers_list *reuse = (struct ers_list *)((unsigned char *)entry - sizeof(struct ers_list));
 
 	if (instance == NULL) 
 	{
@@ -213,9 +253,24 @@ static void ers_obj_free_entry(ERS self, void *entry)
 		return;
 	}
 
-	reuse->Next = instance->Cache->ReuseList;
-	instance->Cache->ReuseList = reuse;
-	instance->Count--;
+	InterlockedDecrement(&instance->Count);
+
+#ifdef HAS_TLS
+	if (instance->Cache->Index >= 0)
+	{
+		struct ers_local *local = &ers_local[instance->Cache->Index];
+
+		if (local->Free < ERS_LOCAL_ENTRIES)
+		{
+			struct ers_list *reuse = (struct ers_list *)entry;
+			reuse->Next = local->ReuseList;
+			local->ReuseList = reuse;
+			local->Free++;
+			return;
+		}
+	}
+#endif
+	mempool_node_put(instance->Cache->Pool, entry);
 }
 
 static size_t ers_obj_entry_size(ERS self)
@@ -242,11 +297,17 @@ static void ers_obj_destroy(ERS self)
 	}
 
 	if (instance->Count > 0)
+	{
 		if (!(instance->Options & ERS_OPT_CLEAR))
 			ShowWarning("Memory leak detected at ERS '%s', %d objects not freed.\n", instance->Name, instance->Count);
+		else
+			InterlockedExchangeAdd(&instance->Cache->Cleared, instance->Count);
+	}
 
+	EnterSpinLock(&CacheListLock);
 	if (--instance->Cache->ReferenceCount <= 0)
 		ers_free_cache(instance->Cache, true);
+	LeaveSpinLock(&CacheListLock);
 
 	aFree(instance);
 }
@@ -256,9 +317,11 @@ ERS ers_new(uint32 size, char *name, enum ERSOptions options)
 	ers_instance_t *instance;
 	CREATE(instance, ers_instance_t, 1);
 
-	size += sizeof(struct ers_list);
+	if (size < sizeof(struct ers_list))
+		size = sizeof(struct ers_list);
 	if (size % ERS_ALIGNED)
 		size += ERS_ALIGNED - size % ERS_ALIGNED;
+	size = (size + 15) & ~15; // size class
 
 	instance->VTable.alloc = ers_obj_alloc_entry;
 	instance->VTable.free = ers_obj_free_entry;
@@ -269,7 +332,6 @@ ERS ers_new(uint32 size, char *name, enum ERSOptions options)
 	instance->Options = options;
 
 	instance->Cache = ers_find_cache(size);
-	instance->Cache->ReferenceCount++;
 
 	instance->Count = 0;
 
@@ -278,15 +340,32 @@ ERS ers_new(uint32 size, char *name, enum ERSOptions options)
 
 void ers_report(void)
 {
-	// FIXME: Someone use this? Is it really needed?
+	ers_cache_t *cache;
+
+	EnterSpinLock(&CacheListLock);
+	for (cache = CacheList; cache; cache = cache->Next)
+	{
+		mempool_stats stats = mempool_get_stats(cache->Pool);
+
+		ShowInfo("ERS %4u bytes: "CL_WHITE"%"PRId64""CL_RESET" used (peak %"PRId64"), %"PRId64" free, %d instance(s), %"PRId64" segment(s), %"PRId64" KB.\n",
+			cache->ObjectSize, stats.num_nodes_used, stats.peak_nodes_used, stats.num_nodes_free,
+			cache->ReferenceCount, stats.num_segments, stats.num_bytes_total/1024);
+	}
+	LeaveSpinLock(&CacheListLock);
 }
 
 void ers_force_destroy_all(void)
 {
-	ers_cache_t *cache;
+	ers_cache_t *cache, *next;
 	
-	for (cache = CacheList; cache; cache = cache->Next)
-			ers_free_cache(cache, false);
+	EnterSpinLock(&CacheListLock);
+	for (cache = CacheList; cache; cache = next)
+	{
+		next = cache->Next;
+		cache->Cleared = 1; // forced destruction, entries still in use are expected
+		ers_free_cache(cache, false);
+	}
+	LeaveSpinLock(&CacheListLock);
 }
 
 #endif
@@ -28,10 +28,12 @@
  *    destroyed so memory will usually only be recovered near the end.       *
  *  - Always wastes space for entries smaller than a pointer.                *
  *                                                                           *
- *  WARNING: The system is not thread-safe at the moment.                    *
+ *  The entries come from a mempool per size class, so the managers can be   *
+ *  used from any thread (see ers.c).                                        *
  *                                                                           *
  *  HISTORY:                                                                 *
  *    0.1 - Initial version                                                  *
+ *    2.0 - Entries from mempools, per-thread caches                         *
  *                                                                           *
  * @version 0.1 - Initial version                                            *
  * @author Flavio @ Amazon Project                                           *
@@ -151,10 +153,8 @@ ERS ers_new(uint32 size, char *name, enum ERSOptions options);
 
 /**
  * Print a report about the current state of the Entry Reusage System.
- * Shows information about the global system and each entry manager.
- * The number of entries are checked and a warning is shown if extra reusable 
- * entries are found.
- * The extra entries are included in the count of reusable entries.
+ * Shows the mempool statistics of each size class (see mempool_get_stats).
+ * Entries kept by the per-thread caches are counted as used.
  */
 void ers_report(void);
 
@@ -31,7 +31,7 @@
 #include "../common/mutex.h"
 
 #define ALIGN16	ra_align(16)
-#define ALIGN_TO(x, a) (x + ( a - ( x % a) ) )
+#define ALIGN_TO(x, a) ( ((x) + (a) - 1) / (a) * (a) )
 #define ALIGN_TO_16(x)	ALIGN_TO(x, 16)
 
 #undef MEMPOOL_DEBUG
@@ -214,6 +214,7 @@ static void segment_allocate_add(mempool p,  uint64 count){
 	size_t total_sz;
 	struct pool_segment *seg = NULL;
 	struct node *nodeList = NULL;
+	struct node *nodeTail = NULL;
 	struct node *node = NULL;
 	char *ptr = NULL;	
 	uint64 i;
@@ -273,6 +274,8 @@ static void segment_allocate_add(mempool p,  uint64 count){
 
 		node->next = nodeList;
 		nodeList = node;
+		if(nodeTail == NULL)
+			nodeTail = node;
 	}	
 
 
@@ -285,7 +288,7 @@ static void segment_allocate_add(mempool p,  uint64 count){
 	
 	// Link in Nodes
 	EnterSpinLock(&p->nodeLock);
-		nodeList->next = p->free_list;
+		nodeTail->next = p->free_list;
 		p->free_list = nodeList;
 	LeaveSpinLock(&p->nodeLock);
 
@@ -365,7 +368,7 @@ mempool mempool_create(const char *name,
 }//end: mempool_create()
 
 
-void mempool_destroy(mempool p){
+static void mempool_destroy_sub(mempool p, bool check_nodes){
 	struct  pool_segment *seg, *segnext;
 	struct	node *niter;
 	mempool piter, pprev;
@@ -411,7 +414,7 @@ void mempool_destroy(mempool p){
 	EnterSpinLock(&p->nodeLock);
 
 
-	if(p->num_nodes_free != p->num_nodes_total)
+	if(check_nodes && p->num_nodes_free != p->num_nodes_total)
 		ShowWarning("Mempool [%s] Destroy - %u nodes are not freed properly!\n", p->name, (p->num_nodes_total - p->num_nodes_free) );
 	
 	// Free All Segments (this will also free all nodes)
@@ -465,9 +468,19 @@ void mempool_destroy(mempool p){
 	aFree(p->name);
 	aFree(p);
 
+}//end: mempool_destroy_sub()
+
+
+void mempool_destroy(mempool p){
+	mempool_destroy_sub(p, true);
 }//end: mempool_destroy()
 
 
+void mempool_discard(mempool p){
+	mempool_destroy_sub(p, false);
+}//end: mempool_discard()
+
+
 void *mempool_node_get(mempool p){
 	struct node *node;
 	int64 num_used;
@@ -487,8 +500,11 @@ void *mempool_node_get(mempool p){
 
 		if(node != NULL)
 			break;
-			
-		rathread_yield();
+		
+		// The async allocator did not keep up (or missed the signal above),
+		// add a segment ourselves instead of waiting for it.
+		segment_allocate_add(p, p->elem_realloc_step);
+		InterlockedIncrement64(&p->num_realloc_events);
 	}
 
 	InterlockedDecrement64(&p->num_nodes_free);
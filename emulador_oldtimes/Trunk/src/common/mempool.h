@@ -66,6 +66,17 @@ mempool mempool_create(const char *name,
 void mempool_destroy(mempool pool);
 
 
+/**
+ * Destroys a Mempool, without warning about nodes that are still in use
+ *
+ * @param pool - the mempool to destroy
+ *
+ * @note:
+ *	For owners that drop their remaining nodes on purpose (see ERS_OPT_CLEAR)
+ */
+void mempool_discard(mempool pool);
+
+
 /**
  * Gets a new / empty node from the given mempool.
  * 
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <zlib.h>
 
 #ifdef WIN32
 	#include "../common/winapi.h"
@@ -243,7 +244,9 @@ static int create_session(int fd, RecvFunc func_recv, SendFunc func_send, ParseF
 #ifndef MINICORE
 	int ip_rules = 1;
 	static int connect_check(uint32 ip);
+	static void inter_stats_add(bool out, uint16 cmd, size_t len);
 #endif
+static int inter_frame_fd = -1; // fd of the open inter-server frame (see inter_frame_begin)
 
 const char* error_msg(void)
 {
@@ -638,6 +641,11 @@ int RFIFOSKIP(int fd, size_t len)
 		len = RFIFOREST(fd);
 	}
 
+#ifndef MINICORE
+	if( s->flag.server && len >= 2 )
+		inter_stats_add(false, RFIFOW(fd,0), len);
+#endif
+
 	s->rdata_pos = s->rdata_pos + len;
 	return 0;
 }
@@ -691,9 +699,15 @@ int WFIFOSET(int fd, size_t len)
 		}
 
 	}
+#ifndef MINICORE
+	if( s->flag.server )
+		inter_stats_add(true, WFIFOW(fd,0), len);
+#endif
+
 	s->wdata_size += len;
 	//If the interserver has 200% of its normal size full, flush the data.
-	if( s->flag.server && s->wdata_size >= 2*FIFOSIZE_SERVERLINK )
+	//(not while a frame is being collected, inter_frame_end does it)
+	if( s->flag.server && s->wdata_size >= 2*FIFOSIZE_SERVERLINK && fd != inter_frame_fd )
 		flush_fifo(fd);
 
 	// always keep a WFIFO_SIZE reserve in the buffer
@@ -1054,6 +1068,197 @@ int access_ipmask(const char* str, AccessControl* acc)
 #endif
 //////////////////////////////
 
+#ifndef MINICORE
+/////////////////////////////////////////////////////////////////////
+// Inter-server frames and traffic counters
+//
+// A frame (INTER_FRAME_CMD) carries several inter-server packets as one
+// zlib-compressed payload:
+//   <cmd>.W <frame len>.W <raw len>.L <deflated packets>
+// The receiver puts the packets back in its read buffer, so they are
+// parsed as if they had been sent one by one.
+/////////////////////////////////////////////////////////////////////
+#define INTER_STATS_FIRST 0x2700 // inter-server packets are in [0x2700,0x4000)
+#define INTER_STATS_COUNT 0x1900
+#define INTER_FRAME_MAX_RAW 0x40000 // sanity limit for a decompressed frame
+
+/// Frames smaller than this are sent uncompressed (0: never compress).
+static unsigned int inter_compress_min = 1024;
+
+struct inter_stat {
+	uint64 bytes_in, bytes_out;
+	uint32 count_in, count_out;
+};
+static struct inter_stat* inter_stats = NULL; // indexed by cmd-INTER_STATS_FIRST, allocated on first use
+static struct {
+	uint32 sent, received;
+	uint64 raw_out, packed_out;
+} inter_frames;
+
+static size_t inter_frame_start = 0; // wdata_size when the frame was opened
+static int inter_frame_depth = 0; // nested begin/end pairs on inter_frame_fd
+
+/// Counts a packet sent to / received from another server.
+static void inter_stats_add(bool out, uint16 cmd, size_t len)
+{
+	struct inter_stat* st;
+
+	if( cmd < INTER_STATS_FIRST || cmd >= INTER_STATS_FIRST + INTER_STATS_COUNT )
+		return;
+	if( inter_stats == NULL )
+		CREATE(inter_stats, struct inter_stat, INTER_STATS_COUNT);
+	st = &inter_stats[cmd - INTER_STATS_FIRST];
+	if( out ) {
+		st->count_out++;
+		st->bytes_out += len;
+	} else {
+		st->count_in++;
+		st->bytes_in += len;
+	}
+}
+
+/// Starts collecting the packets written to fd into a frame.
+/// Nested frames on the same fd are merged into the outermost one.
+/// The packets are only packed if the frame is big enough.
+void inter_frame_begin(int fd)
+{
+	if( inter_frame_fd == fd ) {
+		inter_frame_depth++;
+		return;
+	}
+	if( inter_frame_fd != -1 || !session_isActive(fd) )
+		return;
+	inter_frame_fd = fd;
+	inter_frame_depth = 1;
+	inter_frame_start = session[fd]->wdata_size;
+}
+
+/// Ends the frame opened by inter_frame_begin, compressing its packets.
+void inter_frame_end(int fd)
+{
+	struct socket_data* s;
+	size_t raw_len;
+	uLongf packed_len;
+	uint8* packed;
+
+	if( inter_frame_fd != fd || --inter_frame_depth > 0 )
+		return;
+	inter_frame_fd = -1;
+	if( !session_isActive(fd) )
+		return;
+
+	s = session[fd];
+	raw_len = s->wdata_size - inter_frame_start;
+	if( inter_compress_min == 0 || raw_len < inter_compress_min || raw_len > INTER_FRAME_MAX_RAW )
+		return; // leave the packets as they are
+
+	packed_len = compressBound((uLong)raw_len);
+	CREATE(packed, uint8, packed_len);
+	if( compress2(packed, &packed_len, s->wdata + inter_frame_start, (uLong)raw_len, Z_BEST_SPEED) == Z_OK
+	&&	8 + packed_len < raw_len && 8 + packed_len <= 0xFFFF )
+	{// replace the packets with the frame (it's smaller, so it fits)
+		uint8* buf = s->wdata + inter_frame_start;
+		WBUFW(buf,0) = INTER_FRAME_CMD;
+		WBUFW(buf,2) = (uint16)(8 + packed_len);
+		WBUFL(buf,4) = (uint32)raw_len;
+		memcpy(buf + 8, packed, packed_len);
+		s->wdata_size = inter_frame_start + 8 + packed_len;
+
+		inter_frames.sent++;
+		inter_frames.raw_out += raw_len;
+		inter_frames.packed_out += 8 + packed_len;
+	}
+	aFree(packed);
+
+	if( s->wdata_size >= 2*FIFOSIZE_SERVERLINK )
+		flush_fifo(fd); // skipped by WFIFOSET while the frame was open
+}
+
+/// Unpacks the frame at the start of the read buffer of fd.
+/// Returns 1 if the frame was replaced by its packets, 0 if more data is needed
+/// and -1 if the frame is invalid.
+int inter_frame_unpack(int fd)
+{
+	struct socket_data* s = session[fd];
+	size_t frame_len, raw_len, tail;
+	uLongf out_len;
+	uint8* raw;
+
+	if( RFIFOREST(fd) < 8 || RFIFOREST(fd) < RFIFOW(fd,2) )
+		return 0;
+	frame_len = RFIFOW(fd,2);
+	raw_len = RFIFOL(fd,4);
+	if( frame_len < 8 || raw_len == 0 || raw_len > INTER_FRAME_MAX_RAW )
+	{
+		ShowError("inter_frame_unpack: frame invlido na sesso #%d (tamanho=%u, descompactado=%u).\n", fd, (unsigned int)frame_len, (unsigned int)raw_len);
+		return -1;
+	}
+
+	CREATE(raw, uint8, raw_len);
+	out_len = (uLongf)raw_len;
+	if( uncompress(raw, &out_len, RFIFOP(fd,8), (uLong)(frame_len - 8)) != Z_OK || out_len != raw_len )
+	{
+		ShowError("inter_frame_unpack: falha ao descompactar frame na sesso #%d.\n", fd);
+		aFree(raw);
+		return -1;
+	}
+
+	// put the packets where the frame was, before the data that follows it
+	tail = s->rdata_size - (s->rdata_pos + frame_len);
+	if( s->rdata_pos + frame_len >= raw_len )
+	{
+		s->rdata_pos = s->rdata_pos + frame_len - raw_len;
+		memcpy(s->rdata + s->rdata_pos, raw, raw_len);
+	}
+	else
+	{
+		if( s->max_rdata < raw_len + tail )
+		{
+			RECREATE(s->rdata, uint8, raw_len + tail);
+			s->max_rdata = raw_len + tail;
+		}
+		memmove(s->rdata + raw_len, s->rdata + s->rdata_pos + frame_len, tail);
+		memcpy(s->rdata, raw, raw_len);
+		s->rdata_pos = 0;
+		s->rdata_size = raw_len + tail;
+	}
+	aFree(raw);
+
+	inter_frames.received++;
+	return 1;
+}
+
+/// Shows the inter-server traffic counters, busiest packets first.
+void inter_stats_show(void)
+{
+	int order[INTER_STATS_COUNT];
+	int i, j, n = 0;
+
+	ShowInfo("Frames: "CL_WHITE"%u"CL_RESET" enviados ("CL_WHITE"%"PRIu64""CL_RESET" -> "CL_WHITE"%"PRIu64""CL_RESET" bytes), "CL_WHITE"%u"CL_RESET" recebidos.\n",
+		inter_frames.sent, inter_frames.raw_out, inter_frames.packed_out, inter_frames.received);
+	if( inter_stats == NULL )
+		return;
+
+	for( i = 0; i < INTER_STATS_COUNT; ++i )
+	{
+		struct inter_stat* st = &inter_stats[i];
+		if( st->count_in == 0 && st->count_out == 0 )
+			continue;
+		// insertion sort by total bytes
+		for( j = n; j > 0 && inter_stats[order[j-1]].bytes_in + inter_stats[order[j-1]].bytes_out < st->bytes_in + st->bytes_out; --j )
+			order[j] = order[j-1];
+		order[j] = i;
+		++n;
+	}
+	for( i = 0; i < n; ++i )
+	{
+		struct inter_stat* st = &inter_stats[order[i]];
+		ShowInfo("  0x%04x: enviados "CL_WHITE"%u"CL_RESET" ("CL_WHITE"%"PRIu64""CL_RESET" bytes), recebidos "CL_WHITE"%u"CL_RESET" ("CL_WHITE"%"PRIu64""CL_RESET" bytes)\n",
+			INTER_STATS_FIRST + order[i], st->count_out, st->bytes_out, st->count_in, st->bytes_in);
+	}
+}
+#endif
+
 int socket_config_read(const char* cfgName)
 {
 	char line[1024],w1[1024],w2[1024];
@@ -1107,6 +1312,8 @@ int socket_config_read(const char* cfgName)
 			access_debug = config_switch(w2);
 		else if (!strcmpi(w1,"socket_max_client_packet"))
 			socket_max_client_packet = strtoul(w2, NULL, 0);
+		else if (!strcmpi(w1,"inter_compress_min"))
+			inter_compress_min = (unsigned int)strtoul(w2, NULL, 0);
 #endif
 		else if (!strcmpi(w1, "import"))
 			socket_config_read(w2);
@@ -1138,6 +1345,8 @@ void socket_final(void)
 		aFree(access_allow);
 	if( access_deny )
 		aFree(access_deny);
+	if( inter_stats )
+		aFree(inter_stats);
 #endif
 
 	for( i = 1; i < fd_max; i++ )
@@ -144,6 +144,13 @@ extern int naddr_;   // # of ip addresses
 
 void set_eof(int fd);
 
+// inter-server frames (map-server <-> char-server)
+#define INTER_FRAME_CMD 0x2b28
+void inter_frame_begin(int fd);
+void inter_frame_end(int fd);
+int inter_frame_unpack(int fd);
+void inter_stats_show(void);
+
 /// Use a shortlist of sockets instead of iterating all sessions for sockets 
 /// that have data to send or need eof handling.
 /// Adapted to use a static array instead of a linked list.
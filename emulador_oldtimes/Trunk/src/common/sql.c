@@ -3,8 +3,10 @@
 
 #include "../common/cbasetypes.h"
 #include "../common/malloc.h"
+#include "../common/mutex.h"
 #include "../common/showmsg.h"
 #include "../common/strlib.h"
+#include "../common/thread.h"
 #include "../common/timer.h"
 #include "sql.h"
 
@@ -14,6 +16,10 @@
 #include <mysql.h>
 #include <string.h>// strlen/strnlen/memcpy/memset
 #include <stdlib.h>// strtoul
+#ifndef WIN32
+#include <sys/time.h>// gettimeofday
+#include <time.h>// clock_gettime
+#endif
 
 
 
@@ -26,6 +32,9 @@ struct Sql
 	MYSQL_ROW row;
 	unsigned long* lengths;
 	int keepalive;
+	// statement cache
+	SqlStmt** stmts;
+	size_t max_stmts;
 };
 
 
@@ -53,6 +62,85 @@ struct SqlStmt
 	size_t max_columns;
 	bool bind_params;
 	bool bind_columns;
+	bool reprepare;// execution failed, the statement cache must prepare it again
+	// statistics
+	uint32 stat_hits;// times it was returned by the statement cache
+	uint32 stat_prepares;
+	uint32 stat_execs;
+	uint64 stat_usec;// time spent executing
+};
+
+
+
+#define SQLASYNC_MAX_STMT 32 // maximum number of statements registered in an executor
+#define SQLASYNC_DISPATCH_INTERVAL 20 // interval of the completion dispatcher (ms)
+
+/// Asynchronous job
+struct s_sqlasync_job
+{
+	struct s_sqlasync_job* next;
+	StringBuf query;// query text (empty for statements)
+	int stmt_id;// statement id or SQL_ERROR for queries
+	MYSQL_BIND* params;
+	size_t num_params;
+	int flags;
+	SqlAsyncFunc func;
+	intptr_t data;
+	// filled by the worker
+	MYSQL_RES* result;
+	int status;
+	char error[256];
+};
+
+
+
+/// Worker of an asynchronous executor
+struct s_sqlasync_conn
+{
+	SqlAsync* owner;
+	Sql* sql;
+	rAthread thread;
+	MYSQL_STMT* stmts[SQLASYNC_MAX_STMT];// prepared on first use
+	bool ping;// keepalive requested by the main thread
+};
+
+
+
+/// Asynchronous executor
+struct SqlAsync
+{
+	char name[32];
+	ramutex lock;
+	racond job_cond;// a job was queued, a serial job finished or the workers must stop
+	racond done_cond;// a job was dequeued or finished
+	struct s_sqlasync_job* queue_head;
+	struct s_sqlasync_job* queue_tail;
+	struct s_sqlasync_job* done_head;
+	struct s_sqlasync_job* done_tail;
+	size_t queue_len;
+	size_t max_queue;
+	size_t running;
+	bool serial_running;
+	bool terminate;
+	// workers
+	struct s_sqlasync_conn* conns;
+	size_t num_conns;
+	// registered statements (never change once registered)
+	char* stmts[SQLASYNC_MAX_STMT];
+	int num_stmts;
+	// parameters for the next SqlAsync_Execute (main thread only)
+	MYSQL_BIND* params;
+	size_t num_params;
+	// main thread only
+	Sql* result;// handle passed to the callbacks
+	int dispatcher;
+	int keepalive;
+	// statistics
+	uint32 stat_jobs;
+	uint32 stat_errors;
+	uint32 stat_refused;// jobs refused because the queue was full
+	uint32 stat_overflows;// serial jobs queued over max_queue
+	size_t stat_peak;
 };
 
 
@@ -74,6 +162,8 @@ Sql* Sql_Malloc(void)
 	self->lengths = NULL;
 	self->result = NULL;
 	self->keepalive = INVALID_TIMER;
+	self->stmts = NULL;
+	self->max_stmts = 0;
 
 	return self;
 }
@@ -419,6 +509,13 @@ void Sql_Free(Sql* self)
 		Sql_FreeResult(self);
 		StringBuf_Destroy(&self->buf);
 		if( self->keepalive != INVALID_TIMER ) delete_timer(self->keepalive, Sql_P_KeepaliveTimer);
+		if( self->stmts )
+		{
+			size_t i;
+			for( i = 0; i < self->max_stmts; ++i )
+				SqlStmt_Free(self->stmts[i]);
+			aFree(self->stmts);
+		}
 		aFree(self);
 	}
 }
@@ -431,6 +528,29 @@ void Sql_Free(Sql* self)
 
 
 
+/// Returns a monotonic timestamp in microseconds (statement statistics).
+///
+/// @private
+static uint64 Sql_P_MicroTick(void)
+{
+#if defined(WIN32)
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64)(count.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(HAVE_MONOTONIC_CLOCK)
+	struct timespec tval;
+	clock_gettime(CLOCK_MONOTONIC, &tval);
+	return (uint64)tval.tv_sec * 1000000 + tval.tv_nsec / 1000;
+#else
+	struct timeval tval;
+	gettimeofday(&tval, NULL);
+	return (uint64)tval.tv_sec * 1000000 + tval.tv_usec;
+#endif
+}
+
+
+
 /// Returns the mysql integer type for the target size.
 ///
 /// @private
@@ -613,6 +733,11 @@ SqlStmt* SqlStmt_Malloc(Sql* sql)
 	self->max_columns = 0;
 	self->bind_params = false;
 	self->bind_columns = false;
+	self->reprepare = false;
+	self->stat_hits = 0;
+	self->stat_prepares = 0;
+	self->stat_execs = 0;
+	self->stat_usec = 0;
 
 	return self;
 }
@@ -720,22 +845,29 @@ int SqlStmt_BindParam(SqlStmt* self, size_t idx, enum SqlDataType buffer_type, v
 /// Executes the prepared statement.
 int SqlStmt_Execute(SqlStmt* self)
 {
+	uint64 start;
+
 	if( self == NULL )
 		return SQL_ERROR;
 
 	SqlStmt_FreeResult(self);
+	start = Sql_P_MicroTick();
+	++self->stat_execs;
 	if( (self->bind_params && mysql_stmt_bind_param(self->stmt, self->params)) ||
 		mysql_stmt_execute(self->stmt) )
 	{
 		ShowSQL("DB error - %s\n", mysql_stmt_error(self->stmt));
+		self->reprepare = true;
 		return SQL_ERROR;
 	}
 	self->bind_columns = false;
 	if( mysql_stmt_store_result(self->stmt) )// store all the data
 	{
 		ShowSQL("DB error - %s\n", mysql_stmt_error(self->stmt));
+		self->reprepare = true;
 		return SQL_ERROR;
 	}
+	self->stat_usec += Sql_P_MicroTick() - start;
 
 	return SQL_SUCCESS;
 }
@@ -953,3 +1085,737 @@ void SqlStmt_Free(SqlStmt* self)
 		aFree(self);
 	}
 }
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Statement Cache
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+/// Returns the cached statement with the given id.
+SqlStmt* Sql_GetStmt(Sql* self, int id)
+{
+	SqlStmt* stmt;
+
+	if( self == NULL || id < 0 || (size_t)id >= self->max_stmts )
+		return NULL;
+
+	stmt = self->stmts[id];
+	if( stmt == NULL || stmt->reprepare )
+		return NULL;
+	++stmt->stat_hits;
+	return stmt;
+}
+
+
+
+/// Prepares a statement and keeps it in the cache with the given id.
+SqlStmt* Sql_PrepareStmt(Sql* self, int id, const char* query, ...)
+{
+	SqlStmt* stmt;
+	StringBuf buf;
+	va_list args;
+
+	StringBuf_Init(&buf);
+	va_start(args, query);
+	StringBuf_Vprintf(&buf, query, args);
+	va_end(args);
+	stmt = Sql_PrepareStmtStr(self, id, StringBuf_Value(&buf));
+	StringBuf_Destroy(&buf);
+
+	return stmt;
+}
+
+
+
+/// Prepares a statement and keeps it in the cache with the given id.
+SqlStmt* Sql_PrepareStmtStr(Sql* self, int id, const char* query)
+{
+	SqlStmt* stmt;
+	uint32 hits = 0, prepares = 0, execs = 0;
+	uint64 usec = 0;
+
+	if( self == NULL || id < 0 )
+		return NULL;
+
+	if( (size_t)id >= self->max_stmts )
+	{
+		size_t i = self->max_stmts;
+		self->max_stmts = id + 1;
+		RECREATE(self->stmts, SqlStmt*, self->max_stmts);
+		for( ; i < self->max_stmts; ++i )
+			self->stmts[i] = NULL;
+	}
+
+	if( (stmt = self->stmts[id]) != NULL )
+	{// replaced, keep the statistics
+		hits = stmt->stat_hits;
+		prepares = stmt->stat_prepares;
+		execs = stmt->stat_execs;
+		usec = stmt->stat_usec;
+		SqlStmt_Free(stmt);
+		self->stmts[id] = NULL;
+	}
+
+	stmt = SqlStmt_Malloc(self);
+	if( stmt == NULL )
+		return NULL;
+	stmt->stat_hits = hits;
+	stmt->stat_prepares = prepares + 1;
+	stmt->stat_execs = execs;
+	stmt->stat_usec = usec;
+	if( SQL_ERROR == SqlStmt_PrepareStr(stmt, query) )
+	{
+		SqlStmt_ShowDebug(stmt);
+		SqlStmt_Free(stmt);
+		return NULL;
+	}
+	self->stmts[id] = stmt;
+
+	return stmt;
+}
+
+
+
+/// Prints the statement cache statistics.
+void Sql_ShowStmtStats(Sql* self)
+{
+	size_t i;
+	uint32 hits = 0, prepares = 0, execs = 0;
+	uint64 usec = 0;
+
+	if( self == NULL )
+		return;
+
+	for( i = 0; i < self->max_stmts; ++i )
+	{
+		SqlStmt* stmt = self->stmts[i];
+
+		if( stmt == NULL )
+			continue;
+		ShowInfo("Statement %d: %u hits, %u prepares, %u executions, %u us average.\n", (int)i, stmt->stat_hits, stmt->stat_prepares, stmt->stat_execs,
+			(uint32)(stmt->stat_execs ? stmt->stat_usec / stmt->stat_execs : 0));
+		hits += stmt->stat_hits;
+		prepares += stmt->stat_prepares;
+		execs += stmt->stat_execs;
+		usec += stmt->stat_usec;
+	}
+	if( prepares )
+		ShowInfo("Statement cache: %u hits, %u prepares (%u%% hit rate), %u executions, %u us average.\n", hits, prepares,
+			(uint32)((uint64)hits * 100 / (hits + prepares)), execs, (uint32)(execs ? usec / execs : 0));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous Execution
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+/// Frees a job and the copies of its parameters.
+///
+/// @private
+static void SqlAsync_P_FreeJob(struct s_sqlasync_job* job)
+{
+	size_t i;
+
+	if( job->result )
+		mysql_free_result(job->result);
+	for( i = 0; i < job->num_params; ++i )
+		if( job->params[i].buffer )
+			aFree(job->params[i].buffer);
+	if( job->params )
+		aFree(job->params);
+	StringBuf_Destroy(&job->query);
+	aFree(job);
+}
+
+
+
+/// Frees the parameters bound for the next SqlAsync_Execute.
+///
+/// @private
+static void SqlAsync_P_FreeParams(SqlAsync* self)
+{
+	size_t i;
+
+	for( i = 0; i < self->num_params; ++i )
+		if( self->params[i].buffer )
+			aFree(self->params[i].buffer);
+	if( self->params )
+		aFree(self->params);
+	self->params = NULL;
+	self->num_params = 0;
+}
+
+
+
+/// Records the error of a job.
+///
+/// @private
+static void SqlAsync_P_SetError(struct s_sqlasync_job* job, const char* error)
+{
+	job->status = SQL_ERROR;
+	safestrncpy(job->error, error, sizeof(job->error));
+}
+
+
+
+/// Executes a job on the connection of a worker.
+/// Runs in the worker thread, so it must not touch anything but the job and the connection.
+///
+/// @private
+static void SqlAsync_P_Run(struct s_sqlasync_conn* conn, struct s_sqlasync_job* job)
+{
+	MYSQL* handle = &conn->sql->handle;
+	MYSQL_STMT* stmt;
+	const char* query;
+
+	job->status = SQL_SUCCESS;
+	if( job->stmt_id == SQL_ERROR )
+	{// plain query
+		if( mysql_real_query(handle, StringBuf_Value(&job->query), (unsigned long)StringBuf_Length(&job->query)) )
+		{
+			SqlAsync_P_SetError(job, mysql_error(handle));
+			return;
+		}
+		job->result = mysql_store_result(handle);
+		if( mysql_errno(handle) != 0 )
+			SqlAsync_P_SetError(job, mysql_error(handle));
+		return;
+	}
+
+	// prepared statement, reused while it works
+	stmt = conn->stmts[job->stmt_id];
+	if( stmt == NULL )
+	{
+		query = conn->owner->stmts[job->stmt_id];
+		if( (stmt = mysql_stmt_init(handle)) == NULL )
+		{
+			SqlAsync_P_SetError(job, mysql_error(handle));
+			return;
+		}
+		if( mysql_stmt_prepare(stmt, query, (unsigned long)strlen(query)) )
+		{
+			SqlAsync_P_SetError(job, mysql_stmt_error(stmt));
+			mysql_stmt_close(stmt);
+			return;
+		}
+		conn->stmts[job->stmt_id] = stmt;
+	}
+
+	if( job->num_params < (size_t)mysql_stmt_param_count(stmt) )
+		SqlAsync_P_SetError(job, "not enough parameters bound");
+	else if( (job->num_params > 0 && mysql_stmt_bind_param(stmt, job->params)) || mysql_stmt_execute(stmt) )
+		SqlAsync_P_SetError(job, mysql_stmt_error(stmt));
+	else
+		mysql_stmt_free_result(stmt);
+
+	if( job->status == SQL_ERROR )
+	{// prepare it again next time (the connection might have been reset)
+		mysql_stmt_close(stmt);
+		conn->stmts[job->stmt_id] = NULL;
+	}
+}
+
+
+
+/// Removes the next job that can run from the queue.
+/// Must be called with the lock held.
+///
+/// @private
+static struct s_sqlasync_job* SqlAsync_P_Dequeue(SqlAsync* self)
+{
+	struct s_sqlasync_job* job;
+	struct s_sqlasync_job* prev = NULL;
+
+	for( job = self->queue_head; job != NULL; prev = job, job = job->next )
+	{
+		if( (job->flags&SQLASYNC_SERIAL) && self->serial_running )
+			continue;// must wait for the previous serial job
+
+		if( prev )
+			prev->next = job->next;
+		else
+			self->queue_head = job->next;
+		if( self->queue_tail == job )
+			self->queue_tail = prev;
+		job->next = NULL;
+		--self->queue_len;
+		if( job->flags&SQLASYNC_SERIAL )
+			self->serial_running = true;
+		return job;
+	}
+	return NULL;
+}
+
+
+
+/// Worker thread.
+///
+/// @private
+static void* SqlAsync_P_Worker(void* param)
+{
+	struct s_sqlasync_conn* conn = (struct s_sqlasync_conn*)param;
+	SqlAsync* self = conn->owner;
+	struct s_sqlasync_job* job;
+
+	mysql_thread_init();
+	ramutex_lock(self->lock);
+	for(;;)
+	{
+		job = SqlAsync_P_Dequeue(self);
+		if( job == NULL )
+		{
+			if( self->terminate )
+				break;
+			if( conn->ping )
+			{// idle, keep the connection alive
+				conn->ping = false;
+				ramutex_unlock(self->lock);
+				mysql_ping(&conn->sql->handle);
+				ramutex_lock(self->lock);
+				continue;
+			}
+			racond_wait(self->job_cond, self->lock, -1);
+			continue;
+		}
+		++self->running;
+		racond_broadcast(self->done_cond);// a slot was freed
+		ramutex_unlock(self->lock);
+
+		SqlAsync_P_Run(conn, job);
+
+		ramutex_lock(self->lock);
+		--self->running;
+		if( job->flags&SQLASYNC_SERIAL )
+		{// let the next serial job run
+			self->serial_running = false;
+			racond_broadcast(self->job_cond);
+		}
+		if( self->done_tail )
+			self->done_tail->next = job;
+		else
+			self->done_head = job;
+		self->done_tail = job;
+		racond_broadcast(self->done_cond);
+	}
+	ramutex_unlock(self->lock);
+	mysql_thread_end();
+
+	return NULL;
+}
+
+
+
+/// Runs the callbacks of the finished jobs on the main thread.
+///
+/// @private
+static void SqlAsync_P_Dispatch(SqlAsync* self)
+{
+	struct s_sqlasync_job* job;
+	struct s_sqlasync_job* next;
+
+	ramutex_lock(self->lock);
+	job = self->done_head;
+	self->done_head = NULL;
+	self->done_tail = NULL;
+	ramutex_unlock(self->lock);
+
+	for( ; job != NULL; job = next )
+	{
+		next = job->next;
+
+		// expose the result through the regular Sql interface
+		Sql_FreeResult(self->result);
+		self->result->result = job->result;
+		job->result = NULL;
+		StringBuf_Clear(&self->result->buf);
+		if( job->stmt_id == SQL_ERROR )
+			StringBuf_AppendStr(&self->result->buf, StringBuf_Value(&job->query));
+		else
+			StringBuf_AppendStr(&self->result->buf, self->stmts[job->stmt_id]);
+
+		if( job->status == SQL_ERROR )
+		{
+			++self->stat_errors;
+			ShowSQL("DB error - "CL_WHITE"%s"CL_RESET"\n", job->error);
+			Sql_ShowDebug(self->result);
+		}
+		if( job->func )
+			job->func(self->result, job->status, job->data);
+
+		Sql_FreeResult(self->result);
+		SqlAsync_P_FreeJob(job);
+	}
+}
+
+
+
+/// Timer that runs the callbacks of the finished jobs.
+///
+/// @private
+static int SqlAsync_P_DispatchTimer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	SqlAsync_P_Dispatch((SqlAsync*)data);
+	return 0;
+}
+
+
+
+/// Timer that asks the idle workers to ping their connections.
+///
+/// @private
+static int SqlAsync_P_KeepaliveTimer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	SqlAsync* self = (SqlAsync*)data;
+	size_t i;
+
+	ramutex_lock(self->lock);
+	for( i = 0; i < self->num_conns; ++i )
+		self->conns[i].ping = true;
+	racond_broadcast(self->job_cond);
+	ramutex_unlock(self->lock);
+	return 0;
+}
+
+
+
+/// Adds a job to the queue, without ever waiting for the workers.
+/// When the queue is full, serial jobs are still queued (their order matters
+/// and they must not be lost) and other jobs are freed and refused.
+///
+/// @private
+static int SqlAsync_P_Enqueue(SqlAsync* self, struct s_sqlasync_job* job)
+{
+	ramutex_lock(self->lock);
+	if( self->queue_len >= self->max_queue )
+	{
+		if( !(job->flags&SQLASYNC_SERIAL) )
+		{
+			if( self->stat_refused++ % 1000 == 0 )
+				ShowWarning("SqlAsync: queue of '%s' is full (%u jobs), refusing jobs.\n", self->name, (unsigned int)self->queue_len);
+			ramutex_unlock(self->lock);
+			SqlAsync_P_FreeJob(job);
+			return SQL_ERROR;
+		}
+		++self->stat_overflows;
+	}
+	if( self->queue_tail )
+		self->queue_tail->next = job;
+	else
+		self->queue_head = job;
+	self->queue_tail = job;
+	++self->queue_len;
+	++self->stat_jobs;
+	if( self->stat_peak < self->queue_len )
+		self->stat_peak = self->queue_len;
+	racond_signal(self->job_cond);
+	ramutex_unlock(self->lock);
+
+	return SQL_SUCCESS;
+}
+
+
+
+/// Allocates a job.
+///
+/// @private
+static struct s_sqlasync_job* SqlAsync_P_CreateJob(int stmt_id, int flags, SqlAsyncFunc func, intptr_t data)
+{
+	struct s_sqlasync_job* job;
+
+	CREATE(job, struct s_sqlasync_job, 1);
+	StringBuf_Init(&job->query);
+	job->stmt_id = stmt_id;
+	job->flags = flags;
+	job->func = func;
+	job->data = data;
+	return job;
+}
+
+
+
+/// Allocates and initializes a new asynchronous executor.
+SqlAsync* SqlAsync_Malloc(const char* name, size_t workers, size_t max_queue)
+{
+	SqlAsync* self;
+
+	CREATE(self, SqlAsync, 1);
+	safestrncpy(self->name, name, sizeof(self->name));
+	self->lock = ramutex_create();
+	self->job_cond = racond_create();
+	self->done_cond = racond_create();
+	self->max_queue = max(max_queue, 1);
+	self->num_conns = max(workers, 1);
+	CREATE(self->conns, struct s_sqlasync_conn, self->num_conns);
+	self->result = Sql_Malloc();
+	self->dispatcher = INVALID_TIMER;
+	self->keepalive = INVALID_TIMER;
+
+	return self;
+}
+
+
+
+/// Establishes the connections and starts the worker threads.
+int SqlAsync_Connect(SqlAsync* self, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* encoding)
+{
+	uint32 timeout = 28800; // 8 hours
+	uint32 ping_interval;
+	size_t i;
+
+	if( self == NULL )
+		return SQL_ERROR;
+
+	for( i = 0; i < self->num_conns; ++i )
+	{
+		struct s_sqlasync_conn* conn = &self->conns[i];
+
+		conn->owner = self;
+		conn->sql = Sql_Malloc();
+		if( SQL_ERROR == Sql_Connect(conn->sql, user, passwd, host, port, db) )
+			return SQL_ERROR;
+		// the connection belongs to the worker, the executor does the keepalive
+		delete_timer(conn->sql->keepalive, Sql_P_KeepaliveTimer);
+		conn->sql->keepalive = INVALID_TIMER;
+		if( encoding && *encoding && SQL_ERROR == Sql_SetEncoding(conn->sql, encoding) )
+			Sql_ShowDebug(conn->sql);
+	}
+	Sql_GetTimeout(self->conns[0].sql, &timeout);
+	if( timeout < 60 )
+		timeout = 60;
+
+	for( i = 0; i < self->num_conns; ++i )
+	{
+		if( (self->conns[i].thread = rathread_create(SqlAsync_P_Worker, &self->conns[i])) == NULL )
+		{
+			ShowSQL("SqlAsync_Connect: cannot spawn worker thread for '%s'.\n", self->name);
+			return SQL_ERROR;
+		}
+	}
+
+	ping_interval = timeout - 30; // 30-second reserve
+	self->keepalive = add_timer_interval(gettick() + ping_interval*1000, SqlAsync_P_KeepaliveTimer, 0, (intptr_t)self, ping_interval*1000);
+	self->dispatcher = add_timer_interval(gettick() + SQLASYNC_DISPATCH_INTERVAL, SqlAsync_P_DispatchTimer, 0, (intptr_t)self, SQLASYNC_DISPATCH_INTERVAL);
+
+	return SQL_SUCCESS;
+}
+
+
+
+/// Queues a query.
+int SqlAsync_Query(SqlAsync* self, int flags, SqlAsyncFunc func, intptr_t data, const char* query, ...)
+{
+	int res;
+	va_list args;
+
+	va_start(args, query);
+	res = SqlAsync_QueryV(self, flags, func, data, query, args);
+	va_end(args);
+
+	return res;
+}
+
+
+
+/// Queues a query.
+int SqlAsync_QueryV(SqlAsync* self, int flags, SqlAsyncFunc func, intptr_t data, const char* query, va_list args)
+{
+	struct s_sqlasync_job* job;
+
+	if( self == NULL )
+		return SQL_ERROR;
+
+	job = SqlAsync_P_CreateJob(SQL_ERROR, flags, func, data);
+	StringBuf_Vprintf(&job->query, query, args);
+	return SqlAsync_P_Enqueue(self, job);
+}
+
+
+
+/// Queues a query.
+int SqlAsync_QueryStr(SqlAsync* self, int flags, SqlAsyncFunc func, intptr_t data, const char* query)
+{
+	struct s_sqlasync_job* job;
+
+	if( self == NULL )
+		return SQL_ERROR;
+
+	job = SqlAsync_P_CreateJob(SQL_ERROR, flags, func, data);
+	StringBuf_AppendStr(&job->query, query);
+	return SqlAsync_P_Enqueue(self, job);
+}
+
+
+
+/// Registers a statement that is prepared once per connection and reused.
+int SqlAsync_Prepare(SqlAsync* self, const char* query, ...)
+{
+	StringBuf buf;
+	va_list args;
+
+	if( self == NULL )
+		return SQL_ERROR;
+	if( self->num_stmts >= SQLASYNC_MAX_STMT )
+	{
+		ShowDebug("SqlAsync_Prepare: too many statements in '%s' (max %d)\n", self->name, SQLASYNC_MAX_STMT);
+		return SQL_ERROR;
+	}
+
+	StringBuf_Init(&buf);
+	va_start(args, query);
+	StringBuf_Vprintf(&buf, query, args);
+	va_end(args);
+	self->stmts[self->num_stmts] = aStrdup(StringBuf_Value(&buf));
+	StringBuf_Destroy(&buf);
+
+	return self->num_stmts++;
+}
+
+
+
+/// Binds a parameter for the next SqlAsync_Execute call.
+int SqlAsync_BindParam(SqlAsync* self, size_t idx, enum SqlDataType buffer_type, void* buffer, size_t buffer_len)
+{
+	MYSQL_BIND bind;
+	void* copy = NULL;
+
+	if( self == NULL )
+		return SQL_ERROR;
+
+	if( SQL_ERROR == Sql_P_BindSqlDataType(&bind, buffer_type, buffer, buffer_len, NULL, NULL) )
+		return SQL_ERROR;
+	if( bind.buffer_length > 0 )
+	{// keep a copy, the job runs later
+		copy = aMalloc(bind.buffer_length);
+		memcpy(copy, buffer, bind.buffer_length);
+	}
+	bind.buffer = copy;
+
+	if( idx >= self->num_params )
+	{
+		size_t i;
+
+		RECREATE(self->params, MYSQL_BIND, idx+1);
+		for( i = self->num_params; i <= idx; ++i )
+		{
+			memset(&self->params[i], 0, sizeof(MYSQL_BIND));
+			self->params[i].buffer_type = MYSQL_TYPE_NULL;
+		}
+		self->num_params = idx+1;
+	}
+	else if( self->params[idx].buffer )
+		aFree(self->params[idx].buffer);
+	memcpy(&self->params[idx], &bind, sizeof(MYSQL_BIND));
+
+	return SQL_SUCCESS;
+}
+
+
+
+/// Queues the execution of a registered statement with the parameters bound so far.
+int SqlAsync_Execute(SqlAsync* self, int stmt_id, int flags, SqlAsyncFunc func, intptr_t data)
+{
+	struct s_sqlasync_job* job;
+
+	if( self == NULL )
+		return SQL_ERROR;
+	if( stmt_id < 0 || stmt_id >= self->num_stmts )
+	{
+		ShowDebug("SqlAsync_Execute: invalid statement id %d in '%s'\n", stmt_id, self->name);
+		SqlAsync_P_FreeParams(self);
+		return SQL_ERROR;
+	}
+
+	job = SqlAsync_P_CreateJob(stmt_id, flags, func, data);
+	// the job takes the bindings
+	job->params = self->params;
+	job->num_params = self->num_params;
+	self->params = NULL;
+	self->num_params = 0;
+
+	return SqlAsync_P_Enqueue(self, job);
+}
+
+
+
+/// Waits until all queued jobs are executed and runs their callbacks.
+void SqlAsync_Flush(SqlAsync* self)
+{
+	if( self == NULL )
+		return;
+
+	ramutex_lock(self->lock);
+	while( self->queue_len > 0 || self->running > 0 )
+		racond_wait(self->done_cond, self->lock, -1);
+	ramutex_unlock(self->lock);
+
+	SqlAsync_P_Dispatch(self);
+}
+
+
+
+/// Prints usage statistics.
+void SqlAsync_ShowStats(SqlAsync* self)
+{
+	if( self == NULL )
+		return;
+
+	ShowInfo("SQL async '"CL_WHITE"%s"CL_RESET"': %u jobs, %u errors, %u refused and %u serial over the limit, peak queue %u/%u (%u workers).\n",
+		self->name, self->stat_jobs, self->stat_errors, self->stat_refused, self->stat_overflows, (unsigned int)self->stat_peak, (unsigned int)self->max_queue, (unsigned int)self->num_conns);
+}
+
+
+
+/// Flushes, stops the workers and frees a SqlAsync handle returned by SqlAsync_Malloc.
+void SqlAsync_Free(SqlAsync* self)
+{
+	size_t i;
+	int j;
+
+	if( self == NULL )
+		return;
+
+	if( self->dispatcher != INVALID_TIMER )
+	{// only when the workers were started
+		SqlAsync_Flush(self);
+		delete_timer(self->dispatcher, SqlAsync_P_DispatchTimer);
+	}
+	if( self->keepalive != INVALID_TIMER )
+		delete_timer(self->keepalive, SqlAsync_P_KeepaliveTimer);
+
+	ramutex_lock(self->lock);
+	self->terminate = true;
+	racond_broadcast(self->job_cond);
+	ramutex_unlock(self->lock);
+
+	for( i = 0; i < self->num_conns; ++i )
+	{
+		struct s_sqlasync_conn* conn = &self->conns[i];
+
+		if( conn->thread )
+			rathread_wait(conn->thread, NULL);
+		for( j = 0; j < SQLASYNC_MAX_STMT; ++j )
+			if( conn->stmts[j] )
+				mysql_stmt_close(conn->stmts[j]);
+		if( conn->sql )
+		{
+			mysql_close(&conn->sql->handle);
+			Sql_Free(conn->sql);
+		}
+	}
+
+	for( j = 0; j < self->num_stmts; ++j )
+		aFree(self->stmts[j]);
+	SqlAsync_P_FreeParams(self);
+	Sql_Free(self->result);
+	racond_destroy(self->job_cond);
+	racond_destroy(self->done_cond);
+	ramutex_destroy(self->lock);
+	aFree(self->conns);
+	aFree(self);
+}
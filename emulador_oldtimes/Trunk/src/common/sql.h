@@ -347,4 +347,171 @@ void SqlStmt_Free(SqlStmt* self);
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Statement Cache
+///////////////////////////////////////////////////////////////////////////////
+// Each Sql handle keeps the statements prepared through it, indexed by an id
+// chosen by the caller, so frequently used queries are parsed by the server
+// only once per connection:
+//
+//   SqlStmt* stmt = Sql_GetStmt(sql_handle, MY_STMT);
+//   if( stmt == NULL )
+//       stmt = Sql_PrepareStmt(sql_handle, MY_STMT, "SELECT ... WHERE `id`=?", table);
+//
+// Cached statements belong to the handle and are freed with it, so they must
+// not be freed with SqlStmt_Free. A statement that fails to execute is prepared
+// again on its next use (the connection might have been reset).
+
+
+
+/// Returns the cached statement with the given id.
+///
+/// @return Statement or NULL if it must be prepared with Sql_PrepareStmt
+SqlStmt* Sql_GetStmt(Sql* self, int id);
+
+
+
+/// Prepares a statement and keeps it in the cache with the given id,
+/// replacing any previous statement with that id.
+/// The query is constructed as if it was sprintf.
+///
+/// @return Statement or NULL
+SqlStmt* Sql_PrepareStmt(Sql* self, int id, const char* query, ...);
+
+
+
+/// Prepares a statement and keeps it in the cache with the given id,
+/// replacing any previous statement with that id.
+/// The query is used directly.
+///
+/// @return Statement or NULL
+SqlStmt* Sql_PrepareStmtStr(Sql* self, int id, const char* query);
+
+
+
+/// Prints the statement cache statistics (hits, prepares, executions and average latency).
+void Sql_ShowStmtStats(Sql* self);
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous Execution
+///////////////////////////////////////////////////////////////////////////////
+// Queries and prepared statements are queued and executed by a pool of worker
+// threads, each owning its own connection, so the caller never waits for the
+// database. Completion callbacks are invoked later on the main thread (from a
+// timer), in the same loop as every other timer/socket callback.
+//
+// The queue is bounded: when it is full, the caller blocks until a worker frees
+// a slot (backpressure) instead of growing without limit.
+// Jobs flagged with SQLASYNC_SERIAL run one at a time, in the order they were
+// queued, which is required when later writes depend on earlier ones.
+// Other jobs may run in any order, concurrently.
+
+
+
+struct SqlAsync;// asynchronous executor (private access)
+
+typedef struct SqlAsync SqlAsync;
+
+/// Flags for asynchronous jobs.
+enum e_sqlasync_flag
+{
+	SQLASYNC_NONE   = 0x0,
+	SQLASYNC_SERIAL = 0x1,// run in queue order, never concurrently with another serial job
+};
+
+/// Completion callback of an asynchronous job (runs on the main thread).
+/// The result of a query can be read from 'result' with Sql_NumRows, Sql_NextRow
+/// and Sql_GetData, and is freed after the callback returns.
+/// Sql_ShowDebug(result) shows the query or statement of the job.
+///
+/// @param result Sql handle holding the result of the job
+/// @param status SQL_SUCCESS or SQL_ERROR
+/// @param data User data given when the job was queued
+typedef void (*SqlAsyncFunc)(Sql* result, int status, intptr_t data);
+
+
+
+/// Allocates and initializes a new asynchronous executor.
+/// It uses 'workers' connections and allows up to 'max_queue' pending jobs.
+/// Jobs are never waited for: when the queue is full, new jobs are refused
+/// (SQL_ERROR), except serial ones, which are queued over the limit.
+///
+/// @return SqlAsync handle
+struct SqlAsync* SqlAsync_Malloc(const char* name, size_t workers, size_t max_queue);
+
+
+
+/// Establishes the connections and starts the worker threads.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_Connect(SqlAsync* self, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* encoding);
+
+
+
+/// Queues a query.
+/// The query is constructed as if it was sprintf.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_Query(SqlAsync* self, int flags, SqlAsyncFunc func, intptr_t data, const char* query, ...);
+
+
+
+/// Queues a query.
+/// The query is constructed as if it was svprintf.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_QueryV(SqlAsync* self, int flags, SqlAsyncFunc func, intptr_t data, const char* query, va_list args);
+
+
+
+/// Queues a query.
+/// The query is used directly.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_QueryStr(SqlAsync* self, int flags, SqlAsyncFunc func, intptr_t data, const char* query);
+
+
+
+/// Registers a statement that is prepared once per connection and reused.
+/// The query is constructed as if it was sprintf.
+/// Statements are meant for writes (INSERT/UPDATE/DELETE), no rows are returned.
+///
+/// @return Statement id or SQL_ERROR
+int SqlAsync_Prepare(SqlAsync* self, const char* query, ...);
+
+
+
+/// Binds a parameter for the next SqlAsync_Execute call.
+/// The buffer data is copied, so it doesn't need to outlive this call.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_BindParam(SqlAsync* self, size_t idx, SqlDataType buffer_type, void* buffer, size_t buffer_len);
+
+
+
+/// Queues the execution of a registered statement with the parameters bound so far.
+/// All parameter bindings are removed.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int SqlAsync_Execute(SqlAsync* self, int stmt_id, int flags, SqlAsyncFunc func, intptr_t data);
+
+
+
+/// Waits until all queued jobs are executed and runs their callbacks.
+void SqlAsync_Flush(SqlAsync* self);
+
+
+
+/// Prints usage statistics (jobs, errors, refused jobs).
+void SqlAsync_ShowStats(SqlAsync* self);
+
+
+
+/// Flushes, stops the workers and frees a SqlAsync handle returned by SqlAsync_Malloc.
+void SqlAsync_Free(SqlAsync* self);
+
+
+
 #endif /* _COMMON_SQL_H_ */
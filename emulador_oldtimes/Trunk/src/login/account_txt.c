@@ -15,8 +15,8 @@
 
 /// global defines
 #define ACCOUNT_TXT_DB_VERSION 20110114
-#define AUTHS_BEFORE_SAVE 10 // flush every 10 saves
-#define AUTH_SAVING_INTERVAL 60000 // flush every 10 minutes
+#define JOURNAL_ENTRIES_BEFORE_SAVE 1000 // compact the journal after this many changes
+#define AUTH_SAVING_INTERVAL 60000 // compact the journal every minute
 
 /// internal structure
 typedef struct AccountDB_TXT
@@ -25,10 +25,12 @@ typedef struct AccountDB_TXT
 
 	DBMap* accounts;       // in-memory accounts storage
 	int next_account_id;   // auto_increment
-	int auths_before_save; // prevents writing to disk too often
+	int journal_entries;   // changes appended to the journal since the last full save
 	int save_timer;        // save timer id
+	FILE* journal;         // append-only log of changes not yet in account_db
 
 	char account_db[1024]; // account data storage file
+	char journal_db[1040]; // account_db + ".journal"
 	bool case_sensitive;   // how to look up usernames
 
 } AccountDB_TXT;
@@ -59,6 +61,8 @@ static bool mmo_auth_fromstr(struct mmo_account* acc, char* str, unsigned int ve
 static bool mmo_auth_tostr(const struct mmo_account* acc, char* str);
 static void mmo_auth_sync(AccountDB_TXT* self);
 static int mmo_auth_sync_timer(int tid, unsigned int tick, int id, intptr_t data);
+static int mmo_auth_journal_replay(AccountDB_TXT* db);
+static void mmo_auth_journal(AccountDB_TXT* db, char op, const struct mmo_account* acc, int account_id);
 
 static bool account_db_txt_is_mac_banned(AccountDB* db, const char *mac) { return false; }
 
@@ -83,8 +87,9 @@ AccountDB* account_db_txt(void)
 	// initialize to default values
 	db->accounts = NULL;
 	db->next_account_id = START_ACCOUNT_NUM;
-	db->auths_before_save = AUTHS_BEFORE_SAVE;
+	db->journal_entries = 0;
 	db->save_timer = INVALID_TIMER;
+	db->journal = NULL;
 	safestrncpy(db->account_db, "save/account.txt", sizeof(db->account_db));
 	db->case_sensitive = false;
 
@@ -184,6 +189,15 @@ static bool account_db_txt_init(AccountDB* self)
 	// close data file
 	fclose(fp);
 
+	// recover the changes made after the last full save
+	safesnprintf(db->journal_db, sizeof(db->journal_db), "%s.journal", db->account_db);
+	if( mmo_auth_journal_replay(db) > 0 )
+		mmo_auth_sync(db);
+
+	db->journal = fopen(db->journal_db, "a");
+	if( db->journal == NULL )
+		ShowWarning("account_db_txt_init: cannot open journal file [%s], every change will rewrite the accounts file.\n", db->journal_db);
+
 	// initialize data saving timer
 	add_timer_func_list(mmo_auth_sync_timer, "mmo_auth_sync_timer");
 	db->save_timer = add_timer_interval(gettick() + AUTH_SAVING_INTERVAL, mmo_auth_sync_timer, 0, (intptr_t)db, AUTH_SAVING_INTERVAL);
@@ -202,6 +216,8 @@ static void account_db_txt_destroy(AccountDB* self)
 
 	// write data
 	mmo_auth_sync(db);
+	if( db->journal != NULL )
+		fclose(db->journal);
 
 	// delete accounts database
 	accounts->destroy(accounts, NULL);
@@ -304,7 +320,7 @@ static bool account_db_txt_create(AccountDB* self, struct mmo_account* acc)
 		db->next_account_id = account_id + 1;
 
 	// flush data
-	mmo_auth_sync(db);
+	mmo_auth_journal(db, 'S', tmp, account_id);
 
 	// write output
 	acc->account_id = account_id;
@@ -327,7 +343,7 @@ static bool account_db_txt_remove(AccountDB* self, const int account_id)
 	}
 
 	// flush data
-	mmo_auth_sync(db);
+	mmo_auth_journal(db, 'D', NULL, account_id);
 
 	return true;
 }
@@ -349,9 +365,8 @@ static bool account_db_txt_save(AccountDB* self, const struct mmo_account* acc)
 	// overwrite with new data
 	memcpy(tmp, acc, sizeof(struct mmo_account));
 
-	// modify save counter and save if needed
-	if( --db->auths_before_save == 0 )
-		mmo_auth_sync(db);
+	// flush data
+	mmo_auth_journal(db, 'S', tmp, account_id);
 
 	return true;
 }
@@ -633,16 +648,110 @@ static void mmo_auth_sync(AccountDB_TXT* db)
 
 	lock_fclose(fp, db->account_db, &lock);
 
-	// reset save counter
-	db->auths_before_save = AUTHS_BEFORE_SAVE;
+	// everything in the journal is in the accounts file now
+	if( db->journal != NULL )
+	{
+		fclose(db->journal);
+		db->journal = fopen(db->journal_db, "w");
+	}
+	db->journal_entries = 0;
 }
 
 static int mmo_auth_sync_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
 	AccountDB_TXT* db = (AccountDB_TXT*)data;
 
-	if( db->auths_before_save < AUTHS_BEFORE_SAVE )
+	if( db->journal_entries > 0 )
 		mmo_auth_sync(db); // db was modified, flush it
 
 	return 0;
 }
+
+/// Appends a change to the journal ('S' = account saved/created, 'D' = account removed).
+/// The journal is folded into the accounts file by mmo_auth_sync.
+static void mmo_auth_journal(AccountDB_TXT* db, char op, const struct mmo_account* acc, int account_id)
+{
+	if( db->journal == NULL )
+	{// no journal, write everything
+		mmo_auth_sync(db);
+		return;
+	}
+
+	if( op == 'S' )
+	{
+		char buf[2048];
+		mmo_auth_tostr(acc, buf);
+		fprintf(db->journal, "S\t%s\n", buf);
+	}
+	else
+		fprintf(db->journal, "D\t%d\n", account_id);
+	fflush(db->journal);
+
+	if( ++db->journal_entries >= JOURNAL_ENTRIES_BEFORE_SAVE )
+		mmo_auth_sync(db);
+}
+
+/// Applies the journal left by the previous run on top of the loaded accounts.
+/// Entries are full records, so replaying a journal already folded into the
+/// accounts file (crash right after the save) is harmless.
+/// Returns the number of changes applied.
+static int mmo_auth_journal_replay(AccountDB_TXT* db)
+{
+	FILE* fp;
+	char line[2048];
+	int count = 0;
+
+	fp = fopen(db->journal_db, "r");
+	if( fp == NULL )
+		return 0;
+
+	while( fgets(line, sizeof(line), fp) != NULL )
+	{
+		size_t len = strlen(line);
+		int account_id, n;
+
+		if( len == 0 || line[len-1] != '\n' )
+		{// entry cut short by a crash
+			ShowWarning("mmo_auth_journal_replay: ignoring incomplete entry in [%s].\n", db->journal_db);
+			break;
+		}
+
+		n = 0;
+		if( line[0] == 'D' && sscanf(line, "D\t%d%n", &account_id, &n) == 1 && (line[n] == '\n' || line[n] == '\r') )
+		{
+			idb_remove(db->accounts, account_id);
+			++count;
+		}
+		else if( line[0] == 'S' && line[1] == '\t' )
+		{
+			struct mmo_account acc;
+			struct mmo_account* tmp;
+
+			if( !mmo_auth_fromstr(&acc, line + 2, ACCOUNT_TXT_DB_VERSION) )
+			{
+				ShowError("mmo_auth_journal_replay: skipping invalid data: %s", line);
+				continue;
+			}
+
+			tmp = (struct mmo_account*)idb_get(db->accounts, acc.account_id);
+			if( tmp == NULL )
+			{
+				CREATE(tmp, struct mmo_account, 1);
+				idb_put(db->accounts, acc.account_id, tmp);
+			}
+			memcpy(tmp, &acc, sizeof(struct mmo_account));
+
+			if( acc.account_id >= db->next_account_id )
+				db->next_account_id = acc.account_id + 1;
+			++count;
+		}
+		else
+			ShowError("mmo_auth_journal_replay: skipping invalid data: %s", line);
+	}
+	fclose(fp);
+
+	if( count > 0 )
+		ShowStatus("Recovered '"CL_WHITE"%d"CL_RESET"' account changes from the journal '"CL_WHITE"%s"CL_RESET"'.\n", count, db->journal_db);
+
+	return count;
+}
@@ -3,6 +3,7 @@
 
 #include "../common/cbasetypes.h"
 #include "../common/db.h"
+#include "../common/ers.h"
 #include "../common/malloc.h"
 #include "../common/showmsg.h"
 #include "../common/sql.h"
@@ -14,6 +15,7 @@
 #include "loginlog.h"
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // global sql settings
 static char   global_db_hostname[32] = "127.0.0.1";
@@ -34,9 +36,143 @@ static char   ipban_table[32] = "ipbanlist";
 // globals
 static Sql* sql_handle = NULL;
 static int cleanup_timer_id = INVALID_TIMER;
+static int refresh_timer_id = INVALID_TIMER;
 static bool ipban_inited = false;
 
+/// Node of the binary prefix trie that caches the active bans.
+/// The bit of depth N selects the child; a node with 'expire' in the
+/// future bans every address with its N-bit prefix.
+struct ipban_node {
+	struct ipban_node* child[2];
+	time_t expire;
+};
+static ERS ipban_node_ers = NULL;
+static struct ipban_node* ipban_root = NULL;
+static time_t ipban_loaded_btime = 0; // newest `btime` loaded into the cache
+
+/// Password failures of an address, counted in two fixed windows that
+/// approximate a sliding window of dynamic_pass_failure_ban_interval.
+struct ipban_failures {
+	time_t window; // start of the current window
+	unsigned int prev, cur;
+};
+static DBMap* ipban_failures_db = NULL; // uint32 ip -> struct ipban_failures*
+
 int ipban_cleanup(int tid, unsigned int tick, int id, intptr_t data);
+int ipban_refresh(int tid, unsigned int tick, int id, intptr_t data);
+
+
+/// Frees a trie branch.
+static void ipban_cache_free(struct ipban_node* node)
+{
+	if( node == NULL )
+		return;
+	ipban_cache_free(node->child[0]);
+	ipban_cache_free(node->child[1]);
+	ers_free(ipban_node_ers, node);
+}
+
+/// Bans the addresses with the 'bits'-bit prefix of 'ip' until 'expire'.
+static void ipban_cache_add(uint32 ip, int bits, time_t expire)
+{
+	struct ipban_node** node = &ipban_root;
+	int i;
+
+	for( i = 0; ; ++i )
+	{
+		if( *node == NULL )
+		{
+			*node = ers_alloc(ipban_node_ers, struct ipban_node);
+			memset(*node, 0, sizeof(struct ipban_node));
+		}
+		if( i == bits )
+			break;
+		node = &(*node)->child[(ip>>(31-i))&1];
+	}
+	if( (*node)->expire < expire )
+		(*node)->expire = expire;
+}
+
+/// Parses a `list` pattern ("a.*.*.*", "a.b.*.*", "a.b.c.*" or "a.b.c.d").
+static bool ipban_parse_mask(const char* list, uint32* ip, int* bits)
+{
+	unsigned int a[4];
+	int n;
+	char c;
+
+	n = sscanf(list, "%3u.%3u.%3u.%3u%c", &a[0], &a[1], &a[2], &a[3], &c);
+	if( n < 1 || n > 4 )
+		return false;
+	*bits = 8*n;
+	*ip = 0;
+	for( n = 0; n < *bits/8; ++n )
+	{
+		if( a[n] > 255 )
+			return false;
+		*ip |= a[n]<<(24-8*n);
+	}
+	return true;
+}
+
+/// Loads into the cache the active bans added since 'since' (0 = all).
+static void ipban_cache_load(time_t since)
+{
+	time_t now = time(NULL);
+	int count = 0;
+
+	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `list`, TIMESTAMPDIFF(SECOND, NOW(), `rtime`), UNIX_TIMESTAMP(`btime`) FROM `%s` WHERE `rtime` > NOW() AND `btime` >= FROM_UNIXTIME(%lu)",
+		ipban_table, (unsigned long)since) )
+	{
+		Sql_ShowDebug(sql_handle);
+		return;
+	}
+
+	while( SQL_SUCCESS == Sql_NextRow(sql_handle) )
+	{
+		char* data;
+		uint32 ip;
+		int bits;
+		time_t btime;
+
+		Sql_GetData(sql_handle, 0, &data, NULL);
+		if( !ipban_parse_mask(data, &ip, &bits) )
+			continue;
+		Sql_GetData(sql_handle, 1, &data, NULL);
+		ipban_cache_add(ip, bits, now + strtol(data, NULL, 10));
+		Sql_GetData(sql_handle, 2, &data, NULL);
+		btime = (time_t)strtoul(data, NULL, 10);
+		if( ipban_loaded_btime < btime )
+			ipban_loaded_btime = btime;
+		++count;
+	}
+	Sql_FreeResult(sql_handle);
+
+	if( since == 0 || count > 0 )
+		ShowInfo("Ipban: %d bans de IP carregados no cache.\n", count);
+}
+
+/// Rebuilds the cache from the table.
+static void ipban_cache_reload(void)
+{
+	ipban_cache_free(ipban_root);
+	ipban_root = NULL;
+	ipban_loaded_btime = 0;
+	ipban_cache_load(0);
+}
+
+/// Removes the failure counters that no longer affect the ban decision.
+static void ipban_failures_cleanup(void)
+{
+	DBIterator* iter = db_iterator(ipban_failures_db);
+	struct ipban_failures* f;
+	time_t now = time(NULL);
+	time_t window = login_config.dynamic_pass_failure_ban_interval*60;
+
+	for( f = db_data2ptr(iter->first(iter, NULL)); dbi_exists(iter); f = db_data2ptr(iter->next(iter, NULL)) )
+		if( now - f->window >= 2*window )
+			iter->remove(iter, NULL);
+	dbi_destroy(iter);
+}
 
 
 // initialize
@@ -87,6 +223,16 @@ void ipban_init(void)
 	ShowStatus("Conectado ao banco de dados ipban '"CL_WHITE"%s"CL_RESET"'.\n", database);
 	Sql_PrintExtendedInfo(sql_handle);
 
+	ipban_node_ers = ers_new(sizeof(struct ipban_node), "ipban_sql.c::ipban_node_ers", ERS_OPT_NONE);
+	ipban_failures_db = uidb_alloc(DB_OPT_RELEASE_DATA);
+	ipban_cache_load(0);
+
+	if( login_config.ipban_refresh_interval > 0 )
+	{ // set up periodic loading of new bans into the cache
+		add_timer_func_list(ipban_refresh, "ipban_refresh");
+		refresh_timer_id = add_timer_interval(gettick()+login_config.ipban_refresh_interval*1000, ipban_refresh, 0, 0, login_config.ipban_refresh_interval*1000);
+	}
+
 	if( login_config.ipban_cleanup_interval > 0 )
 	{ // set up periodic cleanup of connection history and active bans
 		add_timer_func_list(ipban_cleanup, "ipban_cleanup");
@@ -104,7 +250,15 @@ void ipban_final(void)
 	if( login_config.ipban_cleanup_interval > 0 )
 		// release data
 		delete_timer(cleanup_timer_id, ipban_cleanup);
+	if( login_config.ipban_refresh_interval > 0 )
+		delete_timer(refresh_timer_id, ipban_refresh);
 	
+	ipban_cache_free(ipban_root);
+	ipban_root = NULL;
+	ers_destroy(ipban_node_ers);
+	db_destroy(ipban_failures_db);
+	ipban_failures_db = NULL;
+
 	ipban_cleanup(0,0,0,0); // always clean up on login-server stop
 
 	// close connections
@@ -204,40 +358,60 @@ bool ipban_config_read(const char* key, const char* value)
 // check ip against active bans list
 bool ipban_check(uint32 ip)
 {
-	uint8* p = (uint8*)&ip;
-	char* data = NULL;
-	int matches;
+	struct ipban_node* node;
+	time_t now;
+	int i;
 
 	if( !login_config.ipban )
 		return false;// ipban disabled
 
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT count(*) FROM `%s` WHERE `rtime` > NOW() AND (`list` = '%u.*.*.*' OR `list` = '%u.%u.*.*' OR `list` = '%u.%u.%u.*' OR `list` = '%u.%u.%u.%u')",
-		ipban_table, p[3], p[3], p[2], p[3], p[2], p[1], p[3], p[2], p[1], p[0]) )
+	now = time(NULL);
+	for( node = ipban_root, i = 0; node != NULL; node = node->child[(ip>>(31-i))&1], ++i )
 	{
-		Sql_ShowDebug(sql_handle);
-		// close connection because we can't verify their connectivity.
-		return true;
+		if( node->expire > now )
+			return true;
+		if( i == 32 )
+			break;
 	}
-
-	if( SQL_ERROR == Sql_NextRow(sql_handle) )
-		return true;// Shouldn't happen, but just in case...
-
-	Sql_GetData(sql_handle, 0, &data, NULL);
-	matches = atoi(data);
-	Sql_FreeResult(sql_handle);
-
-	return( matches > 0 );
+	return false;
 }
 
 // log failed attempt
 void ipban_log(uint32 ip)
 {
+	struct ipban_failures* f;
+	time_t now = time(NULL);
+	time_t window = login_config.dynamic_pass_failure_ban_interval*60;
 	unsigned long failures;
 
 	if( !login_config.ipban )
 		return;// ipban disabled
 
-	failures = loginlog_failedattempts(ip, login_config.dynamic_pass_failure_ban_interval);// how many times failed account? in one ip.
+	if( window <= 0 )
+		window = 1;
+	if( (f = (struct ipban_failures*)uidb_get(ipban_failures_db, ip)) == NULL )
+	{
+		CREATE(f, struct ipban_failures, 1);
+		f->window = now;
+		uidb_put(ipban_failures_db, ip, f);
+	}
+
+	// slide the windows
+	if( now - f->window >= 2*window )
+	{
+		f->prev = f->cur = 0;
+		f->window = now;
+	}
+	else if( now - f->window >= window )
+	{
+		f->prev = f->cur;
+		f->cur = 0;
+		f->window += window;
+	}
+	f->cur++;
+
+	// how many times failed account? in one ip.
+	failures = f->cur + (unsigned long)((uint64)f->prev*(window - (now - f->window))/window);
 
 	// if over the limit, add a temporary ban entry
 	if( failures >= login_config.dynamic_pass_failure_ban_limit )
@@ -246,6 +420,8 @@ void ipban_log(uint32 ip)
 		if( SQL_ERROR == Sql_Query(sql_handle, "INSERT INTO `%s`(`list`,`btime`,`rtime`,`reason`) VALUES ('%u.%u.%u.*', NOW() , NOW() +  INTERVAL %d MINUTE ,'Password error ban')",
 			ipban_table, p[3], p[2], p[1], login_config.dynamic_pass_failure_ban_duration) )
 			Sql_ShowDebug(sql_handle);
+		ipban_cache_add(ip&0xFFFFFF00, 24, now + login_config.dynamic_pass_failure_ban_duration*60);
+		uidb_remove(ipban_failures_db, ip);
 	}
 }
 
@@ -255,8 +431,24 @@ int ipban_cleanup(int tid, unsigned int tick, int id, intptr_t data)
 	if( !login_config.ipban )
 		return 0;// ipban disabled
 
-	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `ipbanlist` WHERE `rtime` <= NOW()") )
+	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `rtime` <= NOW()", ipban_table) )
 		Sql_ShowDebug(sql_handle);
 
+	if( ipban_failures_db != NULL ) // not after ipban_final
+	{
+		ipban_cache_reload();
+		ipban_failures_cleanup();
+	}
+
+	return 0;
+}
+
+// load the bans added since the last refresh
+int ipban_refresh(int tid, unsigned int tick, int id, intptr_t data)
+{
+	if( !login_config.ipban )
+		return 0;// ipban disabled
+
+	ipban_cache_load(ipban_loaded_btime);
 	return 0;
 }
@@ -5,10 +5,12 @@
 #include "../common/db.h"
 #include "../common/malloc.h"
 #include "../common/md5calc.h"
+#include "../common/mutex.h"
 #include "../common/random.h"
 #include "../common/showmsg.h"
 #include "../common/socket.h"
 #include "../common/strlib.h"
+#include "../common/thread.h"
 #include "../common/timer.h"
 #include "account.h"
 #include "ipban.h"
@@ -18,6 +20,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WIN32
+#include <netdb.h>
+#endif
 
 struct Login_Config login_config;
 
@@ -65,6 +70,7 @@ struct s_subnet {
 int subnet_count = 0;
 
 int mmo_auth_new(const char* userid, const char* pass, const char sex, const char* last_ip);
+static void login_admission_stats(void);
 
 //-----------------------------------------------------
 // Auth database
@@ -379,6 +385,15 @@ int parse_console(const char* command)
 		ShowInfo("  'estado|status'\n");
 		ShowInfo("Para criar nova conta:\n");
 		ShowInfo("  'criar'\n");
+		ShowInfo("Para ver os contadores da admisso de logins:\n");
+		ShowInfo("  'admissao'\n");
+	}
+	else if( strcmpi("admissao", command) == 0 )
+	{
+		if( login_config.admission )
+			login_admission_stats();
+		else
+			ShowInfo("A admisso de logins est desabilitada.\n");
 	}
 	else
 	{// commands with parameters
@@ -976,40 +991,463 @@ int mmo_auth_new(const char* userid, const char* pass, const char sex, const cha
 }
 
 //-----------------------------------------------------
-// Check/authentication of a connection
+// DNS Blacklist
+// Lookups run in worker threads so a slow blacklist server doesn't stall
+// the login loop; results are cached per address.
 //-----------------------------------------------------
-int mmo_auth(struct login_session_data* sd, bool isServer)
+enum dnsbl_state {
+	DNSBL_PENDING, // lookup in progress
+	DNSBL_CLEAN,
+	DNSBL_LISTED,
+};
+
+#define DNSBL_THREADS 4
+#define DNSBL_QUEUE_SIZE 256
+#define DNSBL_POLL_INTERVAL 20 // ms between checks for finished lookups
+#define DNSBL_CLEANUP_INTERVAL 60000
+
+struct dnsbl_entry {
+	enum dnsbl_state state;
+	time_t expire;
+};
+static DBMap* dnsbl_db = NULL; // uint32 ip -> struct dnsbl_entry*
+
+/// Shared with the worker threads, protected by 'lock'.
+/// The worker threads only use the fixed arrays (the memory manager is not thread-safe).
+static struct {
+	ramutex lock;
+	racond cond;
+	uint32 jobs[DNSBL_QUEUE_SIZE];
+	int job_head, job_count;
+	struct {
+		uint32 ip;
+		bool listed;
+	} results[DNSBL_QUEUE_SIZE];
+	int result_count;
+	int outstanding; // queued + running + finished lookups not collected yet
+	bool stop;
+	rAthread threads[DNSBL_THREADS];
+	char servers[1024]; // copy of login_config.dnsbl_servs
+} dnsbl;
+static int dnsbl_poll_timer = INVALID_TIMER;
+
+/// Resolves the reverse name of 'ip' in every blacklist (worker thread).
+static bool dnsbl_lookup(uint32 ip)
 {
-	struct mmo_account acc;
-	int len;
+	const char* serv = dnsbl.servers;
 
-	char ip[16];
-	ip2str(session[sd->fd]->client_addr, ip);
+	while( *serv )
+	{
+		size_t len;
 
-	// DNS Blacklist check
-	if( login_config.use_dnsbl )
+		serv += strspn(serv, " \t,");
+		len = strcspn(serv, ",");
+		while( len > 0 && ISSPACE(serv[len-1]) )
+			--len;
+		if( len > 0 )
+		{
+			char name[512];
+			struct addrinfo hints;
+			struct addrinfo* res = NULL;
+
+			snprintf(name, sizeof(name), "%u.%u.%u.%u.%.*s", ip&0xFF, (ip>>8)&0xFF, (ip>>16)&0xFF, ip>>24, (int)len, serv);
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_INET;
+			if( getaddrinfo(name, NULL, &hints, &res) == 0 )
+			{
+				freeaddrinfo(res);
+				return true;
+			}
+		}
+		serv += strcspn(serv, ",");
+	}
+	return false;
+}
+
+static void* dnsbl_worker(void* param)
+{
+	ramutex_lock(dnsbl.lock);
+	for(;;)
+	{
+		uint32 ip;
+		bool listed;
+
+		while( !dnsbl.stop && dnsbl.job_count == 0 )
+			racond_wait(dnsbl.cond, dnsbl.lock, -1);
+		if( dnsbl.stop )
+			break;
+
+		ip = dnsbl.jobs[dnsbl.job_head];
+		dnsbl.job_head = (dnsbl.job_head + 1)%DNSBL_QUEUE_SIZE;
+		dnsbl.job_count--;
+		ramutex_unlock(dnsbl.lock);
+
+		listed = dnsbl_lookup(ip);
+
+		ramutex_lock(dnsbl.lock);
+		dnsbl.results[dnsbl.result_count].ip = ip;
+		dnsbl.results[dnsbl.result_count].listed = listed;
+		dnsbl.result_count++;
+	}
+	ramutex_unlock(dnsbl.lock);
+	return NULL;
+}
+
+/// Collects the finished lookups into the cache.
+static int dnsbl_poll(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int i;
+	int outstanding;
+	time_t now = time(NULL);
+
+	ramutex_lock(dnsbl.lock);
+	for( i = 0; i < dnsbl.result_count; ++i )
+	{
+		struct dnsbl_entry* entry = (struct dnsbl_entry*)uidb_get(dnsbl_db, dnsbl.results[i].ip);
+		if( entry == NULL )
+			continue;
+		entry->state = dnsbl.results[i].listed ? DNSBL_LISTED : DNSBL_CLEAN;
+		entry->expire = now + (dnsbl.results[i].listed ? login_config.dnsbl_listed_ttl : login_config.dnsbl_clean_ttl);
+	}
+	dnsbl.outstanding -= dnsbl.result_count;
+	dnsbl.result_count = 0;
+	outstanding = dnsbl.outstanding;
+	ramutex_unlock(dnsbl.lock);
+
+	if( outstanding > 0 )
+		dnsbl_poll_timer = add_timer(gettick() + DNSBL_POLL_INTERVAL, dnsbl_poll, 0, 0);
+	else
+		dnsbl_poll_timer = INVALID_TIMER;
+	return 0;
+}
+
+/// Removes the expired cache entries.
+static int dnsbl_cleanup(int tid, unsigned int tick, int id, intptr_t data)
+{
+	DBIterator* iter = db_iterator(dnsbl_db);
+	struct dnsbl_entry* entry;
+	time_t now = time(NULL);
+
+	for( entry = db_data2ptr(iter->first(iter, NULL)); dbi_exists(iter); entry = db_data2ptr(iter->next(iter, NULL)) )
+		if( entry->state != DNSBL_PENDING && entry->expire <= now )
+			iter->remove(iter, NULL);
+	dbi_destroy(iter);
+	return 0;
+}
+
+/// Returns the blacklist state of an address, starting a lookup if it isn't cached.
+static enum dnsbl_state dnsbl_check(uint32 ip)
+{
+	struct dnsbl_entry* entry = (struct dnsbl_entry*)uidb_get(dnsbl_db, ip);
+	bool queued = false;
+
+	if( entry != NULL && (entry->state == DNSBL_PENDING || entry->expire > time(NULL)) )
+		return entry->state;
+
+	ramutex_lock(dnsbl.lock);
+	if( dnsbl.outstanding < DNSBL_QUEUE_SIZE )
+	{
+		dnsbl.jobs[(dnsbl.job_head + dnsbl.job_count)%DNSBL_QUEUE_SIZE] = ip;
+		dnsbl.job_count++;
+		dnsbl.outstanding++;
+		racond_signal(dnsbl.cond);
+		queued = true;
+	}
+	ramutex_unlock(dnsbl.lock);
+
+	if( !queued )
+		return DNSBL_PENDING; // queue full, try again on the next parse
+
+	if( entry == NULL )
 	{
-		char r_ip[16];
-		char ip_dnsbl[256];
-		char* dnsbl_serv;
-		bool matched = false;
-		uint8* sin_addr = (uint8*)&session[sd->fd]->client_addr;
+		CREATE(entry, struct dnsbl_entry, 1);
+		uidb_put(dnsbl_db, ip, entry);
+	}
+	entry->state = DNSBL_PENDING;
+	if( dnsbl_poll_timer == INVALID_TIMER )
+		dnsbl_poll_timer = add_timer(gettick() + DNSBL_POLL_INTERVAL, dnsbl_poll, 0, 0);
+	return DNSBL_PENDING;
+}
 
-		sprintf(r_ip, "%u.%u.%u.%u", sin_addr[0], sin_addr[1], sin_addr[2], sin_addr[3]);
+static void dnsbl_init(void)
+{
+	int i;
 
-		for( dnsbl_serv = strtok(login_config.dnsbl_servs,","); !matched && dnsbl_serv != NULL; dnsbl_serv = strtok(NULL,",") )
+	dnsbl_db = uidb_alloc(DB_OPT_RELEASE_DATA);
+	safestrncpy(dnsbl.servers, login_config.dnsbl_servs, sizeof(dnsbl.servers));
+	dnsbl.lock = ramutex_create();
+	dnsbl.cond = racond_create();
+	for( i = 0; i < DNSBL_THREADS; ++i )
+	{
+		if( (dnsbl.threads[i] = rathread_create(dnsbl_worker, NULL)) == NULL )
 		{
-			sprintf(ip_dnsbl, "%s.%s", r_ip, dnsbl_serv);
-			if( host2ip(ip_dnsbl) )
-				matched = true;
+			ShowFatalError("dnsbl_init: falha ao criar a thread de consulta %d.\n", i);
+			exit(EXIT_FAILURE);
 		}
+	}
+	add_timer_func_list(dnsbl_poll, "dnsbl_poll");
+	add_timer_func_list(dnsbl_cleanup, "dnsbl_cleanup");
+	add_timer_interval(gettick() + DNSBL_CLEANUP_INTERVAL, dnsbl_cleanup, 0, 0, DNSBL_CLEANUP_INTERVAL);
+}
 
-		if( matched )
+static void dnsbl_final(void)
+{
+	int i;
+
+	ramutex_lock(dnsbl.lock);
+	dnsbl.stop = true;
+	racond_broadcast(dnsbl.cond);
+	ramutex_unlock(dnsbl.lock);
+	for( i = 0; i < DNSBL_THREADS; ++i )
+	{
+		rathread_wait(dnsbl.threads[i], NULL);
+		dnsbl.threads[i] = NULL;
+	}
+	racond_destroy(dnsbl.cond);
+	ramutex_destroy(dnsbl.lock);
+	db_destroy(dnsbl_db);
+	dnsbl_db = NULL;
+}
+
+//-----------------------------------------------------
+// Login admission
+// Limits the authentications of each IP and /24 subnet with token buckets
+// and spreads the accepted ones over time through a bounded queue, so a
+// connection storm is refused or delayed instead of stalling the server.
+//-----------------------------------------------------
+enum login_admission_state {
+	LOGIN_ADMISSION_NONE,     // next login packet needs admission
+	LOGIN_ADMISSION_QUEUED,   // waiting in the queue
+	LOGIN_ADMISSION_ADMITTED, // next login packet may be processed
+};
+
+#define LOGIN_ADMISSION_INTERVAL 100 // ms between queue runs
+#define LOGIN_ADMISSION_CLEANUP_INTERVAL 60000
+
+struct login_bucket {
+	int tokens;        // in 1/1000 of a token
+	unsigned int tick; // last refill
+};
+
+struct login_admission_entry {
+	int fd;
+	struct login_session_data* sd; // to detect a reused fd
+};
+
+static DBMap* login_ip_buckets = NULL;     // uint32 ip -> struct login_bucket*
+static DBMap* login_subnet_buckets = NULL; // uint32 ip&0xFFFFFF00 -> struct login_bucket*
+
+static struct {
+	struct login_admission_entry* queue;
+	int head, count;
+	int budget; // authentications still allowed in this run
+	// counters
+	unsigned int accepted, queued, rejected_rate, rejected_queue;
+} login_admission;
+
+/// Refills a bucket up to 'burst' tokens at 'rate' tokens per minute.
+static struct login_bucket* login_bucket_refill(DBMap* db, uint32 key, unsigned int rate, unsigned int burst, unsigned int tick)
+{
+	struct login_bucket* b = (struct login_bucket*)uidb_get(db, key);
+
+	if( b == NULL )
+	{
+		CREATE(b, struct login_bucket, 1);
+		b->tokens = burst*1000;
+		uidb_put(db, key, b);
+	}
+	else
+	{
+		int64 tokens = b->tokens + (int64)DIFF_TICK(tick, b->tick)*rate/60;
+		b->tokens = (int)min(tokens, (int64)burst*1000);
+	}
+	b->tick = tick;
+	return b;
+}
+
+/// Takes one token from the buckets of the ip and of its subnet.
+/// Returns false if either is empty.
+static bool login_bucket_take(uint32 ip)
+{
+	unsigned int tick = gettick();
+	struct login_bucket* ip_bucket = NULL;
+	struct login_bucket* subnet_bucket = NULL;
+
+	if( login_config.admission_ip_rate )
+	{
+		ip_bucket = login_bucket_refill(login_ip_buckets, ip, login_config.admission_ip_rate, login_config.admission_ip_burst, tick);
+		if( ip_bucket->tokens < 1000 )
+			return false;
+	}
+	if( login_config.admission_subnet_rate )
+	{
+		subnet_bucket = login_bucket_refill(login_subnet_buckets, ip&0xFFFFFF00, login_config.admission_subnet_rate, login_config.admission_subnet_burst, tick);
+		if( subnet_bucket->tokens < 1000 )
+			return false;
+	}
+
+	if( ip_bucket )
+		ip_bucket->tokens -= 1000;
+	if( subnet_bucket )
+		subnet_bucket->tokens -= 1000;
+	return true;
+}
+
+/// Refuses the login of a connection.
+static void login_admission_reject(int fd)
+{
+	WFIFOHEAD(fd,23);
+	WFIFOW(fd,0) = 0x6a;
+	WFIFOB(fd,2) = 3; // 3 = Rejected from Server
+	WFIFOSET(fd,23);
+	set_eof(fd);
+}
+
+/// Decides if the login packet of a connection can be processed now.
+/// When it returns false the packet must be left in the buffer; it is parsed
+/// again on the next loop and gets through once the queue admits it.
+static bool login_admit(int fd, struct login_session_data* sd)
+{
+	if( !login_config.admission )
+		return true;
+
+	switch( sd->admission )
+	{
+	case LOGIN_ADMISSION_ADMITTED:
+		sd->admission = LOGIN_ADMISSION_NONE; // every attempt needs admission
+		return true;
+	case LOGIN_ADMISSION_QUEUED:
+		return false;
+	}
+
+	if( !login_bucket_take(session[fd]->client_addr) )
+	{
+		login_admission.rejected_rate++;
+		login_admission_reject(fd);
+		return false;
+	}
+
+	if( login_admission.count == 0 && login_admission.budget > 0 )
+	{// nothing waiting, go ahead
+		login_admission.budget--;
+		login_admission.accepted++;
+		return true;
+	}
+
+	if( login_admission.count >= login_config.admission_queue_size )
+	{
+		login_admission.rejected_queue++;
+		login_admission_reject(fd);
+		return false;
+	}
+
+	login_admission.queue[(login_admission.head + login_admission.count)%login_config.admission_queue_size].fd = fd;
+	login_admission.queue[(login_admission.head + login_admission.count)%login_config.admission_queue_size].sd = sd;
+	login_admission.count++;
+	login_admission.queued++;
+	sd->admission = LOGIN_ADMISSION_QUEUED;
+	return false;
+}
+
+/// Admits up to admission_auths_per_tick queued connections.
+static int login_admission_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	login_admission.budget = login_config.admission_auths_per_tick;
+
+	while( login_admission.count > 0 && login_admission.budget > 0 )
+	{
+		struct login_admission_entry* entry = &login_admission.queue[login_admission.head];
+
+		login_admission.head = (login_admission.head + 1)%login_config.admission_queue_size;
+		login_admission.count--;
+
+		if( !session_isActive(entry->fd) || session[entry->fd]->session_data != entry->sd || entry->sd->admission != LOGIN_ADMISSION_QUEUED )
+			continue; // connection closed while waiting
+
+		entry->sd->admission = LOGIN_ADMISSION_ADMITTED;
+		login_admission.budget--;
+		login_admission.accepted++;
+	}
+	return 0;
+}
+
+/// Removes the buckets that are full again.
+static int login_bucket_cleanup_sub(DBMap* db, unsigned int rate, unsigned int burst, unsigned int tick)
+{
+	DBIterator* iter = db_iterator(db);
+	struct login_bucket* b;
+	int count = 0;
+
+	for( b = db_data2ptr(iter->first(iter, NULL)); dbi_exists(iter); b = db_data2ptr(iter->next(iter, NULL)) )
+	{
+		if( b->tokens + (int64)DIFF_TICK(tick, b->tick)*rate/60 >= (int64)burst*1000 )
 		{
-			ShowInfo("DNSBL: ("CL_WHITE"%s"CL_RESET") em "CL_RED"lista negra"CL_RESET". Usurio desconectado.\n", r_ip);
-			return 3;
+			iter->remove(iter, NULL);
+			++count;
 		}
 	}
+	dbi_destroy(iter);
+	return count;
+}
+
+static int login_bucket_cleanup(int tid, unsigned int tick, int id, intptr_t data)
+{
+	login_bucket_cleanup_sub(login_ip_buckets, login_config.admission_ip_rate, login_config.admission_ip_burst, tick);
+	login_bucket_cleanup_sub(login_subnet_buckets, login_config.admission_subnet_rate, login_config.admission_subnet_burst, tick);
+	return 0;
+}
+
+static void login_admission_stats(void)
+{
+	ShowInfo("Admisso de logins: "CL_WHITE"%u"CL_RESET" aceitos, "CL_WHITE"%u"CL_RESET" enfileirados, "CL_WHITE"%u"CL_RESET" recusados por limite de taxa, "CL_WHITE"%u"CL_RESET" recusados por fila cheia.\n",
+		login_admission.accepted, login_admission.queued, login_admission.rejected_rate, login_admission.rejected_queue);
+	ShowInfo("Fila: "CL_WHITE"%d"CL_RESET"/"CL_WHITE"%d"CL_RESET", "CL_WHITE"%u"CL_RESET" IPs e "CL_WHITE"%u"CL_RESET" sub-redes sendo limitados.\n",
+		login_admission.count, login_config.admission_queue_size, db_size(login_ip_buckets), db_size(login_subnet_buckets));
+}
+
+static void login_admission_init(void)
+{
+	if( login_config.admission_queue_size < 1 )
+		login_config.admission_queue_size = 1;
+	login_ip_buckets = uidb_alloc(DB_OPT_RELEASE_DATA);
+	login_subnet_buckets = uidb_alloc(DB_OPT_RELEASE_DATA);
+	CREATE(login_admission.queue, struct login_admission_entry, login_config.admission_queue_size);
+	login_admission.budget = login_config.admission_auths_per_tick;
+
+	add_timer_func_list(login_admission_timer, "login_admission_timer");
+	add_timer_func_list(login_bucket_cleanup, "login_bucket_cleanup");
+	add_timer_interval(gettick() + LOGIN_ADMISSION_INTERVAL, login_admission_timer, 0, 0, LOGIN_ADMISSION_INTERVAL);
+	add_timer_interval(gettick() + LOGIN_ADMISSION_CLEANUP_INTERVAL, login_bucket_cleanup, 0, 0, LOGIN_ADMISSION_CLEANUP_INTERVAL);
+}
+
+static void login_admission_final(void)
+{
+	login_admission_stats();
+	db_destroy(login_ip_buckets);
+	db_destroy(login_subnet_buckets);
+	login_ip_buckets = NULL;
+	login_subnet_buckets = NULL;
+	aFree(login_admission.queue);
+	login_admission.queue = NULL;
+}
+
+//-----------------------------------------------------
+// Check/authentication of a connection
+//-----------------------------------------------------
+int mmo_auth(struct login_session_data* sd, bool isServer)
+{
+	struct mmo_account acc;
+	int len;
+
+	char ip[16];
+	ip2str(session[sd->fd]->client_addr, ip);
+
+	// DNS Blacklist check (the lookup was finished before the login packet was parsed)
+	if( login_config.use_dnsbl && dnsbl_check(session[sd->fd]->client_addr) == DNSBL_LISTED )
+	{
+		ShowInfo("DNSBL: ("CL_WHITE"%s"CL_RESET") em "CL_RED"lista negra"CL_RESET". Usurio desconectado.\n", ip);
+		return 3;
+	}
 
 	//Client Version check
 	if( login_config.check_client_version && sd->version != login_config.client_version_to_connect )
@@ -1401,6 +1839,12 @@ int parse_login(int fd)
 			||  (command == 0x027c && packet_len < 60)
 			||  (command == 0x0825 && (packet_len < 4 || packet_len < RFIFOW(fd, 2))) )
 				return 0;
+
+			if( login_config.use_dnsbl && dnsbl_check(session[fd]->client_addr) == DNSBL_PENDING )
+				return 0; // parsed again once the DNSBL lookup is done
+
+			if( !login_admit(fd, sd) )
+				return 0; // queued or refused
 		}
 		{
 			uint32 version;
@@ -1498,6 +1942,8 @@ int parse_login(int fd)
 		case 0x2710:	// Connection request of a char-server
 			if (RFIFOREST(fd) < 86)
 				return 0;
+			if( login_config.use_dnsbl && dnsbl_check(session[fd]->client_addr) == DNSBL_PENDING )
+				return 0; // parsed again once the DNSBL lookup is done
 		{
 			char server_name[20];
 			char message[256];
@@ -1576,6 +2022,7 @@ void login_set_defaults()
 	login_config.login_ip = INADDR_ANY;
 	login_config.login_port = 6900;
 	login_config.ipban_cleanup_interval = 60;
+	login_config.ipban_refresh_interval = 10;
 	login_config.ip_sync_interval = 0;
 	login_config.log_login = true;
 	safestrncpy(login_config.date_format, "%Y-%m-%d %H:%M:%S", sizeof(login_config.date_format));
@@ -1595,6 +2042,15 @@ void login_set_defaults()
 	login_config.dynamic_pass_failure_ban_duration = 5;
 	login_config.use_dnsbl = false;
 	safestrncpy(login_config.dnsbl_servs, "", sizeof(login_config.dnsbl_servs));
+	login_config.dnsbl_listed_ttl = 3600;
+	login_config.dnsbl_clean_ttl = 600;
+	login_config.admission = true;
+	login_config.admission_ip_rate = 20;
+	login_config.admission_ip_burst = 5;
+	login_config.admission_subnet_rate = 120;
+	login_config.admission_subnet_burst = 30;
+	login_config.admission_queue_size = 512;
+	login_config.admission_auths_per_tick = 10;
 	safestrncpy(login_config.account_engine, "auto", sizeof(login_config.account_engine));
 	
 	login_config.client_hash_check = 0;
@@ -1670,8 +2126,28 @@ int login_config_read(const char* cfgName)
 			login_config.use_dnsbl = (bool)config_switch(w2);
 		else if(!strcmpi(w1, "dnsbl_servers"))
 			safestrncpy(login_config.dnsbl_servs, w2, sizeof(login_config.dnsbl_servs));
+		else if(!strcmpi(w1, "dnsbl_listed_ttl"))
+			login_config.dnsbl_listed_ttl = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "dnsbl_clean_ttl"))
+			login_config.dnsbl_clean_ttl = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "admission.enable"))
+			login_config.admission = (bool)config_switch(w2);
+		else if(!strcmpi(w1, "admission.ip_rate"))
+			login_config.admission_ip_rate = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "admission.ip_burst"))
+			login_config.admission_ip_burst = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "admission.subnet_rate"))
+			login_config.admission_subnet_rate = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "admission.subnet_burst"))
+			login_config.admission_subnet_burst = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "admission.queue_size"))
+			login_config.admission_queue_size = atoi(w2);
+		else if(!strcmpi(w1, "admission.auths_per_tick"))
+			login_config.admission_auths_per_tick = atoi(w2);
 		else if(!strcmpi(w1, "ipban_cleanup_interval"))
 			login_config.ipban_cleanup_interval = (unsigned int)atoi(w2);
+		else if(!strcmpi(w1, "ipban_refresh_interval"))
+			login_config.ipban_refresh_interval = (unsigned int)atoi(w2);
 		else if(!strcmpi(w1, "ip_sync_interval"))
 			login_config.ip_sync_interval = (unsigned int)1000*60*atoi(w2); //w2 comes in minutes.
 		else if(!strcmpi(w1, "client_hash_check"))
@@ -1770,6 +2246,12 @@ void do_final(void)
 
 	ipban_final();
 
+	if( login_config.use_dnsbl )
+		dnsbl_final();
+
+	if( login_config.admission )
+		login_admission_final();
+
 	for( i = 0; account_engines[i].constructor; ++i )
 	{// destroy all account engines
 		AccountDB* db = account_engines[i].db;
@@ -1854,6 +2336,14 @@ int do_init(int argc, char** argv)
 	// initialize static and dynamic ipban system
 	ipban_init();
 
+	// initialize the DNS blacklist resolver
+	if( login_config.use_dnsbl )
+		dnsbl_init();
+
+	// initialize the login admission limits
+	if( login_config.admission )
+		login_admission_init();
+
 	// Online user database init
 	online_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	add_timer_func_list(waiting_disconnect_timer, "waiting_disconnect_timer");
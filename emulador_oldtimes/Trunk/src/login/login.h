@@ -40,6 +40,8 @@ struct login_session_data {
 	uint8 client_hash[16];
 	int has_client_hash;
 
+	uint8 admission; // state of the login admission (enum login_admission_state)
+
 	int fd;
 };
 
@@ -65,6 +67,7 @@ struct Login_Config {
 	uint32 login_ip;                                // the address to bind to
 	uint16 login_port;                              // the port to bind to
 	unsigned int ipban_cleanup_interval;            // interval (in seconds) to clean up expired IP bans
+	unsigned int ipban_refresh_interval;            // interval (in seconds) to load new IP bans into the cache
 	unsigned int ip_sync_interval;                  // interval (in minutes) to execute a DNS/IP update (for dynamic IPs)
 	bool log_login;                                 // whether to log login server actions or not
 	char date_format[32];                           // date format used in messages
@@ -79,11 +82,20 @@ struct Login_Config {
 
 	bool ipban;                                     // perform IP blocking (via contents of `ipbanlist`) ?
 	bool dynamic_pass_failure_ban;                  // automatic IP blocking due to failed login attemps ?
-	unsigned int dynamic_pass_failure_ban_interval; // how far to scan the loginlog for password failures
+	unsigned int dynamic_pass_failure_ban_interval; // window (in minutes) of the password failure counter
 	unsigned int dynamic_pass_failure_ban_limit;    // number of failures needed to trigger the ipban
 	unsigned int dynamic_pass_failure_ban_duration; // duration of the ipban
 	bool use_dnsbl;                                 // dns blacklist blocking ?
 	char dnsbl_servs[1024];                         // comma-separated list of dnsbl servers
+	unsigned int dnsbl_listed_ttl;                  // time (in seconds) a blacklisted address stays cached
+	unsigned int dnsbl_clean_ttl;                   // time (in seconds) an address not blacklisted stays cached
+	bool admission;                                 // rate-limit the authentications ?
+	unsigned int admission_ip_rate;                 // authentications per minute allowed for each IP (0: unlimited)
+	unsigned int admission_ip_burst;                // authentications an IP may do at once
+	unsigned int admission_subnet_rate;             // authentications per minute allowed for each /24 subnet (0: unlimited)
+	unsigned int admission_subnet_burst;            // authentications a /24 subnet may do at once
+	int admission_queue_size;                       // maximum number of authentications waiting to be processed
+	int admission_auths_per_tick;                   // authentications processed every 100ms
 
 	char account_engine[256];                       // name of the engine to use (defaults to auto, for the first available engine)
 	
@@ -1243,6 +1243,134 @@ void battle_consume_ammo(TBL_PC*sd, int skill, int lv)
 	sd->state.arrow_atk = 0;
 }
 
+/*==========================================
+ * Card fix tables
+ *------------------------------------------*/
+#define CARDFIX_STEP(fix,rate) ( (fix)*(100+(rate))/100 )
+
+/// Sums the race, element and size card bonuses of a cardfix set.
+/// The left hand set has no element bonus (see battle_calc_weapon_attack).
+static void battle_cardfix_rates(struct map_session_data* sd, int set, int race, int ele, int size, int* race_rate, int* ele_rate, int* size_rate)
+{
+	struct weapon_data* w = ( set == CARDFIX_LEFT ) ? &sd->left_weapon : &sd->right_weapon;
+
+	*race_rate = w->addrace[race];
+	*ele_rate = ( ele < ELE_MAX && set != CARDFIX_LEFT ) ? w->addele[ele] : 0;
+	*size_rate = w->addsize[size];
+	if( set == CARDFIX_ARROW )
+	{
+		*race_rate += sd->arrow_addrace[race];
+		if( ele < ELE_MAX )
+			*ele_rate += sd->arrow_addele[ele];
+		*size_rate += sd->arrow_addsize[size];
+	}
+	else if( set == CARDFIX_BOTH )
+	{
+		*race_rate += sd->left_weapon.addrace[race];
+		if( ele < ELE_MAX )
+			*ele_rate += sd->left_weapon.addele[ele];
+		*size_rate += sd->left_weapon.addsize[size];
+	}
+}
+
+/// Element bonus of the conditional (bAddEle with flags) entries of a weapon that match the attack flag.
+static int battle_addele2_rate(struct weapon_data* w, int ele, int flag)
+{
+	int i, rate = 0;
+
+	for( i = 0; i < ARRAYLENGTH(w->addele2) && w->addele2[i].rate != 0; i++ )
+	{
+		if( w->addele2[i].ele != ele )
+			continue;
+		if( !(w->addele2[i].flag&flag&BF_WEAPONMASK &&
+			  w->addele2[i].flag&flag&BF_RANGEMASK &&
+			  w->addele2[i].flag&flag&BF_SKILLMASK) )
+			continue;
+		rate += w->addele2[i].rate;
+	}
+	return rate;
+}
+
+/// Bitmask of the elements a weapon has conditional bonuses against.
+static int battle_addele2_mask(struct weapon_data* w)
+{
+	int i, mask = 0;
+
+	for( i = 0; i < ARRAYLENGTH(w->addele2) && w->addele2[i].rate != 0; i++ )
+		if( w->addele2[i].ele < ELE_MAX )
+			mask |= 1<<w->addele2[i].ele;
+	return mask;
+}
+
+/// Precomputes the attacker side card fix of every cardfix set.
+/// The race, element and size steps are folded into one table, the remaining
+/// steps keep their summed rates; the integer rounding of each step is the same
+/// as applying them one by one. Called at the end of status_calc_pc.
+void battle_calc_cardfix_table(struct map_session_data* sd)
+{
+	int set, race, ele, size, i;
+
+	nullpo_retv(sd);
+
+	for( set = 0; set < CARDFIX_MAX; set++ )
+	{
+		struct weapon_data* w = ( set == CARDFIX_LEFT ) ? &sd->left_weapon : &sd->right_weapon;
+		int* extra = ( set == CARDFIX_ARROW ) ? sd->arrow_addrace : ( set == CARDFIX_BOTH ) ? sd->left_weapon.addrace : NULL;
+
+		for( race = 0; race < RC_BOSS; race++ )
+			for( ele = 0; ele <= ELE_MAX; ele++ )
+				for( size = 0; size < 3; size++ )
+				{
+					int race_rate, ele_rate, size_rate;
+					battle_cardfix_rates(sd, set, race, ele, size, &race_rate, &ele_rate, &size_rate);
+					sd->cardfix.rate[set][race][ele][size] = CARDFIX_STEP(CARDFIX_STEP(CARDFIX_STEP(1000, race_rate), ele_rate), size_rate);
+				}
+
+		// race2 bonuses of the ammo are not used
+		for( i = 0; i < RC2_MAX; i++ )
+			sd->cardfix.race2[set][i] = w->addrace2[i] + ( set == CARDFIX_BOTH ? sd->left_weapon.addrace2[i] : 0 );
+
+		sd->cardfix.boss[set][0] = w->addrace[RC_NONBOSS] + ( extra ? extra[RC_NONBOSS] : 0 );
+		sd->cardfix.boss[set][1] = w->addrace[RC_BOSS] + ( extra ? extra[RC_BOSS] : 0 );
+		sd->cardfix.nondemihuman[set] = w->addrace[RC_NONDEMIHUMAN] + ( extra ? extra[RC_NONDEMIHUMAN] : 0 );
+
+		switch( set )
+		{
+		case CARDFIX_LEFT:  sd->cardfix.addele2[set] = 0; break; // no element step
+		case CARDFIX_BOTH:  sd->cardfix.addele2[set] = battle_addele2_mask(&sd->right_weapon)|battle_addele2_mask(&sd->left_weapon); break;
+		default:            sd->cardfix.addele2[set] = battle_addele2_mask(&sd->right_weapon); break;
+		}
+	}
+}
+
+/// Attacker side card fix of a cardfix set against the target (1000 = 100%).
+/// 'ele' is the target element or ELE_MAX when the element fix is not applied.
+static int battle_cardfix(struct map_session_data* sd, int set, struct status_data* tstatus, int t_race2, bool t_boss, int ele, int flag)
+{
+	int cardfix;
+
+	if( tstatus->race < RC_BOSS && !(ele < ELE_MAX && sd->cardfix.addele2[set]&(1<<ele)) )
+		cardfix = sd->cardfix.rate[set][tstatus->race][ele][tstatus->size];
+	else
+	{// conditional element bonuses depend on the attack
+		int race_rate, ele_rate, size_rate;
+		battle_cardfix_rates(sd, set, tstatus->race, ele, tstatus->size, &race_rate, &ele_rate, &size_rate);
+		if( ele < ELE_MAX && set != CARDFIX_LEFT )
+		{
+			ele_rate += battle_addele2_rate(&sd->right_weapon, ele, flag);
+			if( set == CARDFIX_BOTH )
+				ele_rate += battle_addele2_rate(&sd->left_weapon, ele, flag);
+		}
+		cardfix = CARDFIX_STEP(CARDFIX_STEP(CARDFIX_STEP(1000, race_rate), ele_rate), size_rate);
+	}
+
+	cardfix = CARDFIX_STEP(cardfix, sd->cardfix.race2[set][t_race2]);
+	cardfix = CARDFIX_STEP(cardfix, sd->cardfix.boss[set][t_boss?1:0]);
+	if( tstatus->race != RC_DEMIHUMAN )
+		cardfix = CARDFIX_STEP(cardfix, sd->cardfix.nondemihuman[set]);
+	return cardfix;
+}
+
 static int battle_range_type(
 	struct block_list *src, struct block_list *target,
 	int skill_num, int skill_lv)
@@ -2984,102 +3112,22 @@ static struct Damage battle_calc_weapon_attack(struct block_list *src,struct blo
 		{
 			int cardfix = 1000, cardfix_ = 1000;
 			int t_race2 = status_get_race2(target);
+			int t_ele = (nk&NK_NO_ELEFIX) ? ELE_MAX : tstatus->def_ele;
+			bool t_boss = is_boss(target) ? true : false;
 			if(sd->state.arrow_atk)
-			{
-				cardfix=cardfix*(100+sd->right_weapon.addrace[tstatus->race]+sd->arrow_addrace[tstatus->race])/100;
-				if (!(nk&NK_NO_ELEFIX))
-				{
-					int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->arrow_addele[tstatus->def_ele];
-					for (i = 0; ARRAYLENGTH(sd->right_weapon.addele2) > i && sd->right_weapon.addele2[i].rate != 0; i++) {
-						if (sd->right_weapon.addele2[i].ele != tstatus->def_ele) continue;
-						if(!(sd->right_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-								continue;
-						ele_fix += sd->right_weapon.addele2[i].rate;
-					}
-					cardfix=cardfix*(100+ele_fix)/100;
-				}
-				cardfix=cardfix*(100+sd->right_weapon.addsize[tstatus->size]+sd->arrow_addsize[tstatus->size])/100;
-				cardfix=cardfix*(100+sd->right_weapon.addrace2[t_race2])/100;
-				cardfix=cardfix*(100+sd->right_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS]+sd->arrow_addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-				if( tstatus->race != RC_DEMIHUMAN )
-					cardfix=cardfix*(100+sd->right_weapon.addrace[RC_NONDEMIHUMAN]+sd->arrow_addrace[RC_NONDEMIHUMAN])/100;
-			}
-			else
+				cardfix = battle_cardfix(sd, CARDFIX_ARROW, tstatus, t_race2, t_boss, t_ele, wd.flag);
+			else if( !battle_config.left_cardfix_to_right )
 			{ // Melee attack
-				if( !battle_config.left_cardfix_to_right )
-				{
-					cardfix=cardfix*(100+sd->right_weapon.addrace[tstatus->race])/100;
-					if (!(nk&NK_NO_ELEFIX)) {
-						int ele_fix = sd->right_weapon.addele[tstatus->def_ele];
-						for (i = 0; ARRAYLENGTH(sd->right_weapon.addele2) > i && sd->right_weapon.addele2[i].rate != 0; i++) {
-							if (sd->right_weapon.addele2[i].ele != tstatus->def_ele) continue;
-							if(!(sd->right_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-								 sd->right_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-								 sd->right_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-									continue;
-							ele_fix += sd->right_weapon.addele2[i].rate;
-						}
-						cardfix=cardfix*(100+ele_fix)/100;
-					}
-					cardfix=cardfix*(100+sd->right_weapon.addsize[tstatus->size])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace2[t_race2])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-					if( tstatus->race != RC_DEMIHUMAN )
-						cardfix=cardfix*(100+sd->right_weapon.addrace[RC_NONDEMIHUMAN])/100;
-
-					if( flag.lh )
-					{
-						cardfix_=cardfix_*(100+sd->left_weapon.addrace[tstatus->race])/100;
-						if (!(nk&NK_NO_ELEFIX))	{
-							int ele_fix_lh = sd->left_weapon.addele[tstatus->def_ele];
-							for (i = 0; ARRAYLENGTH(sd->left_weapon.addele2) > i && sd->left_weapon.addele2[i].rate != 0; i++) {
-								if (sd->left_weapon.addele2[i].ele != tstatus->def_ele) continue;
-								if(!(sd->left_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-									 sd->left_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-									 sd->left_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-										continue;
-								ele_fix_lh += sd->left_weapon.addele2[i].rate;
-							}
-							cardfix=cardfix*(100+ele_fix_lh)/100;
-						}
-						cardfix_=cardfix_*(100+sd->left_weapon.addsize[tstatus->size])/100;
-						cardfix_=cardfix_*(100+sd->left_weapon.addrace2[t_race2])/100;
-						cardfix_=cardfix_*(100+sd->left_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-						if( tstatus->race != RC_DEMIHUMAN )
-							cardfix_=cardfix_*(100+sd->left_weapon.addrace[RC_NONDEMIHUMAN])/100;
-					}
-				}
-				else
+				cardfix = battle_cardfix(sd, CARDFIX_RIGHT, tstatus, t_race2, t_boss, t_ele, wd.flag);
+				if( flag.lh )
 				{
-					int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->left_weapon.addele[tstatus->def_ele];
-					for (i = 0; ARRAYLENGTH(sd->right_weapon.addele2) > i && sd->right_weapon.addele2[i].rate != 0; i++) {
-						if (sd->right_weapon.addele2[i].ele != tstatus->def_ele) continue;
-						if(!(sd->right_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-							 sd->right_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-								continue;
-						ele_fix += sd->right_weapon.addele2[i].rate;
-					}
-					for (i = 0; ARRAYLENGTH(sd->left_weapon.addele2) > i && sd->left_weapon.addele2[i].rate != 0; i++) {
-						if (sd->left_weapon.addele2[i].ele != tstatus->def_ele) continue;
-						if(!(sd->left_weapon.addele2[i].flag&wd.flag&BF_WEAPONMASK &&
-							 sd->left_weapon.addele2[i].flag&wd.flag&BF_RANGEMASK &&
-							 sd->left_weapon.addele2[i].flag&wd.flag&BF_SKILLMASK))
-								continue;
-						ele_fix += sd->left_weapon.addele2[i].rate;
-					}
-
-					cardfix=cardfix*(100+sd->right_weapon.addrace[tstatus->race]+sd->left_weapon.addrace[tstatus->race])/100;
-					cardfix=cardfix*(100+ele_fix)/100;
-					cardfix=cardfix*(100+sd->right_weapon.addsize[tstatus->size]+sd->left_weapon.addsize[tstatus->size])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace2[t_race2]+sd->left_weapon.addrace2[t_race2])/100;
-					cardfix=cardfix*(100+sd->right_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS]+sd->left_weapon.addrace[is_boss(target)?RC_BOSS:RC_NONBOSS])/100;
-					if( tstatus->race != RC_DEMIHUMAN )
-						cardfix=cardfix*(100+sd->right_weapon.addrace[RC_NONDEMIHUMAN]+sd->left_weapon.addrace[RC_NONDEMIHUMAN])/100;
+					cardfix_ = battle_cardfix(sd, CARDFIX_LEFT, tstatus, t_race2, t_boss, t_ele, wd.flag);
+					if( t_ele < ELE_MAX ) // the left hand element bonus has always been applied to the right hand card fix
+						cardfix = CARDFIX_STEP(cardfix, sd->left_weapon.addele[t_ele] + battle_addele2_rate(&sd->left_weapon, t_ele, wd.flag));
 				}
 			}
+			else // the element fix of both hands was never skipped by NK_NO_ELEFIX
+				cardfix = battle_cardfix(sd, CARDFIX_BOTH, tstatus, t_race2, t_boss, tstatus->def_ele, wd.flag);
 
 			for( i = 0; i < ARRAYLENGTH(sd->right_weapon.add_dmg) && sd->right_weapon.add_dmg[i].rate; i++ )
 			{
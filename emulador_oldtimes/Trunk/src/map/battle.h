@@ -93,6 +93,7 @@ int battle_check_target(struct block_list *src, struct block_list *target,int fl
 bool battle_check_range(struct block_list *src,struct block_list *bl,int range);
 
 void battle_consume_ammo(struct map_session_data* sd, int skill, int lv);
+void battle_calc_cardfix_table(struct map_session_data* sd);
 // ݒ
 
 #define MIN_HAIR_STYLE battle_config.min_hair_style
@@ -191,6 +191,7 @@ void buyingstore_create(struct map_session_data* sd, int zenylimit, unsigned cha
 	sd->buyingstore.zenylimit = zenylimit;
 	sd->buyingstore.slots = i;  // store actual amount of items
 	safestrncpy(sd->message, storename, sizeof(sd->message));
+	searchstore_index(sd);
 	clif_buyingstore_myitemlist(sd);
 	clif_buyingstore_entry(sd);
 }
@@ -203,6 +204,7 @@ void buyingstore_close(struct map_session_data* sd)
 		// invalidate data
 		sd->state.buyingstore = false;
 		memset(&sd->buyingstore, 0, sizeof(sd->buyingstore));
+		searchstore_index(sd);
 
 		// notify other players
 		clif_buyingstore_disappear_entry(sd);
@@ -384,6 +386,9 @@ void buyingstore_trade(struct map_session_data* sd, int account_id, unsigned int
 		clif_buyingstore_update_item(pl_sd, nameid, amount);
 	}
 
+	// drop sold out items from the store search
+	searchstore_index(pl_sd);
+
 	// check whether or not there is still something to buy
 	ARR_FIND( 0, pl_sd->buyingstore.slots, i, pl_sd->buyingstore.items[i].amount != 0 );
 	if( i == pl_sd->buyingstore.slots )
@@ -430,47 +435,28 @@ bool buyingstore_search(struct map_session_data* sd, unsigned short nameid)
 }
 
 
-/// Searches for all items in a buyingstore, that match given ids, price and possible cards.
+/// Sends buying store slot i of sd to the search, if it still matches.
 /// @return Whether or not the search should be continued.
-bool buyingstore_searchall(struct map_session_data* sd, const struct s_search_store_search* s)
+bool buyingstore_searchslot(struct map_session_data* sd, unsigned int i, const struct s_search_store_search* s)
 {
-	unsigned int i, idx;
 	struct s_buyingstore_item* it;
 
-	if( !sd->state.buyingstore )
-	{// not buying
+	if( !sd->state.buyingstore || i >= sd->buyingstore.slots || !sd->buyingstore.items[i].amount )
+	{// not buying (anymore)
 		return true;
 	}
+	it = &sd->buyingstore.items[i];
 
-	for( idx = 0; idx < s->item_count; idx++ )
-	{
-		ARR_FIND( 0, sd->buyingstore.slots, i, sd->buyingstore.items[i].nameid == s->itemlist[idx] && sd->buyingstore.items[i].amount );
-		if( i == sd->buyingstore.slots )
-		{// not found
-			continue;
-		}
-		it = &sd->buyingstore.items[i];
-
-		if( s->min_price && s->min_price > (unsigned int)it->price )
-		{// too low price
-			continue;
-		}
-
-		if( s->max_price && s->max_price < (unsigned int)it->price )
-		{// too high price
-			continue;
-		}
-
-		if( s->card_count )
-		{// ignore cards, as there cannot be any
-			;
-		}
+	if( s->min_price && s->min_price > (unsigned int)it->price )
+	{// too low price
+		return true;
+	}
 
-		if( !searchstore_result(s->search_sd, sd->buyer_id, sd->status.account_id, sd->message, it->nameid, it->amount, it->price, buyingstore_blankslots, 0) )
-		{// result set full
-			return false;
-		}
+	if( s->max_price && s->max_price < (unsigned int)it->price )
+	{// too high price
+		return true;
 	}
 
-	return true;
+	// cards are ignored, as there cannot be any
+	return searchstore_result(s->search_sd, sd->buyer_id, sd->status.account_id, sd->message, it->nameid, it->amount, it->price, buyingstore_blankslots, 0);
 }
@@ -28,6 +28,6 @@ void buyingstore_close(struct map_session_data* sd);
 void buyingstore_open(struct map_session_data* sd, int account_id);
 void buyingstore_trade(struct map_session_data* sd, int account_id, unsigned int buyer_id, const uint8* itemlist, unsigned int count);
 bool buyingstore_search(struct map_session_data* sd, unsigned short nameid);
-bool buyingstore_searchall(struct map_session_data* sd, const struct s_search_store_search* s);
+bool buyingstore_searchslot(struct map_session_data* sd, unsigned int i, const struct s_search_store_search* s);
 
 #endif  // _BUYINGSTORE_H_
@@ -44,7 +44,8 @@ static const int packet_len_table[0x3d] = { // U - used, F - free
 	 6,30, 0, 0,86, 7,44,34,	// 2b08-2b0f: U->2b08, U->2b09, F->2b0a, F->2b0b, U->2b0c, U->2b0d, U->2b0e, U->2b0f
 	11,10,10, 0,11, 0,266,10,	// 2b10-2b17: U->2b10, U->2b11, U->2b12, F->2b13, U->2b14, F->2b15, U->2b16, U->2b17
 	 2,10, 2,-1,-1,-1, 2, 7,	// 2b18-2b1f: U->2b18, U->2b19, U->2b1a, U->2b1b, U->2b1c, U->2b1d, U->2b1e, U->2b1f
-	-1,10, 8, 2, 2,14,19,19,	// 2b20-2b27: U->2b20, U->2b21, U->2b22, U->2b23, U->2b24, U->2b25, U->2b26, U->2b27
+	-1,11, 8, 2, 2,14,19,19,	// 2b20-2b27: U->2b20, U->2b21, U->2b22, U->2b23, U->2b24, U->2b25, U->2b26, U->2b27
+	-1,-1,10,					// 2b28-2b2a: U->2b28, U->2b29, U->2b2a
 };
 
 //Used Packets:
@@ -89,13 +90,16 @@ static const int packet_len_table[0x3d] = { // U - used, F - free
 //2b1e: Incoming, chrif_update_ip -> 'Reqest forwarded from char-server for interserver IP sync.' [Lance]
 //2b1f: Incoming, chrif_disconnectplayer -> 'disconnects a player (aid X) with the message XY ... 0x81 ..' [Sirius]
 //2b20: Incoming, chrif_removemap -> 'remove maps of a server (sample: its going offline)' [Sirius]
-//2b21: Incoming, chrif_save_ack. Returned after a character has been "final saved" on the char-server. [Skotlex]
+//2b21: Incoming, chrif_save_ack. Returned after a character has been saved on the char-server, flagged when it was the "final save". [Skotlex]
 //2b22: Incoming, chrif_updatefamelist_ack. Updated one position in the fame list.
 //2b23: Outgoing, chrif_keepalive. charserver ping.
 //2b24: Incoming, chrif_keepalive_ack. charserver ping reply.
 //2b25: Incoming, chrif_deadopt -> 'Removes baby from Father ID and Mother ID'
 //2b26: Outgoing, chrif_authreq -> 'client authentication request'
 //2b27: Incoming, chrif_authfail -> 'client authentication failed'
+//2b28: Both, inter_frame_unpack -> 'deflated batch of inter-server packets'
+//2b29: Outgoing, chrif_load_report -> 'users, timer delay, memory and users per map of this map-server'
+//2b2a: Incoming, map_setroute -> 'map XY is now served by map-server ip:port'
 
 int chrif_connected = 0;
 int char_fd = -1;
@@ -111,6 +115,13 @@ int other_mapserver_count=0; //Holds count of how many other map servers are onl
 #define CHECK_INTERVAL 3600000
 //Interval at which map server sends number of connected users. [Skotlex]
 #define UPDATE_INTERVAL 10000
+#define LAG_PROBE_INTERVAL 100 // how often the timer delay is sampled for the load report
+
+// timer delay samples since the last load report
+static struct {
+	unsigned int last; // when the previous sample ran
+	unsigned int total, max, count;
+} lag_probe;
 //This define should spare writing the check in every function. [Skotlex]
 #define chrif_check(a) { if(!chrif_isconnected()) return a; }
 
@@ -278,6 +289,9 @@ int chrif_save(struct map_session_data *sd, int flag)
 
 	chrif_check(-1); //Character is saved on reconnect.
 
+	// Everything below goes to the char-server in one frame.
+	inter_frame_begin(char_fd);
+
 	//For data sync
 	if (sd->state.storage_flag == 2)
 		storage_guild_storagesave(sd->status.account_id, sd->status.guild_id, flag);
@@ -301,6 +315,7 @@ int chrif_save(struct map_session_data *sd, int flag)
 	WFIFOB(char_fd,12) = (flag==1)?1:0; //Flag to tell char-server this character is quitting.
 	memcpy(WFIFOP(char_fd,13), &sd->status, sizeof(sd->status));
 	WFIFOSET(char_fd, WFIFOW(char_fd,2));
+	pc_autosave_saved(sd);
 
 	if( sd->status.pet_id > 0 && sd->pd )
 		intif_save_petdata(sd->status.account_id,&sd->pd->pet);
@@ -313,6 +328,8 @@ int chrif_save(struct map_session_data *sd, int flag)
 	if( sd->save_quest )
 		intif_quest_save(sd);
 
+	inter_frame_end(char_fd);
+
 	return 0;
 }
 
@@ -381,11 +398,15 @@ int chrif_removemap(int fd)
 	return 0;
 }
 
-// received after a character has been "final saved" on the char-server
+// received after a character has been saved on the char-server
 static void chrif_save_ack(int fd)
 {
-	chrif_auth_delete(RFIFOL(fd,2), RFIFOL(fd,6), ST_LOGOUT);
-	chrif_check_shutdown();
+	pc_autosave_ack();
+	if( RFIFOB(fd,10) )
+	{// "final save"
+		chrif_auth_delete(RFIFOL(fd,2), RFIFOL(fd,6), ST_LOGOUT);
+		chrif_check_shutdown();
+	}
 }
 
 // request to move a character between mapservers
@@ -1338,6 +1359,7 @@ void chrif_on_disconnect(void)
 	if( chrif_connected != 1 )
 		ShowWarning("Conexo ao char-server perdida.\n\n");
 	chrif_connected = 0;
+	pc_autosave_reset(); // unacknowledged saves are lost with the connection
 	
  	other_mapserver_count = 0; //Reset counter. We receive ALL maps from all map-servers on reconnect.
 	map_eraseallipport();
@@ -1400,6 +1422,13 @@ int chrif_parse(int fd)
 	while (RFIFOREST(fd) >= 2)
 	{
 		cmd = RFIFOW(fd,0);
+		if (cmd == INTER_FRAME_CMD)
+		{// unpack the frame in place and parse its packets
+			int r = inter_frame_unpack(fd);
+			if (r == 0) return 0;
+			if (r < 0) { set_eof(fd); return 0; }
+			continue;
+		}
 		if (cmd < 0x2af8 || cmd >= 0x2af8 + ARRAYLENGTH(packet_len_table) || packet_len_table[cmd-0x2af8] == 0)
 		{
 			int r = intif_parse(fd); // intifɓn
@@ -1449,6 +1478,7 @@ int chrif_parse(int fd)
 		case 0x2b24: chrif_keepalive_ack(fd); break;
 		case 0x2b25: chrif_deadopt(RFIFOL(fd,2), RFIFOL(fd,6), RFIFOL(fd,10)); break;
 		case 0x2b27: chrif_authfail(fd); break;
+		case 0x2b2a: map_setroute(RFIFOW(fd,2), ntohl(RFIFOL(fd,4)), ntohs(RFIFOW(fd,8))); break;
 		default:
 			ShowError("chrif_parse : pacote desconhecido (sesso #%d): 0x%x. Desconectando.\n", fd, cmd);
 			set_eof(fd);
@@ -1480,6 +1510,55 @@ int send_usercount_tochar(int tid, unsigned int tick, int id, intptr_t data)
 	return 0;
 }
 
+/// Measures how late the timers run, the best sign of an overloaded map-server.
+/// tick is when this timer was due, unless it was over a second late (then it's
+/// the current tick and the gap since the previous sample tells the delay).
+static int chrif_lag_probe(int tid, unsigned int tick, int id, intptr_t data)
+{
+	unsigned int now = gettick_nocache();
+	int lag = DIFF_TICK(now, tick);
+
+	if( lag_probe.last && DIFF_TICK(now, lag_probe.last) - LAG_PROBE_INTERVAL > lag )
+		lag = DIFF_TICK(now, lag_probe.last) - LAG_PROBE_INTERVAL;
+	lag_probe.last = now;
+	if( lag < 0 )
+		lag = 0;
+	lag_probe.total += lag;
+	lag_probe.count++;
+	if( (unsigned int)lag > lag_probe.max )
+		lag_probe.max = lag;
+	return 0;
+}
+
+/// Reports the load of this map-server to the char-server, for map rebalancing.
+/// 2b29 <len>.W <users>.L <lag avg>.L <lag max>.L <memory>.L { <map index>.W <users>.W }*
+static int chrif_load_report(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int m, len = 20;
+
+	chrif_check(-1);
+
+	WFIFOHEAD(char_fd, 20 + 4*map_num);
+	WFIFOW(char_fd,0) = 0x2b29;
+	WFIFOL(char_fd,4) = map_usercount();
+	WFIFOL(char_fd,8) = lag_probe.count ? lag_probe.total / lag_probe.count : 0;
+	WFIFOL(char_fd,12) = lag_probe.max;
+	WFIFOL(char_fd,16) = (uint32)malloc_usage();
+	for( m = 0; m < map_num; m++ )
+	{
+		if( !map[m].users )
+			continue;
+		WFIFOW(char_fd,len) = map[m].index;
+		WFIFOW(char_fd,len+2) = map[m].users;
+		len += 4;
+	}
+	WFIFOW(char_fd,2) = len;
+	WFIFOSET(char_fd,len);
+
+	lag_probe.total = lag_probe.max = lag_probe.count = 0;
+	return 0;
+}
+
 /*==========================================
  * timer֐
  * mapIɌqĂNCAglcharI֑
@@ -1606,6 +1685,8 @@ int do_init_chrif(void)
 	add_timer_func_list(check_connect_char_server, "check_connect_char_server");
 	add_timer_func_list(ping_char_server, "ping_char_server");
 	add_timer_func_list(auth_db_cleanup, "auth_db_cleanup");
+	add_timer_func_list(chrif_lag_probe, "chrif_lag_probe");
+	add_timer_func_list(chrif_load_report, "chrif_load_report");
 
 	// establish map-char connection if not present
 	add_timer_interval(gettick() + 1000, check_connect_char_server, 0, 0, 10 * 1000);
@@ -1619,5 +1700,9 @@ int do_init_chrif(void)
 	// send the user count every 10 seconds, to hide the charserver's online counting problem
 	add_timer_interval(gettick() + 1000, send_usercount_tochar, 0, 0, UPDATE_INTERVAL);
 
+	// report the load of this map-server, used to move maps between map-servers
+	add_timer_interval(gettick() + LAG_PROBE_INTERVAL, chrif_lag_probe, 0, 0, LAG_PROBE_INTERVAL);
+	add_timer_interval(gettick() + UPDATE_INTERVAL, chrif_load_report, 0, 0, UPDATE_INTERVAL);
+
 	return 0;
 }
@@ -2654,6 +2654,55 @@ void clif_guild_xy_single(int fd, struct map_session_data *sd)
 	WFIFOSET(fd,packet_len(0x1eb));
 }
 
+/// Writes the position packets (cmd) of the moved members into a single
+/// WFIFO reservation of tsd. Only members on the same map as tsd are sent,
+/// unless it's a spy (samemap false).
+static void clif_xy_batch_sub(struct map_session_data *tsd, int cmd, struct map_session_data **moved, int count, bool samemap)
+{
+	int fd = tsd->fd, i, n = 0;
+
+	if( !fd || !packet_db[tsd->packet_ver][cmd].len )
+		return;
+
+	WFIFOHEAD(fd,count*10);
+	for( i = 0; i < count; i++ )
+	{
+		struct map_session_data *sd = moved[i];
+		if( sd == tsd || (samemap && sd->bl.m != tsd->bl.m) )
+			continue;
+		WFIFOW(fd,n+0)=cmd;
+		WFIFOL(fd,n+2)=sd->status.account_id;
+		WFIFOW(fd,n+6)=sd->bl.x;
+		WFIFOW(fd,n+8)=sd->bl.y;
+		n += 10;
+	}
+	if( n )
+		WFIFOSET(fd,n);
+}
+
+/// Sends the guild members that moved to every member on the same map,
+/// all of them in one batch per recipient (see clif_guild_xy).
+void clif_guild_xy_batch(struct guild *g, struct map_session_data **moved, int count)
+{
+	struct map_session_data *tsd;
+	int i;
+
+	nullpo_retv(g);
+
+	for( i = 0; i < g->max_member; i++ )
+		if( (tsd = g->member[i].sd) != NULL )
+			clif_xy_batch_sub(tsd, 0x1eb, moved, count, true);
+
+	if( enable_spy )
+	{
+		struct s_mapiterator* iter = mapit_getallusers();
+		while( (tsd = (TBL_PC*)mapit_next(iter)) != NULL )
+			if( tsd->guildspy == g->guild_id )
+				clif_xy_batch_sub(tsd, 0x1eb, moved, count, false);
+		mapit_free(iter);
+	}
+}
+
 // Guild XY locators [Valaris]
 void clif_guild_xy_remove(struct map_session_data *sd)
 {
@@ -2799,6 +2848,8 @@ void clif_updatestatus(struct map_session_data *sd,int type)
 		clif_hpmeter(sd);
 		if( !battle_config.party_hp_mode && sd->status.party_id )
 			clif_party_hp(sd);
+		else if( sd->status.party_id )
+			party_xy_dirty(sd); // sent by party_send_xy_timer
 		if( sd->bg_id )
 			clif_bg_hp(sd);
 		break;
@@ -6562,6 +6613,30 @@ void clif_party_xy_single(int fd, struct map_session_data *sd)
 }
 
 
+/// Sends the party members that moved to every member on the same map,
+/// all of them in one batch per recipient (see clif_party_xy).
+void clif_party_xy_batch(struct party_data *p, struct map_session_data **moved, int count)
+{
+	struct map_session_data *tsd;
+	int i;
+
+	nullpo_retv(p);
+
+	for( i = 0; i < MAX_PARTY; i++ )
+		if( (tsd = p->data[i].sd) != NULL )
+			clif_xy_batch_sub(tsd, 0x107, moved, count, true);
+
+	if( enable_spy )
+	{
+		struct s_mapiterator* iter = mapit_getallusers();
+		while( (tsd = (TBL_PC*)mapit_next(iter)) != NULL )
+			if( tsd->partyspy == p->party.party_id )
+				clif_xy_batch_sub(tsd, 0x107, moved, count, false);
+		mapit_free(iter);
+	}
+}
+
+
 /// Updates HP bar of a party member.
 /// 0106 <account id>.L <hp>.W <max hp>.W (ZC_NOTIFY_HP_TO_GROUPM)
 /// 080e <account id>.L <hp>.L <max hp>.L (ZC_NOTIFY_HP_TO_GROUPM_R2)
@@ -17074,14 +17149,19 @@ int do_init_clif(void) {
 		exit(EXIT_FAILURE);
 	}
 
-	add_timer_func_list(clif_clearunit_delayed_sub, "clif_clearunit_delayed_sub");
 	add_timer_func_list(clif_delayquit, "clif_delayquit");
-
-	delay_clearunit_ers = ers_new(sizeof(struct block_list),"clif.c::delay_clearunit_ers",ERS_OPT_CLEAR);
+	clif_init_delayed();
 
 	return 0;
 }
 
+/// Sets up the delayed unit removal used by the units themselves (mob_dead, ...),
+/// without opening the game port (see combat_test_run).
+void clif_init_delayed(void) {
+	add_timer_func_list(clif_clearunit_delayed_sub, "clif_clearunit_delayed_sub");
+	delay_clearunit_ers = ers_new(sizeof(struct block_list),"clif.c::delay_clearunit_ers",ERS_OPT_CLEAR);
+}
+
 void do_final_clif(void)	{
 	ers_destroy(delay_clearunit_ers);
 }
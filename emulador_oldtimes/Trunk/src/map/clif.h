@@ -518,6 +518,7 @@ void clif_party_withdraw(struct party_data* p, struct map_session_data* sd, int
 void clif_party_message(struct party_data* p, int account_id, const char* mes, int len);
 void clif_party_xy(struct map_session_data *sd);
 void clif_party_xy_single(int fd, struct map_session_data *sd);
+void clif_party_xy_batch(struct party_data *p, struct map_session_data **moved, int count);
 void clif_party_hp(struct map_session_data *sd);
 void clif_hpmeter_single(int fd, int id, unsigned int hp, unsigned int maxhp);
 
@@ -550,6 +551,7 @@ void clif_guild_broken(struct map_session_data *sd,int flag);
 void clif_guild_xy(struct map_session_data *sd);
 void clif_guild_xy_single(int fd, struct map_session_data *sd);
 void clif_guild_xy_remove(struct map_session_data *sd);
+void clif_guild_xy_batch(struct guild *g, struct map_session_data **moved, int count);
 
 // Battleground
 void clif_bg_hp(struct map_session_data *sd);
@@ -654,6 +656,7 @@ void clif_displayexp(struct map_session_data *sd, unsigned int exp, char type, b
 
 int clif_send(const uint8* buf, int len, struct block_list* bl, enum send_target type);
 int do_init_clif(void);
+void clif_init_delayed(void);
 void do_final_clif(void);
 
 // MAIL SYSTEM
@@ -0,0 +1,586 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "../common/cbasetypes.h"
+#include "../common/malloc.h"
+#include "../common/random.h"
+#include "../common/showmsg.h"
+#include "../common/strlib.h"
+#include "../common/timer.h"
+#include "../common/utils.h"
+#include "atcommand.h"
+#include "battle.h"
+#include "clif.h"
+#include "combat_test.h"
+#include "itemdb.h"
+#include "log.h"
+#include "map.h"
+#include "mob.h"
+#include "pc.h"
+#include "script.h"
+#include "skill.h"
+#include "status.h"
+#include "unit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Headless combat test (map-server --combat-test <cases> [--combat-golden <file>]).
+//
+// Players and monsters described in the cases file are created on a synthetic
+// map, without sql, network or npcs, and every case runs battle_calc_attack,
+// skill_castend_damage_id or status_damage a fixed number of times with rnd()
+// seeded per case. Each case gives one result line (counts, damage sum/min/max
+// and a hash of every single result); the lines are written to the golden file
+// when it doesn't exist and compared with it otherwise.
+//
+// Timer based effects (delayed damage, timer skills, skill units) are not run.
+// Nobody gains exp or loot and dead units are revived/respawned before the next
+// iteration, so iterations don't influence each other.
+
+#define COMBAT_TEST_MAX_UNITS 64
+#define COMBAT_TEST_MAP_SIZE 40
+#define COMBAT_TEST_MAX_COLUMNS (11+EQI_MAX)
+
+enum e_combat_test_mode {
+	CTM_ATTACK, // battle_calc_attack
+	CTM_SKILL,  // skill_castend_damage_id
+	CTM_DAMAGE, // status_damage
+};
+
+static const char* combat_test_modename[] = { "attack", "skill", "damage" };
+
+struct combat_test_unit {
+	char name[NAME_LENGTH];
+	struct block_list* bl;
+	struct spawn_data spawn; // monsters respawn in place after being killed
+	short x, y; // parking cell, away from the fight
+};
+
+struct combat_test_case {
+	enum e_combat_test_mode mode;
+	int src, target; // index in combat_units
+	int skill_id, skill_lv; // CTM_DAMAGE: hp and sp damage
+	int iterations;
+};
+
+struct combat_test_result {
+	unsigned int count, hits, kills;
+	int64 total;
+	int min, max;
+	uint32 hash;
+};
+
+static struct combat_test_unit combat_units[COMBAT_TEST_MAX_UNITS];
+static int combat_unit_count = 0;
+
+static struct combat_test_case* combat_cases = NULL;
+static int combat_case_count = 0;
+static int combat_case_max = 0;
+
+static uint32 combat_seed = 1;
+static int combat_map = -1;
+
+/// FNV-1a of a result value.
+static uint32 combat_test_hash(uint32 hash, int value)
+{
+	int i;
+
+	for( i = 0; i < 4; i++ )
+	{
+		hash ^= (value>>(i*8))&0xff;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/// Adds the test map, an open field where players can be skill targets and
+/// there is no exp, loot or death penalty.
+static int combat_test_map(void)
+{
+	int m = map_addfield("combat_test", COMBAT_TEST_MAP_SIZE, COMBAT_TEST_MAP_SIZE);
+
+	if( m < 0 )
+		return m;
+	map[m].flag.pvp = map[m].flag.pvp_nocalcrank = 1;
+	map[m].flag.nobaseexp = map[m].flag.nojobexp = map[m].flag.nomobloot = map[m].flag.nomvploot = 1;
+	map[m].flag.noexppenalty = map[m].flag.nozenypenalty = 1;
+	return m;
+}
+
+static struct combat_test_unit* combat_test_searchunit(const char* name)
+{
+	int i;
+
+	ARR_FIND(0, combat_unit_count, i, strcmp(combat_units[i].name, name) == 0);
+	return ( i < combat_unit_count ) ? &combat_units[i] : NULL;
+}
+
+/// Creates a player with the given job, levels and stats, every skill of its
+/// skill tree at max level and the listed items equipped.
+/// Items are "<item id>[:<refine>[:<card1>:<card2>:<card3>:<card4>]]".
+static struct block_list* combat_test_pc(struct combat_test_unit* u, char* fields[], int columns)
+{
+	struct map_session_data* sd;
+	int job = atoi(fields[2]), n = 0, i, used = 0;
+
+	if( pc_jobid2mapid(job) == -1 )
+	{
+		ShowError("combat_test_pc: Classe %d invlida para '%s'.\n", job, u->name);
+		return NULL;
+	}
+
+	CREATE(sd, TBL_PC, 1);
+	pc_setnewpc(sd, START_ACCOUNT_NUM + combat_unit_count, START_CHAR_NUM + combat_unit_count, 0, 0, SEX_MALE, 0);
+	safestrncpy(sd->status.name, u->name, NAME_LENGTH);
+	sd->status.class_ = job;
+	sd->class_ = pc_jobid2mapid(job);
+	sd->status.base_level = cap_value(atoi(fields[3]), 1, MAX_LEVEL);
+	sd->status.job_level = cap_value(atoi(fields[4]), 1, MAX_LEVEL);
+	sd->status.str = cap_value(atoi(fields[5]), 1, battle_config.max_parameter);
+	sd->status.agi = cap_value(atoi(fields[6]), 1, battle_config.max_parameter);
+	sd->status.vit = cap_value(atoi(fields[7]), 1, battle_config.max_parameter);
+	sd->status.int_ = cap_value(atoi(fields[8]), 1, battle_config.max_parameter);
+	sd->status.dex = cap_value(atoi(fields[9]), 1, battle_config.max_parameter);
+	sd->status.luk = cap_value(atoi(fields[10]), 1, battle_config.max_parameter);
+	sd->status.hp = sd->status.max_hp = 1;
+	sd->status.sp = sd->status.max_sp = 1;
+
+	sd->followtimer = sd->invincible_timer = sd->npc_timer_id = sd->pvp_timer = INVALID_TIMER;
+	sd->rental_timer = INVALID_TIMER;
+	for( i = 0; i < MAX_SKILL_LEVEL; i++ )
+		sd->spirit_timer[i] = INVALID_TIMER;
+	for( i = 0; i < MAX_EVENTTIMER; i++ )
+		sd->eventtimer[i] = INVALID_TIMER;
+	for( i = 0; i < ARRAYLENGTH(sd->autobonus); i++ )
+		sd->autobonus[i].active = sd->autobonus2[i].active = sd->autobonus3[i].active = INVALID_TIMER;
+
+	for( i = 11; i < columns && n < MAX_INVENTORY; i++ )
+	{
+		struct item* it = &sd->status.inventory[n];
+		int v[6] = { 0, 0, 0, 0, 0, 0 };
+
+		sscanf(fields[i], "%d:%d:%d:%d:%d:%d", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]);
+		if( !itemdb_exists(v[0]) )
+		{
+			ShowWarning("combat_test_pc: Item %d no existe, ignorado em '%s'.\n", v[0], u->name);
+			continue;
+		}
+		it->nameid = v[0];
+		it->amount = ( itemdb_type(v[0]) == IT_AMMO ) ? MAX_AMOUNT : 1;
+		it->identify = 1;
+		it->refine = cap_value(v[1], 0, MAX_REFINE);
+		it->card[0] = v[2];
+		it->card[1] = v[3];
+		it->card[2] = v[4];
+		it->card[3] = v[5];
+		n++;
+	}
+
+	pc_setinventorydata(sd);
+	status_change_init(&sd->bl);
+	status_set_viewdata(&sd->bl, job);
+	unit_dataset(&sd->bl);
+	sd->bl.m = combat_map;
+	sd->bl.x = u->x;
+	sd->bl.y = u->y;
+	map_addiddb(&sd->bl); // item scripts look the player up by id
+
+	for( i = 0; i < n; i++ )
+	{// in list order, the first item of a slot wins
+		int ep = pc_equippoint(sd, i);
+		if( ep == EQP_ARMS && sd->inventory_data[i]->equip == EQP_HAND_R )
+			ep = ( used&EQP_HAND_R ) ? EQP_HAND_L : EQP_HAND_R; // dual wielding
+		if( !ep || used&ep )
+			continue;
+		sd->status.inventory[i].equip = ep;
+		used |= ep;
+	}
+	pc_setequipindex(sd);
+	status_calc_pc(sd, 1);
+	pc_allskillup(sd);
+
+	sd->state.active = 1;
+	map_addblock(&sd->bl);
+	status_percent_heal(&sd->bl, 100, 100);
+	return &sd->bl;
+}
+
+static struct block_list* combat_test_mob(struct combat_test_unit* u, int class_)
+{
+	struct mob_data* md;
+
+	if( !mobdb_checkid(class_) )
+	{
+		ShowError("combat_test_mob: Monstro %d invlido para '%s'.\n", class_, u->name);
+		return NULL;
+	}
+
+	u->spawn.m = combat_map;
+	u->spawn.x = u->x;
+	u->spawn.y = u->y;
+	u->spawn.num = 1;
+	u->spawn.class_ = class_;
+	strcpy(u->spawn.name, "--ja--");
+	if( !mob_parse_dataset(&u->spawn) )
+		return NULL;
+
+	md = mob_spawn_dataset(&u->spawn);
+	md->spawn = &u->spawn;
+	mob_spawn(md);
+	return &md->bl;
+}
+
+/// Puts a unit back on (x,y) with full hp/sp and no status changes.
+static void combat_test_reset(struct combat_test_unit* u, short x, short y)
+{
+	struct block_list* bl = u->bl;
+
+	if( bl->type == BL_MOB && bl->prev == NULL )
+	{// killed, mob_dead took it out of the map
+		u->spawn.x = x;
+		u->spawn.y = y;
+		mob_spawn((TBL_MOB*)bl);
+	}
+	else if( status_isdead(bl) )
+		status_revive(bl, 100, 100);
+
+	status_change_clear(bl, 1);
+	status_percent_heal(bl, 100, 100);
+	if( bl->x != x || bl->y != y )
+		unit_movepos(bl, x, y, 0, false);
+}
+
+static bool combat_test_addcase(enum e_combat_test_mode mode, int src, int target, int skill_id, int skill_lv, int iterations)
+{
+	struct combat_test_case* c;
+
+	if( src == target || iterations <= 0 )
+		return false;
+
+	if( combat_case_count == combat_case_max )
+	{
+		combat_case_max += 64;
+		RECREATE(combat_cases, struct combat_test_case, combat_case_max);
+	}
+	c = &combat_cases[combat_case_count++];
+	c->mode = mode;
+	c->src = src;
+	c->target = target;
+	c->skill_id = skill_id;
+	c->skill_lv = skill_lv;
+	c->iterations = iterations;
+	return true;
+}
+
+/// Adds random battle_calc_attack cases between the units read so far,
+/// using normal attacks and the offensive skills of the skill db.
+static bool combat_test_fuzz(int cases, int iterations)
+{
+	int* skills;
+	int count = 0, id, i;
+
+	if( combat_unit_count < 2 )
+	{
+		ShowError("combat_test_fuzz: So necessrias ao menos duas unidades.\n");
+		return false;
+	}
+
+	CREATE(skills, int, MAX_SKILL_DB);
+	for( id = 1; id < MAX_SKILL_DB; id++ )
+		if( skill_get_index(id) == id && skill_get_max(id) > 0 && skill_get_inf(id)&INF_ATTACK_SKILL && skill_get_type(id) )
+			skills[count++] = id;
+
+	rnd_seed(combat_seed);
+	for( i = 0; i < cases; i++ )
+	{
+		int src = rnd()%combat_unit_count;
+		int target = (src + 1 + rnd()%(combat_unit_count - 1))%combat_unit_count;
+		int skill_id = 0, skill_lv = 0;
+
+		if( count && rnd()%4 )
+		{
+			skill_id = skills[rnd()%count];
+			skill_lv = 1 + rnd()%skill_get_max(skill_id);
+		}
+		combat_test_addcase(CTM_ATTACK, src, target, skill_id, skill_lv, iterations);
+	}
+
+	aFree(skills);
+	return true;
+}
+
+/// Reads a line of the cases file.
+///   seed,<value>
+///   pc,<name>,<job id>,<base lv>,<job lv>,<str>,<agi>,<vit>,<int>,<dex>,<luk>{,<item>}
+///   mob,<name>,<mob id>
+///   attack|skill,<attacker>,<target>,<skill id or name>,<skill lv>,<iterations>
+///   damage,<attacker>,<target>,<hp>,<sp>,<iterations>
+///   fuzz,<cases>,<iterations>
+static bool combat_test_parse(char* fields[], int columns, int current)
+{
+	const char* type = fields[0];
+	int i;
+
+	if( strcmp(type, "seed") == 0 )
+	{
+		combat_seed = (uint32)strtoul(fields[1], NULL, 10);
+		return true;
+	}
+
+	if( strcmp(type, "fuzz") == 0 )
+		return ( columns >= 3 && combat_test_fuzz(atoi(fields[1]), atoi(fields[2])) );
+
+	if( strcmp(type, "pc") == 0 || strcmp(type, "mob") == 0 )
+	{
+		struct combat_test_unit* u;
+		bool pc = ( type[0] == 'p' );
+
+		if( columns < (pc ? 11 : 3) )
+			return false;
+		if( combat_unit_count == COMBAT_TEST_MAX_UNITS )
+		{
+			ShowError("combat_test_parse: Limite de %d unidades atingido.\n", COMBAT_TEST_MAX_UNITS);
+			return false;
+		}
+		if( combat_test_searchunit(fields[1]) )
+		{
+			ShowError("combat_test_parse: Unidade '%s' duplicada.\n", fields[1]);
+			return false;
+		}
+
+		u = &combat_units[combat_unit_count];
+		memset(u, 0, sizeof(*u));
+		safestrncpy(u->name, fields[1], NAME_LENGTH);
+		u->x = 1 + combat_unit_count%(COMBAT_TEST_MAP_SIZE - 2);
+		u->y = 1 + combat_unit_count/(COMBAT_TEST_MAP_SIZE - 2);
+		u->bl = pc ? combat_test_pc(u, fields, columns) : combat_test_mob(u, atoi(fields[2]));
+		if( u->bl == NULL )
+			return false;
+		combat_unit_count++;
+		return true;
+	}
+
+	ARR_FIND(0, ARRAYLENGTH(combat_test_modename), i, strcmp(type, combat_test_modename[i]) == 0);
+	if( i < ARRAYLENGTH(combat_test_modename) && columns >= 6 )
+	{
+		struct combat_test_unit* src = combat_test_searchunit(fields[1]);
+		struct combat_test_unit* target = combat_test_searchunit(fields[2]);
+		int skill_id = ( ISDIGIT(fields[3][0]) ) ? atoi(fields[3]) : skill_name2id(fields[3]);
+
+		if( src == NULL || target == NULL )
+		{
+			ShowError("combat_test_parse: Unidade '%s' desconhecida.\n", src ? fields[2] : fields[1]);
+			return false;
+		}
+		return combat_test_addcase((enum e_combat_test_mode)i, src - combat_units, target - combat_units, skill_id, atoi(fields[4]), atoi(fields[5]));
+	}
+
+	ShowError("combat_test_parse: Tipo de linha '%s' desconhecido.\n", type);
+	return false;
+}
+
+static void combat_test_case(struct combat_test_case* c, int n, struct combat_test_result* r)
+{
+	struct combat_test_unit* src = &combat_units[c->src];
+	struct combat_test_unit* target = &combat_units[c->target];
+	int attack_type = ( c->skill_id ) ? skill_get_type(c->skill_id) : BF_WEAPON;
+	int flag = ( skill_get_nk(c->skill_id)&NK_SPLASHSPLIT ) ? 1 : 0; // a single target to split the damage between
+	int i;
+
+	memset(r, 0, sizeof(*r));
+	r->min = INT_MAX;
+	r->max = INT_MIN;
+	r->hash = 2166136261u;
+
+	rnd_seed(combat_seed + n);
+	combat_test_reset(src, COMBAT_TEST_MAP_SIZE/2, COMBAT_TEST_MAP_SIZE/2);
+	combat_test_reset(target, COMBAT_TEST_MAP_SIZE/2 + 1, COMBAT_TEST_MAP_SIZE/2);
+
+	for( i = 0; i < c->iterations; i++ )
+	{
+		int damage = 0;
+
+		switch( c->mode )
+		{
+		case CTM_ATTACK:
+			{
+				struct Damage d = battle_calc_attack(attack_type ? attack_type : BF_WEAPON, src->bl, target->bl, c->skill_id, c->skill_lv, flag);
+				damage = d.damage + d.damage2;
+				r->hash = combat_test_hash(r->hash, d.damage);
+				r->hash = combat_test_hash(r->hash, d.damage2);
+				r->hash = combat_test_hash(r->hash, d.div_);
+				r->hash = combat_test_hash(r->hash, d.type);
+				r->hash = combat_test_hash(r->hash, d.flag);
+				r->hash = combat_test_hash(r->hash, d.dmg_lv);
+			}
+			break;
+		case CTM_SKILL:
+			{
+				struct status_data* status = status_get_status_data(target->bl);
+				unsigned int hp = status->hp, sp = status->sp;
+
+				skill_castend_damage_id(src->bl, target->bl, c->skill_id, c->skill_lv, gettick(), 0);
+				damage = hp - status->hp;
+				r->hash = combat_test_hash(r->hash, damage);
+				r->hash = combat_test_hash(r->hash, sp - status->sp);
+				r->hash = combat_test_hash(r->hash, target->bl->x);
+				r->hash = combat_test_hash(r->hash, target->bl->y);
+			}
+			break;
+		case CTM_DAMAGE:
+			damage = status_damage(src->bl, target->bl, c->skill_id, c->skill_lv, 0, 0);
+			r->hash = combat_test_hash(r->hash, damage);
+			break;
+		}
+
+		r->count++;
+		if( damage > 0 )
+			r->hits++;
+		if( status_isdead(target->bl) || target->bl->prev == NULL )
+			r->kills++;
+		r->total += damage;
+		r->min = min(r->min, damage);
+		r->max = max(r->max, damage);
+
+		if( c->mode != CTM_ATTACK )
+		{// battle_calc_attack doesn't change the units
+			combat_test_reset(src, COMBAT_TEST_MAP_SIZE/2, COMBAT_TEST_MAP_SIZE/2);
+			combat_test_reset(target, COMBAT_TEST_MAP_SIZE/2 + 1, COMBAT_TEST_MAP_SIZE/2);
+		}
+	}
+
+	combat_test_reset(src, src->x, src->y);
+	combat_test_reset(target, target->x, target->y);
+}
+
+/// Records the results in the golden file, or compares them with it.
+/// Returns the number of differences.
+static int combat_test_golden(const char* golden, StringBuf* results)
+{
+	const char* p = StringBuf_Value(results);
+	char line[1024];
+	int n = 0, diffs = 0;
+	FILE* fp;
+
+	if( (fp = fopen(golden, "r")) == NULL )
+	{
+		if( (fp = fopen(golden, "w")) == NULL )
+		{
+			ShowError("combat_test_golden: No foi possvel criar '%s'.\n", golden);
+			return 1;
+		}
+		fputs(p, fp);
+		fclose(fp);
+		ShowStatus("Teste de combate: resultados gravados em '"CL_WHITE"%s"CL_RESET"'.\n", golden);
+		return 0;
+	}
+
+	while( *p )
+	{
+		const char* end = strchr(p, '\n');
+		size_t len = end - p + 1;
+
+		n++;
+		if( fgets(line, sizeof(line), fp) == NULL )
+			line[0] = '\0';
+		if( strlen(line) != len || strncmp(line, p, len) != 0 )
+		{
+			if( ++diffs <= 10 )
+				ShowError("Teste de combate: caso %d diferente.\n  esperado: %s  obtido:   %.*s", n, line[0] ? line : "(nada)\n", (int)len, p);
+		}
+		p = end + 1;
+	}
+	if( fgets(line, sizeof(line), fp) != NULL )
+	{
+		ShowError("Teste de combate: '%s' tem mais casos que o arquivo de casos.\n", golden);
+		diffs++;
+	}
+	fclose(fp);
+
+	if( diffs )
+		ShowError("Teste de combate: %d caso(s) diferente(s) de '%s'.\n", diffs, golden);
+	else
+		ShowStatus("Teste de combate: %d casos iguais a '"CL_WHITE"%s"CL_RESET"'.\n", n, golden);
+	return diffs;
+}
+
+/// Runs the cases file, reporting throughput and golden differences.
+/// Returns the process exit code.
+int combat_test_run(const char* cases, const char* golden)
+{
+	StringBuf results;
+	char dir[1024];
+	const char* file;
+	double elapsed = 0;
+	int64 calls = 0;
+	int n, diffs = 0;
+
+	// only the txt databases, nothing is logged and damage is not delayed
+	db_use_sqldbs = 0;
+	memset(&log_config, 0, sizeof(log_config));
+	battle_config.delay_battle_damage = 0;
+	battle_config.mvp_tomb_enabled = 0;
+
+	do_init_atcommand();
+	do_init_battle();
+	clif_init_delayed();
+	script_init_engine();
+	do_init_itemdb();
+	do_init_skill();
+	do_init_mob();
+	do_init_pc();
+	do_init_status();
+	do_init_unit();
+	if( (combat_map = combat_test_map()) < 0 )
+		return EXIT_FAILURE;
+
+	if( (file = strrchr(cases, '/')) != NULL )
+	{
+		safestrncpy(dir, cases, min(sizeof(dir), (size_t)(file - cases + 1)));
+		file++;
+	}
+	else
+	{
+		strcpy(dir, ".");
+		file = cases;
+	}
+	if( !sv_readdb(dir, file, ',', 2, COMBAT_TEST_MAX_COLUMNS, INT_MAX, &combat_test_parse) || !combat_case_count )
+	{
+		ShowError("Teste de combate: nenhum caso em '%s'.\n", cases);
+		return EXIT_FAILURE;
+	}
+
+	StringBuf_Init(&results);
+	for( n = 0; n < combat_case_count; n++ )
+	{
+		struct combat_test_case* c = &combat_cases[n];
+		struct combat_test_result r;
+		clock_t start = clock();
+		double secs;
+
+		combat_test_case(c, n, &r);
+		secs = (double)(clock() - start)/CLOCKS_PER_SEC;
+		elapsed += secs;
+		calls += r.count;
+
+		StringBuf_Printf(&results, "%d %s %s %s %d,%d n=%u hits=%u kills=%u total=%"PRId64" min=%d max=%d hash=%08x\n",
+			n + 1, combat_test_modename[c->mode], combat_units[c->src].name, combat_units[c->target].name,
+			c->skill_id, c->skill_lv, r.count, r.hits, r.kills, r.total, r.min, r.max, r.hash);
+		ShowInfo("Caso %d (%s %s -> %s, %d,%d): %u execues em %.3fs (%.0f/s).\n",
+			n + 1, combat_test_modename[c->mode], combat_units[c->src].name, combat_units[c->target].name,
+			c->skill_id, c->skill_lv, r.count, secs, secs > 0 ? r.count/secs : 0.);
+	}
+	ShowStatus("Teste de combate: %d casos, %"PRId64" execues em %.3fs (%.0f/s).\n",
+		combat_case_count, calls, elapsed, elapsed > 0 ? calls/elapsed : 0.);
+
+	if( golden )
+		diffs = combat_test_golden(golden, &results);
+	else
+		printf("%s", StringBuf_Value(&results));
+	StringBuf_Destroy(&results);
+
+	return diffs ? EXIT_FAILURE : EXIT_SUCCESS;
+}
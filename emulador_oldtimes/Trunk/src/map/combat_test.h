@@ -0,0 +1,9 @@
+// Copyright (c) Athena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef _COMBAT_TEST_H_
+#define _COMBAT_TEST_H_
+
+int combat_test_run(const char* cases, const char* golden);
+
+#endif /* _COMBAT_TEST_H_ */
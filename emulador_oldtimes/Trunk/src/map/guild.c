@@ -33,6 +33,7 @@ static DBMap* guild_db; // int guild_id -> struct guild*
 static DBMap* castle_db; // int castle_id -> struct guild_castle*
 static DBMap* guild_expcache_db; // int char_id -> struct guild_expcache*
 static DBMap* guild_infoevent_db; // int guild_id -> struct eventlist*
+static DBMap* guild_xy_db; // int guild_id -> guilds with members that moved since the last guild_send_xy_timer
 
 struct eventlist {
 	char name[EVENT_NAME_LENGTH];
@@ -320,18 +321,26 @@ int guild_payexp_timer(int tid, unsigned int tick, int id, intptr_t data)
 	return 0;
 }
 
+/// Marks the guild of sd for a position update on the next guild_send_xy_timer.
+/// Called whenever a guild member is placed or moved on a map.
+void guild_xy_dirty(struct map_session_data *sd)
+{
+	if( sd->status.guild_id && !sd->bg_id )
+		idb_iput(guild_xy_db, sd->status.guild_id, 1);
+}
+
 /**
  * Taken from party_send_xy_timer_sub. [Skotlex]
+ * Sends the members that moved to the rest of the guild, one batch per recipient.
  * @see DBApply
  */
 int guild_send_xy_timer_sub(DBKey key, DBData *data, va_list ap)
 {
-	struct guild *g = db_data2ptr(data);
-	int i;
-
-	nullpo_ret(g);
+	struct guild *g = guild_search(key.i);
+	struct map_session_data* moved[MAX_GUILD];
+	int i, count = 0;
 
-	if( !g->connect_member )
+	if( g == NULL || !g->connect_member )
 	{// no members connected to this guild so do not iterate
 		return 0;
 	}
@@ -340,18 +349,21 @@ int guild_send_xy_timer_sub(DBKey key, DBData *data, va_list ap)
 		struct map_session_data* sd = g->member[i].sd;
 		if( sd != NULL && sd->fd && (sd->guild_x != sd->bl.x || sd->guild_y != sd->bl.y) && !sd->bg_id )
 		{
-			clif_guild_xy(sd);
+			moved[count++] = sd;
 			sd->guild_x = sd->bl.x;
 			sd->guild_y = sd->bl.y;
 		}
 	}
+	if( count )
+		clif_guild_xy_batch(g, moved, count);
 	return 0;
 }
 
 //Code from party_send_xy_timer [Skotlex]
 static int guild_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
-	guild_db->foreach(guild_db,guild_send_xy_timer_sub,tick);
+	guild_xy_db->foreach(guild_xy_db,guild_send_xy_timer_sub,tick);
+	db_clear(guild_xy_db);
 	return 0;
 }
 
@@ -1990,6 +2002,7 @@ void do_init_guild(void)
 	castle_db=idb_alloc(DB_OPT_BASE);
 	guild_expcache_db=idb_alloc(DB_OPT_BASE);
 	guild_infoevent_db=idb_alloc(DB_OPT_BASE);
+	guild_xy_db=idb_alloc(DB_OPT_BASE);
 	expcache_ers = ers_new(sizeof(struct guild_expcache),"guild.c::expcache_ers",ERS_OPT_NONE);
 
 	sv_readdb(db_path, "castle_db.txt", ',', 4, 5, -1, &guild_read_castledb);
@@ -2009,5 +2022,6 @@ void do_final_guild(void)
 	castle_db->destroy(castle_db,guild_castle_db_final);
 	guild_expcache_db->destroy(guild_expcache_db,guild_expcache_db_final);
 	guild_infoevent_db->destroy(guild_infoevent_db,eventlist_db_final);
+	db_destroy(guild_xy_db);
 	ers_destroy(expcache_ers);
 }
@@ -377,6 +377,7 @@ int intif_send_guild_storage(int account_id,struct guild_storage *gstor)
 {
 	if (CheckForCharServer())
 		return 0;
+	inter_frame_begin(inter_fd);
 	WFIFOHEAD(inter_fd,sizeof(struct guild_storage)+12);
 	WFIFOW(inter_fd,0) = 0x3019;
 	WFIFOW(inter_fd,2) = (unsigned short)sizeof(struct guild_storage)+12;
@@ -384,6 +385,7 @@ int intif_send_guild_storage(int account_id,struct guild_storage *gstor)
 	WFIFOL(inter_fd,8) = gstor->guild_id;
 	memcpy( WFIFOP(inter_fd,12),gstor, sizeof(struct guild_storage) );
 	WFIFOSET(inter_fd,WFIFOW(inter_fd,2));
+	inter_frame_end(inter_fd);
 	return 0;
 }
 
@@ -1016,6 +1018,7 @@ int intif_parse_LoadGuildStorage(int fd)
 	}
 
 	memcpy(gstor,RFIFOP(fd,12),sizeof(struct guild_storage));
+	storage_guild_storageloaded(guild_id);
 	storage_guild_storageopen(sd);
 	return 0;
 }
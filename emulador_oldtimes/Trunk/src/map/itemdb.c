@@ -22,61 +22,59 @@ static DBMap*            itemdb_other;// int nameid -> struct item_data*
 
 static struct item_group itemgroup_db[MAX_ITEMGROUP];
 
+static DBMap*            itemdb_name_db;// aegis name (case-insensitive) -> struct item_data*
+static DBMap*            itemdb_jname_db;// client name (case-insensitive) -> struct item_data*
+static struct trigramdb  itemdb_name_tdb;// name/jname substrings -> nameid
+
 struct item_data dummy_item; //This is the default dummy item used for non-existant items. [Skotlex]
 
-/**
- * OŌp
- * name = item alias, so we should find items aliases first. if not found then look for "jname" (full name)
- * @see DBApply
- */
-static int itemdb_searchname_sub(DBKey key, DBData *data, va_list ap)
+/// Adds an item's names to the name indexes.
+/// The first item added under a name keeps it.
+static void itemdb_nameindex_add(struct item_data* item)
 {
-	struct item_data *item = db_data2ptr(data), **dst, **dst2;
-	char *str;
-	str=va_arg(ap,char *);
-	dst=va_arg(ap,struct item_data **);
-	dst2=va_arg(ap,struct item_data **);
-	if(item == &dummy_item) return 0;
+	if( !strdb_exists(itemdb_name_db, item->name) )
+		strdb_put(itemdb_name_db, item->name, item);
+	if( !strdb_exists(itemdb_jname_db, item->jname) )
+		strdb_put(itemdb_jname_db, item->jname, item);
+	trigramdb_add(&itemdb_name_tdb, item->name, item->nameid);
+	trigramdb_add(&itemdb_name_tdb, item->jname, item->nameid);
+}
+
+/// (Re)builds the name indexes, in the same order the item tables are searched.
+static void itemdb_build_nameindex(void)
+{
+	DBIterator* iter;
+	struct item_data* item;
+	int i;
 
-	//Absolute priority to Aegis code name.
-	if (*dst != NULL) return 0;
-	if( strcmpi(item->name,str)==0 )
-		*dst=item;
+	db_clear(itemdb_name_db);
+	db_clear(itemdb_jname_db);
+	trigramdb_clear(&itemdb_name_tdb);
 
-	//Second priority to Client displayed name.
-	if (*dst2 != NULL) return 0;
-	if( strcmpi(item->jname,str)==0 )
-		*dst2=item;
-	return 0;
+	for( i = 0; i < ARRAYLENGTH(itemdb_array); ++i )
+		if( itemdb_array[i] )
+			itemdb_nameindex_add(itemdb_array[i]);
+
+	iter = db_iterator(itemdb_other);
+	for( item = dbi_first(iter); dbi_exists(iter); item = dbi_next(iter) )
+		if( item != &dummy_item )
+			itemdb_nameindex_add(item);
+	dbi_destroy(iter);
 }
 
 /*==========================================
- * OŌ
+ * Searches an item by exact name (case-insensitive).
  *------------------------------------------*/
 struct item_data* itemdb_searchname(const char *str)
 {
 	struct item_data* item;
-	struct item_data* item2=NULL;
-	int i;
-
-	for( i = 0; i < ARRAYLENGTH(itemdb_array); ++i )
-	{
-		item = itemdb_array[i];
-		if( item == NULL )
-			continue;
 
-		// Absolute priority to Aegis code name.
-		if( strcasecmp(item->name,str) == 0 )
-			return item;
+	// Absolute priority to Aegis code name.
+	if( ( item = (struct item_data*)strdb_get(itemdb_name_db, str) ) != NULL )
+		return item;
 
-		//Second priority to Client displayed name.
-		if( strcasecmp(item->jname,str) == 0 )
-			item2 = item;
-	}
-
-	item = NULL;
-	itemdb_other->foreach(itemdb_other,itemdb_searchname_sub,str,&item,&item2);
-	return item?item:item2;
+	//Second priority to Client displayed name.
+	return (struct item_data*)strdb_get(itemdb_jname_db, str);
 }
 
 /**
@@ -102,8 +100,26 @@ static int itemdb_searchname_array_sub(DBKey key, DBData data, va_list ap)
 int itemdb_searchname_array(struct item_data** data, int size, const char *str)
 {
 	struct item_data* item;
-	int i;
+	int i, n;
 	int count=0;
+	const int* ids = trigramdb_candidates(&itemdb_name_tdb, str, &n);
+
+	if( ids != NULL )
+	{// only the items sharing the rarest piece of str
+		for( i = 0; i < n; ++i )
+		{
+			if( ( item = itemdb_exists(ids[i]) ) == NULL )
+				continue;
+
+			if( stristr(item->jname,str) || stristr(item->name,str) )
+			{
+				if( count < size )
+					data[count] = item;
+				++count;
+			}
+		}
+		return count;
+	}
 
 	// Search in the array
 	for( i = 0; i < ARRAYLENGTH(itemdb_array); ++i )
@@ -1257,6 +1273,8 @@ static void itemdb_read(void) {
 	sv_readdb(db_path, "item_delay.txt",         ',', 2, 2, -1, &itemdb_read_itemdelay);
 	sv_readdb(db_path, "item_stack.txt",         ',', 3, 3, -1, &itemdb_read_stack);
 	sv_readdb(db_path, DBPATH"item_buyingstore.txt",   ',', 1, 1, -1, &itemdb_read_buyingstore);	
+
+	itemdb_build_nameindex();
 }
 
 /*==========================================
@@ -1385,11 +1403,17 @@ void do_final_itemdb(void)
 
 	itemdb_other->destroy(itemdb_other, itemdb_final_sub);
 	destroy_item_data(&dummy_item, 0);
+	db_destroy(itemdb_name_db);
+	db_destroy(itemdb_jname_db);
+	trigramdb_final(&itemdb_name_tdb);
 }
 
 int do_init_itemdb(void) {
 	memset(itemdb_array, 0, sizeof(itemdb_array));
 	itemdb_other = idb_alloc(DB_OPT_BASE);
+	itemdb_name_db = stridb_alloc(DB_OPT_BASE, ITEM_NAME_LENGTH);
+	itemdb_jname_db = stridb_alloc(DB_OPT_BASE, ITEM_NAME_LENGTH);
+	trigramdb_init(&itemdb_name_tdb);
 	create_dummy_data(); //Dummy data item.
 	itemdb_read();
 
@@ -2,10 +2,13 @@
 // For more information, see LICENCE in the main folder
 
 #include "../common/cbasetypes.h"
+#include "../common/malloc.h"
 #include "../common/sql.h" // SQL_INNODB
 #include "../common/strlib.h"
 #include "../common/nullpo.h"
 #include "../common/showmsg.h"
+#include "../common/timer.h"
+#include "../common/utils.h"
 #include "battle.h"
 #include "itemdb.h"
 #include "log.h"
@@ -13,9 +16,11 @@
 #include "mob.h"
 #include "pc.h"
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 
 /// filters for item logging
@@ -51,6 +56,293 @@ struct Log_Config log_config;
 #endif
 
 
+/// buffered log targets
+typedef enum e_log_buffer
+{
+	LOG_BUFFER_BRANCH,
+	LOG_BUFFER_PICK,
+	LOG_BUFFER_ZENY,
+	LOG_BUFFER_MVPDROP,
+	LOG_BUFFER_GM,
+	LOG_BUFFER_NPC,
+	LOG_BUFFER_CHAT,
+	LOG_BUFFER_MAX
+}
+e_log_buffer;
+
+/// column list of each log table, the first column always receives the log time
+static const char* log_buffer_columns[LOG_BUFFER_MAX] =
+{
+	"(`branch_date`, `account_id`, `char_id`, `char_name`, `map`)",
+	"(`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`)",
+	"(`time`, `char_id`, `src_id`, `type`, `amount`, `map`)",
+	"(`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`)",
+	"(`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`)",
+	"(`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`)",
+	"(`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`)",
+};
+
+/// number of columns in log_buffer_columns
+static const int log_buffer_num_columns[LOG_BUFFER_MAX] = { 5, 11, 6, 6, 6, 6, 10 };
+
+/// maximum size of a pending file chunk before it is flushed (bytes)
+#define LOG_BUFFER_MAX_SIZE 65536
+/// upper limit of log_buffer_rows (a batch must stay below the 65535 placeholders of a statement)
+#define LOG_BUFFER_MAX_ROWS 1000
+
+/// value of a buffered sql log row
+struct s_log_param
+{
+	SqlDataType type; // SQLDT_INT or SQLDT_STRING
+	int val;
+	size_t offset, length; // string in the text of the buffer
+};
+
+/// rows waiting to be written to a log table or file
+static struct s_log_buffer
+{
+	StringBuf text; // text lines (file) or the string values of the rows (sql)
+	struct s_log_param* params; // values of the rows (sql), buffer_rows * columns
+	int count;
+	FILE* fp; // file logs are kept open between flushes
+}
+log_buffer[LOG_BUFFER_MAX];
+
+static int log_buffer_timer_id = INVALID_TIMER;
+
+/// Inserts of the log tables, one for a single row and one for a full batch of buffer_rows rows.
+/// Cached in logmysql_handle with these ids (see Sql_GetStmt) or registered in logmysql_async.
+#define LOG_STMT_ROW(type) (type)
+#define LOG_STMT_BATCH(type) (LOG_BUFFER_MAX + (type))
+static int log_async_stmt[LOG_BUFFER_MAX*2];
+
+
+/// obtain the table or file name of a log target
+static const char* log_buffer_name(e_log_buffer type)
+{
+	switch( type )
+	{
+		case LOG_BUFFER_BRANCH:  return log_config.log_branch;
+		case LOG_BUFFER_PICK:    return log_config.log_pick;
+		case LOG_BUFFER_ZENY:    return log_config.log_zeny;
+		case LOG_BUFFER_MVPDROP: return log_config.log_mvpdrop;
+		case LOG_BUFFER_GM:      return log_config.log_gm;
+		case LOG_BUFFER_NPC:     return log_config.log_npc;
+		case LOG_BUFFER_CHAT:    return log_config.log_chat;
+	}
+	return "";
+}
+
+
+/// builds the insert of 'rows' rows into a log table
+static void log_buffer_query(StringBuf* buf, e_log_buffer type, int rows)
+{
+	int i, j;
+
+	StringBuf_Printf(buf, LOG_QUERY " INTO `%s` %s VALUES ", log_buffer_name(type), log_buffer_columns[type]);
+	for( i = 0; i < rows; ++i )
+	{
+		StringBuf_AppendStr(buf, i ? ",(?" : "(?");
+		for( j = 1; j < log_buffer_num_columns[type]; ++j )
+			StringBuf_AppendStr(buf, ",?");
+		StringBuf_AppendStr(buf, ")");
+	}
+}
+
+
+/// obtain the statement that inserts 'rows' rows (1 or buffer_rows) into a log table
+static int log_buffer_async_stmt(e_log_buffer type, int rows)
+{
+	int id = ( rows == 1 ? LOG_STMT_ROW(type) : LOG_STMT_BATCH(type) );
+
+	if( log_async_stmt[id] == SQL_ERROR )
+	{// registered on first use
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		log_buffer_query(&buf, type, rows);
+		log_async_stmt[id] = SqlAsync_Prepare(logmysql_async, "%s", StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+	}
+	return log_async_stmt[id];
+}
+
+
+/// obtain the cached statement of logmysql_handle that inserts 'rows' rows (1 or buffer_rows) into a log table
+static SqlStmt* log_buffer_stmt(e_log_buffer type, int rows)
+{
+	int id = ( rows == 1 ? LOG_STMT_ROW(type) : LOG_STMT_BATCH(type) );
+	SqlStmt* stmt;
+
+	if( (stmt = Sql_GetStmt(logmysql_handle, id)) == NULL )
+	{
+		StringBuf buf;
+
+		StringBuf_Init(&buf);
+		log_buffer_query(&buf, type, rows);
+		stmt = Sql_PrepareStmtStr(logmysql_handle, id, StringBuf_Value(&buf));
+		StringBuf_Destroy(&buf);
+	}
+	return stmt;
+}
+
+
+/// inserts 'rows' buffered rows starting at 'first'
+static void log_buffer_execute(e_log_buffer type, int first, int rows)
+{
+	struct s_log_buffer* buf = &log_buffer[type];
+	int cols = log_buffer_num_columns[type];
+	char* text = (char*)StringBuf_Value(&buf->text);
+	SqlStmt* stmt = NULL;
+	int i;
+
+	if( logmysql_async == NULL && (stmt = log_buffer_stmt(type, rows)) == NULL )
+		return;
+
+	for( i = 0; i < rows*cols; ++i )
+	{
+		struct s_log_param* param = &buf->params[first*cols + i];
+		void* buffer = ( param->type == SQLDT_STRING ? (void*)(text + param->offset) : (void*)&param->val );
+
+		if( stmt != NULL )
+			SqlStmt_BindParam(stmt, i, param->type, buffer, param->length);
+		else
+			SqlAsync_BindParam(logmysql_async, i, param->type, buffer, param->length);
+	}
+
+	if( stmt == NULL )
+		SqlAsync_Execute(logmysql_async, log_buffer_async_stmt(type, rows), SQLASYNC_NONE, NULL, 0);
+	else if( SQL_ERROR == SqlStmt_Execute(stmt) )
+		SqlStmt_ShowDebug(stmt);
+}
+
+
+/// writes all pending rows of a log target as a single batch insert or file write
+static void log_buffer_flush(e_log_buffer type)
+{
+	struct s_log_buffer* buf = &log_buffer[type];
+
+	if( buf->count == 0 )
+		return;
+
+	if( log_config.sql_logs )
+	{
+		if( buf->count == log_config.buffer_rows )
+			log_buffer_execute(type, 0, buf->count);
+		else
+		{// partial batch (timer or shutdown), row by row
+			int i;
+
+			for( i = 0; i < buf->count; ++i )
+				log_buffer_execute(type, i, 1);
+		}
+	}
+	else
+	{
+		if( buf->fp == NULL )
+			buf->fp = fopen(log_buffer_name(type), "a");
+		if( buf->fp != NULL )
+		{
+			fwrite(StringBuf_Value(&buf->text), 1, StringBuf_Length(&buf->text), buf->fp);
+			fflush(buf->fp);
+		}
+	}
+
+	StringBuf_Clear(&buf->text);
+	buf->count = 0;
+}
+
+
+/// adds a string value to the current row of a sql log
+static void log_buffer_string(struct s_log_buffer* buf, struct s_log_param* param, const char* str, size_t length)
+{
+	param->type = SQLDT_STRING;
+	param->offset = StringBuf_Length(&buf->text);
+	param->length = length;
+	StringBuf_AppendStr(&buf->text, str);
+}
+
+
+/// queues a row of a sql log, flushing the target once it reaches the configured size.
+/// The time column is filled in, 'types' describes the other values:
+/// 'd' int, 'c' char, 's' string (NULL is stored as an empty string)
+static void log_buffer_bind(e_log_buffer type, const char* types, ...)
+{
+	struct s_log_buffer* buf = &log_buffer[type];
+	struct s_log_param* param = &buf->params[buf->count*log_buffer_num_columns[type]];
+	char timestring[255];
+	time_t curtime;
+	va_list ap;
+
+	time(&curtime);
+	strftime(timestring, sizeof(timestring), "%Y-%m-%d %H:%M:%S", localtime(&curtime));
+	log_buffer_string(buf, param++, timestring, strlen(timestring));
+
+	va_start(ap, types);
+	for( ; *types; ++types, ++param )
+	{
+		switch( *types )
+		{
+		case 'd':
+			param->type = SQLDT_INT;
+			param->val = va_arg(ap, int);
+			param->length = 0;
+			break;
+		case 'c':
+			{
+				char c[2] = { (char)va_arg(ap, int), '\0' };
+				log_buffer_string(buf, param, c, 1);
+			}
+			break;
+		case 's':
+			{
+				const char* str = va_arg(ap, const char*);
+				if( str == NULL )
+					str = "";
+				log_buffer_string(buf, param, str, strlen(str));
+			}
+			break;
+		}
+	}
+	va_end(ap);
+
+	if( ++buf->count >= log_config.buffer_rows )
+		log_buffer_flush(type);
+}
+
+
+/// queues a line of a file log, flushing the target once it reaches the configured size
+static void log_buffer_add(e_log_buffer type, const char* fmt, ...)
+{
+	struct s_log_buffer* buf = &log_buffer[type];
+	char timestring[255];
+	time_t curtime;
+	va_list ap;
+
+	time(&curtime);
+	strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
+	StringBuf_Printf(&buf->text, "%s - ", timestring);
+	va_start(ap, fmt);
+	StringBuf_Vprintf(&buf->text, fmt, ap);
+	va_end(ap);
+	StringBuf_AppendStr(&buf->text, "\n");
+
+	if( ++buf->count >= log_config.buffer_rows || StringBuf_Length(&buf->text) >= LOG_BUFFER_MAX_SIZE )
+		log_buffer_flush(type);
+}
+
+
+/// periodically writes the pending rows of all logs
+static int log_buffer_timer(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int i;
+
+	for( i = 0; i < LOG_BUFFER_MAX; ++i )
+		log_buffer_flush((e_log_buffer)i);
+	return 0;
+}
+
+
 /// obtain log type character for item/zeny logs
 static char log_picktype2char(e_log_pick_type type)
 {
@@ -136,39 +428,10 @@ void log_branch(struct map_session_data* sd)
 	if( !log_config.branch )
 		return;
 
-	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', '%s', '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex));
-		queryThread_log(entry,e_length);
-#else
-		SqlStmt* stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', ?, '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
-	}
+	if( log_config.sql_logs )
+		log_buffer_bind(LOG_BUFFER_BRANCH, "ddss", sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex));
 	else
-	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_branch, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp,"%s - %s[%d:%d]\t%s\n", timestring, sd->status.name, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex));
-		fclose(logfp);
-	}
+		log_buffer_add(LOG_BUFFER_BRANCH, "%s[%d:%d]\t%s", sd->status.name, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex));
 }
 
 /// logs item transactions (generic)
@@ -184,35 +447,10 @@ void log_pick(int id, int m, e_log_pick_type type, int amount, struct item* itm)
 		return; //we skip logging this item set - it doesn't meet our logging conditions [Lupus]
 
 	if( log_config.sql_logs )
-	{
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`) VALUES (NOW(), '%d', '%c', '%d', '%d', '%d', '%d', '%d', '%d', '%d', '%s')",
-				log_config.log_pick, id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], map[m].name?map[m].name:"" );
-		queryThread_log(entry,e_length);
-#else
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `card0`, `card1`, `card2`, `card3`, `map`) VALUES (NOW(), '%d', '%c', '%d', '%d', '%d', '%d', '%d', '%d', '%d', '%s')",
-			log_config.log_pick, id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], map[m].name?map[m].name:"") )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
-#endif
-	}
+		log_buffer_bind(LOG_BUFFER_PICK, "dcddddddds",
+			id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], map[m].name);
 	else
-	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_pick, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp,"%s - %d\t%c\t%d,%d,%d,%d,%d,%d,%d,%s\n", timestring, id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], map[m].name?map[m].name:"");
-		fclose(logfp);
-	}
+		log_buffer_add(LOG_BUFFER_PICK, "%d\t%c\t%d,%d,%d,%d,%d,%d,%d,%s", id, log_picktype2char(type), itm->nameid, amount, itm->refine, itm->card[0], itm->card[1], itm->card[2], itm->card[3], map[m].name);
 }
 
 /// logs item transactions (players)
@@ -239,35 +477,9 @@ void log_zeny(struct map_session_data* sd, e_log_pick_type type, struct map_sess
 		return;
 
 	if( log_config.sql_logs )
-	{
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry,  LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-				log_config.log_zeny, sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex));
-		queryThread_log(entry,e_length);
-#else
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-			log_config.log_zeny, sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
-#endif
-	}
+		log_buffer_bind(LOG_BUFFER_ZENY, "ddcds", sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex));
 	else
-	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_zeny, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %s[%d]\t%s[%d]\t%d\t\n", timestring, src_sd->status.name, src_sd->status.account_id, sd->status.name, sd->status.account_id, amount);
-		fclose(logfp);
-	}
+		log_buffer_add(LOG_BUFFER_ZENY, "%s[%d]\t%s[%d]\t%d\t", src_sd->status.name, src_sd->status.account_id, sd->status.name, sd->status.account_id, amount);
 }
 
 
@@ -280,35 +492,9 @@ void log_mvpdrop(struct map_session_data* sd, int monster_id, int* log_mvp)
 		return;
 
 	if( log_config.sql_logs )
-	{
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry,  LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%d', '%d', '%s') ",
-						   log_config.log_mvpdrop, sd->status.char_id, monster_id, log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex));
-		queryThread_log(entry,e_length);
-#else		
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%d', '%d', '%s') ",
-			log_config.log_mvpdrop, sd->status.char_id, monster_id, log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
-#endif
-	}
+		log_buffer_bind(LOG_BUFFER_MVPDROP, "dddds", sd->status.char_id, monster_id, log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex));
 	else
-	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_mvpdrop,"a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp,"%s - %s[%d:%d]\t%d\t%d,%d\n", timestring, sd->status.name, sd->status.account_id, sd->status.char_id, monster_id, log_mvp[0], log_mvp[1]);
-		fclose(logfp);
-	}
+		log_buffer_add(LOG_BUFFER_MVPDROP, "%s[%d:%d]\t%d\t%d,%d", sd->status.name, sd->status.account_id, sd->status.char_id, monster_id, log_mvp[0], log_mvp[1]);
 }
 
 
@@ -322,41 +508,9 @@ void log_atcommand(struct map_session_data* sd, const char* message)
 		return;
 
 	if( log_config.sql_logs )
-	{
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry,  LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', '%s', '%s', '%s')", log_config.log_gm, sd->status.account_id, sd->status.char_id, sd->status.name ,mapindex_id2name(sd->mapindex), message);
-		queryThread_log(entry,e_length);
-#else				
-		SqlStmt* stmt;
-
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_gm, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
-	}
+		log_buffer_bind(LOG_BUFFER_GM, "ddsss", sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex), message);
 	else
-	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_gm, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %s[%d]: %s\n", timestring, sd->status.name, sd->status.account_id, message);
-		fclose(logfp);
-	}
+		log_buffer_add(LOG_BUFFER_GM, "%s[%d]: %s", sd->status.name, sd->status.account_id, message);
 }
 
 
@@ -369,40 +523,9 @@ void log_npc(struct map_session_data* sd, const char* message)
 		return;
 
 	if( log_config.sql_logs )
-	{
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', '%s', '%s', '%s')", log_config.log_npc, sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex), message );
-		queryThread_log(entry,e_length);
-#else						
-		SqlStmt* stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_npc, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
-	}
+		log_buffer_bind(LOG_BUFFER_NPC, "ddsss", sd->status.account_id, sd->status.char_id, sd->status.name, mapindex_id2name(sd->mapindex), message);
 	else
-	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_npc, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %s[%d]: %s\n", timestring, sd->status.name, sd->status.account_id, message);
-		fclose(logfp);
-	}
+		log_buffer_add(LOG_BUFFER_NPC, "%s[%d]: %s", sd->status.name, sd->status.account_id, message);
 }
 
 
@@ -419,40 +542,60 @@ void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid,
 		return;
 	}
 
-	if( log_config.sql_logs ) {
-#ifdef BETA_THREAD_TEST
-		char entry[512];
-		int e_length = 0;
-		e_length = sprintf(entry, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', '%s', '%s')", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, map, x, y, dst_charname, message );
-		queryThread_log(entry,e_length);
-#else		
-		SqlStmt* stmt;
-
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', ?, ?)", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, map, x, y)
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, (char*)dst_charname, safestrnlen(dst_charname, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, CHAT_SIZE_MAX))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
-#endif
-	}
+	if( log_config.sql_logs )
+		log_buffer_bind(LOG_BUFFER_CHAT, "cdddsddss", log_chattype2char(type), type_id, src_charid, src_accid, map, x, y, dst_charname, message);
 	else
+		log_buffer_add(LOG_BUFFER_CHAT, "%c,%d,%d,%d,%s,%d,%d,%s,%s", log_chattype2char(type), type_id, src_charid, src_accid, map, x, y, dst_charname, message);
+}
+
+
+void do_init_log(void)
+{
+	int i;
+
+	log_config.buffer_rows = cap_value(log_config.buffer_rows, 1, LOG_BUFFER_MAX_ROWS);
+	for( i = 0; i < LOG_BUFFER_MAX; ++i )
+	{
+		StringBuf_Init(&log_buffer[i].text);
+		log_buffer[i].params = NULL;
+		if( log_config.sql_logs )
+			CREATE(log_buffer[i].params, struct s_log_param, log_config.buffer_rows*log_buffer_num_columns[i]);
+		log_buffer[i].count = 0;
+		log_buffer[i].fp = NULL;
+	}
+	for( i = 0; i < ARRAYLENGTH(log_async_stmt); ++i )
+		log_async_stmt[i] = SQL_ERROR;
+
+	add_timer_func_list(log_buffer_timer, "log_buffer_timer");
+	if( log_config.buffer_interval > 0 )
+		log_buffer_timer_id = add_timer_interval(gettick() + log_config.buffer_interval, log_buffer_timer, 0, 0, log_config.buffer_interval);
+}
+
+
+void do_final_log(void)
+{
+	int i;
+
+	if( log_buffer_timer_id != INVALID_TIMER )
+	{
+		delete_timer(log_buffer_timer_id, log_buffer_timer);
+		log_buffer_timer_id = INVALID_TIMER;
+	}
+
+	for( i = 0; i < LOG_BUFFER_MAX; ++i )
 	{
-		char timestring[255];
-		time_t curtime;
-		FILE* logfp;
-
-		if( ( logfp = fopen(log_config.log_chat, "a") ) == NULL )
-			return;
-		time(&curtime);
-		strftime(timestring, sizeof(timestring), "%m/%d/%Y %H:%M:%S", localtime(&curtime));
-		fprintf(logfp, "%s - %c,%d,%d,%d,%s,%d,%d,%s,%s\n", timestring, log_chattype2char(type), type_id, src_charid, src_accid, map, x, y, dst_charname, message);
-		fclose(logfp);
+		log_buffer_flush((e_log_buffer)i);
+		StringBuf_Destroy(&log_buffer[i].text);
+		if( log_buffer[i].params != NULL )
+		{
+			aFree(log_buffer[i].params);
+			log_buffer[i].params = NULL;
+		}
+		if( log_buffer[i].fp != NULL )
+		{
+			fclose(log_buffer[i].fp);
+			log_buffer[i].fp = NULL;
+		}
 	}
 }
 
@@ -466,6 +609,9 @@ void log_set_defaults(void)
 	log_config.rare_items_log   = 100;  // log rare items. drop chance <= 1%
 	log_config.price_items_log  = 1000; // 1000z
 	log_config.amount_items_log = 100;
+
+	log_config.buffer_rows = 50;
+	log_config.buffer_interval = 1000;
 }
 
 
@@ -519,6 +665,10 @@ int log_config_read(const char* cfgName)
 				log_config.chat = config_switch(w2);
 			else if( strcmpi(w1, "log_mvpdrop") == 0 )
 				log_config.mvpdrop = config_switch(w2);
+			else if( strcmpi(w1, "log_buffer_rows") == 0 )
+				log_config.buffer_rows = atoi(w2);
+			else if( strcmpi(w1, "log_buffer_interval") == 0 )
+				log_config.buffer_interval = atoi(w2);
 			else if( strcmpi(w1, "log_chat_woe_disable") == 0 )
 				log_config.log_chat_woe_disable = (bool)config_switch(w2);
 			else if( strcmpi(w1, "log_branch_db") == 0 )
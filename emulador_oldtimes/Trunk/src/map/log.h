@@ -67,6 +67,9 @@ void log_mvpdrop(struct map_session_data* sd, int monster_id, int* log_mvp);
 
 int log_config_read(const char* cfgName);
 
+void do_init_log(void);
+void do_final_log(void);
+
 extern struct Log_Config
 {
 	e_log_pick_type enable_logs;
@@ -75,15 +78,9 @@ extern struct Log_Config
 	bool log_chat_woe_disable;
 	int rare_items_log,refine_items_log,price_items_log,amount_items_log; //for filter
 	int branch, mvpdrop, zeny, commands, npc, chat;
+	int buffer_rows, buffer_interval; // rows are written in batches of buffer_rows or every buffer_interval ms
 	char log_branch[64], log_pick[64], log_zeny[64], log_mvpdrop[64], log_gm[64], log_npc[64], log_chat[64];
 }
 log_config;
 
-#ifdef BETA_THREAD_TEST
-	struct {
-		char** entry;
-		int count;
-	} logThreadData;
-#endif
-
 #endif /* _LOG_H_ */
@@ -3,6 +3,7 @@
 
 #include "../common/cbasetypes.h"
 #include "../common/core.h"
+#include "../common/ers.h"
 #include "../common/timer.h"
 #include "../common/grfio.h"
 #include "../common/malloc.h"
@@ -45,6 +46,7 @@
 #include "atcommand.h"
 #include "log.h"
 #include "mail.h"
+#include "combat_test.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -80,6 +82,12 @@ char log_db_pw[32] = "ragnarok";
 char log_db_db[32] = "log";
 Sql* logmysql_handle;
 
+// asynchronous sql execution (query_sql_async, logs, mapreg)
+int async_sql_threads = 2; // worker connections per database, 0 = disabled
+int async_sql_queue = 4096; // maximum pending queries per database
+SqlAsync* mmysql_async = NULL;
+SqlAsync* logmysql_async = NULL;
+
 // This param using for sending mainchat
 // messages like whispers to this nick. [LuzZza]
 char main_chat_nick[16] = "Main";
@@ -102,12 +110,14 @@ static DBMap* map_db=NULL; // unsigned int mapindex -> struct map_data*
 static DBMap* nick_db=NULL; // int char_id -> struct charid2nick* (requested names of offline characters)
 static DBMap* charid_db=NULL; // int char_id -> struct map_session_data*
 static DBMap* regen_db=NULL; // int id -> struct block_list* (status_natural_heal processing)
+static ERS flooritem_ers=NULL; // struct flooritem_data
 
 static int map_users=0;
 
 #define BLOCK_SIZE 8
 #define block_free_max 1048576
 struct block_list *block_free[block_free_max];
+static ERS block_free_ers[block_free_max]; // entry manager of each block_free entry, NULL for the heap
 static int block_free_count = 0, block_free_lock = 0;
 
 #define BL_LIST_MAX 1048576
@@ -120,6 +130,7 @@ int map_port=0;
 
 int autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
 int minsave_interval = 100;
+int autosave_max_pending = 16;
 int save_settings = 0xFFFF;
 int agit_flag = 0;
 int agit2_flag = 0;
@@ -191,16 +202,27 @@ int map_usercount(void)
  * bNĂƂ̓obt@ɂ߂
  *------------------------------------------*/
 int map_freeblock (struct block_list *bl)
+{
+	return map_freeblock_ers(bl, NULL);
+}
+
+/// Same as map_freeblock, for a block allocated from the entry manager 'ers' (NULL for the heap).
+int map_freeblock_ers (struct block_list *bl, ERS ers)
 {
 	nullpo_retr(block_free_lock, bl);
 	if (block_free_lock == 0 || block_free_count >= block_free_max)
 	{
-		aFree(bl);
+		if( ers )
+			ers_free(ers, bl);
+		else
+			aFree(bl);
 		bl = NULL;
 		if (block_free_count >= block_free_max)
 			ShowWarning("map_freeblock: too many free block! %d %d\n", block_free_count, block_free_lock);
-	} else
+	} else {
+		block_free_ers[block_free_count] = ers;
 		block_free[block_free_count++] = bl;
+	}
 
 	return block_free_lock;
 }
@@ -223,8 +245,12 @@ int map_freeblock_unlock (void)
 		int i;
 		for (i = 0; i < block_free_count; i++)
 		{
-			aFree(block_free[i]);
+			if( block_free_ers[i] )
+				ers_free(block_free_ers[i], block_free[i]);
+			else
+				aFree(block_free[i]);
 			block_free[i] = NULL;
+			block_free_ers[i] = NULL;
 		}
 		block_free_count = 0;
 	} else if (block_free_lock < 0) {
@@ -327,6 +353,12 @@ int map_addblock(struct block_list* bl)
 #ifdef CELL_NOSTACK
 	map_addblcell(bl);
 #endif
+
+	if( bl->type == BL_PC )
+	{// guild/party minimap dots
+		guild_xy_dirty((TBL_PC*)bl);
+		party_xy_dirty((TBL_PC*)bl);
+	}
 	
 	return 0;
 }
@@ -422,6 +454,12 @@ int map_moveblock(struct block_list *bl, int x1, int y1, unsigned int tick)
 
 		skill_unit_move(bl,tick,3);
 
+		if( bl->type == BL_PC )
+		{// guild/party minimap dots
+			guild_xy_dirty((TBL_PC*)bl);
+			party_xy_dirty((TBL_PC*)bl);
+		}
+
 		if( bl->type == BL_PC && ((TBL_PC*)bl)->shadowform_id ) {//Shadow Form Target Moving
 			struct block_list *d_bl;
 			if( (d_bl = map_id2bl(((TBL_PC*)bl)->shadowform_id)) == NULL || bl->m != d_bl->m || !check_distance_bl(bl,d_bl,skill_get_range(SC_SHADOWFORM,1)) ) {
@@ -1349,7 +1387,7 @@ int map_clearflooritem_timer(int tid, unsigned int tick, int id, intptr_t data)
 	clif_clearflooritem(fitem,0);
 	map_deliddb(&fitem->bl);
 	map_delblock(&fitem->bl);
-	map_freeblock(&fitem->bl);
+	map_freeblock_ers(&fitem->bl, flooritem_ers);
 
 	return 0;
 }
@@ -1485,7 +1523,8 @@ int map_addflooritem(struct item *item_data,int amount,int m,int x,int y,int fir
 		return 0;
 	r=rnd();
 
-	CREATE(fitem, struct flooritem_data, 1);
+	fitem = ers_alloc(flooritem_ers, struct flooritem_data);
+	memset(fitem, 0, sizeof(struct flooritem_data));
 	fitem->bl.type=BL_ITEM;
 	fitem->bl.prev = fitem->bl.next = NULL;
 	fitem->bl.m=m;
@@ -1493,7 +1532,7 @@ int map_addflooritem(struct item *item_data,int amount,int m,int x,int y,int fir
 	fitem->bl.y=y;
 	fitem->bl.id = map_get_new_object_id();
 	if(fitem->bl.id==0){
-		aFree(fitem);
+		ers_free(flooritem_ers, fitem);
 		return 0;
 	}
 
@@ -1619,6 +1658,7 @@ void map_addiddb(struct block_list *bl)
 		TBL_PC* sd = (TBL_PC*)bl;
 		idb_put(pc_db,sd->bl.id,sd);
 		idb_put(charid_db,sd->status.char_id,sd);
+		pc_autosave_add(sd);
 	}
 	else if( bl->type == BL_MOB )
 	{
@@ -1647,6 +1687,7 @@ void map_deliddb(struct block_list *bl)
 		TBL_PC* sd = (TBL_PC*)bl;
 		idb_remove(pc_db,sd->bl.id);
 		idb_remove(charid_db,sd->status.char_id);
+		pc_autosave_remove(sd);
 	}
 	else if( bl->type == BL_MOB )
 	{
@@ -2810,6 +2851,42 @@ int map_eraseipport(unsigned short mapindex, uint32 ip, uint16 port)
 	return 0;
 }
 
+/// Sends a player on a map handed off to another map-server there.
+static int map_handoff_sub(struct block_list *bl, va_list ap)
+{
+	struct map_session_data *sd = (struct map_session_data *)bl;
+	pc_setpos(sd, sd->mapindex, sd->bl.x, sd->bl.y, CLR_TELEPORT);
+	return 1;
+}
+
+/// The char-server tells which map-server serves mapindex.
+/// If it's a local map served elsewhere, its players are sent there and anyone
+/// warping in is redirected by pc_setpos, until the map is routed back here.
+void map_setroute(unsigned short mapindex, uint32 ip, uint16 port)
+{
+	int m = map_mapindex2mapid(mapindex);
+
+	if( m < 0 )
+	{// not loaded here, just follow the map
+		map_setipport(mapindex, ip, port);
+		return;
+	}
+
+	if( ip == clif_getip() && port == clif_getport() )
+	{
+		if( map[m].handoff.port )
+			ShowStatus("Mapa '"CL_WHITE"%s"CL_RESET"' voltou a ser servido por este map-server.\n", map[m].name);
+		map[m].handoff.ip = 0;
+		map[m].handoff.port = 0;
+		return;
+	}
+
+	map[m].handoff.ip = ip;
+	map[m].handoff.port = port;
+	ShowStatus("Mapa '"CL_WHITE"%s"CL_RESET"' passou para o map-server %u.%u.%u.%u:%u, transferindo "CL_WHITE"%d"CL_RESET" jogadores.\n", map[m].name, CONVIP(ip), port, map[m].users);
+	map_foreachinmap(map_handoff_sub, m, BL_PC);
+}
+
 /*==========================================
  * [Shinryo]: Init the mapcache
  *------------------------------------------*/
@@ -3049,6 +3126,37 @@ void map_removemapdb(struct map_data *m)
 	uidb_remove(map_db, (unsigned int)m->index);
 }
 
+/*======================================
+ * Adds an open field of xs*ys walkable cells that isn't read from the
+ * map cache, for headless runs (see combat_test.c). Returns the map id.
+ *--------------------------------------*/
+int map_addfield(const char* name, short xs, short ys)
+{
+	struct map_data* m;
+	int i, size;
+
+	if( map_num >= MAX_MAP_PER_SERVER )
+		return -1;
+
+	m = &map[map_num];
+	safestrncpy(m->name, name, MAP_NAME_LENGTH);
+	m->m = map_num;
+	m->xs = xs;
+	m->ys = ys;
+	m->cell = (struct mapcell*)aCalloc(xs * ys, sizeof(struct mapcell));
+	for( i = 0; i < xs * ys; i++ )
+		m->cell[i].walkable = m->cell[i].shootable = 1;
+	m->mob_delete_timer = INVALID_TIMER;
+
+	m->bxs = (m->xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	m->bys = (m->ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	size = m->bxs * m->bys * sizeof(struct block_list*);
+	m->block = (struct block_list**)aCalloc(size, 1);
+	m->block_mob = (struct block_list**)aCalloc(size, 1);
+
+	return map_num++;
+}
+
 /*======================================
  * Initiate maps loading stage
  *--------------------------------------*/
@@ -3218,6 +3326,22 @@ int parse_console(const char* buf)
 		{
 			runflag = 0;
 		}
+		else if( strcmpi("autosave", command) == 0 )
+		{
+			pc_autosave_stats();
+		}
+		else if( strcmpi("interstats", command) == 0 )
+		{
+			inter_stats_show();
+		}
+		else if( strcmpi("skillunits", command) == 0 )
+		{
+			skill_unit_pool_stats();
+		}
+		else if( strcmpi("ers", command) == 0 )
+		{
+			ers_report();
+		}
 	}
 	else if( strcmpi("help", type) == 0 )
 	{
@@ -3229,6 +3353,14 @@ int parse_console(const char* buf)
 		ShowInfo("IE: @spawn\n");
 		ShowInfo("To shutdown the server:\n");
 		ShowInfo("  server:shutdown\n");
+		ShowInfo("To show the autosave statistics:\n");
+		ShowInfo("  server:autosave\n");
+		ShowInfo("To show the char-server traffic per packet:\n");
+		ShowInfo("  server:interstats\n");
+		ShowInfo("To show the usage of the skill unit pools:\n");
+		ShowInfo("  server:skillunits\n");
+		ShowInfo("To show the memory pools of the entry managers:\n");
+		ShowInfo("  server:ers\n");
 	}
 
 	return 0;
@@ -3306,6 +3438,10 @@ int map_config_read(char *cfgName)
 			minsave_interval= atoi(w2);
 			if (minsave_interval < 1)
 				minsave_interval = 1;
+		} else if (strcmpi(w1, "autosave_max_pending") == 0) {
+			autosave_max_pending = atoi(w2);
+			if (autosave_max_pending < 1)
+				autosave_max_pending = 1;
 		} else if (strcmpi(w1, "save_settings") == 0)
 			save_settings = atoi(w2);
 		else if (strcmpi(w1, "motd_txt") == 0)
@@ -3465,6 +3601,12 @@ int inter_config_read(char *cfgName)
 		if(strcmpi(w1,"log_db_db")==0)
 			strcpy(log_db_db, w2);
 		else
+		if(strcmpi(w1,"async_sql_threads")==0)
+			async_sql_threads = atoi(w2);
+		else
+		if(strcmpi(w1,"async_sql_queue")==0)
+			async_sql_queue = atoi(w2);
+		else
 		if( mapreg_config_read(w1,w2) )
 			continue;
 		//support the import command, just like any other config
@@ -3494,28 +3636,45 @@ int map_sql_init(void)
 		if ( SQL_ERROR == Sql_SetEncoding(mmysql_handle, default_codepage) )
 			Sql_ShowDebug(mmysql_handle);
 
+	if( async_sql_threads > 0 )
+	{// worker connections for query_sql_async and mapreg
+		mmysql_async = SqlAsync_Malloc("map", async_sql_threads, async_sql_queue);
+		if( SQL_ERROR == SqlAsync_Connect(mmysql_async, map_server_id, map_server_pw, map_server_ip, map_server_port, map_server_db, default_codepage) )
+			exit(EXIT_FAILURE);
+		ShowStatus("Iniciadas %d conexes assncronas com o Servidor de Mapas.\n", async_sql_threads);
+	}
+
 	return 0;
 }
 
 int map_sql_close(void)
 {
 	ShowStatus("Fechada conexo com banco de dados de Mapas....\n");
+	if( mmysql_async )
+	{
+		SqlAsync_ShowStats(mmysql_async);
+		SqlAsync_Free(mmysql_async);
+		mmysql_async = NULL;
+	}
 	Sql_Free(mmysql_handle);
 	mmysql_handle = NULL;
-#ifndef BETA_THREAD_TEST
 	if (log_config.sql_logs)
 	{
 		ShowStatus("Fechada conexo com banco de dados de Logs....\n");
+		if( logmysql_async )
+		{
+			SqlAsync_ShowStats(logmysql_async);
+			SqlAsync_Free(logmysql_async);
+			logmysql_async = NULL;
+		}
 		Sql_Free(logmysql_handle);
 		logmysql_handle = NULL;
 	}
-#endif
 	return 0;
 }
 
 int log_sql_init(void)
 {
-#ifndef BETA_THREAD_TEST
 	// log db connection
 	logmysql_handle = Sql_Malloc();
 
@@ -3527,7 +3686,13 @@ int log_sql_init(void)
 	if( strlen(default_codepage) > 0 )
 		if ( SQL_ERROR == Sql_SetEncoding(logmysql_handle, default_codepage) )
 			Sql_ShowDebug(logmysql_handle);
-#endif
+
+	if( async_sql_threads > 0 )
+	{// worker connections for the logs
+		logmysql_async = SqlAsync_Malloc("log", async_sql_threads, async_sql_queue);
+		if( SQL_ERROR == SqlAsync_Connect(logmysql_async, log_db_id, log_db_pw, log_db_ip, log_db_port, log_db_db, default_codepage) )
+			exit(EXIT_FAILURE);
+	}
 	return 0;
 }
 
@@ -3648,9 +3813,12 @@ void do_final(void)
 	do_final_skill();
 	do_final_status();
 	do_final_unit();
+	do_final_searchstore();
 	do_final_battleground();
 	do_final_duel();
 	do_final_elemental();
+	do_final_quest();
+	do_final_log();
 	
 	map_db->destroy(map_db, map_db_final);
 	
@@ -3678,6 +3846,7 @@ void do_final(void)
 	charid_db->destroy(charid_db, NULL);
 	iwall_db->destroy(iwall_db, NULL);
 	regen_db->destroy(regen_db, NULL);
+	ers_destroy(flooritem_ers);
 
     map_sql_close();
 
@@ -3734,6 +3903,8 @@ static void map_helpscreen(bool do_exit)
 	ShowInfo("  --grf-path <file>\t\tConfigurao alternativa do caminho da GRF.\n");
 	ShowInfo("  --inter-config <file>\t\tConfigurao alternativa do inter-server.\n");
 	ShowInfo("  --log-config <file>\t\tConfigurao alternativa de log.\n");
+	ShowInfo("  --combat-test <file>\t\tExecuta os casos de teste de combate e sai.\n");
+	ShowInfo("  --combat-golden <file>\tGrava ou compara os resultados do teste de combate.\n");
 	if( do_exit )
 		exit(EXIT_SUCCESS);
 }
@@ -3792,6 +3963,8 @@ static bool map_arg_next_value(const char* option, int i, int argc)
 
 int do_init(int argc, char *argv[])
 {
+	const char* combat_test_cases = NULL;
+	const char* combat_test_golden = NULL;
 	int i;
 
 #ifdef GCOLLECT
@@ -3874,6 +4047,16 @@ int do_init(int argc, char *argv[])
 			{
 				runflag = CORE_ST_STOP;
 			}
+			else if( strcmp(arg, "combat-test") == 0 )
+			{
+				if( map_arg_next_value(arg, i, argc) )
+					combat_test_cases = argv[++i];
+			}
+			else if( strcmp(arg, "combat-golden") == 0 )
+			{
+				if( map_arg_next_value(arg, i, argc) )
+					combat_test_golden = argv[++i];
+			}
 			else
 			{
 				ShowError("Opo '%s' desconhecida.\n", argv[i]);
@@ -3938,10 +4121,17 @@ int do_init(int argc, char *argv[])
 	regen_db = idb_alloc(DB_OPT_BASE); // efficient status_natural_heal processing
 
 	iwall_db = strdb_alloc(DB_OPT_RELEASE_DATA,2*NAME_LENGTH+2+1); // [Zephyrus] Invisible Walls
+	flooritem_ers = ers_new(sizeof(struct flooritem_data),"map.c::flooritem_ers",ERS_OPT_CLEAR);
+
+	if( combat_test_cases )
+	{// headless run of the battle formulas, without sql, network or npcs (see combat_test.c)
+		exit(combat_test_run(combat_test_cases, combat_test_golden));
+	}
 
 	map_sql_init();
 	if (log_config.sql_logs)
 		log_sql_init();
+	do_init_log();
 
 	mapindex_init();
 	if(enable_grf)
@@ -3975,6 +4165,7 @@ int do_init(int argc, char *argv[])
 	do_init_quest();
 	do_init_npc();
 	do_init_unit();
+	do_init_searchstore();
 	do_init_battleground();
 	do_init_duel();
 	
@@ -19,6 +19,7 @@
 
 struct npc_data;
 struct item_data;
+struct eri;
 
 enum E_MAPSERVER_ST
 {
@@ -495,6 +496,10 @@ struct map_data {
 	int npc_num;
 	int users;
 	int users_pvp;
+	struct { // map-server that serves this map when it's in standby here (see map_setroute)
+		uint32 ip;
+		uint16 port;
+	} handoff;
 	int iwall_num; // Total of invisible walls in this map
 	struct map_flag {
 		unsigned town : 1; // [Suggestion to protect Mail System]
@@ -596,6 +601,7 @@ extern int map_num;
 
 extern int autosave_interval;
 extern int minsave_interval;
+extern int autosave_max_pending;
 extern int save_settings;
 extern int agit_flag;
 extern int agit2_flag;
@@ -616,6 +622,7 @@ int map_getusers(void);
 int map_usercount(void);
 // block폜֘A
 int map_freeblock(struct block_list *bl);
+int map_freeblock_ers(struct block_list *bl, struct eri *ers);
 int map_freeblock_lock(void);
 int map_freeblock_unlock(void);
 // block֘A
@@ -670,6 +677,7 @@ int map_mapname2mapid(const char* name);
 int map_mapname2ipport(unsigned short name, uint32* ip, uint16* port);
 int map_setipport(unsigned short map, uint32 ip, uint16 port);
 int map_eraseipport(unsigned short map, uint32 ip, uint16 port);
+void map_setroute(unsigned short mapindex, uint32 ip, uint16 port);
 int map_eraseallipport(void);
 void map_addiddb(struct block_list *);
 void map_deliddb(struct block_list *bl);
@@ -724,6 +732,7 @@ void map_spawnmobs(int); // [Wizputer]
 void map_removemobs(int); // [Wizputer]
 void do_reconnect_map(void); //Invoked on map-char reconnection [Skotlex]
 void map_addmap2db(struct map_data *m);
+int map_addfield(const char* name, short xs, short ys);
 void map_removemapdb(struct map_data *m);
 
 extern char *INTER_CONF_NAME;
@@ -753,29 +762,24 @@ typedef struct elemental_data	TBL_ELEM;
 
 extern char main_chat_nick[16];
 
-#ifdef BETA_THREAD_TEST
-
-extern char default_codepage[32];
-extern int map_server_port;
-extern char map_server_ip[32];
-extern char map_server_id[32];
-extern char map_server_pw[32];
-extern char map_server_db[32];
-
-extern char log_db_ip[32];
-extern int log_db_port;
-extern char log_db_id[32];
-extern char log_db_pw[32];
-extern char log_db_db[32];
-
-#endif
-
 #include "../common/sql.h"
 
 extern int db_use_sqldbs;
 
 extern Sql* mmysql_handle;
 extern Sql* logmysql_handle;
+extern SqlAsync* mmysql_async; // NULL when asynchronous execution is disabled
+extern SqlAsync* logmysql_async;
+
+/// Ids of the statements cached in mmysql_handle (see Sql_GetStmt).
+enum e_map_stmt
+{
+	// mapreg writes, in the order of enum mapreg_stmt (mapreg_sql.c)
+	MAP_STMT_MAPREG_INSERT,
+	MAP_STMT_MAPREG_UPDATE,
+	MAP_STMT_MAPREG_DELETE,
+	MAP_STMT_MAX
+};
 
 extern char item_db_db[32];
 extern char item_db2_db[32];
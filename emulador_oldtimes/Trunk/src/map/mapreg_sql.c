@@ -21,6 +21,74 @@ static bool mapreg_dirty = false;
 #define MAPREG_AUTOSAVE_INTERVAL (300*1000)
 
 
+/// Writes of the variables, prepared once per connection.
+/// Cached in mmysql_handle as MAP_STMT_MAPREG_INSERT + id (see Sql_GetStmt).
+enum mapreg_stmt {
+	MAPREG_STMT_INSERT, // varname, index, value
+	MAPREG_STMT_UPDATE, // value, varname, index
+	MAPREG_STMT_DELETE, // varname, index
+	MAPREG_STMT_MAX
+};
+static const char* mapreg_stmt_query[MAPREG_STMT_MAX] = {
+	"INSERT INTO `%s`(`varname`,`index`,`value`) VALUES (?,?,?)",
+	"UPDATE `%s` SET `value`=? WHERE `varname`=? AND `index`=?",
+	"DELETE FROM `%s` WHERE `varname`=? AND `index`=?",
+};
+static int mapreg_async_stmt[MAPREG_STMT_MAX]; // statement ids of mmysql_async
+
+
+/// Executes a write of variable 'name'[index].
+/// The value is 'str' for string variables (NULL for integer ones) or 'val'.
+/// With asynchronous sql it runs in the background, in the same order the writes were made.
+static void mapreg_write(enum mapreg_stmt id, const char* name, int index, const char* str, int val)
+{
+	struct {
+		SqlDataType type;
+		void* buffer;
+		size_t length;
+	} params[3];
+	int n = 0, value = -1, i;
+
+	if( id == MAPREG_STMT_UPDATE )
+		value = n++;
+	params[n].type = SQLDT_STRING; params[n].buffer = (void*)name; params[n].length = strnlen(name, 32); n++;
+	params[n].type = SQLDT_INT; params[n].buffer = &index; params[n].length = 0; n++;
+	if( id == MAPREG_STMT_INSERT )
+		value = n++;
+	if( value >= 0 )
+	{
+		if( str != NULL )
+		{
+			params[value].type = SQLDT_STRING; params[value].buffer = (void*)str; params[value].length = strnlen(str, 255);
+		}
+		else
+		{
+			params[value].type = SQLDT_INT; params[value].buffer = &val; params[value].length = 0;
+		}
+	}
+
+	if( mmysql_async != NULL )
+	{
+		for( i = 0; i < n; ++i )
+			SqlAsync_BindParam(mmysql_async, i, params[i].type, params[i].buffer, params[i].length);
+		SqlAsync_Execute(mmysql_async, mapreg_async_stmt[id], SQLASYNC_SERIAL, NULL, 0);
+	}
+	else
+	{
+		SqlStmt* stmt;
+
+		if( (stmt = Sql_GetStmt(mmysql_handle, MAP_STMT_MAPREG_INSERT + id)) == NULL )
+			stmt = Sql_PrepareStmt(mmysql_handle, MAP_STMT_MAPREG_INSERT + id, mapreg_stmt_query[id], mapreg_table);
+		if( stmt == NULL )
+			return;
+		for( i = 0; i < n; ++i )
+			SqlStmt_BindParam(stmt, i, params[i].type, params[i].buffer, params[i].length);
+		if( SQL_ERROR == SqlStmt_Execute(stmt) )
+			SqlStmt_ShowDebug(stmt);
+	}
+}
+
+
 /// Looks up the value of an integer variable using its uid.
 int mapreg_readreg(int uid)
 {
@@ -46,10 +114,7 @@ bool mapreg_setreg(int uid, int val)
 			mapreg_dirty = true; // already exists, delay write
 		else if(name[1] != '@')
 		{// write new variable to database
-			char tmp_str[32*2+1];
-			Sql_EscapeStringLen(mmysql_handle, tmp_str, name, strnlen(name, 32));
-			if( SQL_ERROR == Sql_Query(mmysql_handle, "INSERT INTO `%s`(`varname`,`index`,`value`) VALUES ('%s','%d','%d')", mapreg_table, tmp_str, i, val) )
-				Sql_ShowDebug(mmysql_handle);
+			mapreg_write(MAPREG_STMT_INSERT, name, i, NULL, val);
 		}
 	}
 	else // val == 0
@@ -58,8 +123,7 @@ bool mapreg_setreg(int uid, int val)
 
 		if( name[1] != '@' )
 		{// Remove from database because it is unused.
-			if( SQL_ERROR == Sql_Query(mmysql_handle, "DELETE FROM `%s` WHERE `varname`='%s' AND `index`='%d'", mapreg_table, name, i) )
-				Sql_ShowDebug(mmysql_handle);
+			mapreg_write(MAPREG_STMT_DELETE, name, i, NULL, 0);
 		}
 	}
 
@@ -76,8 +140,7 @@ bool mapreg_setregstr(int uid, const char* str)
 	if( str == NULL || *str == 0 )
 	{
 		if(name[1] != '@') {
-			if( SQL_ERROR == Sql_Query(mmysql_handle, "DELETE FROM `%s` WHERE `varname`='%s' AND `index`='%d'", mapreg_table, name, i) )
-				Sql_ShowDebug(mmysql_handle);
+			mapreg_write(MAPREG_STMT_DELETE, name, i, NULL, 0);
 		}
 		idb_remove(mapregstr_db,uid);
 	}
@@ -87,12 +150,7 @@ bool mapreg_setregstr(int uid, const char* str)
 			mapreg_dirty = true;
 		else if(name[1] != '@') { //put returned null, so we must insert.
 			// Someone is causing a database size infinite increase here without name[1] != '@' [Lance]
-			char tmp_str[32*2+1];
-			char tmp_str2[255*2+1];
-			Sql_EscapeStringLen(mmysql_handle, tmp_str, name, strnlen(name, 32));
-			Sql_EscapeStringLen(mmysql_handle, tmp_str2, str, strnlen(str, 255));
-			if( SQL_ERROR == Sql_Query(mmysql_handle, "INSERT INTO `%s`(`varname`,`index`,`value`) VALUES ('%s','%d','%s')", mapreg_table, tmp_str, i, tmp_str2) )
-				Sql_ShowDebug(mmysql_handle);
+			mapreg_write(MAPREG_STMT_INSERT, name, i, str, 0);
 		}
 	}
 
@@ -159,8 +217,7 @@ static void script_save_mapreg(void)
 		if( name[1] == '@' )
 			continue;
 
-		if( SQL_ERROR == Sql_Query(mmysql_handle, "UPDATE `%s` SET `value`='%d' WHERE `varname`='%s' AND `index`='%d'", mapreg_table, db_data2i(data), name, i) )
-			Sql_ShowDebug(mmysql_handle);
+		mapreg_write(MAPREG_STMT_UPDATE, name, i, NULL, db_data2i(data));
 	}
 	dbi_destroy(iter);
 
@@ -170,14 +227,11 @@ static void script_save_mapreg(void)
 		int num = (key.i & 0x00ffffff);
 		int i   = (key.i & 0xff000000) >> 24;
 		const char* name = get_str(num);
-		char tmp_str2[2*255+1];
 
 		if( name[1] == '@' )
 			continue;
 
-		Sql_EscapeStringLen(mmysql_handle, tmp_str2, db_data2ptr(data), safestrnlen(db_data2ptr(data), 255));
-		if( SQL_ERROR == Sql_Query(mmysql_handle, "UPDATE `%s` SET `value`='%s' WHERE `varname`='%s' AND `index`='%d'", mapreg_table, tmp_str2, name, i) )
-			Sql_ShowDebug(mmysql_handle);
+		mapreg_write(MAPREG_STMT_UPDATE, name, i, (const char*)db_data2ptr(data), 0);
 	}
 	dbi_destroy(iter);
 
@@ -197,6 +251,7 @@ void mapreg_reload(void)
 {
 	if( mapreg_dirty )
 		script_save_mapreg();
+	SqlAsync_Flush(mmysql_async);// pending writes must reach the table before it is read again
 
 	db_clear(mapreg_db);
 	db_clear(mapregstr_db);
@@ -215,8 +270,13 @@ void mapreg_final(void)
 
 void mapreg_init(void)
 {
+	int i;
+
 	mapreg_db = idb_alloc(DB_OPT_BASE);
 	mapregstr_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	if( mmysql_async != NULL )
+		for( i = 0; i < MAPREG_STMT_MAX; ++i )
+			mapreg_async_stmt[i] = SqlAsync_Prepare(mmysql_async, mapreg_stmt_query[i], mapreg_table);
 
 	script_load_mapreg();
 
@@ -75,6 +75,10 @@ static struct item_drop_ratio *item_drop_ratio_db[MAX_ITEMDB];
 
 static struct eri *item_drop_ers; //For loot drops delay structures.
 static struct eri *item_drop_list_ers;
+static struct eri *mob_data_ers; // struct mob_data, see mob_spawn_dataset/mob_freeblock
+
+static DBMap* mobdb_name_db; // name/jname/sprite (case-insensitive) -> mob id
+static struct trigramdb mobdb_name_tdb; // name/jname substrings -> mob id
 
 static struct {
 	int qty;
@@ -97,18 +101,35 @@ int mob_skillid2skillidx(int class_,int skillid);
  * Mob is searched with a name.
  *------------------------------------------*/
 int mobdb_searchname(const char *str)
+{
+	return strdb_iget(mobdb_name_db, str);
+}
+
+/*==========================================
+ * (Re)builds the name indexes after the mob db was read.
+ * Clones are spawned later and are never indexed.
+ *------------------------------------------*/
+static void mobdb_build_nameindex(void)
 {
 	int i;
 	struct mob_db* mob;
+
+	db_clear(mobdb_name_db);
+	trigramdb_clear(&mobdb_name_tdb);
 	for(i=0;i<=MAX_MOB_DB;i++){
 		mob = mob_db(i);
-		if(mob == mob_dummy) //Skip dummy mobs.
+		if(mob == mob_dummy || mob_is_clone(i)) //Skip dummy mobs and clones.
 			continue;
-		if(strcmpi(mob->name,str)==0 || strcmpi(mob->jname,str)==0 || strcmpi(mob->sprite,str)==0)
-			return i;
+		// lowest id wins, whichever of its names matched
+		if(!strdb_exists(mobdb_name_db, mob->name))
+			strdb_iput(mobdb_name_db, mob->name, i);
+		if(!strdb_exists(mobdb_name_db, mob->jname))
+			strdb_iput(mobdb_name_db, mob->jname, i);
+		if(!strdb_exists(mobdb_name_db, mob->sprite))
+			strdb_iput(mobdb_name_db, mob->sprite, i);
+		trigramdb_add(&mobdb_name_tdb, mob->name, i);
+		trigramdb_add(&mobdb_name_tdb, mob->jname, i);
 	}
-
-	return 0;
 }
 static int mobdb_searchname_array_sub(struct mob_db* mob, const char *str)
 {
@@ -198,8 +219,23 @@ void mvptomb_destroy(struct mob_data *md) {
  *------------------------------------------*/
 int mobdb_searchname_array(struct mob_db** data, int size, const char *str)
 {
-	int count = 0, i;
+	int count = 0, i, n;
 	struct mob_db* mob;
+	const int* ids = trigramdb_candidates(&mobdb_name_tdb, str, &n);
+
+	if( ids != NULL )
+	{// only the mobs sharing the rarest piece of str
+		for( i = 0; i < n; i++ ){
+			mob = mob_db(ids[i]);
+			if (!mobdb_searchname_array_sub(mob, str)) {
+				if (count < size)
+					data[count] = mob;
+				count++;
+			}
+		}
+		return count;
+	}
+
 	for(i=0;i<=MAX_MOB_DB;i++){
 		mob = mob_db(i);
 		if (mob == mob_dummy || mob_is_clone(i) ) //keep clones out (or you leak player stats)
@@ -288,7 +324,8 @@ int mob_parse_dataset(struct spawn_data *data)
  *------------------------------------------*/
 struct mob_data* mob_spawn_dataset(struct spawn_data *data)
 {
-	struct mob_data *md = (struct mob_data*)aCalloc(1, sizeof(struct mob_data));
+	struct mob_data *md = ers_alloc(mob_data_ers, struct mob_data);
+	memset(md, 0, sizeof(struct mob_data));
 	md->bl.id= npc_get_new_npc_id();
 	md->bl.type = BL_MOB;
 	md->bl.m = data->m;
@@ -317,6 +354,12 @@ struct mob_data* mob_spawn_dataset(struct spawn_data *data)
 	return md;
 }
 
+/// Schedules the release of a monster created by mob_spawn_dataset (see map_freeblock).
+int mob_freeblock(struct mob_data *md)
+{
+	return map_freeblock_ers(&md->bl, mob_data_ers);
+}
+
 /*==========================================
  * Fetches a random mob_id [Skotlex]
  * type: Where to fetch from:
@@ -2580,7 +2623,7 @@ int mob_dead(struct mob_data *md, struct block_list *src, int type)
 			
 			if( sd->status.party_id )
 				map_foreachinrange(quest_update_objective_sub,&md->bl,AREA_SIZE,BL_PC,sd->status.party_id,md->class_);
-			else if( sd->avail_quests )
+			else if( sd->num_quest_objectives )
 				quest_update_objective(sd, md->class_);
 			
 			if( sd->md && src && src->type != BL_HOM && mob_db(md->class_)->lv > sd->status.base_level/2 )
@@ -4602,6 +4645,7 @@ static void mob_load(void)
 	sv_readdb(db_path, "mob_avail.txt", ',', 2, 12, -1, &mob_readdb_mobavail);
 	mob_read_randommonster();
 	sv_readdb(db_path, DBPATH"mob_race2_db.txt", ',', 2, 20, -1, &mob_readdb_race2);
+	mobdb_build_nameindex();
 }
 
 void mob_reload(void) {
@@ -4643,6 +4687,9 @@ int do_init_mob(void)
 	mob_makedummymobdb(0); //The first time this is invoked, it creates the dummy mob
 	item_drop_ers = ers_new(sizeof(struct item_drop),"mob.c::item_drop_ers",ERS_OPT_NONE);
 	item_drop_list_ers = ers_new(sizeof(struct item_drop_list),"mob.c::item_drop_list_ers",ERS_OPT_NONE);
+	mob_data_ers = ers_new(sizeof(struct mob_data),"mob.c::mob_data_ers",ERS_OPT_CLEAR);
+	mobdb_name_db = stridb_alloc(DB_OPT_BASE, NAME_LENGTH);
+	trigramdb_init(&mobdb_name_tdb);
 
 	mob_load();
 
@@ -4696,5 +4743,8 @@ int do_final_mob(void)
 	}
 	ers_destroy(item_drop_ers);
 	ers_destroy(item_drop_list_ers);
+	ers_destroy(mob_data_ers);
+	db_destroy(mobdb_name_db);
+	trigramdb_final(&mobdb_name_tdb);
 	return 0;
 }
@@ -69,6 +69,15 @@
  *  deletes a pset
  */
 
+/* JIT-compile the patterns when studying them, if this PCRE can */
+#ifdef PCRE_STUDY_JIT_COMPILE
+#define NPC_CHAT_STUDY_OPTIONS PCRE_STUDY_JIT_COMPILE
+#define npc_chat_free_study(extra) pcre_free_study(extra)
+#else
+#define NPC_CHAT_STUDY_OPTIONS 0
+#define npc_chat_free_study(extra) pcre_free(extra)
+#endif
+
 /* Structure containing all info associated with a single pattern block */
 struct pcrematch_entry {
 	struct pcrematch_entry* next;
@@ -76,6 +85,9 @@ struct pcrematch_entry {
 	pcre* pcre_;
 	pcre_extra* pcre_extra_;
 	char* label;
+	int pos;        // script position of the label, -1 if not found
+	int minlength;  // shortest text that can match
+	int literal[2]; // (lowercase) bytes every match contains, -1 if none
 };
 
 /* A set of patterns that can be activated and deactived with a single command */
@@ -109,7 +121,7 @@ struct npc_parse {
 void finalize_pcrematch_entry(struct pcrematch_entry* e)
 {
 	pcre_free(e->pcre_);
-	pcre_free(e->pcre_extra_);
+	npc_chat_free_study(e->pcre_extra_);
 	aFree(e->pattern);
 	aFree(e->label);
 }
@@ -312,12 +324,39 @@ void npc_chat_def_pattern(struct npc_data* nd, int setid, const char* pattern, c
 	const char *err;
 	int erroff;
 	
+	int i;
+	struct npc_label_list* lst;
 	struct pcrematch_set * s = lookup_pcreset(nd, setid);
 	struct pcrematch_entry *e = create_pcrematch_entry(s);
 	e->pattern = aStrdup(pattern);
 	e->label = aStrdup(label);
 	e->pcre_ = pcre_compile(pattern, PCRE_CASELESS, &err, &erroff, NULL);
-	e->pcre_extra_ = pcre_study(e->pcre_, 0, &err);
+	e->pos = -1;
+	e->minlength = 0;
+	e->literal[0] = e->literal[1] = -1;
+	if (e->pcre_ == NULL) {
+		ShowError("npc_chat_def_pattern: Invalid pattern \"%s\" in NPC '%s' (offset %d: %s).\n", pattern, nd->exname, erroff, err);
+		return;
+	}
+	e->pcre_extra_ = pcre_study(e->pcre_, NPC_CHAT_STUDY_OPTIONS, &err);
+	
+	// cheap checks to reject most lines without running the pattern
+	if (pcre_fullinfo(e->pcre_, e->pcre_extra_, PCRE_INFO_MINLENGTH, &e->minlength) != 0 || e->minlength < 0)
+		e->minlength = 0;
+	if (pcre_fullinfo(e->pcre_, NULL, PCRE_INFO_FIRSTBYTE, &e->literal[0]) != 0 || e->literal[0] < 0)
+		e->literal[0] = -1;
+	else
+		e->literal[0] = TOLOWER(e->literal[0]);
+	if (pcre_fullinfo(e->pcre_, NULL, PCRE_INFO_LASTLITERAL, &e->literal[1]) != 0 || e->literal[1] < 0)
+		e->literal[1] = -1;
+	else
+		e->literal[1] = TOLOWER(e->literal[1]);
+	
+	// the labels of a NPC don't change after it was parsed
+	lst = nd->u.scr.label_list;
+	ARR_FIND(0, nd->u.scr.label_list_num, i, strncmp(lst[i].name, label, sizeof(lst[i].name)) == 0);
+	if (i < nd->u.scr.label_list_num)
+		e->pos = lst[i].pos;
 }
 
 /**
@@ -351,8 +390,8 @@ int npc_chat_sub(struct block_list* bl, va_list ap)
 	struct npc_parse* npcParse = (struct npc_parse *) nd->chatdb;
 	char* msg;
 	int len, i;
+	uint8 seen[256/8]; // (lowercase) bytes present in msg
 	struct map_session_data* sd;
-	struct npc_label_list* lst;
 	struct pcrematch_set* pcreset;
 	struct pcrematch_entry* e;
 	
@@ -364,6 +403,13 @@ int npc_chat_sub(struct block_list* bl, va_list ap)
 	len = va_arg(ap,int);
 	sd = va_arg(ap,struct map_session_data *);
 	
+	memset(seen, 0, sizeof(seen));
+	for (i = 0; i < len; i++)
+	{
+		uint8 c = (uint8)TOLOWER(msg[i]);
+		seen[c>>3] |= 1<<(c&7);
+	}
+	
 	// iterate across all active sets
 	for (pcreset = npcParse->active; pcreset != NULL; pcreset = pcreset->next)
 	{
@@ -371,9 +417,18 @@ int npc_chat_sub(struct block_list* bl, va_list ap)
 		for (e = pcreset->head; e != NULL; e = e->next)
 		{
 			int offsets[2*10 + 10]; // 1/3 reserved for temp space requred by pcre_exec
+			int r;
+			
+			// skip patterns, that can't match this line
+			if (e->pcre_ == NULL || len < e->minlength)
+				continue;
+			if (e->literal[0] >= 0 && !(seen[e->literal[0]>>3]&(1<<(e->literal[0]&7))))
+				continue;
+			if (e->literal[1] >= 0 && !(seen[e->literal[1]>>3]&(1<<(e->literal[1]&7))))
+				continue;
 			
 			// perform pattern match
-			int r = pcre_exec(e->pcre_, e->pcre_extra_, msg, len, 0, 0, offsets, ARRAYLENGTH(offsets));
+			r = pcre_exec(e->pcre_, e->pcre_extra_, msg, len, 0, 0, offsets, ARRAYLENGTH(offsets));
 			if (r > 0)
 			{
 				// save out the matched strings
@@ -385,16 +440,14 @@ int npc_chat_sub(struct block_list* bl, va_list ap)
 					set_var(sd, var, val);
 				}
 				
-				// find the target label.. this sucks..
-				lst = nd->u.scr.label_list;
-				ARR_FIND(0, nd->u.scr.label_list_num, i, strncmp(lst[i].name, e->label, sizeof(lst[i].name)) == 0);
-				if (i == nd->u.scr.label_list_num) {
+				// target label was resolved when the pattern was defined
+				if (e->pos < 0) {
 					ShowWarning("Unable to find label: %s\n", e->label);
 					return 0;
 				}
 				
 				// run the npc script
-				run_script(nd->u.scr.script,lst[i].pos,sd->bl.id,nd->bl.id);
+				run_script(nd->u.scr.script,e->pos,sd->bl.id,nd->bl.id);
 				return 0;
 			}
 		}
@@ -31,6 +31,7 @@
 
 static DBMap* party_db; // int party_id -> struct party_data* (releases data)
 static DBMap* party_booking_db; // int char_id -> struct party_booking_ad_info* (releases data) // Party Booking [Spiria]
+static DBMap* party_xy_db; // int party_id -> parties with members that moved since the last party_send_xy_timer
 static unsigned long party_booking_nextid = 1;
 
 int party_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data);
@@ -121,12 +122,14 @@ void do_final_party(void)
 {
 	party_db->destroy(party_db,NULL);
 	party_booking_db->destroy(party_booking_db,NULL); // Party Booking [Spiria]
+	db_destroy(party_xy_db);
 }
 // 
 void do_init_party(void)
 {
 	party_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	party_booking_db = idb_alloc(DB_OPT_RELEASE_DATA); // Party Booking [Spiria]
+	party_xy_db = idb_alloc(DB_OPT_BASE);
 	add_timer_func_list(party_send_xy_timer, "party_send_xy_timer");
 	add_timer_interval(gettick()+battle_config.party_update_interval, party_send_xy_timer, 0, 0, battle_config.party_update_interval);
 }
@@ -867,17 +870,28 @@ int party_skill_check(struct map_session_data *sd, int party_id, int skillid, in
 	return 0;
 }
 
+/// Marks the party of sd for an update on the next party_send_xy_timer.
+/// Called whenever a party member is placed or moved on a map, and on hp
+/// changes when party_hp_mode delays them to the timer.
+void party_xy_dirty(struct map_session_data *sd)
+{
+	if( sd->status.party_id )
+		idb_iput(party_xy_db, sd->status.party_id, 1);
+}
+
 int party_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
 {
-	struct party_data* p;
+	DBIterator *iter = db_iterator(party_xy_db);
+	DBKey key;
 
-	DBIterator *iter = db_iterator(party_db);
-	// for each existing party,
-	for( p = dbi_first(iter); dbi_exists(iter); p = dbi_next(iter) )
+	// for each party with members that moved,
+	for( iter->first(iter,&key); dbi_exists(iter); iter->next(iter,&key) )
 	{
-		int i;
+		struct party_data* p = party_search(key.i);
+		struct map_session_data* moved[MAX_PARTY];
+		int i, count = 0;
 
-		if( !p->party.count )
+		if( p == NULL || !p->party.count )
 		{// no online party members so do not iterate
 			continue;
 		}
@@ -889,8 +903,8 @@ int party_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
 			if( !sd ) continue;
 
 			if( p->data[i].x != sd->bl.x || p->data[i].y != sd->bl.y )
-			{// perform position update
-				clif_party_xy(sd);
+			{// position update, sent below in one batch per recipient
+				moved[count++] = sd;
 				p->data[i].x = sd->bl.x;
 				p->data[i].y = sd->bl.y;
 			}
@@ -900,8 +914,11 @@ int party_send_xy_timer(int tid, unsigned int tick, int id, intptr_t data)
 				p->data[i].hp = sd->battle_status.hp;
 			}
 		}
+		if( count )
+			clif_party_xy_batch(p, moved, count);
 	}
 	dbi_destroy(iter);
+	db_clear(party_xy_db);
 
 	return 0;
 }
@@ -603,15 +603,52 @@ int pc_equippoint(struct map_session_data *sd,int n)
 	return ep;
 }
 
+/// Bucket of the inventory slot index an item belongs to.
+#define pc_inventory_bucket(nameid) ( (nameid)&(INVENTORY_INDEX_SIZE-1) )
+
+/// Links the item in slot n into the inventory slot index.
+static void pc_inventory_index_add(struct map_session_data *sd, int n)
+{
+	short* p = &sd->inventory_index.head[pc_inventory_bucket(sd->status.inventory[n].nameid)];
+
+	// keep slot order, so searches find the first slot like a full scan did
+	while( *p && *p-1 < n )
+		p = &sd->inventory_index.next[*p-1];
+	sd->inventory_index.next[n] = *p;
+	*p = n+1;
+}
+
+/// Unlinks slot n, that held nameid, from the inventory slot index.
+static void pc_inventory_index_del(struct map_session_data *sd, int n, int nameid)
+{
+	short* p = &sd->inventory_index.head[pc_inventory_bucket(nameid)];
+
+	while( *p && *p-1 != n )
+		p = &sd->inventory_index.next[*p-1];
+	if( *p )
+		*p = sd->inventory_index.next[n];
+	sd->inventory_index.next[n] = 0;
+	if( n < sd->inventory_index.free )
+		sd->inventory_index.free = n;
+}
+
 int pc_setinventorydata(struct map_session_data *sd)
 {
 	int i,id;
 
 	nullpo_ret(sd);
 
-	for(i=0;i<MAX_INVENTORY;i++) {
+	memset(&sd->inventory_index, 0, sizeof(sd->inventory_index));
+	sd->inventory_index.free = MAX_INVENTORY;
+
+	for(i=MAX_INVENTORY-1;i>=0;i--) {
 		id = sd->status.inventory[i].nameid;
 		sd->inventory_data[i] = id?itemdb_search(id):NULL;
+		if( id ) {// walking backwards, prepending keeps slot order
+			sd->inventory_index.next[i] = sd->inventory_index.head[pc_inventory_bucket(id)];
+			sd->inventory_index.head[pc_inventory_bucket(id)] = i+1;
+		} else
+			sd->inventory_index.free = i;
 	}
 	return 0;
 }
@@ -3559,13 +3596,11 @@ int pc_checkadditem(struct map_session_data *sd,int nameid,int amount)
 	if( data->stack.inventory && amount > data->stack.amount )
 		return ADDITEM_OVERAMOUNT;
 
-	for(i=0;i<MAX_INVENTORY;i++){
-		// FIXME: This does not consider the checked item's cards, thus could check a wrong slot for stackability.
-		if(sd->status.inventory[i].nameid==nameid){
-			if( amount > MAX_AMOUNT - sd->status.inventory[i].amount || ( data->stack.inventory && amount > data->stack.amount - sd->status.inventory[i].amount ) )
-				return ADDITEM_OVERAMOUNT;
-			return ADDITEM_EXIST;
-		}
+	// FIXME: This does not consider the checked item's cards, thus could check a wrong slot for stackability.
+	if( (i = pc_search_inventory(sd,nameid)) >= 0 ){
+		if( amount > MAX_AMOUNT - sd->status.inventory[i].amount || ( data->stack.inventory && amount > data->stack.amount - sd->status.inventory[i].amount ) )
+			return ADDITEM_OVERAMOUNT;
+		return ADDITEM_EXIST;
 	}
 
 	return ADDITEM_NEW;
@@ -3606,6 +3641,7 @@ int pc_payzeny(struct map_session_data *sd,int zeny)
 
 	sd->status.zeny -= zeny;
 	clif_updatestatus(sd,SP_ZENY);
+	pc_autosave_dirty(sd);
 
 	if( zeny > 0 && sd->state.showzeny ) {
 		char output[255];
@@ -3721,6 +3757,7 @@ int pc_getzeny(struct map_session_data *sd,int zeny)
 
 	sd->status.zeny += zeny;
 	clif_updatestatus(sd,SP_ZENY);
+	pc_autosave_dirty(sd);
 
 	if( zeny > 0 && sd->state.showzeny ) {
 		char output[255];
@@ -3739,8 +3776,29 @@ int pc_search_inventory(struct map_session_data *sd,int item_id)
 	int i;
 	nullpo_retr(-1, sd);
 
-	ARR_FIND( 0, MAX_INVENTORY, i, sd->status.inventory[i].nameid == item_id && (sd->status.inventory[i].amount > 0 || item_id == 0) );
-	return ( i < MAX_INVENTORY ) ? i : -1;
+	if( item_id == 0 )
+	{// first free slot
+		for( i = sd->inventory_index.free; i < MAX_INVENTORY && sd->status.inventory[i].nameid; i++ );
+		sd->inventory_index.free = i;
+		return ( i < MAX_INVENTORY ) ? i : -1;
+	}
+
+	for( i = sd->inventory_index.head[pc_inventory_bucket(item_id)]-1; i >= 0; i = sd->inventory_index.next[i]-1 )
+		if( sd->status.inventory[i].nameid == item_id && sd->status.inventory[i].amount > 0 )
+			return i;
+	return -1;
+}
+
+/// Returns the next slot after n, that holds the same item as slot n, or -1.
+/// ex: for( i = pc_search_inventory(sd,nameid); i >= 0; i = pc_search_inventory_next(sd,i) )
+int pc_search_inventory_next(struct map_session_data *sd,int n)
+{
+	int i, nameid = sd->status.inventory[n].nameid;
+
+	for( i = sd->inventory_index.next[n]-1; i >= 0; i = sd->inventory_index.next[i]-1 )
+		if( sd->status.inventory[i].nameid == nameid && sd->status.inventory[i].amount > 0 )
+			return i;
+	return -1;
 }
 
 /*==========================================
@@ -3775,9 +3833,9 @@ int pc_additem(struct map_session_data *sd,struct item *item_data,int amount,e_l
 
 	if( itemdb_isstackable2(data) && item_data->expire_time == 0 )
 	{ // Stackable | Non Rental
-		for( i = 0; i < MAX_INVENTORY; i++ )
+		for( i = pc_search_inventory(sd,item_data->nameid); i >= 0; i = pc_search_inventory_next(sd,i) )
 		{
-			if( sd->status.inventory[i].nameid == item_data->nameid && memcmp(&sd->status.inventory[i].card, &item_data->card, sizeof(item_data->card)) == 0 )
+			if( memcmp(&sd->status.inventory[i].card, &item_data->card, sizeof(item_data->card)) == 0 )
 			{
 				if( amount > MAX_AMOUNT - sd->status.inventory[i].amount || ( data->stack.inventory && amount > data->stack.amount - sd->status.inventory[i].amount ) )
 					return 5;
@@ -3786,6 +3844,8 @@ int pc_additem(struct map_session_data *sd,struct item *item_data,int amount,e_l
 				break;
 			}
 		}
+		if( i < 0 )
+			i = MAX_INVENTORY;
 	}
 
 	if( i >= MAX_INVENTORY )
@@ -3795,6 +3855,7 @@ int pc_additem(struct map_session_data *sd,struct item *item_data,int amount,e_l
 			return 4;
 
 		memcpy(&sd->status.inventory[i], item_data, sizeof(sd->status.inventory[0]));
+		pc_inventory_index_add(sd, i);
 		// clear equips field first, just in case
 		if( item_data->equip )
 			sd->status.inventory[i].equip = 0;
@@ -3804,6 +3865,7 @@ int pc_additem(struct map_session_data *sd,struct item *item_data,int amount,e_l
 		clif_additem(sd,i,amount,0);
 	}
 	log_pick_pc(sd, log_type, amount, &sd->status.inventory[i]);
+	pc_autosave_dirty(sd);
 	
 	sd->weight += w;
 	clif_updatestatus(sd,SP_WEIGHT);
@@ -3837,12 +3899,14 @@ int pc_delitem(struct map_session_data *sd,int n,int amount,int type, short reas
 		return 1;
 
 	log_pick_pc(sd, log_type, -amount, &sd->status.inventory[n]);
+	pc_autosave_dirty(sd);
 
 	sd->status.inventory[n].amount -= amount;
 	sd->weight -= sd->inventory_data[n]->weight*amount ;
 	if( sd->status.inventory[n].amount <= 0 ){
 		if(sd->status.inventory[n].equip)
 			pc_unequipitem(sd,n,3);
+		pc_inventory_index_del(sd, n, sd->status.inventory[n].nameid);
 		memset(&sd->status.inventory[n],0,sizeof(sd->status.inventory[0]));
 		sd->inventory_data[n] = NULL;
 	}
@@ -4304,6 +4368,7 @@ int pc_cart_additem(struct map_session_data *sd,struct item *item_data,int amoun
 	}
 	sd->status.cart[i].favorite = 0;/* clear */
 	log_pick_pc(sd, log_type, amount, &sd->status.cart[i]);
+	pc_autosave_dirty(sd);
 	
 	sd->cart_weight += w;
 	clif_updatestatus(sd,SP_CARTINFO);
@@ -4323,6 +4388,7 @@ int pc_cart_delitem(struct map_session_data *sd,int n,int amount,int type,e_log_
 		return 1;
 
 	log_pick_pc(sd, log_type, -amount, &sd->status.cart[n]);
+	pc_autosave_dirty(sd);
 
 	sd->status.cart[n].amount -= amount;
 	sd->cart_weight -= itemdb_weight(sd->status.cart[n].nameid)*amount ;
@@ -4612,12 +4678,19 @@ int pc_setpos(struct map_session_data* sd, unsigned short mapindex, int x, int y
 			sd->regen.state.gc = 0;
 	}
 
-	if( m < 0 )
+	if( m < 0 || map[m].handoff.port )
 	{
 		uint32 ip;
 		uint16 port;
 		//if can't find any map-servers, just abort setting position.
-		if(!sd->mapindex || map_mapname2ipport(mapindex,&ip,&port))
+		if( !sd->mapindex )
+			return 2;
+		if( m >= 0 )
+		{// in standby here, served by another map-server (see map_setroute)
+			ip = map[m].handoff.ip;
+			port = map[m].handoff.port;
+		}
+		else if( map_mapname2ipport(mapindex,&ip,&port) )
 			return 2;
 
 		if (sd->npc_id)
@@ -8755,37 +8828,175 @@ int pc_setsavepoint(struct map_session_data *sd, short mapindex,int x,int y)
 /*==========================================
  * Z?u (timer??)
  *------------------------------------------*/
-int pc_autosave(int tid, unsigned int tick, int id, intptr_t data)
+/// Autosave scheduler.
+/// Online characters wait in the clean queue ordered by their last save (or
+/// skip); characters whose zeny or items changed move to the dirty queue,
+/// which is served first. Characters with no change since their last save
+/// are skipped, and no autosave is sent while autosave_max_pending saves
+/// wait for the char-server ack.
+static struct {
+	struct map_session_data *head[PC_AUTOSAVE_QUEUE_MAX], *tail[PC_AUTOSAVE_QUEUE_MAX];
+	int pending; // saves not acknowledged by the char-server yet
+	// statistics
+	unsigned int saves, dirty_saves, skips, deferrals;
+	uint64 lag_sum; // unsaved time of the saved characters (ms)
+	unsigned int lag_max;
+} autosave;
+
+/// Dirty characters are not autosaved more than once per this fraction of autosave_interval.
+#define PC_AUTOSAVE_DIRTY_RATIO 4
+/// Maximum number of characters looked at in each queue per autosave tick.
+#define PC_AUTOSAVE_MAX_SKIP 8
+
+static void pc_autosave_unlink(struct map_session_data* sd)
+{
+	int q = sd->autosave.queue;
+
+	if( sd->autosave.prev )
+		sd->autosave.prev->autosave.next = sd->autosave.next;
+	else
+		autosave.head[q] = sd->autosave.next;
+	if( sd->autosave.next )
+		sd->autosave.next->autosave.prev = sd->autosave.prev;
+	else
+		autosave.tail[q] = sd->autosave.prev;
+	sd->autosave.prev = sd->autosave.next = NULL;
+	sd->autosave.linked = 0;
+}
+
+static void pc_autosave_link(struct map_session_data* sd, enum e_pc_autosave_queue q)
+{
+	sd->autosave.queue = q;
+	sd->autosave.prev = autosave.tail[q];
+	sd->autosave.next = NULL;
+	if( autosave.tail[q] )
+		autosave.tail[q]->autosave.next = sd;
+	else
+		autosave.head[q] = sd;
+	autosave.tail[q] = sd;
+	sd->autosave.linked = 1;
+}
+
+/// FNV-1a hash of the data sent by chrif_save.
+static uint32 pc_autosave_hash(struct map_session_data* sd)
+{
+	const uint8* p = (const uint8*)&sd->status;
+	uint32 hash = 2166136261U;
+	size_t i;
+
+	for( i = 0; i < sizeof(sd->status); ++i )
+		hash = (hash^p[i])*16777619U;
+	return hash;
+}
+
+/// Adds a character that entered the map-server to the autosave queue.
+void pc_autosave_add(struct map_session_data* sd)
+{
+	if( sd->autosave.linked )
+		return;
+	sd->autosave.tick = gettick();
+	sd->autosave.hash = pc_autosave_hash(sd);
+	pc_autosave_link(sd, PC_AUTOSAVE_QUEUE_CLEAN);
+}
+
+/// Removes a character that left the map-server from the autosave queue.
+void pc_autosave_remove(struct map_session_data* sd)
+{
+	if( sd->autosave.linked )
+		pc_autosave_unlink(sd);
+}
+
+/// Marks the zeny or items of a character as changed, so it is autosaved before the others.
+void pc_autosave_dirty(struct map_session_data* sd)
+{
+	if( !sd->autosave.linked || sd->autosave.queue == PC_AUTOSAVE_QUEUE_DIRTY )
+		return;
+	pc_autosave_unlink(sd);
+	sd->autosave.dirty_tick = gettick();
+	pc_autosave_link(sd, PC_AUTOSAVE_QUEUE_DIRTY);
+}
+
+/// Called by chrif_save after the character data was sent to the char-server.
+void pc_autosave_saved(struct map_session_data* sd)
+{
+	unsigned int tick = gettick();
+	unsigned int lag;
+
+	autosave.pending++;
+	if( !sd->autosave.linked )
+		return;
+
+	lag = DIFF_TICK(tick, sd->autosave.queue == PC_AUTOSAVE_QUEUE_DIRTY ? sd->autosave.dirty_tick : sd->autosave.tick);
+	autosave.lag_sum += lag;
+	autosave.lag_max = max(autosave.lag_max, lag);
+	autosave.saves++;
+	if( sd->autosave.queue == PC_AUTOSAVE_QUEUE_DIRTY )
+		autosave.dirty_saves++;
+
+	pc_autosave_unlink(sd);
+	sd->autosave.tick = tick;
+	sd->autosave.hash = pc_autosave_hash(sd);
+	pc_autosave_link(sd, PC_AUTOSAVE_QUEUE_CLEAN);
+}
+
+/// Called when the char-server acknowledges a save.
+void pc_autosave_ack(void)
+{
+	if( autosave.pending > 0 )
+		autosave.pending--;
+}
+
+/// Forgets the unacknowledged saves (char-server connection lost).
+void pc_autosave_reset(void)
+{
+	autosave.pending = 0;
+}
+
+/// Shows the autosave statistics.
+void pc_autosave_stats(void)
+{
+	ShowInfo("Autosave: %u salvamentos (%u com zeny/itens alterados), %u pulados sem alteraes, %u adiados pelo char-server.\n",
+		autosave.saves, autosave.dirty_saves, autosave.skips, autosave.deferrals);
+	ShowInfo("Autosave: atraso mdio %ums, mximo %ums, %d salvamentos aguardando confirmao.\n",
+		autosave.saves ? (unsigned int)(autosave.lag_sum/autosave.saves) : 0, autosave.lag_max, autosave.pending);
+}
+
+/// Picks the next character to autosave, or NULL.
+static struct map_session_data* pc_autosave_next(unsigned int tick)
 {
-	int interval;
-	struct s_mapiterator* iter;
 	struct map_session_data* sd;
-	static int last_save_id = 0, save_flag = 0;
+	int n;
 
-	if(save_flag == 2) //Someone was saved on last call, normal cycle
-		save_flag = 0;
-	else
-		save_flag = 1; //Noone was saved, so save first found char.
+	// the dirty queue is ordered by first change, not by last save: look past recently saved characters
+	for( n = 0, sd = autosave.head[PC_AUTOSAVE_QUEUE_DIRTY]; sd != NULL && n < PC_AUTOSAVE_MAX_SKIP; ++n, sd = sd->autosave.next )
+		if( DIFF_TICK(tick, sd->autosave.tick) >= autosave_interval/PC_AUTOSAVE_DIRTY_RATIO )
+			return sd;
 
-	iter = mapit_getallusers();
-	for( sd = (TBL_PC*)mapit_first(iter); mapit_exists(iter); sd = (TBL_PC*)mapit_next(iter) )
+	for( n = 0; (sd = autosave.head[PC_AUTOSAVE_QUEUE_CLEAN]) != NULL && n < PC_AUTOSAVE_MAX_SKIP; ++n )
 	{
-		if(sd->bl.id == last_save_id && save_flag != 1) {
-			save_flag = 1;
-			continue;
-		}
-
-		if(save_flag != 1) //Not our turn to save yet.
-			continue;
+		pc_makesavestatus(sd);
+		if( sd->state.reg_dirty || sd->save_quest || sd->state.storage_flag == 2 || sd->pd || sd->hd || sd->md || sd->ed
+		||	sd->autosave.hash != pc_autosave_hash(sd) )
+			return sd;
+		// unchanged, check it again after the others
+		autosave.skips++;
+		pc_autosave_unlink(sd);
+		pc_autosave_link(sd, PC_AUTOSAVE_QUEUE_CLEAN);
+		if( autosave.head[PC_AUTOSAVE_QUEUE_CLEAN] == sd )
+			break; // only one character
+	}
+	return NULL;
+}
 
-		//Save char.
-		last_save_id = sd->bl.id;
-		save_flag = 2;
+int pc_autosave(int tid, unsigned int tick, int id, intptr_t data)
+{
+	int interval;
+	struct map_session_data* sd;
 
+	if( autosave.pending >= autosave_max_pending )
+		autosave.deferrals++; // char-server is behind
+	else if( (sd = pc_autosave_next(tick)) != NULL )
 		chrif_save(sd,0);
-		break;
-	}
-	mapit_free(iter);
 
 	interval = autosave_interval/(map_usercount()+1);
 	if(interval < minsave_interval)
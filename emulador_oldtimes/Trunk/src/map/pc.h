@@ -23,6 +23,7 @@
 #define MAX_PC_BONUS 10
 #define MAX_PC_SKILL_REQUIRE 5
 #define MAX_PC_FEELHATE 3
+#define INVENTORY_INDEX_SIZE 64 // buckets of the inventory slot index (power of 2)
 
 struct weapon_data {
 	int atkmods[3];
@@ -57,6 +58,15 @@ struct weapon_data {
 	} addele2[MAX_PC_BONUS];
 };
 
+/// Card bonus combinations of the weapon attack card fix (see battle_calc_cardfix_table).
+enum e_cardfix_set {
+	CARDFIX_RIGHT = 0, // right hand weapon
+	CARDFIX_ARROW,     // right hand weapon and ammo
+	CARDFIX_LEFT,      // left hand weapon, without its element bonus
+	CARDFIX_BOTH,      // both weapons added together (left_cardfix_to_right)
+	CARDFIX_MAX
+};
+
 struct s_autospell {
 	short id, lv, rate, card_id, flag;
 	bool lock;  // bAutoSpellOnSkill: blocks autospell from triggering again, while being executed
@@ -87,6 +97,13 @@ struct s_autobonus {
 	unsigned short pos;
 };
 
+/// Queues of the autosave scheduler (see pc_autosave).
+enum e_pc_autosave_queue {
+	PC_AUTOSAVE_QUEUE_CLEAN, // ordered by last save
+	PC_AUTOSAVE_QUEUE_DIRTY, // zeny/items changed, ordered by first change
+	PC_AUTOSAVE_QUEUE_MAX
+};
+
 struct map_session_data {
 	struct block_list bl;
 	struct unit_data ud;
@@ -165,9 +182,15 @@ struct map_session_data {
 
 	int packet_ver;  // 5: old, 6: 7july04, 7: 13july04, 8: 26july04, 9: 9aug04/16aug04/17aug04, 10: 6sept04, 11: 21sept04, 12: 18oct04, 13: 25oct04 ... 18
 	struct mmo_charstatus status;
+	struct storage_index* storage_index; // slot lookup of status.storage (see storage.c)
 	struct registry save_reg;
 	
 	struct item_data* inventory_data[MAX_INVENTORY]; // direct pointers to itemdb entries (faster than doing item_id lookups)
+	struct {
+		short head[INVENTORY_INDEX_SIZE]; // first slot+1 of the items hashed to each bucket
+		short next[MAX_INVENTORY];        // next slot+1 in the same bucket, in slot order
+		short free;                       // no free slot below this one
+	} inventory_index; // nameid -> slots lookup, see pc_search_inventory
 	short equip_index[14];
 	unsigned int weight,max_weight;
 	int cart_weight,cart_num,cart_weight_max;
@@ -207,6 +230,15 @@ struct map_session_data {
 	int cloneskill_id, reproduceskill_id;
 	int menuskill_id, menuskill_val, menuskill_val2;
 
+	struct {
+		struct map_session_data *prev, *next; // position in the autosave queue
+		unsigned int tick; // last save
+		unsigned int dirty_tick; // first zeny/item change since the last save
+		uint32 hash; // hash of the status at the last save
+		unsigned char queue; // see enum e_pc_autosave_queue
+		unsigned linked : 1;
+	} autosave;
+
 	int invincible_timer;
 	unsigned int canlog_tick;
 	unsigned int canuseitem_tick;	// [Skotlex]
@@ -226,6 +258,13 @@ struct map_session_data {
 	short disguise; // [Valaris]
 
 	struct weapon_data right_weapon, left_weapon;
+	struct {
+		int rate[CARDFIX_MAX][RC_BOSS][ELE_MAX+1][3]; // race x element x size card fix, element ELE_MAX is 'no elemental fix'
+		int race2[CARDFIX_MAX][RC2_MAX];
+		int boss[CARDFIX_MAX][2]; // [0] non-boss, [1] boss
+		int nondemihuman[CARDFIX_MAX];
+		int addele2[CARDFIX_MAX]; // bitmask of the elements with conditional (per attack) bonuses
+	} cardfix; // rebuilt at the end of status_calc_pc
 	
 	// here start arrays to be globally zeroed at the beginning of status_calc_pc()
 	int param_bonus[6],param_equip[6]; //Stores card/equipment bonuses.
@@ -430,6 +469,9 @@ struct map_session_data {
 	int avail_quests;
 	int quest_index[MAX_QUEST_DB];
 	struct quest quest_log[MAX_QUEST_DB];
+	struct s_quest_objective* quest_objectives; // objectives of the active quests, sorted by mob id
+	int num_quest_objectives;
+	int max_quest_objectives;
 	bool save_quest;
 
 	// temporary debug [flaviojs]
@@ -666,6 +708,13 @@ bool pc_should_log_commands(struct map_session_data *sd);
 
 int pc_setrestartvalue(struct map_session_data *sd,int type);
 int pc_makesavestatus(struct map_session_data *);
+void pc_autosave_add(struct map_session_data *sd);
+void pc_autosave_remove(struct map_session_data *sd);
+void pc_autosave_dirty(struct map_session_data *sd);
+void pc_autosave_saved(struct map_session_data *sd);
+void pc_autosave_ack(void);
+void pc_autosave_reset(void);
+void pc_autosave_stats(void);
 void pc_respawn(struct map_session_data* sd, clr_type clrtype);
 int pc_setnewpc(struct map_session_data*,int,int,int,unsigned int,int,int);
 bool pc_authok(struct map_session_data *sd, int login_id2, time_t expiration_time, int group_id, struct mmo_charstatus *st, bool changing_mapservers);
@@ -675,6 +724,7 @@ int pc_reg_received(struct map_session_data *sd);
 int pc_isequip(struct map_session_data *sd,int n);
 int pc_equippoint(struct map_session_data *sd,int n);
 int pc_setinventorydata(struct map_session_data *sd);
+int pc_setequipindex(struct map_session_data *sd);
 
 int pc_checkskill(struct map_session_data *sd,int skill_id);
 int pc_checkallowskill(struct map_session_data *sd);
@@ -695,6 +745,7 @@ int pc_memo(struct map_session_data* sd, int pos);
 int pc_checkadditem(struct map_session_data*,int,int);
 int pc_inventoryblank(struct map_session_data*);
 int pc_search_inventory(struct map_session_data *sd,int item_id);
+int pc_search_inventory_next(struct map_session_data *sd,int n);
 int pc_payzeny(struct map_session_data*,int);
 int pc_additem(struct map_session_data*,struct item*,int,e_log_pick_type);
 int pc_getzeny(struct map_session_data*,int);
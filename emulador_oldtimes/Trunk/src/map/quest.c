@@ -34,22 +34,59 @@
 
 
 struct s_quest_db quest_db[MAX_QUEST_DB];
+static DBMap* quest_db_index; // quest id -> quest_db index + 1
 
 
 int quest_search_db(int quest_id)
 {
-	int i;
+	return idb_iget(quest_db_index, quest_id) - 1;
+}
 
-	ARR_FIND(0, MAX_QUEST_DB,i,quest_id == quest_db[i].id);
-	if( i == MAX_QUEST_DB )
-		return -1;
+static int quest_objective_cmp(const void* a, const void* b)
+{
+	const struct s_quest_objective* qa = (const struct s_quest_objective*)a;
+	const struct s_quest_objective* qb = (const struct s_quest_objective*)b;
+
+	if( qa->mob != qb->mob )
+		return qa->mob < qb->mob ? -1 : 1;
+	if( qa->slot != qb->slot )
+		return qa->slot - qb->slot;
+	return qa->objective - qb->objective;
+}
+
+/// Rebuilds the mob id -> (quest slot, objective) lookup of the active quests.
+/// Must be called whenever quests are added, removed, moved or (de)activated.
+void quest_build_objectives(TBL_PC * sd)
+{
+	int i, j, n = 0;
+
+	if( sd->avail_quests*MAX_QUEST_OBJECTIVES > sd->max_quest_objectives ) {
+		sd->max_quest_objectives = sd->avail_quests*MAX_QUEST_OBJECTIVES;
+		RECREATE(sd->quest_objectives, struct s_quest_objective, sd->max_quest_objectives);
+	}
+
+	for( i = 0; i < sd->avail_quests; i++ ) {
+		if( sd->quest_log[i].state != Q_ACTIVE )
+			continue;
+
+		for( j = 0; j < quest_db[sd->quest_index[i]].num_objectives; j++ ) {
+			sd->quest_objectives[n].mob = quest_db[sd->quest_index[i]].mob[j];
+			sd->quest_objectives[n].slot = i;
+			sd->quest_objectives[n].objective = j;
+			n++;
+		}
+	}
 
-	return i;
+	if( n > 1 )
+		qsort(sd->quest_objectives, n, sizeof(struct s_quest_objective), quest_objective_cmp);
+	sd->num_quest_objectives = n;
 }
 
 //Send quest info on login
 int quest_pc_login(TBL_PC * sd)
 {
+	quest_build_objectives(sd);
+
 	if(sd->avail_quests == 0)
 		return 1;
 
@@ -96,6 +133,7 @@ int quest_add(TBL_PC * sd, int quest_id)
 	sd->num_quests++;
 	sd->avail_quests++;
 	sd->save_quest = true;
+	quest_build_objectives(sd);
 
 	clif_quest_add(sd, &sd->quest_log[i], sd->quest_index[i]);
 
@@ -143,6 +181,7 @@ int quest_change(TBL_PC * sd, int qid1, int qid2)
 
 	sd->quest_index[i] = j;
 	sd->save_quest = true;
+	quest_build_objectives(sd);
 
 	clif_quest_delete(sd, qid1);
 	clif_quest_add(sd, &sd->quest_log[i], sd->quest_index[i]);
@@ -175,6 +214,7 @@ int quest_delete(TBL_PC * sd, int quest_id)
 	memset(&sd->quest_log[sd->num_quests], 0, sizeof(struct quest));
 	sd->quest_index[sd->num_quests] = 0;
 	sd->save_quest = true;
+	quest_build_objectives(sd);
 
 	clif_quest_delete(sd, quest_id);
 
@@ -195,7 +235,7 @@ int quest_update_objective_sub(struct block_list *bl, va_list ap)
 	party = va_arg(ap,int);
 	mob = va_arg(ap,int);
 
-	if( !sd->avail_quests )
+	if( !sd->num_quest_objectives )
 		return 0;
 	if( sd->status.party_id != party )
 		return 0;
@@ -207,18 +247,25 @@ int quest_update_objective_sub(struct block_list *bl, va_list ap)
 
 
 void quest_update_objective(TBL_PC * sd, int mob) {
-	int i,j;
-
-	for( i = 0; i < sd->avail_quests; i++ ) {
-		if( sd->quest_log[i].state != Q_ACTIVE )
-			continue;
+	int i, j, lo = 0, hi = sd->num_quest_objectives;
+
+	// first objective on this mob
+	while( lo < hi ) {
+		int mid = (lo+hi)/2;
+		if( sd->quest_objectives[mid].mob < mob )
+			lo = mid+1;
+		else
+			hi = mid;
+	}
 
-		for( j = 0; j < MAX_QUEST_OBJECTIVES; j++ )
-			if( quest_db[sd->quest_index[i]].mob[j] == mob && sd->quest_log[i].count[j] < quest_db[sd->quest_index[i]].count[j] ) {
-				sd->quest_log[i].count[j]++;
-				sd->save_quest = true;
-				clif_quest_update_objective(sd,&sd->quest_log[i],sd->quest_index[i]);
-			}
+	for( ; lo < sd->num_quest_objectives && sd->quest_objectives[lo].mob == mob; lo++ ) {
+		i = sd->quest_objectives[lo].slot;
+		j = sd->quest_objectives[lo].objective;
+		if( sd->quest_log[i].count[j] < quest_db[sd->quest_index[i]].count[j] ) {
+			sd->quest_log[i].count[j]++;
+			sd->save_quest = true;
+			clif_quest_update_objective(sd,&sd->quest_log[i],sd->quest_index[i]);
+		}
 	}
 }
 
@@ -236,6 +283,7 @@ int quest_update_status(TBL_PC * sd, int quest_id, quest_state status) {
 	sd->save_quest = true;
 
 	if( status < Q_COMPLETE ) {
+		quest_build_objectives(sd);
 		clif_quest_update_status(sd, quest_id, (bool)status);
 		return 0;
 	}
@@ -245,7 +293,9 @@ int quest_update_status(TBL_PC * sd, int quest_id, quest_state status) {
 		memcpy(&tmp_quest, &sd->quest_log[i],sizeof(struct quest));
 		memcpy(&sd->quest_log[i], &sd->quest_log[sd->avail_quests],sizeof(struct quest));
 		memcpy(&sd->quest_log[sd->avail_quests], &tmp_quest,sizeof(struct quest));
+		swap(sd->quest_index[i], sd->quest_index[sd->avail_quests]);
 	}
+	quest_build_objectives(sd);
 
 	clif_quest_delete(sd, quest_id);
 
@@ -329,6 +379,8 @@ int quest_read_db(void) {
 		memset(&quest_db[k], 0, sizeof(quest_db[0]));
 
 		quest_db[k].id = atoi(str[0]);
+		if( !idb_exists(quest_db_index, quest_db[k].id) )
+			idb_iput(quest_db_index, quest_db[k].id, k+1);
 		quest_db[k].time = atoi(str[1]);
 		for( i = 0; i < MAX_QUEST_OBJECTIVES; i++ ) {
 			quest_db[k].mob[i] = atoi(str[2*i+2]);
@@ -348,10 +400,30 @@ int quest_read_db(void) {
 }
 
 void do_init_quest(void) {
+	quest_db_index = idb_alloc(DB_OPT_BASE);
 	quest_read_db();
 }
 
+void do_final_quest(void) {
+	db_destroy(quest_db_index);
+}
+
 void do_reload_quest() {
+	struct s_mapiterator* iter;
+	struct map_session_data* sd;
+	int i;
+
 	memset(&quest_db, 0, sizeof(quest_db));
+	db_clear(quest_db_index);
 	quest_read_db();
+
+	// quests may have moved or changed their objectives
+	iter = mapit_geteachpc();
+	for( sd = (struct map_session_data*)mapit_first(iter); mapit_exists(iter); sd = (struct map_session_data*)mapit_next(iter) ) {
+		for( i = 0; i < sd->num_quests; i++ )
+			if( (sd->quest_index[i] = quest_search_db(sd->quest_log[i].quest_id)) < 0 )
+				sd->quest_index[i] = 0; // removed from the db, keep a valid index
+		quest_build_objectives(sd);
+	}
+	mapit_free(iter);
 }
@@ -14,6 +14,13 @@ struct s_quest_db {
 };
 extern struct s_quest_db quest_db[MAX_QUEST_DB];
 
+/// hunting objective of one of a player's active quests
+struct s_quest_objective {
+	int mob;
+	short slot;      // index in quest_log
+	short objective; // index in mob/count
+};
+
 typedef enum quest_check_type { HAVEQUEST, PLAYTIME, HUNTING } quest_check_type;
 
 int quest_pc_login(TBL_PC * sd);
@@ -21,6 +28,7 @@ int quest_pc_login(TBL_PC * sd);
 int quest_add(TBL_PC * sd, int quest_id);
 int quest_delete(TBL_PC * sd, int quest_id);
 int quest_change(TBL_PC * sd, int qid1, int qid2);
+void quest_build_objectives(TBL_PC * sd);
 int quest_update_objective_sub(struct block_list *bl, va_list ap);
 void quest_update_objective(TBL_PC * sd, int mob);
 int quest_update_status(TBL_PC * sd, int quest_id, quest_state status);
@@ -29,6 +37,7 @@ int quest_check(TBL_PC * sd, int quest_id, quest_check_type type);
 int quest_search_db(int quest_id);
 
 void do_init_quest();
+void do_final_quest(void);
 void do_reload_quest(void);
 
 #endif
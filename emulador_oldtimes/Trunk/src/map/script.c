@@ -8,6 +8,7 @@
 //#define DEBUG_DUMP_STACK
 
 #include "../common/cbasetypes.h"
+#include "../common/ers.h"
 #include "../common/malloc.h"
 #include "../common/md5calc.h"
 #include "../common/lock.h"
@@ -61,13 +62,6 @@
 #include <setjmp.h>
 #include <errno.h>
 
-#ifdef BETA_THREAD_TEST
-	#include "../common/atomic.h"
-	#include "../common/spinlock.h"
-	#include "../common/thread.h"
-	#include "../common/mutex.h"
-#endif
-
 
 ///////////////////////////////////////////////////////////////////////////////
 //## TODO possible enhancements: [FlavioJS]
@@ -174,6 +168,9 @@
 /// Maximum amount of elements in script arrays
 #define SCRIPT_MAX_ARRAYSIZE 128
 
+/// Maximum time a script waits for query_sql_async/query_logsql_async (ms)
+#define SCRIPT_QUERY_TIMEOUT (60*1000)
+
 #define SCRIPT_BLOCK_SIZE 512
 enum { LABEL_NEXTLINE=1,LABEL_START };
 
@@ -223,6 +220,8 @@ int str_hash[SCRIPT_HASH_SIZE];
 
 static DBMap* scriptlabel_db=NULL; // const char* label_name -> int script_pos
 static DBMap* userfunc_db=NULL; // const char* func_name -> struct script_code*
+static ERS script_state_ers=NULL; // struct script_state
+static ERS script_stack_ers=NULL; // struct script_stack
 static int parse_options=0;
 DBMap* script_get_label_db(void){ return scriptlabel_db; }
 DBMap* script_get_userfunc_db(void){ return userfunc_db; }
@@ -315,29 +314,6 @@ extern script_function buildin_func[];
 
 static struct linkdb_node* sleep_db;// int oid -> struct script_state*
 
-#ifdef BETA_THREAD_TEST
-/**
- * MySQL Query Slave
- **/
-static SPIN_LOCK queryThreadLock;
-static rAthread queryThread = NULL;
-static ramutex	queryThreadMutex = NULL;
-static racond	queryThreadCond = NULL;
-static volatile int32 queryThreadTerminate = 0;
-
-struct queryThreadEntry {
-	bool ok;
-	bool type; /* main db or log db? */
-	struct script_state *st;
-};
-
-/* Ladies and Gentleman the Manager! */
-struct {
-	struct queryThreadEntry **entry;/* array of structs */
-	int count;
-	int timer;/* used to receive processed entries */
-} queryThreadData;
-#endif
 
 /*==========================================
  * [Jvg^Cv錾 (Kvȕ̂)
@@ -3010,8 +2986,9 @@ void script_free_code(struct script_code* code)
 struct script_state* script_alloc_state(struct script_code* script, int pos, int rid, int oid)
 {
 	struct script_state* st;
-	CREATE(st, struct script_state, 1);
-	st->stack = (struct script_stack*)aMalloc(sizeof(struct script_stack));
+	st = ers_alloc(script_state_ers, struct script_state);
+	memset(st, 0, sizeof(struct script_state));
+	st->stack = ers_alloc(script_stack_ers, struct script_stack);
 	st->stack->sp = 0;
 	st->stack->sp_max = 64;
 	CREATE(st->stack->stack_data, struct script_data, st->stack->sp_max);
@@ -3041,10 +3018,10 @@ void script_free_state(struct script_state* st)
 	script_free_vars(st->stack->var_function);
 	pop_stack(st, 0, st->stack->sp);
 	aFree(st->stack->stack_data);
-	aFree(st->stack);
+	ers_free(script_stack_ers, st->stack);
 	st->stack = NULL;
 	st->pos = -1;
-	aFree(st);
+	ers_free(script_state_ers, st);
 }
 
 //
@@ -3970,175 +3947,6 @@ void script_setarray_pc(struct map_session_data* sd, const char* varname, uint8
 		refcache[0] = key;
 	}
 }
-#ifdef BETA_THREAD_TEST
-int buildin_query_sql_sub(struct script_state* st, Sql* handle);
-
-/* used to receive items the queryThread has already processed */
-int queryThread_timer(int tid, unsigned int tick, int id, intptr_t data) {
-	int i, cursor = 0;
-	bool allOk = true;
-	
-	EnterSpinLock(&queryThreadLock);
-	
-	for( i = 0; i < queryThreadData.count; i++ ) {
-		struct queryThreadEntry *entry = queryThreadData.entry[i];
-		
-		if( !entry->ok ) {
-			allOk = false;
-			continue;
-		}
-
-		run_script_main(entry->st);
-		
-		entry->st = NULL;/* empty entries */
-		aFree(entry);
-		queryThreadData.entry[i] = NULL;
-	}
-
-	
-	if( allOk ) {
-		/* cancel the repeating timer -- it'll re-create itself when necessary, dont need to remain looping */
-		delete_timer(queryThreadData.timer, queryThread_timer);
-		queryThreadData.timer = INVALID_TIMER;
-	}
-	
-	/* now lets clear the mess. */
-	for( i = 0; i < queryThreadData.count; i++ ) {
-		struct queryThreadEntry *entry = queryThreadData.entry[i];
-		if( entry == NULL )
-			continue;/* entry on hold */
-		
-		/* move */
-		memmove(&queryThreadData.entry[cursor], &queryThreadData.entry[i], sizeof(struct queryThreadEntry*));
-		
-		cursor++;
-	}
-	
-	queryThreadData.count = cursor;
-	
-	LeaveSpinLock(&queryThreadLock);
-	
-	return 0;
-}
-
-void queryThread_add(struct script_state *st, bool type) {
-	int idx = 0;
-	struct queryThreadEntry* entry = NULL;
-	
-	EnterSpinLock(&queryThreadLock);
-	
-	if( queryThreadData.count++ != 0 )
-		RECREATE(queryThreadData.entry, struct queryThreadEntry* , queryThreadData.count);
-	
-	idx = queryThreadData.count-1;
-	
-	CREATE(queryThreadData.entry[idx],struct queryThreadEntry,1);
-	
-	entry = queryThreadData.entry[idx];
-	
-	entry->st = st;
-	entry->ok = false;
-	entry->type = type;
-	if( queryThreadData.timer == INVALID_TIMER ) { /* start the receiver timer */
-		queryThreadData.timer = add_timer_interval(gettick() + 100, queryThread_timer, 0, 0, 100);
-	}
-	
-	LeaveSpinLock(&queryThreadLock);
-	
-	/* unlock the queryThread */
-	racond_signal(queryThreadCond);
-}
-/* adds a new log to the queue */
-void queryThread_log(char * entry, int length) {
-	int idx = logThreadData.count;
-	
-	EnterSpinLock(&queryThreadLock);
-	
-	if( logThreadData.count++ != 0 )
-		RECREATE(logThreadData.entry, char* , logThreadData.count);	
-	
-	CREATE(logThreadData.entry[idx], char, length + 1 );
-	safestrncpy(logThreadData.entry[idx], entry, length + 1 );
-	
-	LeaveSpinLock(&queryThreadLock);
-
-	/* unlock the queryThread */
-	racond_signal(queryThreadCond);
-}
-
-/* queryThread_main */
-static void *queryThread_main(void *x) {
-	Sql *queryThread_handle = Sql_Malloc();
-	int i;
-	
-	if ( SQL_ERROR == Sql_Connect(queryThread_handle, map_server_id, map_server_pw, map_server_ip, map_server_port, map_server_db) )
-		exit(EXIT_FAILURE);
-	
-	if( strlen(default_codepage) > 0 )
-		if ( SQL_ERROR == Sql_SetEncoding(queryThread_handle, default_codepage) )
-			Sql_ShowDebug(queryThread_handle);
-
-	if( log_config.sql_logs ) {
-		logmysql_handle = Sql_Malloc();
-		
-		if ( SQL_ERROR == Sql_Connect(logmysql_handle, log_db_id, log_db_pw, log_db_ip, log_db_port, log_db_db) )
-			exit(EXIT_FAILURE);
-		
-		if( strlen(default_codepage) > 0 )
-			if ( SQL_ERROR == Sql_SetEncoding(logmysql_handle, default_codepage) )
-				Sql_ShowDebug(logmysql_handle);
-	}
-	
-	while( 1 ) {
-		
-		if(queryThreadTerminate > 0)
-			break;
-				
-		EnterSpinLock(&queryThreadLock);
-		
-		/* mess with queryThreadData within the lock */
-		for( i = 0; i < queryThreadData.count; i++ ) {
-			struct queryThreadEntry *entry = queryThreadData.entry[i];
-			
-			if( entry->ok )
-				continue;
-			else if ( !entry->st || !entry->st->stack ) {
-				entry->ok = true;/* dispose */
-				continue;
-			}
-						
-			buildin_query_sql_sub(entry->st, entry->type ? logmysql_handle : queryThread_handle);
-			
-			entry->ok = true;/* we're done with this */
-		}
-		
-		/* also check for any logs in need to be sent */
-		if( log_config.sql_logs ) {
-			for( i = 0; i < logThreadData.count; i++ ) {
-				if( SQL_ERROR == Sql_Query(logmysql_handle, logThreadData.entry[i]) )
-					Sql_ShowDebug(logmysql_handle);
-				aFree(logThreadData.entry[i]);
-			}
-			logThreadData.count = 0;
-		}
-		
-		LeaveSpinLock(&queryThreadLock);
-		
-		ramutex_lock( queryThreadMutex );
-		racond_wait( queryThreadCond,	queryThreadMutex,  -1 );
-		ramutex_unlock( queryThreadMutex );
-
-	}
-		
-	Sql_Free(queryThread_handle);
-	
-	if( log_config.sql_logs ) {
-		Sql_Free(logmysql_handle);
-	}
-	
-	return NULL;
-}
-#endif
 /*==========================================
  * I
  *------------------------------------------*/
@@ -4219,6 +4027,9 @@ int do_final_script() {
 	if (str_buf)
 		aFree(str_buf);
 
+	ers_destroy(script_state_ers);
+	ers_destroy(script_stack_ers);
+
 	for( i = 0; i < atcmd_binding_count; i++ ) {
 		aFree(atcmd_binding[i]);
 	}
@@ -4231,58 +4042,24 @@ int do_final_script() {
 /*==========================================
  * 
  *------------------------------------------*/
-int do_init_script() {
+/// Allocates the script engine databases, without loading the map registries (see do_init_script).
+void script_init_engine(void) {
 	userfunc_db=strdb_alloc(DB_OPT_DUP_KEY,0);
 	scriptlabel_db=strdb_alloc(DB_OPT_DUP_KEY,50);
 	autobonus_db = strdb_alloc(DB_OPT_DUP_KEY,0);
+	script_state_ers = ers_new(sizeof(struct script_state),"script.c::script_state_ers",ERS_OPT_CLEAR);
+	script_stack_ers = ers_new(sizeof(struct script_stack),"script.c::script_stack_ers",ERS_OPT_CLEAR);
+}
 
+int do_init_script() {
+	script_init_engine();
 	mapreg_init();
-#ifdef BETA_THREAD_TEST
-	CREATE(queryThreadData.entry, struct queryThreadEntry*, 1);
-	queryThreadData.count = 0;
-	CREATE(logThreadData.entry, char *, 1);
-	logThreadData.count = 0;
-	/* QueryThread Start */
-	
-	InitializeSpinLock(&queryThreadLock);
-	
-	queryThreadData.timer = INVALID_TIMER;
-	queryThreadTerminate = 0;
-	queryThreadMutex = ramutex_create();
-	queryThreadCond = racond_create();
-	
-	queryThread = rathread_create(queryThread_main, NULL);
-	
-	if(queryThread == NULL){
-		ShowFatalError("do_init_script: cannot spawn Query Thread.\n");
-		exit(EXIT_FAILURE);
-	}
-
-	add_timer_func_list(queryThread_timer, "queryThread_timer");
-#endif
 	return 0;
 }
 
 int script_reload() {
 	int i;
 
-#ifdef BETA_THREAD_TEST
-	/* we're reloading so any queries undergoing should be...exterminated. */
-	EnterSpinLock(&queryThreadLock);
-	
-	for( i = 0; i < queryThreadData.count; i++ ) {
-		aFree(queryThreadData.entry[i]);
-	}
-	queryThreadData.count = 0;
-	
-	if( queryThreadData.timer != INVALID_TIMER ) {
-		delete_timer(queryThreadData.timer, queryThread_timer);
-		queryThreadData.timer = INVALID_TIMER;
-	}
-	
-	LeaveSpinLock(&queryThreadLock);
-#endif
-	
 	userfunc_db->clear(userfunc_db, db_script_free_code_sub);
 	db_clear(scriptlabel_db);
 
@@ -6023,9 +5800,8 @@ BUILDIN_FUNC(countitem)
 
 	nameid = id->nameid;
 
-	for(i = 0; i < MAX_INVENTORY; i++)
-		if(sd->status.inventory[i].nameid == nameid)
-			count += sd->status.inventory[i].amount;
+	for( i = pc_search_inventory(sd, nameid); i >= 0; i = pc_search_inventory_next(sd, i) )
+		count += sd->status.inventory[i].amount;
 
 	script_pushint(st,count);
 	return 0;
@@ -6077,9 +5853,8 @@ BUILDIN_FUNC(countitem2)
 	c3 = (short)script_getnum(st,8);
 	c4 = (short)script_getnum(st,9);
 
-	for(i = 0; i < MAX_INVENTORY; i++)
-		if (sd->status.inventory[i].nameid > 0 && sd->inventory_data[i] != NULL &&
-			sd->status.inventory[i].amount > 0 && sd->status.inventory[i].nameid == nameid &&
+	for( i = pc_search_inventory(sd, nameid); i >= 0; i = pc_search_inventory_next(sd, i) )
+		if (sd->inventory_data[i] != NULL &&
 			sd->status.inventory[i].identify == iden && sd->status.inventory[i].refine == ref &&
 			sd->status.inventory[i].attribute == attr && sd->status.inventory[i].card[0] == c1 &&
 			sd->status.inventory[i].card[1] == c2 && sd->status.inventory[i].card[2] == c3 &&
@@ -6587,7 +6362,7 @@ static void buildin_delitem_delete(struct map_session_data* sd, int idx, int* am
 static bool buildin_delitem_search(struct map_session_data* sd, struct item* it, bool exact_match)
 {
 	bool delete_items = false;
-	int i, amount, important;
+	int i, next, amount, important;
 	struct item* inv;
 
 	// prefer always non-equipped items
@@ -6608,8 +6383,9 @@ static bool buildin_delitem_search(struct map_session_data* sd, struct item* it,
 		important = 0;
 
 		// 1st pass -- less important items / exact match
-		for( i = 0; amount && i < ARRAYLENGTH(sd->status.inventory); i++ )
+		for( i = pc_search_inventory(sd, it->nameid); amount && i >= 0; i = next )
 		{
+			next = pc_search_inventory_next(sd, i); // before slot i gets deleted
 			inv = &sd->status.inventory[i];
 
 			if( !inv->nameid || !sd->inventory_data[i] || inv->nameid != it->nameid )
@@ -6655,8 +6431,9 @@ static bool buildin_delitem_search(struct map_session_data* sd, struct item* it,
 		{// either everything was already consumed or no items were skipped
 			;
 		}
-		else for( i = 0; amount && i < ARRAYLENGTH(sd->status.inventory); i++ )
+		else for( i = pc_search_inventory(sd, it->nameid); amount && i >= 0; i = next )
 		{
+			next = pc_search_inventory_next(sd, i); // before slot i gets deleted
 			inv = &sd->status.inventory[i];
 
 			if( !inv->nameid || !sd->inventory_data[i] || inv->nameid != it->nameid )
@@ -14285,16 +14062,16 @@ BUILDIN_FUNC(setd)
 	return 0;
 }
 
-int buildin_query_sql_sub(struct script_state* st, Sql* handle)
+/// Checks the target variables of query_sql/query_logsql.
+///
+/// @return number of variables, or -1 if the script was ended
+static int buildin_query_sql_vars(struct script_state* st, TBL_PC** out_sd, int* out_max_rows)
 {
-	int i, j;
+	int i;
 	TBL_PC* sd = NULL;
-	const char* query;
 	struct script_data* data;
 	const char* name;
 	int max_rows = SCRIPT_MAX_ARRAYSIZE;// maximum number of rows
-	int num_vars;
-	int num_cols;
 
 	// check target variables
 	for( i = 3; script_hasdata(st,i); ++i )
@@ -14310,7 +14087,7 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 				{// no player attached
 					script_reportdata(data);
 					st->state = END;
-					return 1;
+					return -1;
 				}
 			}
 			if( not_array_variable(*name) )
@@ -14321,20 +14098,22 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 			ShowError("script:query_sql: not a variable\n");
 			script_reportdata(data);
 			st->state = END;
-			return 1;
+			return -1;
 		}
 	}
-	num_vars = i - 3;
 
-	// Execute the query
-	query = script_getstr(st,2);
+	*out_sd = sd;
+	*out_max_rows = max_rows;
+	return i - 3;
+}
 
-	if( SQL_ERROR == Sql_QueryStr(handle, query) )
-	{
-		Sql_ShowDebug(handle);
-		script_pushint(st, 0);
-		return 1;
-	}
+/// Stores the result of query_sql/query_logsql in the target variables.
+static int buildin_query_sql_store(struct script_state* st, TBL_PC* sd, Sql* handle, int num_vars, int max_rows)
+{
+	int i, j;
+	struct script_data* data;
+	const char* name;
+	int num_cols;
 
 	if( Sql_NumRows(handle) == 0 )
 	{// No data received
@@ -14387,19 +14166,115 @@ int buildin_query_sql_sub(struct script_state* st, Sql* handle)
 	return 0;
 }
 
-BUILDIN_FUNC(query_sql) {
-#ifdef BETA_THREAD_TEST
-	if( st->state != RERUNLINE ) {
-		queryThread_add(st,false);
+int buildin_query_sql_sub(struct script_state* st, Sql* handle)
+{
+	TBL_PC* sd = NULL;
+	int max_rows;
+	int num_vars;
 
-		st->state = RERUNLINE;/* will continue when the query is finished running. */
-	} else
-		st->state = RUN;
-		
-	return 0;
-#else
+	if( (num_vars = buildin_query_sql_vars(st, &sd, &max_rows)) < 0 )
+		return 1;
+
+	// Execute the query
+	if( SQL_ERROR == Sql_QueryStr(handle, script_getstr(st,2)) )
+	{
+		Sql_ShowDebug(handle);
+		script_pushint(st, 0);
+		return 1;
+	}
+
+	return buildin_query_sql_store(st, sd, handle, num_vars, max_rows);
+}
+
+/// Result of the asynchronous query being delivered to a sleeping script.
+static struct {
+	bool done;// false if the script was woken up before the query finished
+	int status;
+	Sql* result;
+} script_query;
+
+static int script_query_id = 0;
+
+/// Completion of query_sql_async/query_logsql_async.
+/// Wakes up the script waiting for it, if it is still around.
+static void script_query_sql_async(Sql* result, int status, intptr_t data)
+{
+	struct linkdb_node* node = (struct linkdb_node*)sleep_db;
+	struct script_state* st = NULL;
+	TBL_PC* sd;
+
+	for( ; node != NULL; node = node->next )
+	{
+		st = (struct script_state*)node->data;
+		if( st->sleep.query == (int)data && st->sleep.timer != INVALID_TIMER )
+			break;
+	}
+	if( node == NULL )
+		return;// script timed out, was woken up or no longer exists
+
+	sd = map_id2sd(st->rid);
+	if( (sd && sd->status.char_id != st->sleep.charid) || (st->rid && !sd) )
+	{// char not online anymore / another char of the same account is online - Cancel execution
+		st->state = END;
+		st->rid = 0;
+	}
+	delete_timer(st->sleep.timer, run_script_timer);
+	script_erase_sleepdb(node);
+	st->sleep.timer = INVALID_TIMER;
+
+	script_query.done = true;
+	script_query.status = status;
+	script_query.result = result;
+	run_script_main(st);
+	script_query.done = false;
+	script_query.result = NULL;
+}
+
+/// Runs query_sql_async/query_logsql_async through the asynchronous executor.
+/// The script sleeps, like with sleep2, until the result arrives. The query is
+/// a serial job, so it runs after the writes queued before it (mapreg).
+/// Without asynchronous sql it runs like query_sql.
+static int buildin_query_sql_async_sub(struct script_state* st, SqlAsync* async, Sql* handle)
+{
+	TBL_PC* sd = NULL;
+	int max_rows;
+	int num_vars;
+
+	if( (num_vars = buildin_query_sql_vars(st, &sd, &max_rows)) < 0 )
+		return 1;
+
+	if( st->sleep.query == 0 )
+	{// queue the query and wait
+		if( ++script_query_id <= 0 )
+			script_query_id = 1;
+		if( async == NULL || SQL_ERROR == SqlAsync_QueryStr(async, SQLASYNC_SERIAL, script_query_sql_async, script_query_id, script_getstr(st,2)) )
+			return buildin_query_sql_sub(st, handle);
+		st->sleep.query = script_query_id;
+		st->sleep.tick = SCRIPT_QUERY_TIMEOUT;
+		st->state = RERUNLINE;
+		return 0;
+	}
+
+	// woken up
+	st->sleep.query = 0;
+	st->sleep.tick = 0;
+	st->state = RUN;
+	if( !script_query.done )
+	{
+		ShowWarning("script:query_sql: query did not finish in %d ms, result discarded.\n", SCRIPT_QUERY_TIMEOUT);
+		script_pushint(st, 0);
+		return 1;
+	}
+	if( script_query.status == SQL_ERROR )
+	{
+		script_pushint(st, 0);
+		return 1;
+	}
+	return buildin_query_sql_store(st, sd, script_query.result, num_vars, max_rows);
+}
+
+BUILDIN_FUNC(query_sql) {
 	return buildin_query_sql_sub(st, mmysql_handle);
-#endif
 }
 
 BUILDIN_FUNC(query_logsql) {
@@ -14408,18 +14283,24 @@ BUILDIN_FUNC(query_logsql) {
 		script_pushint(st,-1);
 		return 1;
 	}
-#ifdef BETA_THREAD_TEST
-	if( st->state != RERUNLINE ) {
-		queryThread_add(st,true);
-		
-		st->state = RERUNLINE;/* will continue when the query is finished running. */
-	} else
-		st->state = RUN;
-	
-	return 0;	
-#else
 	return buildin_query_sql_sub(st, logmysql_handle);
-#endif
+}
+
+/// query_sql_async "<query>", <array variable> {,<array variable>, ...};
+/// Same as query_sql, but the script sleeps until the result arrives.
+BUILDIN_FUNC(query_sql_async) {
+	return buildin_query_sql_async_sub(st, mmysql_async, mmysql_handle);
+}
+
+/// query_logsql_async "<query>", <array variable> {,<array variable>, ...};
+/// Same as query_logsql, but the script sleeps until the result arrives.
+BUILDIN_FUNC(query_logsql_async) {
+	if( !log_config.sql_logs ) {// logmysql_handle == NULL
+		ShowWarning("buildin_query_logsql_async: SQL logs are disabled, query '%s' will not be executed.\n", script_getstr(st,2));
+		script_pushint(st,-1);
+		return 1;
+	}
+	return buildin_query_sql_async_sub(st, logmysql_async, logmysql_handle);
 }
 
 //Allows escaping of a given string.
@@ -17446,6 +17327,8 @@ struct script_function buildin_func[] = {
 	BUILDIN_DEF(axtoi,"s"),
 	BUILDIN_DEF(query_sql,"s*"),
 	BUILDIN_DEF(query_logsql,"s*"),
+	BUILDIN_DEF(query_sql_async,"s*"),
+	BUILDIN_DEF(query_logsql_async,"s*"),
 	BUILDIN_DEF(escape_sql,"v"),
 	BUILDIN_DEF(atoi,"s"),
 	// [zBuffer] List of player cont commands --->
@@ -125,6 +125,7 @@ struct script_state {
 	struct script_code *script, *scriptroot;
 	struct sleep_data {
 		int tick,timer,charid;
+		int query;// asynchronous query_sql being waited for (0 = none)
 	} sleep;
 	int instance_id;
 	//For backing up purposes
@@ -181,6 +182,7 @@ void script_cleararray_pc(struct map_session_data* sd, const char* varname, void
 void script_setarray_pc(struct map_session_data* sd, const char* varname, uint8 idx, void* value, int* refcache);
 
 int script_config_read(char *cfgName);
+void script_init_engine(void);
 int do_init_script(void);
 int do_final_script(void);
 int add_str(const char* p);
@@ -190,8 +192,4 @@ int script_reload(void);
 // @commands (script based)
 void setd_sub(struct script_state *st, TBL_PC *sd, const char *varname, int elem, void *value, struct DBMap **ref);
 
-#ifdef BETA_THREAD_TEST
-void queryThread_log(char * entry, int length);
-#endif
-
 #endif /* _SCRIPT_H_ */
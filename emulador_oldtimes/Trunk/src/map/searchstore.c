@@ -2,6 +2,7 @@
 // For more information, see LICENCE in the main folder
 
 #include "../common/cbasetypes.h"
+#include "../common/db.h"  // DBMap, idb_*
 #include "../common/malloc.h"  // aMalloc, aRealloc, aFree
 #include "../common/showmsg.h"  // ShowError, ShowWarning
 #include "../common/strlib.h"  // safestrncpy
@@ -39,7 +40,45 @@ enum e_searchstore_effecttype
 
 /// type for shop search function
 typedef bool (*searchstore_search_t)(struct map_session_data* sd, unsigned short nameid);
-typedef bool (*searchstore_searchall_t)(struct map_session_data* sd, const struct s_search_store_search* s);
+typedef bool (*searchstore_searchslot_t)(struct map_session_data* sd, unsigned int slot, const struct s_search_store_search* s);
+
+
+/// index key of an item sold (vending) or bought (buying store)
+#define SEARCHSTORE_KEY(type,nameid) ( ((unsigned int)(type)<<16)|(unsigned short)(nameid) )
+
+/// max. amount of slots a single store can have indexed
+#define SEARCHSTORE_SHOP_SLOTS MAX_VENDING  // >= MAX_BUYINGSTORE_SLOTS
+
+
+/// one store slot in the index
+struct s_searchstore_entry
+{
+	int account_id;
+	unsigned int price;
+	unsigned char slot;
+};
+
+
+/// all store slots of one item, sorted by price
+struct s_searchstore_list
+{
+	struct s_searchstore_entry* entries;
+	unsigned int count;
+	unsigned int max;
+};
+
+
+/// what a store put into the index, so it can be taken out again
+struct s_searchstore_shop
+{
+	unsigned int count;
+	unsigned int key[SEARCHSTORE_SHOP_SLOTS];
+	unsigned int price[SEARCHSTORE_SHOP_SLOTS];
+};
+
+
+static DBMap* searchstore_list_db;  // SEARCHSTORE_KEY -> struct s_searchstore_list*
+static DBMap* searchstore_shop_db;  // account_id -> struct s_searchstore_shop*
 
 
 /// retrieves search function by type
@@ -54,18 +93,155 @@ static searchstore_search_t searchstore_getsearchfunc(unsigned char type)
 }
 
 
-/// retrieves search-all function by type
-static searchstore_searchall_t searchstore_getsearchallfunc(unsigned char type)
+/// retrieves search-slot function by type
+static searchstore_searchslot_t searchstore_getsearchslotfunc(unsigned char type)
 {
 	switch( type )
 	{
-		case SEARCHTYPE_VENDING:      return &vending_searchall;
-		case SEARCHTYPE_BUYING_STORE: return &buyingstore_searchall;
+		case SEARCHTYPE_VENDING:      return &vending_searchslot;
+		case SEARCHTYPE_BUYING_STORE: return &buyingstore_searchslot;
 	}
 	return NULL;
 }
 
 
+/// returns the first entry of the list, that is not cheaper than price
+static unsigned int searchstore_lowerbound(struct s_searchstore_list* list, unsigned int price)
+{
+	unsigned int lo = 0, hi = list->count;
+
+	while( lo < hi )
+	{
+		unsigned int mid = (lo+hi)/2;
+
+		if( list->entries[mid].price < price )
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+/// creates the list of an item on first use
+static DBData searchstore_create_list(DBKey key, va_list args)
+{
+	struct s_searchstore_list* list;
+
+	CREATE(list, struct s_searchstore_list, 1);
+	return db_ptr2data(list);
+}
+
+
+/// adds a store slot to the list of its item, keeping it sorted by price
+static void searchstore_index_add(unsigned int key, unsigned int price, int account_id, unsigned char slot)
+{
+	struct s_searchstore_list* list = uidb_ensure(searchstore_list_db, key, searchstore_create_list);
+	unsigned int i;
+
+	if( list->count == list->max )
+	{
+		list->max = list->max ? list->max*2 : 8;
+		RECREATE(list->entries, struct s_searchstore_entry, list->max);
+	}
+
+	// insert after the slots of the same price
+	i = ( price == UINT_MAX ) ? list->count : searchstore_lowerbound(list, price+1);
+	memmove(&list->entries[i+1], &list->entries[i], (list->count-i)*sizeof(list->entries[0]));
+	list->entries[i].account_id = account_id;
+	list->entries[i].price      = price;
+	list->entries[i].slot       = slot;
+	list->count++;
+}
+
+
+/// removes all slots of a store from the list of an item at given price
+static void searchstore_index_remove(unsigned int key, unsigned int price, int account_id)
+{
+	struct s_searchstore_list* list = uidb_get(searchstore_list_db, key);
+	unsigned int i, j;
+
+	if( list == NULL )
+		return;
+
+	for( i = j = searchstore_lowerbound(list, price); i < list->count && list->entries[i].price == price; i++ )
+	{
+		if( list->entries[i].account_id != account_id )
+			list->entries[j++] = list->entries[i];
+	}
+	memmove(&list->entries[j], &list->entries[i], (list->count-i)*sizeof(list->entries[0]));
+	list->count-= i-j;
+}
+
+
+/// removes a player's store from the index
+void searchstore_unindex(struct map_session_data* sd)
+{
+	struct s_searchstore_shop* shop = idb_get(searchstore_shop_db, sd->status.account_id);
+	unsigned int i;
+
+	if( shop == NULL )
+	{// nothing indexed
+		return;
+	}
+
+	for( i = 0; i < shop->count; i++ )
+	{// same key and price is removed at once, the rest finds nothing
+		searchstore_index_remove(shop->key[i], shop->price[i], sd->status.account_id);
+	}
+
+	idb_remove(searchstore_shop_db, sd->status.account_id);
+}
+
+
+/// (re)indexes the current contents of a player's store
+/// must be called whenever a store is opened, closed or its items change
+void searchstore_index(struct map_session_data* sd)
+{
+	struct s_searchstore_shop shop;
+	unsigned int i;
+
+	searchstore_unindex(sd);
+	shop.count = 0;
+
+	if( sd->state.vending )
+	{
+		for( i = 0; i < (unsigned int)sd->vend_num && shop.count < SEARCHSTORE_SHOP_SLOTS; i++ )
+		{
+			shop.key[shop.count]   = SEARCHSTORE_KEY(SEARCHTYPE_VENDING, sd->status.cart[sd->vending[i].index].nameid);
+			shop.price[shop.count] = sd->vending[i].value;
+			searchstore_index_add(shop.key[shop.count], shop.price[shop.count], sd->status.account_id, i);
+			shop.count++;
+		}
+	}
+
+	if( sd->state.buyingstore )
+	{
+		for( i = 0; i < sd->buyingstore.slots && shop.count < SEARCHSTORE_SHOP_SLOTS; i++ )
+		{
+			if( !sd->buyingstore.items[i].amount )
+			{// sold out
+				continue;
+			}
+			shop.key[shop.count]   = SEARCHSTORE_KEY(SEARCHTYPE_BUYING_STORE, sd->buyingstore.items[i].nameid);
+			shop.price[shop.count] = (unsigned int)sd->buyingstore.items[i].price;
+			searchstore_index_add(shop.key[shop.count], shop.price[shop.count], sd->status.account_id, i);
+			shop.count++;
+		}
+	}
+
+	if( shop.count )
+	{
+		struct s_searchstore_shop* p;
+
+		CREATE(p, struct s_searchstore_shop, 1);
+		memcpy(p, &shop, sizeof(shop));
+		idb_put(searchstore_shop_db, sd->status.account_id, p);
+	}
+}
+
+
 /// checks if the player has a store by type
 static bool searchstore_hasstore(struct map_session_data* sd, unsigned char type)
 {
@@ -115,10 +291,12 @@ bool searchstore_open(struct map_session_data* sd, unsigned int uses, unsigned s
 void searchstore_query(struct map_session_data* sd, unsigned char type, unsigned int min_price, unsigned int max_price, const unsigned short* itemlist, unsigned int item_count, const unsigned short* cardlist, unsigned int card_count)
 {
 	unsigned int i;
+	unsigned int j;
+	bool full = false;
 	struct map_session_data* pl_sd;
-	struct s_mapiterator* iter;
 	struct s_search_store_search s;
-	searchstore_searchall_t store_searchall;
+	struct s_searchstore_list* list;
+	searchstore_searchslot_t store_searchslot;
 	time_t querytime;
 
 	if( !battle_config.feature_search_stores )
@@ -131,7 +309,7 @@ void searchstore_query(struct map_session_data* sd, unsigned char type, unsigned
 		return;
 	}
 
-	if( ( store_searchall = searchstore_getsearchallfunc(type) ) == NULL )
+	if( ( store_searchslot = searchstore_getsearchslotfunc(type) ) == NULL )
 	{
 		ShowError("searchstore_query: Unknown search type %u (account_id=%d).\n", (unsigned int)type, sd->bl.id);
 		return;
@@ -194,24 +372,36 @@ void searchstore_query(struct map_session_data* sd, unsigned char type, unsigned
 	s.card_count = card_count;
 	s.min_price  = min_price;
 	s.max_price  = max_price;
-	iter         = mapit_geteachpc();
 
-	for( pl_sd = (struct map_session_data*)mapit_first(iter); mapit_exists(iter);  pl_sd = (struct map_session_data*)mapit_next(iter) )
+	// only the stores, that sell/buy one of the items, in the price range and cheapest first
+	for( i = 0; i < item_count && !full; i++ )
 	{
-		if( sd == pl_sd )
-		{// skip own shop, if any
+		if( ( list = uidb_get(searchstore_list_db, SEARCHSTORE_KEY(type, itemlist[i])) ) == NULL )
+		{// nobody has it
 			continue;
 		}
 
-		if( !store_searchall(pl_sd, &s) )
-		{// exceeded result size
-			clif_search_store_info_failed(sd, SSI_FAILED_OVER_MAXCOUNT);
-			break;
+		for( j = searchstore_lowerbound(list, min_price); j < list->count && ( !max_price || list->entries[j].price <= max_price ); j++ )
+		{
+			if( list->entries[j].account_id == sd->status.account_id )
+			{// skip own shop, if any
+				continue;
+			}
+
+			if( ( pl_sd = map_id2sd(list->entries[j].account_id) ) == NULL )
+			{
+				continue;
+			}
+
+			if( !store_searchslot(pl_sd, list->entries[j].slot, &s) )
+			{// exceeded result size
+				clif_search_store_info_failed(sd, SSI_FAILED_OVER_MAXCOUNT);
+				full = true;
+				break;
+			}
 		}
 	}
 
-	mapit_free(iter);
-
 	if( sd->searchstore.count )
 	{
 		// reclaim unused memory
@@ -403,3 +593,28 @@ bool searchstore_result(struct map_session_data* sd, int store_id, int account_i
 
 	return true;
 }
+
+
+static int searchstore_list_final(DBKey key, DBData *data, va_list ap)
+{
+	struct s_searchstore_list* list = db_data2ptr(data);
+
+	if( list->entries )
+		aFree(list->entries);
+	aFree(list);
+	return 0;
+}
+
+
+void do_init_searchstore(void)
+{
+	searchstore_list_db = uidb_alloc(DB_OPT_BASE);
+	searchstore_shop_db = idb_alloc(DB_OPT_RELEASE_DATA);
+}
+
+
+void do_final_searchstore(void)
+{
+	searchstore_list_db->destroy(searchstore_list_db, searchstore_list_final);
+	db_destroy(searchstore_shop_db);
+}
@@ -53,5 +53,10 @@ void searchstore_click(struct map_session_data* sd, int account_id, int store_id
 bool searchstore_queryremote(struct map_session_data* sd, int account_id);
 void searchstore_clearremote(struct map_session_data* sd);
 bool searchstore_result(struct map_session_data* sd, int store_id, int account_id, const char* store_name, unsigned short nameid, unsigned short amount, unsigned int price, const short* card, unsigned char refine);
+void searchstore_index(struct map_session_data* sd);
+void searchstore_unindex(struct map_session_data* sd);
+
+void do_init_searchstore(void);
+void do_final_searchstore(void);
 
 #endif  // _SEARCHSTORE_H_
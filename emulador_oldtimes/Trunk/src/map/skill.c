@@ -57,9 +57,26 @@
 #if GD_SKILLRANGEMAX > 999
 	#error GD_SKILLRANGEMAX is greater than 999
 #endif
-static struct eri *skill_unit_ers = NULL; //For handling skill_unit's [Skotlex]
 static struct eri *skill_timer_ers = NULL; //For handling skill_timerskills [Skotlex]
 
+/// Skill unit groups and their unit arrays come from entry managers.
+/// The unit arrays have one manager per power of two of units, up to
+/// SKILL_UNIT_POOL_MAX units; bigger arrays are taken from the heap.
+#define SKILL_UNIT_POOLS 7
+#define SKILL_UNIT_POOL_MAX (1<<(SKILL_UNIT_POOLS-1))
+struct skill_unit_pool {
+	struct eri* ers; // NULL for the heap
+	unsigned int used; // entries in use
+	unsigned int peak; // highest 'used'
+	unsigned int total; // entries handed out
+};
+static struct skill_unit_pool skill_group_pool; // struct skill_unit_group
+static struct skill_unit_pool skill_unit_pools[SKILL_UNIT_POOLS+1]; // struct skill_unit[1<<i], the last one is the heap
+static char* skill_unit_pool_names[SKILL_UNIT_POOLS] = {
+	"skill.c::skill_unit_pool[1]", "skill.c::skill_unit_pool[2]", "skill.c::skill_unit_pool[4]", "skill.c::skill_unit_pool[8]",
+	"skill.c::skill_unit_pool[16]", "skill.c::skill_unit_pool[32]", "skill.c::skill_unit_pool[64]",
+};
+
 DBMap* skillunit_db = NULL; // int id -> struct skill_unit*
 
 DBMap* skilldb_name2id = NULL;
@@ -14723,6 +14740,71 @@ struct skill_unit_group* skill_id2group(int group_id)
 }
 
 
+/// Counts an entry handed out by the pool.
+static void skill_unit_pool_use(struct skill_unit_pool* pool)
+{
+	pool->total++;
+	if( ++pool->used > pool->peak )
+		pool->peak = pool->used;
+}
+
+/// Returns the pool of the unit arrays of 'count' units.
+static struct skill_unit_pool* skill_unit_pool_search(int count)
+{
+	int i = 0;
+
+	while( i < SKILL_UNIT_POOLS && (1<<i) < count )
+		i++;
+	return &skill_unit_pools[i];
+}
+
+/// Allocates a zeroed array of 'count' units.
+static struct skill_unit* skill_unit_pool_alloc(int count)
+{
+	struct skill_unit_pool* pool = skill_unit_pool_search(count);
+	struct skill_unit* unit;
+
+	if( pool->ers )
+	{
+		unit = ers_alloc(pool->ers, struct skill_unit);
+		memset(unit, 0, count*sizeof(struct skill_unit));
+	}
+	else
+		unit = (struct skill_unit *)aCalloc(count,sizeof(struct skill_unit));
+	skill_unit_pool_use(pool);
+	return unit;
+}
+
+/// Schedules the release of an array of 'count' units (see map_freeblock).
+static void skill_unit_pool_free(struct skill_unit* unit, int count)
+{
+	struct skill_unit_pool* pool = skill_unit_pool_search(count);
+
+	pool->used--;
+	map_freeblock_ers(&unit->bl, pool->ers);
+}
+
+/// Shows the usage of the skill unit pools.
+void skill_unit_pool_stats(void)
+{
+	int i;
+
+	ShowInfo("Grupos de unidades: "CL_WHITE"%u"CL_RESET" em uso, m\xe1ximo "CL_WHITE"%u"CL_RESET", "CL_WHITE"%u"CL_RESET" alocados.\n",
+		skill_group_pool.used, skill_group_pool.peak, skill_group_pool.total);
+	for( i = 0; i <= SKILL_UNIT_POOLS; i++ )
+	{
+		struct skill_unit_pool* pool = &skill_unit_pools[i];
+
+		if( pool->total == 0 )
+			continue;
+		if( i < SKILL_UNIT_POOLS )
+			ShowInfo("  at\xe9 %d unidades: ", 1<<i);
+		else
+			ShowInfo("  mais de %d unidades (heap): ", SKILL_UNIT_POOL_MAX);
+		ShowMessage(CL_WHITE"%u"CL_RESET" em uso, m\xe1ximo "CL_WHITE"%u"CL_RESET", "CL_WHITE"%u"CL_RESET" alocados.\n", pool->used, pool->peak, pool->total);
+	}
+}
+
 static int skill_unit_group_newid = MAX_SKILL_DB;
 
 /// Returns a new group_id that isn't being used in group_db.
@@ -14774,13 +14856,14 @@ struct skill_unit_group* skill_initunitgroup (struct block_list* src, int count,
 		i = MAX_SKILLUNITGROUP-1;
 	}
 
-	group             = ers_alloc(skill_unit_ers, struct skill_unit_group);
+	group             = ers_alloc(skill_group_pool.ers, struct skill_unit_group);
+	skill_unit_pool_use(&skill_group_pool);
 	group->src_id     = src->id;
 	group->party_id   = status_get_party_id(src);
 	group->guild_id   = status_get_guild_id(src);
 	group->bg_id      = bg_team_get_id(src);
 	group->group_id   = skill_get_new_group_id();
-	group->unit       = (struct skill_unit *)aCalloc(count,sizeof(struct skill_unit));
+	group->unit       = skill_unit_pool_alloc(count);
 	group->unit_count = count;
 	group->alive_count = 0;
 	group->val1       = 0;
@@ -14922,7 +15005,7 @@ int skill_delunitgroup_(struct skill_unit_group *group, const char* file, int li
 	}
 
 	idb_remove(group_db, group->group_id);
-	map_freeblock(&group->unit->bl); // schedules deallocation of whole array (HACK)
+	skill_unit_pool_free(group->unit, group->unit_count); // schedules deallocation of whole array (HACK)
 	group->unit=NULL;
 	group->group_id=0;
 	group->unit_count=0;
@@ -14934,7 +15017,8 @@ int skill_delunitgroup_(struct skill_unit_group *group, const char* file, int li
 	{
 		ud->skillunit[i] = ud->skillunit[j];
 		ud->skillunit[j] = NULL;
-		ers_free(skill_unit_ers, group);
+		ers_free(skill_group_pool.ers, group);
+		skill_group_pool.used--;
 	}
 	else
 		ShowError("skill_delunitgroup: Group not found! (src_id: %d skill_id: %d)\n", group->src_id, group->skill_id);
@@ -15408,13 +15492,13 @@ int skill_unit_move_unit_group (struct skill_unit_group *group, int m, int dx, i
 {
 	int i,j;
 	unsigned int tick = gettick();
-	int *m_flag;
+	int m_flag[MAX_SKILL_UNIT_COUNT];
 	struct skill_unit *unit1;
 	struct skill_unit *unit2;
 
 	if (group == NULL)
 		return 0;
-	if (group->unit_count<=0)
+	if (group->unit_count<=0 || group->unit_count>MAX_SKILL_UNIT_COUNT)
 		return 0;
 	if (group->unit==NULL)
 		return 0;
@@ -15425,7 +15509,7 @@ int skill_unit_move_unit_group (struct skill_unit_group *group, int m, int dx, i
 	if( group->unit_id == UNT_ICEWALL || group->unit_id == UNT_WALLOFTHORN )
 		return 0; //Icewalls and Wall of Thorns don't get knocked back
 	
-	m_flag = (int *) aCalloc(group->unit_count, sizeof(int));
+	memset(m_flag, 0, group->unit_count*sizeof(int));
 	//    m_flag
 	//		0: Neither of the following (skill_unit_onplace & skill_unit_onout are needed)
 	//		1: Unit will move to a slot that had another unit of the same group (skill_unit_onplace not needed)
@@ -15489,7 +15573,6 @@ int skill_unit_move_unit_group (struct skill_unit_group *group, int m, int dx, i
 			map_foreachincell(skill_unit_effect,unit1->bl.m,unit1->bl.x,unit1->bl.y,group->bl_flag,&unit1->bl,tick,1);
 		}
 	}
-	aFree(m_flag);
 	return 0;
 }
 
@@ -17537,6 +17620,8 @@ void skill_reload (void)
  *------------------------------------------*/
 int do_init_skill (void)
 {
+	int i;
+
 	skilldb_name2id = strdb_alloc(DB_OPT_DUP_KEY|DB_OPT_RELEASE_DATA, 0);
 	skill_readdb();
 
@@ -17544,7 +17629,9 @@ int do_init_skill (void)
 	skillunit_db = idb_alloc(DB_OPT_BASE);
 	skillcd_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	skillusave_db = idb_alloc(DB_OPT_RELEASE_DATA);
-	skill_unit_ers = ers_new(sizeof(struct skill_unit_group),"skill.c::skill_unit_ers",ERS_OPT_NONE);
+	skill_group_pool.ers = ers_new(sizeof(struct skill_unit_group),"skill.c::skill_unit_ers",ERS_OPT_NONE);
+	for( i = 0; i < SKILL_UNIT_POOLS; i++ )
+		skill_unit_pools[i].ers = ers_new(sizeof(struct skill_unit)<<i,skill_unit_pool_names[i],ERS_OPT_NONE);
 	skill_timer_ers  = ers_new(sizeof(struct skill_timerskill),"skill.c::skill_timer_ers",ERS_OPT_NONE);
 
 	add_timer_func_list(skill_unit_timer,"skill_unit_timer");
@@ -17560,12 +17647,16 @@ int do_init_skill (void)
 
 int do_final_skill(void)
 {
+	int i;
+
 	db_destroy(skilldb_name2id);
 	db_destroy(group_db);
 	db_destroy(skillunit_db);
 	db_destroy(skillcd_db);
 	db_destroy(skillusave_db);
-	ers_destroy(skill_unit_ers);
+	ers_destroy(skill_group_pool.ers);
+	for( i = 0; i < SKILL_UNIT_POOLS; i++ )
+		ers_destroy(skill_unit_pools[i].ers);
 	ers_destroy(skill_timer_ers);
 	return 0;
 }
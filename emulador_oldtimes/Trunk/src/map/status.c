@@ -3063,6 +3063,7 @@ int status_calc_pc_(struct map_session_data* sd, bool first)
 		if( sc->data[SC_EARTH_INSIGNIA] && sc->data[SC_EARTH_INSIGNIA]->val1 == 3 )
 			sd->magic_addele[ELE_EARTH] += 25;
 	}
+	battle_calc_cardfix_table(sd);
 	status_cpy(&sd->battle_status, status);
 
 // ----- CLIENT-SIDE REFRESH -----
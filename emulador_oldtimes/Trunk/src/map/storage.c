@@ -25,6 +25,144 @@
 
 
 static DBMap* guild_storage_db; // int guild_id -> struct guild_storage*
+static DBMap* guild_storage_index_db; // int guild_id -> struct storage_index*
+
+/// Map-side lookup of a storage's slots, so adding an item doesn't have to
+/// scan all of them. Kept up to date by the add/del functions below.
+struct storage_index {
+	DBMap* stack; // int nameid -> slot+1 of a stack of that (stackable) item
+	int free;     // no free slot below this one
+	bool valid;   // false when the items were replaced or moved (loaded, sorted)
+	bool sorted;  // not changed since it was sorted for the client
+};
+
+int compare_item(struct item *a, struct item *b);
+
+/*==========================================
+ * Storage slot index
+ *------------------------------------------*/
+static void storage_index_build(struct storage_index* idx, struct item* items, int size)
+{
+	int i;
+
+	if( idx->stack == NULL )
+		idx->stack = idb_alloc(DB_OPT_BASE);
+	else
+		db_clear(idx->stack);
+
+	idx->free = size;
+	for( i = 0; i < size; i++ )
+	{
+		if( items[i].nameid == 0 )
+		{
+			if( idx->free == size )
+				idx->free = i;
+			continue;
+		}
+		if( itemdb_isstackable(items[i].nameid) && !idb_exists(idx->stack, items[i].nameid) )
+			idb_iput(idx->stack, items[i].nameid, i+1);
+	}
+	idx->valid = true;
+}
+
+/// Returns the slot of a stack the item can be merged into, or -1.
+static int storage_index_findstack(struct storage_index* idx, struct item* items, int size, struct item* item)
+{
+	int i;
+
+	if( !idx->valid )
+		storage_index_build(idx, items, size);
+
+	if( ( i = idb_iget(idx->stack, item->nameid)-1 ) < 0 )
+		return -1; // none of this item stored
+
+	if( !compare_item(&items[i], item) )
+	{// another stack of the same item, but different refine/cards/...
+		ARR_FIND( 0, size, i, compare_item(&items[i], item) );
+		if( i == size )
+			return -1;
+	}
+	return i;
+}
+
+/// Returns the first free slot, or -1.
+static int storage_index_findfree(struct storage_index* idx, struct item* items, int size)
+{
+	int i;
+
+	if( !idx->valid )
+		storage_index_build(idx, items, size);
+
+	for( i = idx->free; i < size && items[i].nameid; i++ );
+	idx->free = i;
+	return ( i < size ) ? i : -1;
+}
+
+/// Item was put into the free slot n.
+static void storage_index_add(struct storage_index* idx, struct item* items, int n)
+{
+	if( idx->valid && itemdb_isstackable(items[n].nameid) && !idb_exists(idx->stack, items[n].nameid) )
+		idb_iput(idx->stack, items[n].nameid, n+1);
+	idx->sorted = false;
+}
+
+/// Slot n, that held nameid, was emptied.
+static void storage_index_del(struct storage_index* idx, struct item* items, int size, int n, int nameid)
+{
+	if( idx->valid )
+	{
+		if( n < idx->free )
+			idx->free = n;
+		if( idb_iget(idx->stack, nameid) == n+1 )
+		{// look for another stack of it
+			int i;
+			ARR_FIND( 0, size, i, items[i].nameid == nameid );
+			if( i < size )
+				idb_iput(idx->stack, nameid, i+1);
+			else
+				idb_remove(idx->stack, nameid);
+		}
+	}
+	idx->sorted = false;
+}
+
+static void storage_index_free(struct storage_index* idx)
+{
+	if( idx->stack )
+		db_destroy(idx->stack);
+	aFree(idx);
+}
+
+static struct storage_index* storage_index_pc(struct map_session_data* sd)
+{
+	if( sd->storage_index == NULL )
+		CREATE(sd->storage_index, struct storage_index, 1);
+	return sd->storage_index;
+}
+
+/**
+ * @see DBCreateData
+ */
+static DBData create_guildstorage_index(DBKey key, va_list args)
+{
+	struct storage_index* idx;
+	CREATE(idx, struct storage_index, 1);
+	return db_ptr2data(idx);
+}
+
+static struct storage_index* storage_index_guild(int guild_id)
+{
+	return idb_ensure(guild_storage_index_db, guild_id, create_guildstorage_index);
+}
+
+/**
+ * @see DBApply
+ */
+static int storage_index_final_sub(DBKey key, DBData *data, va_list ap)
+{
+	storage_index_free(db_data2ptr(data));
+	return 0;
+}
 
 /*==========================================
  * qɓACe\[g
@@ -43,13 +181,15 @@ static int storage_comp_item(const void *_i1, const void *_i2)
 	return i1->nameid - i2->nameid;
 }
 
-static void storage_sortitem(struct item* items, unsigned int size)
+static void storage_sortitem(struct item* items, unsigned int size, struct storage_index* idx)
 {
 	nullpo_retv(items);
 
-	if( battle_config.client_sort_storage )
-	{
+	if( battle_config.client_sort_storage && !idx->sorted )
+	{// only when something was added/removed since the last sort
 		qsort(items, size, sizeof(struct item), storage_comp_item);
+		idx->valid = false;
+		idx->sorted = true;
 	}
 }
 
@@ -59,11 +199,23 @@ static void storage_sortitem(struct item* items, unsigned int size)
 int do_init_storage(void) // map.c::do_init()Ă΂
 {
 	guild_storage_db=idb_alloc(DB_OPT_RELEASE_DATA);
+	guild_storage_index_db=idb_alloc(DB_OPT_BASE);
 	return 1;
 }
 void do_final_storage(void) // by [MC Cameri]
 {
 	guild_storage_db->destroy(guild_storage_db,NULL);
+	guild_storage_index_db->destroy(guild_storage_index_db,storage_index_final_sub);
+}
+
+/// Frees the storage index of a player leaving the server.
+void storage_pc_final(struct map_session_data* sd)
+{
+	if( sd->storage_index )
+	{
+		storage_index_free(sd->storage_index);
+		sd->storage_index = NULL;
+	}
 }
 
 /**
@@ -104,7 +256,7 @@ int storage_storageopen(struct map_session_data *sd)
 	}
 	
 	sd->state.storage_flag = 1;
-	storage_sortitem(sd->status.storage.items, ARRAYLENGTH(sd->status.storage.items));
+	storage_sortitem(sd->status.storage.items, ARRAYLENGTH(sd->status.storage.items), storage_index_pc(sd));
 	clif_storagelist(sd, sd->status.storage.items, ARRAYLENGTH(sd->status.storage.items));
 	clif_updatestorageamount(sd, sd->status.storage.storage_amount, MAX_STORAGE);
 	return 0;
@@ -132,6 +284,7 @@ int compare_item(struct item *a, struct item *b)
 static int storage_additem(struct map_session_data* sd, struct item* item_data, int amount)
 {
 	struct storage_data* stor = &sd->status.storage;
+	struct storage_index* idx = storage_index_pc(sd);
 	struct item_data *data;
 	int i;
 
@@ -151,30 +304,24 @@ static int storage_additem(struct map_session_data* sd, struct item* item_data,
 		return 1;
 	}
 	
-	if( itemdb_isstackable2(data) )
-	{//Stackable
-		for( i = 0; i < MAX_STORAGE; i++ )
-		{
-			if( compare_item(&stor->items[i], item_data) )
-			{// existing items found, stack them
-				if( amount > MAX_AMOUNT - stor->items[i].amount || ( data->stack.storage && amount > data->stack.amount - stor->items[i].amount ) )
-					return 1;
-				stor->items[i].amount += amount;
-				clif_storageitemadded(sd,&stor->items[i],i,amount);
-				return 0;
-			}
-		}
+	if( itemdb_isstackable2(data) && ( i = storage_index_findstack(idx, stor->items, MAX_STORAGE, item_data) ) >= 0 )
+	{// existing items found, stack them
+		if( amount > MAX_AMOUNT - stor->items[i].amount || ( data->stack.storage && amount > data->stack.amount - stor->items[i].amount ) )
+			return 1;
+		stor->items[i].amount += amount;
+		clif_storageitemadded(sd,&stor->items[i],i,amount);
+		return 0;
 	}
 
 	// find free slot
-	ARR_FIND( 0, MAX_STORAGE, i, stor->items[i].nameid == 0 );
-	if( i >= MAX_STORAGE )
+	if( ( i = storage_index_findfree(idx, stor->items, MAX_STORAGE) ) < 0 )
 		return 1;
 
 	// add item to slot
 	memcpy(&stor->items[i],item_data,sizeof(stor->items[0]));
 	stor->storage_amount++;
 	stor->items[i].amount = amount;
+	storage_index_add(idx, stor->items, i);
 	clif_storageitemadded(sd,&stor->items[i],i,amount);
 	clif_updatestorageamount(sd, stor->storage_amount, MAX_STORAGE);
 
@@ -192,7 +339,9 @@ int storage_delitem(struct map_session_data* sd, int n, int amount)
 	sd->status.storage.items[n].amount -= amount;
 	if( sd->status.storage.items[n].amount == 0 )
 	{
+		int nameid = sd->status.storage.items[n].nameid;
 		memset(&sd->status.storage.items[n],0,sizeof(sd->status.storage.items[0]));
+		storage_index_del(storage_index_pc(sd), sd->status.storage.items, MAX_STORAGE, n, nameid);
 		sd->status.storage.storage_amount--;
 		if( sd->state.storage_flag == 1 ) clif_updatestorageamount(sd, sd->status.storage.storage_amount, MAX_STORAGE);
 	}
@@ -351,10 +500,24 @@ struct guild_storage *guild2storage2(int guild_id)
 
 int guild_storage_delete(int guild_id)
 {
+	struct storage_index* idx = (struct storage_index*)idb_get(guild_storage_index_db,guild_id);
+	if( idx )
+	{
+		storage_index_free(idx);
+		idb_remove(guild_storage_index_db,guild_id);
+	}
 	idb_remove(guild_storage_db,guild_id);
 	return 0;
 }
 
+/// Guild storage items were replaced by the char-server's copy.
+void storage_guild_storageloaded(int guild_id)
+{
+	struct storage_index* idx = storage_index_guild(guild_id);
+	idx->valid = false;
+	idx->sorted = false;
+}
+
 int storage_guild_storageopen(struct map_session_data* sd)
 {
 	struct guild_storage *gstor;
@@ -381,7 +544,7 @@ int storage_guild_storageopen(struct map_session_data* sd)
 	
 	gstor->storage_status = 1;
 	sd->state.storage_flag = 2;
-	storage_sortitem(gstor->items, ARRAYLENGTH(gstor->items));
+	storage_sortitem(gstor->items, ARRAYLENGTH(gstor->items), storage_index_guild(gstor->guild_id));
 	clif_storagelist(sd, gstor->items, ARRAYLENGTH(gstor->items));
 	clif_updatestorageamount(sd, gstor->storage_amount, MAX_GUILD_STORAGE);
 	return 0;
@@ -389,6 +552,7 @@ int storage_guild_storageopen(struct map_session_data* sd)
 
 int guild_storage_additem(struct map_session_data* sd, struct guild_storage* stor, struct item* item_data, int amount)
 {
+	struct storage_index* idx;
 	struct item_data *data;
 	int i;
 
@@ -412,27 +576,23 @@ int guild_storage_additem(struct map_session_data* sd, struct guild_storage* sto
 		return 1;
 	}
 
-	if(itemdb_isstackable2(data)){ //Stackable
-		for(i=0;i<MAX_GUILD_STORAGE;i++){
-			if(compare_item(&stor->items[i], item_data)) {
-				if( amount > MAX_AMOUNT - stor->items[i].amount || ( data->stack.guildstorage && amount > data->stack.amount - stor->items[i].amount ) )
-					return 1;
-				stor->items[i].amount+=amount;
-				clif_storageitemadded(sd,&stor->items[i],i,amount);
-				stor->dirty = 1;
-				return 0;
-			}
-		}
+	idx = storage_index_guild(stor->guild_id);
+	if(itemdb_isstackable2(data) && (i = storage_index_findstack(idx, stor->items, MAX_GUILD_STORAGE, item_data)) >= 0){ //Stackable
+		if( amount > MAX_AMOUNT - stor->items[i].amount || ( data->stack.guildstorage && amount > data->stack.amount - stor->items[i].amount ) )
+			return 1;
+		stor->items[i].amount+=amount;
+		clif_storageitemadded(sd,&stor->items[i],i,amount);
+		stor->dirty = 1;
+		return 0;
 	}
 	//Add item
-	for(i=0;i<MAX_GUILD_STORAGE && stor->items[i].nameid;i++);
-	
-	if(i>=MAX_GUILD_STORAGE)
+	if((i = storage_index_findfree(idx, stor->items, MAX_GUILD_STORAGE)) < 0)
 		return 1;
 	
 	memcpy(&stor->items[i],item_data,sizeof(stor->items[0]));
 	stor->items[i].amount=amount;
 	stor->storage_amount++;
+	storage_index_add(idx, stor->items, i);
 	clif_storageitemadded(sd,&stor->items[i],i,amount);
 	clif_updatestorageamount(sd, stor->storage_amount, MAX_GUILD_STORAGE);
 	stor->dirty = 1;
@@ -449,7 +609,9 @@ int guild_storage_delitem(struct map_session_data* sd, struct guild_storage* sto
 
 	stor->items[n].amount-=amount;
 	if(stor->items[n].amount==0){
+		int nameid = stor->items[n].nameid;
 		memset(&stor->items[n],0,sizeof(stor->items[0]));
+		storage_index_del(storage_index_guild(stor->guild_id), stor->items, MAX_GUILD_STORAGE, n, nameid);
 		stor->storage_amount--;
 		clif_updatestorageamount(sd, stor->storage_amount, MAX_GUILD_STORAGE);
 	}
@@ -22,6 +22,7 @@ int do_init_storage(void);
 void do_final_storage(void);
 void do_reconnect_storage(void);
 void storage_storage_quit(struct map_session_data *sd, int flag);
+void storage_pc_final(struct map_session_data *sd);
 
 struct guild_storage* guild2storage(int guild_id);
 int guild_storage_delete(int guild_id);
@@ -36,5 +37,6 @@ int storage_guild_storageclose(struct map_session_data *sd);
 int storage_guild_storage_quit(struct map_session_data *sd,int flag);
 int storage_guild_storagesave(int account_id, int guild_id, int flag);
 int storage_guild_storagesaved(int guild_id); //Ack from char server that guild store was saved.
+void storage_guild_storageloaded(int guild_id);
 
 #endif /* _STORAGE_H_ */
@@ -2044,6 +2044,7 @@ int unit_remove_map_(struct block_list *bl, clr_type clrtype, const char* file,
 				trade_tradecancel(sd);
 			buyingstore_close(sd);
 			searchstore_close(sd);
+			searchstore_unindex(sd);
 			if(sd->state.storage_flag == 1)
 				storage_storage_quit(sd,0);
 			else if (sd->state.storage_flag == 2)
@@ -2292,6 +2293,12 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 				aFree(sd->combos.id);
 				sd->combos.count = 0;
 			}
+			storage_pc_final(sd);
+			if( sd->quest_objectives ) {
+				aFree(sd->quest_objectives);
+				sd->quest_objectives = NULL;
+				sd->num_quest_objectives = sd->max_quest_objectives = 0;
+			}
 			break;
 		}
 		case BL_PET:
@@ -2462,7 +2469,9 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 	skill_clear_unitgroup(bl);
 	status_change_clear(bl,1);
 	map_deliddb(bl);
-	if( bl->type != BL_PC ) //Players are handled by map_quit
+	if( bl->type == BL_MOB )
+		mob_freeblock((TBL_MOB*)bl);
+	else if( bl->type != BL_PC ) //Players are handled by map_quit
 		map_freeblock(bl);
 	map_freeblock_unlock();
 	return 0;
@@ -39,6 +39,7 @@ void vending_closevending(struct map_session_data* sd)
 	{
 		sd->state.vending = false;
 		clif_closevendingboard(&sd->bl, 0);
+		searchstore_index(sd);
 	}
 }
 
@@ -213,6 +214,7 @@ void vending_purchasereq(struct map_session_data* sd, int aid, int uid, const ui
 		cursor++;
 	}
 	vsd->vend_num = cursor;
+	searchstore_index(vsd);
 
 	//Always save BOTH: buyer and customer
 	if( save_settings&2 )
@@ -328,6 +330,7 @@ void vending_openvending(struct map_session_data* sd, const char* message, bool
 	sd->vender_id = vending_getuid();
 	sd->vend_num = i;
 	safestrncpy(sd->message, message, MESSAGE_SIZE);
+	searchstore_index(sd);
 
 	pc_stop_walking(sd,1);
 	clif_openvending(sd,sd->bl.id,sd->vending);
@@ -355,66 +358,52 @@ bool vending_search(struct map_session_data* sd, unsigned short nameid)
 }
 
 
-/// Searches for all items in a vending, that match given ids, price and possible cards.
-/// @return Whether or not the search should be continued.
-bool vending_searchall(struct map_session_data* sd, const struct s_search_store_search* s)
+/// Sends vending slot i of sd to the search, if it still matches.
+/// Returns false if the result set is full.
+bool vending_searchslot(struct map_session_data* sd, unsigned int i, const struct s_search_store_search* s)
 {
-	int i, c, slot;
-	unsigned int idx, cidx;
+	int c, slot;
+	unsigned int cidx;
 	struct item* it;
 
-	if( !sd->state.vending )
-	{// not vending
+	if( !sd->state.vending || i >= (unsigned int)sd->vend_num )
+	{// not vending (anymore)
 		return true;
 	}
+	it = &sd->status.cart[sd->vending[i].index];
 
-	for( idx = 0; idx < s->item_count; idx++ )
-	{
-		ARR_FIND( 0, sd->vend_num, i, sd->status.cart[sd->vending[i].index].nameid == (short)s->itemlist[idx] );
-		if( i == sd->vend_num )
-		{// not found
-			continue;
-		}
-		it = &sd->status.cart[sd->vending[i].index];
+	if( s->min_price && s->min_price > sd->vending[i].value )
+	{// too low price
+		return true;
+	}
 
-		if( s->min_price && s->min_price > sd->vending[i].value )
-		{// too low price
-			continue;
-		}
+	if( s->max_price && s->max_price < sd->vending[i].value )
+	{// too high price
+		return true;
+	}
 
-		if( s->max_price && s->max_price < sd->vending[i].value )
-		{// too high price
-			continue;
+	if( s->card_count )
+	{// check cards
+		if( itemdb_isspecial(it->card[0]) )
+		{// something, that is not a carded
+			return true;
 		}
+		slot = itemdb_slot(it->nameid);
 
-		if( s->card_count )
-		{// check cards
-			if( itemdb_isspecial(it->card[0]) )
-			{// something, that is not a carded
-				continue;
-			}
-			slot = itemdb_slot(it->nameid);
-
-			for( c = 0; c < slot && it->card[c]; c ++ )
-			{
-				ARR_FIND( 0, s->card_count, cidx, s->cardlist[cidx] == it->card[c] );
-				if( cidx != s->card_count )
-				{// found
-					break;
-				}
-			}
-
-			if( c == slot || !it->card[c] )
-			{// no card match
-				continue;
+		for( c = 0; c < slot && it->card[c]; c ++ )
+		{
+			ARR_FIND( 0, s->card_count, cidx, s->cardlist[cidx] == it->card[c] );
+			if( cidx != s->card_count )
+			{// found
+				break;
 			}
 		}
 
-		if( !searchstore_result(s->search_sd, sd->vender_id, sd->status.account_id, sd->message, it->nameid, sd->vending[i].amount, sd->vending[i].value, it->card, it->refine) )
-		{// result set full
-			return false;
+		if( c == slot || !it->card[c] )
+		{// no card match
+			return true;
 		}
 	}
 
-	return true;
+	return searchstore_result(s->search_sd, sd->vender_id, sd->status.account_id, sd->message, it->nameid, sd->vending[i].amount, sd->vending[i].value, it->card, it->refine);
 }
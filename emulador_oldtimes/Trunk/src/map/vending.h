@@ -20,7 +20,7 @@ void vending_openvending(struct map_session_data* sd, const char* message, bool
 void vending_vendinglistreq(struct map_session_data* sd, int id);
 void vending_purchasereq(struct map_session_data* sd, int aid, int uid, const uint8* data, int count);
 bool vending_search(struct map_session_data* sd, unsigned short nameid);
-bool vending_searchall(struct map_session_data* sd, const struct s_search_store_search* s);
+bool vending_searchslot(struct map_session_data* sd, unsigned int i, const struct s_search_store_search* s);
 bool vending_checknearnpc(struct block_list * bl);
 
 #endif /* _VENDING_H_ */